@@ -0,0 +1,1588 @@
+/*
+ * mem_buffer与mem_stream热点路径的微基准。内置一个与Google Benchmark用法相近的小型框架，不依赖第三方库，命令行参数与JSON输出格式与Google Benchmark相同，可直接使用其
+ * tools/compare.py对比两次运行的结果。
+ *
+ * 编译：g++ -std=c++20 -O2 -I.. mem_bench.cpp -o mem_bench -pthread
+ * 用法：mem_bench [--benchmark_filter=<子串>] [--benchmark_min_time=<秒>] [--benchmark_repetitions=<次数>] [--benchmark_format=console|json]
+ *                 [--benchmark_out=<文件>] [--benchmark_list_tests]
+ *
+ * 每个用例至少运行min_time秒(默认0.5)，迭代次数按上一轮的耗时自动放大。JSON中real_time/cpu_time为每次迭代的纳秒数，bytes_per_second与items_per_second由用例设置的处理量
+ * 计算，用例通过state.counters设置的计数器原样输出。growth/下的1 GB用例单次迭代即超过min_time，内存不足1.5 GB的机器上应通过filter排除；parallel_xxh3/4096M需要4 GB内存，同样应按机器的内存决定是否排除。
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../mem_lz4.hpp"
+#include "../mem_parallel.hpp"
+#include "../mem_pool.hpp"
+#include "../mem_serialize.hpp"
+#include "../mem_thread_pool.hpp"
+#include "../mem_utf.hpp"
+
+/*
+ * 一次运行的状态，用法与benchmark::State相同：for (auto _ : state) { ... }循环max_iterations次，循环之外的准备工作不计时；pause_timing()/resume_timing()之间的时间从结果中扣除。
+ */
+class bench_state {
+private:
+    using clock = std::chrono::steady_clock;
+    size_t max_iterations;
+    std::vector<int64_t> args;
+    clock::time_point start;
+    clock::duration paused {0};
+    clock::time_point pause_start;
+    double cpu_start {0};
+    double cpu_paused {0};
+    int64_t bytes {0};
+    int64_t items {0};
+
+    static double cpu_now() {
+        timespec ts {};
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+        return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) * 1e-9;
+    }
+public:
+    double real_seconds {0};
+    double cpu_seconds {0};
+    //用户计数器，与benchmark::State::counters相同，按名称输出到结果中
+    std::map<std::string, double> counters;
+
+    bench_state(size_t max_iterations, std::vector<int64_t> args) : max_iterations(max_iterations), args(std::move(args)) {}
+
+    //循环变量的类型，带maybe_unused使for (auto _ : state)不产生未使用变量的警告
+    struct [[maybe_unused]] value {};
+
+    struct iterator {
+        bench_state *state;
+        size_t remaining;
+
+        bool operator!=(iterator const&) const {
+            if (remaining != 0) {
+                return true;
+            }
+            state->finish();
+            return false;
+        }
+
+        void operator++() {
+            --remaining;
+        }
+
+        value operator*() const {
+            return {};
+        }
+    };
+
+    iterator begin() {
+        cpu_paused = 0;
+        cpu_start = cpu_now();
+        start = clock::now();
+        return {this, max_iterations};
+    }
+
+    iterator end() {
+        return {this, 0};
+    }
+
+    void finish() {
+        auto stop = clock::now();
+        real_seconds = std::chrono::duration<double>(stop - start - paused).count();
+        cpu_seconds = cpu_now() - cpu_start - cpu_paused;
+    }
+
+    void pause_timing() {
+        pause_start = clock::now();
+        cpu_paused -= cpu_now();
+    }
+
+    void resume_timing() {
+        paused += clock::now() - pause_start;
+        cpu_paused += cpu_now();
+    }
+
+    size_t iterations() const {
+        return max_iterations;
+    }
+
+    int64_t range(size_t i = 0) const {
+        return args.at(i);
+    }
+
+    void set_bytes_processed(int64_t n) {
+        bytes = n;
+    }
+
+    void set_items_processed(int64_t n) {
+        items = n;
+    }
+
+    int64_t bytes_processed() const {
+        return bytes;
+    }
+
+    int64_t items_processed() const {
+        return items;
+    }
+};
+
+struct bench_case {
+    std::string name;
+    std::function<void(bench_state&)> fn;
+    std::vector<int64_t> args;
+};
+
+struct bench_result {
+    std::string name;
+    size_t iterations;
+    double real_ns;
+    double cpu_ns;
+    double bytes_per_second;
+    double items_per_second;
+    std::map<std::string, double> counters;
+};
+
+static std::vector<bench_case>& bench_registry() {
+    static std::vector<bench_case> cases;
+    return cases;
+}
+
+static void bench_register(std::string name, std::function<void(bench_state&)> fn, std::vector<int64_t> args = {}) {
+    for (int64_t a : args) {
+        name += "/" + std::to_string(a);
+    }
+    bench_registry().push_back({std::move(name), std::move(fn), std::move(args)});
+}
+
+//防止编译器删除结果未被使用的计算
+template<typename T>
+static void bench_do_not_optimize(T const& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+static void bench_clobber_memory() {
+    asm volatile("" : : : "memory");
+}
+
+//迭代次数从1开始，耗时不足min_time时按比例放大，与Google Benchmark的策略相同
+static bench_result bench_run(bench_case const& c, double min_time) {
+    size_t iterations = 1;
+    for (;;) {
+        bench_state state(iterations, c.args);
+        c.fn(state);
+        if (state.real_seconds >= min_time || iterations >= 1000000000) {
+            double n = static_cast<double>(iterations);
+            return {c.name, iterations, state.real_seconds / n * 1e9, state.cpu_seconds / n * 1e9,
+                    static_cast<double>(state.bytes_processed()) / state.real_seconds, static_cast<double>(state.items_processed()) / state.real_seconds,
+                    std::move(state.counters)};
+        }
+        double multiplier = state.real_seconds <= 0 ? 10 : std::min(10.0, min_time * 1.4 / state.real_seconds);
+        iterations = static_cast<size_t>(std::max(static_cast<double>(iterations) * multiplier, static_cast<double>(iterations + 1)));
+    }
+}
+
+static void bench_write_json(std::ostream& out, std::vector<bench_result> const& results) {
+    char date[64];
+    time_t now = time(nullptr);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", localtime(&now));
+    out << "{\n  \"context\": {\n    \"date\": \"" << date << "\",\n    \"executable\": \"mem_bench\",\n    \"num_cpus\": " << std::thread::hardware_concurrency()
+        << ",\n    \"isa\": \"" << mem_isa_name(mem_active_isa()) << "\",\n    \"library_build_type\": \""
+#ifdef NDEBUG
+        << "release"
+#else
+        << "debug"
+#endif
+        << "\"\n  },\n  \"benchmarks\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        auto const& r = results[i];
+        out << (i == 0 ? "\n" : ",\n") << "    {\n      \"name\": \"" << r.name << "\",\n      \"run_name\": \"" << r.name
+            << "\",\n      \"run_type\": \"iteration\",\n      \"iterations\": " << r.iterations << ",\n      \"real_time\": " << r.real_ns
+            << ",\n      \"cpu_time\": " << r.cpu_ns << ",\n      \"time_unit\": \"ns\"";
+        if (r.bytes_per_second > 0) {
+            out << ",\n      \"bytes_per_second\": " << r.bytes_per_second;
+        }
+        if (r.items_per_second > 0) {
+            out << ",\n      \"items_per_second\": " << r.items_per_second;
+        }
+        for (auto const& [name, value] : r.counters) {
+            out << ",\n      \"" << name << "\": " << value;
+        }
+        out << "\n    }";
+    }
+    out << "\n  ]\n}\n";
+}
+
+static void bench_write_console(std::ostream& out, bench_result const& r) {
+    char line[256];
+    int n = snprintf(line, sizeof(line), "%-48s %14.1f ns %14.1f ns %12zu", r.name.c_str(), r.real_ns, r.cpu_ns, r.iterations);
+    if (r.bytes_per_second > 0) {
+        n += snprintf(line + n, sizeof(line) - static_cast<size_t>(n), " %10.3f GB/s", r.bytes_per_second / 1e9);
+    }
+    if (r.items_per_second > 0) {
+        n += snprintf(line + n, sizeof(line) - static_cast<size_t>(n), " %10.3f M items/s", r.items_per_second / 1e6);
+    }
+    for (auto const& [name, value] : r.counters) {
+        if (static_cast<size_t>(n) < sizeof(line)) {
+            n += snprintf(line + n, sizeof(line) - static_cast<size_t>(n), " %s=%.1f", name.c_str(), value);
+        }
+    }
+    out << line << std::endl;
+}
+
+/*
+ * 构造与析构
+ */
+static void bm_construct(bench_state& state) {
+    auto capacity = static_cast<size_t>(state.range(0));
+    for (auto _ : state) {
+        mem_buffer<> b(capacity);
+        bench_do_not_optimize(b.data());
+    }
+    state.set_items_processed(static_cast<int64_t>(state.iterations()));
+}
+
+static void bm_construct_small(bench_state& state) {
+    auto capacity = static_cast<size_t>(state.range(0));
+    for (auto _ : state) {
+        mem_small_buffer<256> b(capacity);
+        bench_do_not_optimize(b.data());
+    }
+    state.set_items_processed(static_cast<int64_t>(state.iterations()));
+}
+
+/*
+ * 从缓冲池取得并交还，与construct/mem_buffer对比。稳定状态下不调用分配器，第二个参数为0时复用时不清零
+ */
+static void bm_buffer_pool_acquire(bench_state& state) {
+    auto capacity = static_cast<size_t>(state.range(0));
+    mem_buffer_pool_options options;
+    options.zero_on_reuse = state.range(1) != 0;
+    mem_buffer_pool<> pool(options);
+    for (auto _ : state) {
+        auto b = pool.acquire(capacity);
+        bench_do_not_optimize(b.data());
+    }
+    state.set_items_processed(static_cast<int64_t>(state.iterations()));
+}
+
+/*
+ * threads个线程同时从同一个池取得并交还，每个线程固定使用一个分片，只有映射到同一分片的线程之间争用
+ */
+static void bm_buffer_pool_acquire_threads(bench_state& state) {
+    auto threads = static_cast<size_t>(state.range(0));
+    constexpr size_t batch = 1 << 14;
+    mem_buffer_pool<> pool;
+    auto work = [&] {
+        for (size_t i = 0; i < batch; ++i) {
+            auto b = pool.acquire(4096);
+            bench_do_not_optimize(b.data());
+        }
+    };
+    for (auto _ : state) {
+        std::vector<std::thread> workers;
+        for (size_t t = 1; t < threads; ++t) {
+            workers.emplace_back(work);
+        }
+        work();
+        for (auto& t : workers) {
+            t.join();
+        }
+    }
+    state.set_items_processed(static_cast<int64_t>(state.iterations() * threads * batch));
+}
+
+/*
+ * 引用拷贝：一次加锁递增与一次加锁递减
+ */
+static void bm_copy_refcount(bench_state& state) {
+    mem_buffer<> shared(64);
+    for (auto _ : state) {
+        mem_buffer<> b(shared);
+        bench_do_not_optimize(b.data());
+    }
+    state.set_items_processed(static_cast<int64_t>(state.iterations()));
+}
+
+/*
+ * threads个线程同时拷贝同一个缓冲，比较控制块上的争用。每次迭代中每个线程拷贝batch次，线程的创建开销分摊到batch次拷贝上
+ */
+static void bm_copy_refcount_threads(bench_state& state) {
+    auto threads = static_cast<size_t>(state.range(0));
+    constexpr size_t batch = 1 << 14;
+    mem_buffer<> shared(64);
+    auto work = [&] {
+        for (size_t i = 0; i < batch; ++i) {
+            mem_buffer<> b(shared);
+            bench_do_not_optimize(b.data());
+        }
+    };
+    for (auto _ : state) {
+        std::vector<std::thread> pool;
+        for (size_t t = 1; t < threads; ++t) {
+            pool.emplace_back(work);
+        }
+        work();
+        for (auto& t : pool) {
+            t.join();
+        }
+    }
+    state.set_items_processed(static_cast<int64_t>(state.iterations() * threads * batch));
+}
+
+/*
+ * 每个线程拷贝各自的缓冲，逻辑上没有共享。连续构造的控制块在堆上相邻，若落在同一缓存行上，各线程的引用计数修改会互相使对方的缓存行失效(伪共享)
+ */
+static void bm_copy_refcount_private(bench_state& state) {
+    auto threads = static_cast<size_t>(state.range(0));
+    constexpr size_t batch = 1 << 14;
+    std::vector<mem_buffer<>> buffers;
+    buffers.reserve(threads);
+    for (size_t t = 0; t < threads; ++t) {
+        buffers.emplace_back(64);
+    }
+    auto work = [&](size_t t) {
+        for (size_t i = 0; i < batch; ++i) {
+            mem_buffer<> b(buffers[t]);
+            bench_do_not_optimize(b.data());
+        }
+    };
+    for (auto _ : state) {
+        std::vector<std::thread> pool;
+        for (size_t t = 1; t < threads; ++t) {
+            pool.emplace_back(work, t);
+        }
+        work(0);
+        for (auto& t : pool) {
+            t.join();
+        }
+    }
+    state.set_items_processed(static_cast<int64_t>(state.iterations() * threads * batch));
+}
+
+/*
+ * 一个线程持续读取，其余threads - 1个线程同时拷贝并析构同一个缓冲，只统计读取的次数，衡量引用计数的修改对读取路径(互斥量与容量)的干扰
+ */
+static void bm_read_while_copying(bench_state& state) {
+    auto threads = static_cast<size_t>(state.range(0));
+    constexpr size_t reads = 1 << 16;
+    mem_buffer<> shared(64);
+    for (auto _ : state) {
+        std::atomic<bool> done {false};
+        std::vector<std::thread> pool;
+        for (size_t t = 1; t < threads; ++t) {
+            pool.emplace_back([&] {
+                while (!done.load(std::memory_order_relaxed)) {
+                    mem_buffer<> b(shared);
+                    bench_do_not_optimize(b.data());
+                }
+            });
+        }
+        uint64_t v = 0;
+        for (size_t i = 0; i < reads; ++i) {
+            shared.read(reinterpret_cast<char*>(&v), 8, 0);
+            bench_do_not_optimize(v);
+        }
+        done = true;
+        for (auto& t : pool) {
+            t.join();
+        }
+    }
+    state.set_items_processed(static_cast<int64_t>(state.iterations() * reads));
+}
+
+/*
+ * 逐元素流读写：对每种get_*_stream()的元素类型put/get elements个元素
+ */
+template<typename T, auto Make>
+static void bm_stream_put(bench_state& state) {
+    auto elements = static_cast<size_t>(state.range(0));
+    mem_buffer<> b(elements * sizeof(T));
+    auto s = (b.*Make)();
+    for (auto _ : state) {
+        s.reset();
+        for (size_t i = 0; i < elements; ++i) {
+            s.put(static_cast<T>(i));
+        }
+        bench_clobber_memory();
+    }
+    state.set_bytes_processed(static_cast<int64_t>(state.iterations() * elements * sizeof(T)));
+    state.set_items_processed(static_cast<int64_t>(state.iterations() * elements));
+}
+
+template<typename T, auto Make>
+static void bm_stream_get(bench_state& state) {
+    auto elements = static_cast<size_t>(state.range(0));
+    mem_buffer<> b(elements * sizeof(T));
+    auto s = (b.*Make)();
+    for (auto _ : state) {
+        s.reset();
+        T sum {};
+        for (size_t i = 0; i < elements; ++i) {
+            sum = static_cast<T>(sum + s.get());
+        }
+        bench_do_not_optimize(sum);
+    }
+    state.set_bytes_processed(static_cast<int64_t>(state.iterations() * elements * sizeof(T)));
+    state.set_items_processed(static_cast<int64_t>(state.iterations() * elements));
+}
+
+/*
+ * 批量流读写：以chunk字节为单位write/read，总量固定为1 MiB
+ */
+template<typename T, auto Make>
+static void bm_stream_write_bulk(bench_state& state) {
+    auto chunk = static_cast<size_t>(state.range(0));
+    constexpr size_t total = 1 << 20;
+    mem_buffer<> b(total);
+    auto s = (b.*Make)();
+    std::vector<char> src(chunk, 'x');
+    for (auto _ : state) {
+        s.reset();
+        for (size_t done = 0; done < total; done += chunk) {
+            s.write(src.data(), chunk);
+        }
+        bench_clobber_memory();
+    }
+    state.set_bytes_processed(static_cast<int64_t>(state.iterations() * total));
+}
+
+template<typename T, auto Make>
+static void bm_stream_read_bulk(bench_state& state) {
+    auto chunk = static_cast<size_t>(state.range(0));
+    constexpr size_t total = 1 << 20;
+    mem_buffer<> b(total);
+    auto s = (b.*Make)();
+    std::vector<char> dst(chunk);
+    for (auto _ : state) {
+        s.reset();
+        for (size_t done = 0; done < total; done += chunk) {
+            s.read(dst.data(), chunk);
+        }
+        bench_do_not_optimize(dst.data());
+    }
+    state.set_bytes_processed(static_cast<int64_t>(state.iterations() * total));
+}
+
+//小缓冲内联存储上的逐元素读写，与mem_buffer的加锁路径对比
+static void bm_small_stream_put_get(bench_state& state) {
+    auto elements = static_cast<size_t>(state.range(0));
+    mem_small_buffer<256> b(elements);
+    auto s = b.get_byte_stream();
+    for (auto _ : state) {
+        s.reset();
+        for (size_t i = 0; i < elements; ++i) {
+            s.put(static_cast<uint8_t>(i));
+        }
+        s.reset();
+        unsigned sum = 0;
+        for (size_t i = 0; i < elements; ++i) {
+            sum += s.get();
+        }
+        bench_do_not_optimize(sum);
+    }
+    state.set_items_processed(static_cast<int64_t>(state.iterations() * elements * 2));
+}
+
+/*
+ * 按大端序读写count个uint32_t：batch为带count参数的批量接口(SIMD反转)，loop为逐个调用write_be/read_be，shift为在write_with/read_with中手写移位拼接的标量循环
+ */
+template<int Mode>
+static void bm_stream_endian_write(bench_state& state) {
+    auto count = static_cast<size_t>(state.range(0));
+    std::vector<uint32_t> values(count);
+    for (size_t i = 0; i < count; ++i) {
+        values[i] = static_cast<uint32_t>(i * 0x9E3779B9u);
+    }
+    mem_buffer<> b(count * 4);
+    auto s = b.get_byte_stream();
+    for (auto _ : state) {
+        s.reset();
+        if constexpr (Mode == 0) {
+            s.write_be(values.data(), count);
+        } else if constexpr (Mode == 1) {
+            for (uint32_t v : values) {
+                s.write_be(v);
+            }
+        } else {
+            s.write_with(count * 4, [&](char *dst) {
+                for (size_t i = 0; i < count; ++i) {
+                    for (int k = 0; k < 4; ++k) {
+                        dst[i * 4 + k] = static_cast<char>(values[i] >> (24 - 8 * k));
+                    }
+                }
+            });
+        }
+        bench_clobber_memory();
+    }
+    state.set_bytes_processed(static_cast<int64_t>(state.iterations() * count * 4));
+}
+
+template<int Mode>
+static void bm_stream_endian_read(bench_state& state) {
+    auto count = static_cast<size_t>(state.range(0));
+    std::vector<uint32_t> values(count);
+    mem_buffer<> b(count * 4);
+    auto s = b.get_byte_stream();
+    for (auto _ : state) {
+        s.reset();
+        if constexpr (Mode == 0) {
+            s.read_be(values.data(), count);
+        } else if constexpr (Mode == 1) {
+            for (auto& v : values) {
+                s.read_be(v);
+            }
+        } else {
+            s.read_with(count * 4, [&](const char *src) {
+                auto *p = reinterpret_cast<const uint8_t*>(src);
+                for (size_t i = 0; i < count; ++i) {
+                    values[i] = static_cast<uint32_t>(p[i * 4]) << 24 | static_cast<uint32_t>(p[i * 4 + 1]) << 16 | static_cast<uint32_t>(p[i * 4 + 2]) << 8 | p[i * 4 + 3];
+                }
+            });
+        }
+        bench_do_not_optimize(values.data());
+        bench_clobber_memory();
+    }
+    state.set_bytes_processed(static_cast<int64_t>(state.iterations() * count * 4));
+}
+
+//各ISA档位的字节序反转内核，64 KB
+template<size_t Width>
+static void bm_byteswap(bench_state& state, typename mem_byteswap_kernel<Width>::type *fn) {
+    constexpr size_t len = 64 * 1024;
+    std::vector<char> src(len, 1), dst(len);
+    for (auto _ : state) {
+        fn(dst.data(), src.data(), len / Width);
+        bench_clobber_memory();
+    }
+    state.set_bytes_processed(static_cast<int64_t>(state.iterations() * len));
+}
+
+/*
+ * 各ISA档位的变长整数批量解码。64K个整数的位宽在1到range(0)之间均匀随机，range(0)为7时全部是单字节整数；按编码后的字节数计算吞吐量。
+ */
+template<typename T>
+static void bm_varint_decode(bench_state& state, typename mem_varint_decode_kernel<T>::type *fn) {
+    constexpr size_t count = 64 * 1024;
+    auto bits = static_cast<unsigned>(state.range(0));
+    std::mt19937_64 rng(30);
+    std::vector<char> src(count * mem_varint_max_size<T>);
+    size_t len = 0;
+    for (size_t i = 0; i < count; ++i) {
+        unsigned width = static_cast<unsigned>(rng() % bits) + 1;
+        len += mem_varint_encode(src.data() + len, static_cast<T>(rng() >> (64 - width)));
+    }
+    std::vector<T> dst(count);
+    for (auto _ : state) {
+        size_t consumed;
+        bench_do_not_optimize(fn(src.data(), len, dst.data(), count, consumed));
+        bench_clobber_memory();
+    }
+    state.set_bytes_processed(static_cast<int64_t>(state.iterations() * len));
+    state.set_items_processed(static_cast<int64_t>(state.iterations() * count));
+}
+
+/*
+ * 各ISA档位的CRC32C与XXH3-64内核，输入为range(0)字节。XXH3只有长于240字节的输入按ISA分派，短输入与XXH32不分档位
+ */
+static void bm_crc32c(bench_state& state, mem_crc32c_kernel::type *fn) {
+    auto len = static_cast<size_t>(state.range(0));
+    std::vector<char> src(len, 'x');
+    for (auto _ : state) {
+        bench_do_not_optimize(fn(0, src.data(), len));
+    }
+    state.set_bytes_processed(static_cast<int64_t>(state.iterations() * len));
+}
+
+static void bm_xxh3_long(bench_state& state, mem_xxh3::hash_long_kernel::type *fn) {
+    auto len = static_cast<size_t>(state.range(0));
+    std::vector<uint8_t> src(len, 'x');
+    for (auto _ : state) {
+        bench_do_not_optimize(fn(src.data(), len, mem_xxh3::default_secret));
+    }
+    state.set_bytes_processed(static_cast<int64_t>(state.iterations() * len));
+}
+
+static void bm_xxh3_short(bench_state& state) {
+    auto len = static_cast<size_t>(state.range(0));
+    std::vector<char> src(len, 'x');
+    for (auto _ : state) {
+        bench_do_not_optimize(mem_xxh3_64(src.data(), len));
+    }
+    state.set_bytes_processed(static_cast<int64_t>(state.iterations() * len));
+}
+
+static void bm_xxh32(bench_state& state) {
+    auto len = static_cast<size_t>(state.range(0));
+    std::vector<char> src(len, 'x');
+    for (auto _ : state) {
+        bench_do_not_optimize(mem_xxh32(src.data(), len));
+    }
+    state.set_bytes_processed(static_cast<int64_t>(state.iterations() * len));
+}
+
+/*
+ * 按4 KiB分块写入range(0)字节并得到校验和：fused通过mem_checksum_stream在写入的同时累加，separate写完后再对整段数据单独计算一遍
+ */
+template<typename Digest, bool Fused>
+static void bm_checksum_write(bench_state& state) {
+    auto len = static_cast<size_t>(state.range(0));
+    constexpr size_t chunk = 4096;
+    std::vector<char> src(chunk, 'x');
+    mem_buffer<> b(len);
+    for (auto _ : state) {
+        if constexpr (Fused) {
+            mem_checksum_stream<char, mem_buffer<>, Digest> s(b);
+            for (size_t done = 0; done < len; done += chunk) {
+                s.write(src.data(), chunk);
+            }
+            bench_do_not_optimize(s.digest());
+        } else {
+            auto s = b.get_char_stream();
+            for (size_t done = 0; done < len; done += chunk) {
+                s.write(src.data(), chunk);
+            }
+            Digest digest;
+            b.read_with(len, 0, [&digest, len](const char *data) { digest.update(data, len); });
+            bench_do_not_optimize(digest.value());
+        }
+    }
+    state.set_bytes_processed(static_cast<int64_t>(state.iterations() * len));
+}
+
+/*
+ * LZ4的压缩与解压，吞吐量按原始数据的长度计算。words为随机拼接的短单词(匹配很短，是解压最慢的情形)，log为字段取值随机的日志行，random为不可压缩的随机字节；
+ * ratio计数器为压缩比
+ */
+enum class bench_lz4_kind {
+    words,
+    log,
+    random
+};
+
+static std::string bench_lz4_input(bench_lz4_kind kind, size_t len) {
+    static const char *words[] = {"buffer ", "stream ", "lz4 ", "block ", "frame ", "mem_utils ", "\n"};
+    static const char *events[] = {"expand capacity", "shrink capacity", "unshare snapshot", "acquire pooled block"};
+    std::mt19937 rng(38);
+    auto pick = [&rng](unsigned n) { return static_cast<unsigned>(rng() % n); };
+    std::string s;
+    while (s.size() < len) {
+        if (kind == bench_lz4_kind::words) {
+            s += words[pick(7)];
+        } else if (kind == bench_lz4_kind::log) {
+            char line[160];
+            int n = std::snprintf(line, sizeof(line), "2026-10-16T12:%02u:%02u.%03uZ INFO  [worker-%u] mem_buffer %s id=%u size=%u used=%u\n", pick(60), pick(60), pick(1000),
+                                  pick(8), events[pick(4)], pick(100000), 4096u << pick(12), pick(65536));
+            s.append(line, static_cast<size_t>(n));
+        } else {
+            s.push_back(static_cast<char>(rng()));
+        }
+    }
+    s.resize(len);
+    return s;
+}
+
+static void bm_lz4_compress_block(bench_state& state, bench_lz4_kind kind) {
+    auto len = static_cast<size_t>(state.range(0));
+    auto in = bench_lz4_input(kind, len);
+    std::vector<char> out(mem_lz4_bound(len));
+    size_t packed = 0;
+    for (auto _ : state) {
+        packed = mem_lz4_compress_block(in.data(), len, out.data());
+        bench_do_not_optimize(packed);
+        bench_clobber_memory();
+    }
+    state.set_bytes_processed(static_cast<int64_t>(state.iterations() * len));
+    state.counters["ratio"] = static_cast<double>(len) / static_cast<double>(packed);
+}
+
+static void bm_lz4_decompress_block(bench_state& state, bench_lz4_kind kind) {
+    auto len = static_cast<size_t>(state.range(0));
+    auto in = bench_lz4_input(kind, len);
+    std::vector<char> packed(mem_lz4_bound(len)), out(len);
+    packed.resize(mem_lz4_compress_block(in.data(), len, packed.data()));
+    for (auto _ : state) {
+        bench_do_not_optimize(mem_lz4_decompress_block(packed.data(), packed.size(), out.data(), len));
+        bench_clobber_memory();
+    }
+    state.set_bytes_processed(static_cast<int64_t>(state.iterations() * len));
+    state.counters["ratio"] = static_cast<double>(len) / static_cast<double>(packed.size());
+}
+
+//帧格式经过mem_stream：frame_write按64 KiB分多次写入mem_lz4_frame_writer，frame_read用mem_lz4_decompress_frame解压到另一个缓冲，两者都带内容校验
+static void bm_lz4_frame_write(bench_state& state, bench_lz4_kind kind) {
+    auto len = static_cast<size_t>(state.range(0));
+    constexpr size_t chunk = 64 * 1024;
+    auto in = bench_lz4_input(kind, len);
+    mem_buffer<> frame(mem_lz4_bound(len));
+    for (auto _ : state) {
+        auto os = frame.get_char_stream();
+        mem_lz4_frame_writer writer(os);
+        for (size_t i = 0; i < len; i += chunk) {
+            writer.write(in.data() + i, std::min(chunk, len - i));
+        }
+        writer.finish();
+        bench_do_not_optimize(frame.data());
+    }
+    state.set_bytes_processed(static_cast<int64_t>(state.iterations() * len));
+}
+
+static void bm_lz4_frame_read(bench_state& state, bench_lz4_kind kind) {
+    auto len = static_cast<size_t>(state.range(0));
+    auto in = bench_lz4_input(kind, len);
+    mem_buffer<> frame(mem_lz4_bound(len)), out(len);
+    auto os = frame.get_char_stream();
+    mem_lz4_frame_writer writer(os);
+    writer.write(in.data(), len);
+    writer.finish();
+    for (auto _ : state) {
+        auto is = frame.get_char_stream();
+        auto dst = out.get_char_stream();
+        bench_do_not_optimize(mem_lz4_decompress_frame(is, dst));
+    }
+    state.set_bytes_processed(static_cast<int64_t>(state.iterations() * len));
+}
+
+/*
+ * 结构体序列化与逐字段读写的对比，每次迭代处理1024条记录。header为8个定长字段(紧凑排列25字节)，mem_serialize拼接后一次写入，per_field逐个调用mem_buffer::write<T>/read<T>；
+ * mixed含字符串与vector，per_field通过mem_stream逐个写入字段与varint长度，与mem_serialize的编码相同。
+ */
+struct bench_header {
+    uint8_t version;
+    uint8_t flags;
+    uint16_t kind;
+    uint32_t length;
+    uint64_t id;
+    int32_t seq;
+    uint32_t checksum;
+    uint8_t tag;
+};
+
+struct bench_mixed {
+    uint64_t id;
+    std::string name;
+    uint32_t score;
+    std::vector<uint32_t> tags;
+};
+
+static constexpr size_t bench_records = 1024;
+
+static std::vector<bench_header> bench_headers() {
+    std::vector<bench_header> headers(bench_records);
+    for (size_t i = 0; i < bench_records; ++i) {
+        auto k = static_cast<uint32_t>(i);
+        headers[i] = {1, static_cast<uint8_t>(k), static_cast<uint16_t>(k * 3), k * 100, k * 0x9e3779b97f4a7c15ull, -static_cast<int32_t>(k), ~k, 'h'};
+    }
+    return headers;
+}
+
+static std::vector<bench_mixed> bench_mixed_records() {
+    std::vector<bench_mixed> records(bench_records);
+    for (size_t i = 0; i < bench_records; ++i) {
+        records[i] = {i, "user-" + std::to_string(i), static_cast<uint32_t>(i * 7), std::vector<uint32_t>(i % 8, static_cast<uint32_t>(i))};
+    }
+    return records;
+}
+
+template<bool Serializer>
+static void bm_serialize_header(bench_state& state) {
+    auto headers = bench_headers();
+    mem_buffer<> b(bench_records * sizeof(bench_header));
+    for (auto _ : state) {
+        if constexpr (Serializer) {
+            auto s = b.get_char_stream();
+            for (auto const& h : headers) {
+                mem_serialize(s, h);
+            }
+        } else {
+            b.rewind();
+            for (auto const& h : headers) {
+                b.write(h.version);
+                b.write(h.flags);
+                b.write(h.kind);
+                b.write(h.length);
+                b.write(h.id);
+                b.write(h.seq);
+                b.write(h.checksum);
+                b.write(h.tag);
+            }
+        }
+        bench_clobber_memory();
+    }
+    state.set_bytes_processed(static_cast<int64_t>(state.iterations() * bench_records * mem_layout<bench_header>::size));
+    state.set_items_processed(static_cast<int64_t>(state.iterations() * bench_records));
+}
+
+template<bool Serializer>
+static void bm_deserialize_header(bench_state& state) {
+    auto headers = bench_headers();
+    mem_buffer<> b(bench_records * sizeof(bench_header));
+    auto out = b.get_char_stream();
+    for (auto const& h : headers) {
+        mem_serialize(out, h);
+    }
+    bench_header h {};
+    for (auto _ : state) {
+        if constexpr (Serializer) {
+            auto s = b.get_char_stream();
+            for (size_t i = 0; i < bench_records; ++i) {
+                mem_deserialize(s, h);
+                bench_do_not_optimize(h);
+            }
+        } else {
+            b.rewind();
+            for (size_t i = 0; i < bench_records; ++i) {
+                b.read(h.version);
+                b.read(h.flags);
+                b.read(h.kind);
+                b.read(h.length);
+                b.read(h.id);
+                b.read(h.seq);
+                b.read(h.checksum);
+                b.read(h.tag);
+                bench_do_not_optimize(h);
+            }
+        }
+    }
+    state.set_bytes_processed(static_cast<int64_t>(state.iterations() * bench_records * mem_layout<bench_header>::size));
+    state.set_items_processed(static_cast<int64_t>(state.iterations() * bench_records));
+}
+
+template<bool Serializer>
+static void bm_serialize_mixed(bench_state& state) {
+    auto records = bench_mixed_records();
+    mem_buffer<> b(bench_records * 64);
+    size_t len = 0;
+    for (auto _ : state) {
+        auto s = b.get_char_stream();
+        for (auto const& r : records) {
+            if constexpr (Serializer) {
+                mem_serialize(s, r);
+            } else {
+                s.write(reinterpret_cast<const char*>(&r.id), sizeof(r.id));
+                s.put_varint(r.name.size());
+                s.write(r.name.data(), r.name.size());
+                s.write(reinterpret_cast<const char*>(&r.score), sizeof(r.score));
+                s.put_varint(r.tags.size());
+                if (!r.tags.empty()) {
+                    s.write(reinterpret_cast<const char*>(r.tags.data()), r.tags.size() * sizeof(uint32_t));
+                }
+            }
+        }
+        len = b.capacity() - s.remaining();
+        bench_clobber_memory();
+    }
+    state.set_bytes_processed(static_cast<int64_t>(state.iterations() * len));
+    state.set_items_processed(static_cast<int64_t>(state.iterations() * bench_records));
+}
+
+template<bool Serializer>
+static void bm_deserialize_mixed(bench_state& state) {
+    auto records = bench_mixed_records();
+    mem_buffer<> b(bench_records * 64);
+    auto out = b.get_char_stream();
+    for (auto const& r : records) {
+        mem_serialize(out, r);
+    }
+    size_t len = b.capacity() - out.remaining();
+    bench_mixed r;
+    for (auto _ : state) {
+        auto s = b.get_char_stream();
+        for (size_t i = 0; i < bench_records; ++i) {
+            if constexpr (Serializer) {
+                mem_deserialize(s, r);
+            } else {
+                uint64_t n = 0;
+                s.read(reinterpret_cast<char*>(&r.id), sizeof(r.id));
+                s.get_varint(n);
+                r.name.resize(n);
+                s.read(r.name.data(), n);
+                s.read(reinterpret_cast<char*>(&r.score), sizeof(r.score));
+                s.get_varint(n);
+                r.tags.resize(n);
+                s.read(reinterpret_cast<char*>(r.tags.data()), n * sizeof(uint32_t));
+            }
+            bench_do_not_optimize(r);
+        }
+    }
+    state.set_bytes_processed(static_cast<int64_t>(state.iterations() * len));
+    state.set_items_processed(static_cast<int64_t>(state.iterations() * bench_records));
+}
+
+/*
+ * 各ISA档位的查找内核，在range(0)字节中查找只出现在末尾的目标，即扫描整块输入。find_any的集合为"\r\n\t,"，
+ * find(needle)的输入为小写字母随机文本，子串首尾字节频繁出现，用以体现验证分支的开销
+ */
+static std::vector<char> bench_scan_input(size_t len, bool text) {
+    std::vector<char> src(len, 'a');
+    if (text) {
+        std::mt19937 rng(42);
+        for (auto& c : src) {
+            c = static_cast<char>('a' + rng() % 26);
+        }
+    }
+    return src;
+}
+
+static void bm_find_byte(bench_state& state, mem_find_byte_kernel::type *fn) {
+    auto len = static_cast<size_t>(state.range(0));
+    auto src = bench_scan_input(len, false);
+    src[len - 1] = '\n';
+    for (auto _ : state) {
+        bench_do_not_optimize(fn(src.data(), len, '\n'));
+    }
+    state.set_bytes_processed(static_cast<int64_t>(state.iterations() * len));
+}
+
+static void bm_find_any(bench_state& state, mem_find_any_kernel::type *fn) {
+    auto len = static_cast<size_t>(state.range(0));
+    auto src = bench_scan_input(len, false);
+    src[len - 1] = ',';
+    constexpr std::string_view set = "\r\n\t,";
+    for (auto _ : state) {
+        bench_do_not_optimize(fn(src.data(), len, set.data(), set.size()));
+    }
+    state.set_bytes_processed(static_cast<int64_t>(state.iterations() * len));
+}
+
+static void bm_find_needle(bench_state& state, mem_find_kernel::type *fn) {
+    auto len = static_cast<size_t>(state.range(0));
+    auto src = bench_scan_input(len, true);
+    constexpr std::string_view needle = "e\r\n\r\ne";
+    memcpy(src.data() + len - needle.size(), needle.data(), needle.size());
+    for (auto _ : state) {
+        bench_do_not_optimize(fn(src.data(), len, needle.data(), needle.size()));
+    }
+    state.set_bytes_processed(static_cast<int64_t>(state.iterations() * len));
+}
+
+/*
+ * 在range(0)字节的mem_buffer中跳到末尾的'\n'：skip_until一次SIMD查找完成，get_loop逐个get()比较
+ */
+template<bool Loop>
+static void bm_skip_until(bench_state& state) {
+    auto len = static_cast<size_t>(state.range(0));
+    mem_buffer b(len);
+    auto src = bench_scan_input(len, false);
+    src[len - 1] = '\n';
+    b.write(src.data(), len, 0);
+    for (auto _ : state) {
+        auto s = b.get_char_stream();
+        if constexpr (Loop) {
+            while (!s.eof() && s.get() != '\n') {
+            }
+        } else {
+            s.skip_until('\n');
+        }
+        bench_do_not_optimize(s.remaining());
+    }
+    state.set_bytes_processed(static_cast<int64_t>(state.iterations() * len));
+}
+
+/*
+ * 从1字节增长到limit字节：auto_expand按默认的16 KiB步长随写入自动扩容(总拷贝量与大小的平方成正比，只测到16 MiB)，doubling每次expand到两倍容量，reserve一次性扩容后写入
+ */
+static constexpr size_t bench_growth_chunk = 64 * 1024;
+
+static void bm_growth_auto_expand(bench_state& state) {
+    auto limit = static_cast<size_t>(state.range(0));
+    std::vector<char> src(bench_growth_chunk, 'x');
+    for (auto _ : state) {
+        mem_buffer<> b(1);
+        auto s = b.get_char_stream();
+        for (size_t done = 0; done < limit; done += bench_growth_chunk) {
+            s.write(src.data(), bench_growth_chunk);
+        }
+        bench_do_not_optimize(b.data());
+    }
+    state.set_bytes_processed(static_cast<int64_t>(state.iterations() * limit));
+}
+
+static void bm_growth_doubling(bench_state& state) {
+    auto limit = static_cast<size_t>(state.range(0));
+    for (auto _ : state) {
+        mem_buffer<> b(1);
+        for (size_t cap = 2; cap <= limit; cap *= 2) {
+            b.expand(cap);
+        }
+        bench_do_not_optimize(b.data());
+    }
+    state.set_bytes_processed(static_cast<int64_t>(state.iterations() * limit));
+}
+
+static void bm_growth_reserve(bench_state& state) {
+    auto limit = static_cast<size_t>(state.range(0));
+    std::vector<char> src(bench_growth_chunk, 'x');
+    for (auto _ : state) {
+        mem_buffer<> b(1);
+        auto s = b.get_char_stream();
+        s.reserve(limit);
+        for (size_t done = 0; done < limit; done += bench_growth_chunk) {
+            s.write(src.data(), bench_growth_chunk);
+        }
+        bench_do_not_optimize(b.data());
+    }
+    state.set_bytes_processed(static_cast<int64_t>(state.iterations() * limit));
+}
+
+/*
+ * 扩容时的缓存污染：后台线程在range(1) KiB的工作集上随机追指针，主线程把range(0) MiB的缓冲扩容到两倍。分配器不能原地resize，扩容总是拷贝旧内容并清零新增部分；
+ * memcpy把非临时存储的阈值设为SIZE_MAX，streaming使用默认阈值。chase_ns为扩容期间追指针每一跳的平均纳秒数，工作集被拷贝挤出缓存时明显变大。两个线程需要在不同的
+ * 核心上同时运行，单核机器上的结果没有意义。
+ */
+template<bool Streaming>
+static void bm_expand_pollution(bench_state& state) {
+    using clock = std::chrono::steady_clock;
+    struct alignas(mem_cache_line_size) node {
+        node *next;
+    };
+    auto size = static_cast<size_t>(state.range(0)) << 20;
+    size_t nodes = (static_cast<size_t>(state.range(1)) << 10) / sizeof(node);
+    std::vector<node> ring(nodes);
+    std::vector<size_t> order(nodes);
+    for (size_t i = 0; i < nodes; ++i) {
+        order[i] = i;
+    }
+    std::shuffle(order.begin(), order.end(), std::mt19937(36));
+    for (size_t i = 0; i < nodes; ++i) {
+        ring[order[i]].next = &ring[order[(i + 1) % nodes]];
+    }
+    size_t threshold = mem_streaming_threshold();
+    mem_set_streaming_threshold(Streaming ? threshold : SIZE_MAX);
+    std::atomic<bool> stop {false};
+    std::atomic<size_t> hops {0};
+    std::thread chaser([&] {
+        node *p = &ring[0];
+        while (!stop.load(std::memory_order_relaxed)) {
+            for (int i = 0; i < 1024; ++i) {
+                p = p->next;
+            }
+            hops.fetch_add(1024, std::memory_order_relaxed);
+        }
+        bench_do_not_optimize(p);
+    });
+    clock::duration chase_time {0};
+    size_t chase_hops = 0;
+    for (auto _ : state) {
+        state.pause_timing();
+        {
+            mem_buffer<mem_aligned_allocator<64>> b(size);
+            auto start = clock::now();
+            size_t before = hops.load(std::memory_order_relaxed);
+            state.resume_timing();
+            b.expand(size * 2);
+            bench_do_not_optimize(b.data());
+            state.pause_timing();
+            chase_hops += hops.load(std::memory_order_relaxed) - before;
+            chase_time += clock::now() - start;
+        }
+        state.resume_timing();
+    }
+    stop = true;
+    chaser.join();
+    mem_set_streaming_threshold(threshold);
+    state.set_bytes_processed(static_cast<int64_t>(state.iterations() * size));
+    state.counters["chase_ns"] = chase_hops != 0 ? std::chrono::duration<double, std::nano>(chase_time).count() / static_cast<double>(chase_hops) : 0;
+}
+
+/*
+ * 流量高峰后归还内存：缓冲写满range(0) MB后只保留开头4KB。heap为shrink_to_fit()(realloc)，mmap为trim()(madvise，容量不变，下一轮写入时重新分配页面)
+ */
+template<typename Allocator>
+static void bm_shrink_after_spike(bench_state& state) {
+    auto limit = static_cast<size_t>(state.range(0)) << 20;
+    constexpr size_t keep = 4096;
+    mem_buffer<Allocator> b(limit);
+    for (auto _ : state) {
+        b.expand(limit);
+        memset(b.data(), 'x', limit);
+        b.write_with(keep, 0, [](char *dst) { dst[0] = 'y'; });
+        if constexpr (mem_decommit_allocator<Allocator>) {
+            b.trim();
+        } else {
+            b.shrink_to_fit(keep);
+        }
+        bench_do_not_optimize(b.data());
+    }
+    state.set_bytes_processed(static_cast<int64_t>(state.iterations() * limit));
+}
+
+/*
+ * 多线程争用：threads个线程通过各自的引用拷贝对同一个缓冲中互不重叠的8字节槽位交替write/read
+ */
+static void bm_contended_read_write(bench_state& state) {
+    auto threads = static_cast<size_t>(state.range(0));
+    constexpr size_t ops = 1 << 16;
+    mem_buffer<> shared(threads * 64);
+    for (auto _ : state) {
+        std::vector<std::thread> pool;
+        std::atomic<size_t> ready {0};
+        auto work = [&](size_t slot) {
+            mem_buffer<> b(shared);
+            ready.fetch_add(1);
+            while (ready.load() < threads) {
+                std::this_thread::yield();
+            }
+            uint64_t v = 0;
+            for (size_t i = 0; i < ops; ++i) {
+                b.write(reinterpret_cast<const char*>(&i), 8, slot * 64);
+                b.read(reinterpret_cast<char*>(&v), 8, slot * 64);
+            }
+            bench_do_not_optimize(v);
+        };
+        for (size_t t = 1; t < threads; ++t) {
+            pool.emplace_back(work, t);
+        }
+        work(0);
+        for (auto& t : pool) {
+            t.join();
+        }
+    }
+    state.set_items_processed(static_cast<int64_t>(state.iterations() * threads * ops * 2));
+}
+
+/*
+ * mem_parallel::transform_reduce分块计算xxh3并按块的顺序合并，线程数从1增加到全部核心，衡量分块并行的扩展性。缓冲在计时前写满，避免首次访问的缺页计入结果
+ */
+static void bm_parallel_xxh3(bench_state& state) {
+    auto size = static_cast<size_t>(state.range(0)) << 20;
+    auto threads = static_cast<size_t>(state.range(1));
+    constexpr size_t chunk = 1 << 20;
+    mem_buffer<> buffer(size);
+    for (size_t off = 0; off < size; off += chunk) {
+        buffer.write_with(chunk, off, [off](char *dst) { memset(dst, static_cast<int>(off >> 20), chunk); });
+    }
+    for (auto _ : state) {
+        uint64_t h = mem_parallel::transform_reduce(buffer, chunk, uint64_t {0}, [](uint64_t a, uint64_t b) { return a * 0x9E3779B97F4A7C15ull ^ b; },
+                                                    [](const char *data, size_t len, size_t) { return mem_xxh3_64(data, len); }, threads);
+        bench_do_not_optimize(h);
+    }
+    state.set_bytes_processed(static_cast<int64_t>(state.iterations() * size));
+}
+
+/*
+ * 转码用的UTF-8文本：0为纯ASCII，1为夹杂少量2字节与3字节字符的英文，2为中文(3字节为主，夹杂ASCII标点)，3为夹杂4字节emoji的英文。片段按伪随机顺序拼接，
+ * 避免周期过短的文本让标量实现的分支预测全部命中
+ */
+static std::string bench_utf8_text(int64_t kind, size_t size) {
+    static const char *pieces[][4] = {
+        {"plain ascii text ", "buffer ", "stream, ", "0123456789\n"},
+        {"caf\xc3\xa9 ", "na\xc3\xafve ", "r\xc3\xa9sum\xc3\xa9 ", "\xe2\x82\xac" "12 "},
+        {"\xe5\x86\x85\xe5\xad\x98", "\xe7\xbc\x93\xe5\x86\xb2\xe5\x8c\xba", "\xe8\xbd\xac\xe7\xa0\x81, ", "\xe6\xb5\x8b\xe8\xaf\x95\xe3\x80\x82"},
+        {"emoji ", "\xf0\x9f\x98\x80 ", "text and ", "\xf0\x9f\x9a\x80\n"}
+    };
+    std::mt19937 rng(static_cast<uint32_t>(kind));
+    std::string text;
+    while (text.size() < size) {
+        text += kind == 1 && rng() % 3 != 0 ? pieces[0][rng() % 4] : pieces[kind][rng() % 4];
+    }
+    text.resize(size);
+    while ((static_cast<uint8_t>(text.back()) & 0xc0) == 0x80 || static_cast<uint8_t>(text.back()) >= 0xc0) {
+        text.pop_back();
+    }
+    return text;
+}
+
+static const char *bench_utf8_kind_name(int64_t kind) {
+    static const char *names[] = {"ascii", "mixed", "cjk", "emoji"};
+    return names[kind];
+}
+
+/*
+ * 64 KB的UTF-8文本与UTF-16/UTF-32之间的转码，fn为某个ISA档位的内核，吞吐量按UTF-8一侧的字节数计算
+ */
+template<typename Unit>
+static void bm_utf8_to_wide(bench_state& state, typename mem_utf8_to_wide_kernel<Unit>::type *fn) {
+    std::string text = bench_utf8_text(state.range(0), 64 * 1024);
+    std::string out((text.size() + 1) * sizeof(Unit), '\0');
+    for (auto _ : state) {
+        bench_do_not_optimize(fn(text.data(), text.size(), out.data()));
+        bench_clobber_memory();
+    }
+    state.set_bytes_processed(static_cast<int64_t>(state.iterations() * text.size()));
+}
+
+template<typename Unit>
+static void bm_wide_to_utf8(bench_state& state, typename mem_wide_to_utf8_kernel<Unit>::type *fn) {
+    std::string text = bench_utf8_text(state.range(0), 64 * 1024);
+    std::basic_string<Unit> wide(text.size() + 1, Unit {});
+    wide.resize(mem_utf8_to_wide(text.data(), text.size(), wide.data()));
+    std::string out(text.size() + 32, '\0');
+    for (auto _ : state) {
+        bench_do_not_optimize(fn(reinterpret_cast<const char*>(wide.data()), wide.size(), out.data()));
+        bench_clobber_memory();
+    }
+    state.set_bytes_processed(static_cast<int64_t>(state.iterations() * text.size()));
+}
+
+/*
+ * 作为对照的线程池：一个互斥量保护的全局队列与一个条件变量，接口与mem_thread_pool相同
+ */
+class bench_mutex_pool {
+private:
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<std::function<void()>> tasks;
+    std::vector<std::thread> workers;
+    bool stopping {false};
+public:
+    explicit bench_mutex_pool(size_t threads) {
+        for (size_t t = 0; t < threads; ++t) {
+            workers.emplace_back([this] {
+                for (;;) {
+                    std::unique_lock lock(mutex);
+                    cv.wait(lock, [this] { return stopping || !tasks.empty(); });
+                    if (tasks.empty()) {
+                        return;
+                    }
+                    auto fn = std::move(tasks.front());
+                    tasks.pop_front();
+                    lock.unlock();
+                    fn();
+                }
+            });
+        }
+    }
+
+    ~bench_mutex_pool() {
+        {
+            std::lock_guard guard(mutex);
+            stopping = true;
+        }
+        cv.notify_all();
+        for (auto& w : workers) {
+            w.join();
+        }
+    }
+
+    void submit(mem_wait_group& group, std::function<void()> fn) {
+        group.add();
+        {
+            std::lock_guard guard(mutex);
+            tasks.emplace_back([&group, fn = std::move(fn)] {
+                fn();
+                group.done();
+            });
+        }
+        cv.notify_one();
+    }
+
+    void wait(mem_wait_group& group) {
+        group.wait();
+    }
+};
+
+/*
+ * 吞吐量：池外线程逐个提交tasks个很短的任务后等待全部完成
+ */
+template<typename Pool>
+static void bm_pool_submit(bench_state& state) {
+    auto threads = static_cast<size_t>(state.range(0));
+    constexpr size_t tasks = 1 << 14;
+    Pool pool(threads);
+    std::atomic<uint64_t> sink {0};
+    for (auto _ : state) {
+        mem_wait_group group;
+        for (size_t i = 0; i < tasks; ++i) {
+            pool.submit(group, [&sink, i] { sink.fetch_add(i, std::memory_order_relaxed); });
+        }
+        pool.wait(group);
+    }
+    state.set_items_processed(static_cast<int64_t>(state.iterations() * tasks));
+}
+
+static void bm_pool_submit_batch(bench_state& state) {
+    auto threads = static_cast<size_t>(state.range(0));
+    constexpr size_t tasks = 1 << 14;
+    mem_thread_pool pool(threads);
+    std::atomic<uint64_t> sink {0};
+    for (auto _ : state) {
+        mem_wait_group group;
+        pool.submit_batch(group, tasks, [&sink](size_t i) { sink.fetch_add(i, std::memory_order_relaxed); });
+        pool.wait(group);
+    }
+    state.set_items_processed(static_cast<int64_t>(state.iterations() * tasks));
+}
+
+/*
+ * 任务内提交子任务：roots个根任务各自提交fanout个子任务，工作窃取池中子任务进入工作线程自己的队列，对照池中全部经过同一个锁
+ */
+template<typename Pool>
+static void bm_pool_spawn(bench_state& state) {
+    auto threads = static_cast<size_t>(state.range(0));
+    constexpr size_t roots = 64, fanout = 256;
+    Pool pool(threads);
+    std::atomic<uint64_t> sink {0};
+    for (auto _ : state) {
+        mem_wait_group group;
+        for (size_t r = 0; r < roots; ++r) {
+            pool.submit(group, [&] {
+                for (size_t i = 0; i < fanout; ++i) {
+                    pool.submit(group, [&sink, i] { sink.fetch_add(i, std::memory_order_relaxed); });
+                }
+            });
+        }
+        pool.wait(group);
+    }
+    state.set_items_processed(static_cast<int64_t>(state.iterations() * roots * (fanout + 1)));
+}
+
+/*
+ * 调度延迟：池空闲时逐个提交任务并等待其完成，记录从提交到任务开始执行的时间，输出各分位数(纳秒)。池空闲时工作线程可能已休眠，延迟包括唤醒的时间
+ */
+template<typename Pool>
+static void bm_pool_latency(bench_state& state) {
+    using clock = std::chrono::steady_clock;
+    auto threads = static_cast<size_t>(state.range(0));
+    constexpr size_t rounds = 256;
+    Pool pool(threads);
+    std::vector<double> latencies;
+    for (auto _ : state) {
+        for (size_t i = 0; i < rounds; ++i) {
+            mem_wait_group group;
+            auto submitted = clock::now();
+            clock::time_point started;
+            pool.submit(group, [&started] { started = clock::now(); });
+            pool.wait(group);
+            latencies.push_back(std::chrono::duration<double, std::nano>(started - submitted).count());
+        }
+    }
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p) { return latencies[std::min(latencies.size() - 1, static_cast<size_t>(p * static_cast<double>(latencies.size())))]; };
+    state.counters["p50_ns"] = percentile(0.5);
+    state.counters["p99_ns"] = percentile(0.99);
+    state.counters["p999_ns"] = percentile(0.999);
+    state.set_items_processed(static_cast<int64_t>(state.iterations() * rounds));
+}
+
+/*
+ * 对不超过当前机器档位的每个ISA分别注册一个用例，名称中带ISA名称，便于对比各档位内核的吞吐量。某个档位没有单独的实现时与低一档解析到同一个函数，只注册较低的一档
+ */
+template<typename Kernel, typename Fn>
+static void bench_register_isa(std::string const& name, Fn bm, std::vector<int64_t> args = {}) {
+    typename Kernel::type *last = nullptr;
+    for (int i = 0; i <= static_cast<int>(mem_active_isa()); ++i) {
+        auto isa = static_cast<mem_isa>(i);
+        auto *fn = Kernel::resolve(isa);
+        if (fn == last) {
+            continue;
+        }
+        last = fn;
+        bench_register(name + "/" + std::string(mem_isa_name(isa)), [bm, fn](bench_state& state) { bm(state, fn); }, args);
+    }
+}
+
+template<typename T, auto Make>
+static void bench_register_stream(std::string const& type) {
+    for (int64_t n : {4096, 1 << 20}) {
+        bench_register("stream_put/" + type, bm_stream_put<T, Make>, {n});
+        bench_register("stream_get/" + type, bm_stream_get<T, Make>, {n});
+    }
+    for (int64_t chunk : {64, 4096, 65536}) {
+        bench_register("stream_write_bulk/" + type, bm_stream_write_bulk<T, Make>, {chunk});
+        bench_register("stream_read_bulk/" + type, bm_stream_read_bulk<T, Make>, {chunk});
+    }
+}
+
+static void bench_register_all() {
+    for (int64_t cap : {64, 4096, 1 << 20}) {
+        bench_register("construct/mem_buffer", bm_construct, {cap});
+    }
+    for (int64_t cap : {64, 4096}) {
+        bench_register("construct/mem_small_buffer<256>", bm_construct_small, {cap});
+    }
+    for (int64_t cap : {64, 4096, 1 << 20}) {
+        bench_register("buffer_pool_acquire", bm_buffer_pool_acquire, {cap, 1});
+        bench_register("buffer_pool_acquire", bm_buffer_pool_acquire, {cap, 0});
+    }
+    for (int64_t threads : {1, 2, 4}) {
+        bench_register("buffer_pool_acquire/threads", bm_buffer_pool_acquire_threads, {threads});
+    }
+    bench_register("copy_refcount", bm_copy_refcount);
+    for (int64_t threads : {1, 2, 4}) {
+        bench_register("copy_refcount/threads", bm_copy_refcount_threads, {threads});
+    }
+    for (int64_t threads : {1, 2, 4}) {
+        bench_register("copy_refcount_private/threads", bm_copy_refcount_private, {threads});
+    }
+    for (int64_t threads : {1, 2, 4}) {
+        bench_register("read_while_copying/threads", bm_read_while_copying, {threads});
+    }
+    bench_register_stream<uint8_t, &mem_buffer<>::get_byte_stream>("byte");
+    bench_register_stream<char, &mem_buffer<>::get_char_stream>("char");
+    bench_register_stream<char8_t, &mem_buffer<>::get_char8_stream>("char8");
+    bench_register_stream<char16_t, &mem_buffer<>::get_char16_stream>("char16");
+    bench_register_stream<char32_t, &mem_buffer<>::get_char32_stream>("char32");
+    bench_register("small_stream_put_get/byte", bm_small_stream_put_get, {256});
+    for (int64_t count : {16, 4096}) {
+        bench_register("stream_endian_write/batch", bm_stream_endian_write<0>, {count});
+        bench_register("stream_endian_write/loop", bm_stream_endian_write<1>, {count});
+        bench_register("stream_endian_write/shift", bm_stream_endian_write<2>, {count});
+        bench_register("stream_endian_read/batch", bm_stream_endian_read<0>, {count});
+        bench_register("stream_endian_read/loop", bm_stream_endian_read<1>, {count});
+        bench_register("stream_endian_read/shift", bm_stream_endian_read<2>, {count});
+    }
+    bench_register_isa<mem_byteswap_kernel<2>>("byteswap/2", bm_byteswap<2>);
+    bench_register_isa<mem_byteswap_kernel<4>>("byteswap/4", bm_byteswap<4>);
+    bench_register_isa<mem_byteswap_kernel<8>>("byteswap/8", bm_byteswap<8>);
+    for (int64_t bits : {7, 14, 32}) {
+        bench_register_isa<mem_varint_decode_kernel<uint32_t>>("varint_decode/u32", bm_varint_decode<uint32_t>, {bits});
+#ifdef MEM_SIMD_X86
+        //未接入分发的AVX2版本单独测量，用于和SSSE3版本比较
+        if (mem_active_isa() >= mem_isa::avx2) {
+            bench_register("varint_decode/u32/avx2", [](bench_state& state) { bm_varint_decode<uint32_t>(state, mem_varint_decode_batch_avx2<uint32_t>); }, {bits});
+        }
+#endif
+    }
+    for (int64_t bits : {7, 64}) {
+        bench_register_isa<mem_varint_decode_kernel<uint64_t>>("varint_decode/u64", bm_varint_decode<uint64_t>, {bits});
+    }
+    for (int64_t len : {64, 4096, 1 << 20}) {
+        bench_register_isa<mem_crc32c_kernel>("crc32c", bm_crc32c, {len});
+    }
+    for (int64_t len : {4096, 1 << 20}) {
+        bench_register_isa<mem_xxh3::hash_long_kernel>("xxh3_64", bm_xxh3_long, {len});
+        bench_register("xxh32", bm_xxh32, {len});
+    }
+    for (int64_t len : {16, 128}) {
+        bench_register("xxh3_64/short", bm_xxh3_short, {len});
+    }
+    for (int64_t len : {1 << 20, 64 << 20}) {
+        bench_register("checksum_write/crc32c/fused", bm_checksum_write<mem_crc32c_digest, true>, {len});
+        bench_register("checksum_write/crc32c/separate", bm_checksum_write<mem_crc32c_digest, false>, {len});
+        bench_register("checksum_write/xxh3/fused", bm_checksum_write<mem_xxh3_digest, true>, {len});
+        bench_register("checksum_write/xxh3/separate", bm_checksum_write<mem_xxh3_digest, false>, {len});
+    }
+    for (auto kind : {bench_lz4_kind::words, bench_lz4_kind::log, bench_lz4_kind::random}) {
+        std::string name = kind == bench_lz4_kind::words ? "words" : kind == bench_lz4_kind::log ? "log" : "random";
+        for (int64_t len : {64 * 1024, 4 << 20}) {
+            bench_register("lz4_compress_block/" + name, [kind](bench_state& state) { bm_lz4_compress_block(state, kind); }, {len});
+            bench_register("lz4_decompress_block/" + name, [kind](bench_state& state) { bm_lz4_decompress_block(state, kind); }, {len});
+        }
+        bench_register("lz4_frame_write/" + name, [kind](bench_state& state) { bm_lz4_frame_write(state, kind); }, {4 << 20});
+        bench_register("lz4_frame_read/" + name, [kind](bench_state& state) { bm_lz4_frame_read(state, kind); }, {4 << 20});
+    }
+    bench_register("serialize/header/serializer", bm_serialize_header<true>);
+    bench_register("serialize/header/per_field", bm_serialize_header<false>);
+    bench_register("deserialize/header/serializer", bm_deserialize_header<true>);
+    bench_register("deserialize/header/per_field", bm_deserialize_header<false>);
+    bench_register("serialize/mixed/serializer", bm_serialize_mixed<true>);
+    bench_register("serialize/mixed/per_field", bm_serialize_mixed<false>);
+    bench_register("deserialize/mixed/serializer", bm_deserialize_mixed<true>);
+    bench_register("deserialize/mixed/per_field", bm_deserialize_mixed<false>);
+    for (int64_t len : {4096, 1 << 20}) {
+        bench_register_isa<mem_find_byte_kernel>("find", bm_find_byte, {len});
+        bench_register_isa<mem_find_any_kernel>("find_any", bm_find_any, {len});
+        bench_register_isa<mem_find_kernel>("find_needle", bm_find_needle, {len});
+        bench_register("skip_until/skip_until", bm_skip_until<false>, {len});
+        bench_register("skip_until/get_loop", bm_skip_until<true>, {len});
+    }
+    bench_register("growth/auto_expand", bm_growth_auto_expand, {16 << 20});
+    bench_register("growth/doubling", bm_growth_doubling, {1 << 30});
+    bench_register("growth/reserve", bm_growth_reserve, {1 << 30});
+    for (int64_t working_set : {1024, 8192}) {
+        bench_register("expand_pollution/memcpy", bm_expand_pollution<false>, {64, working_set});
+        bench_register("expand_pollution/streaming", bm_expand_pollution<true>, {64, working_set});
+    }
+    bench_register("shrink_after_spike/heap", bm_shrink_after_spike<mem_heap_allocator>, {64});
+    bench_register("shrink_after_spike/mmap", bm_shrink_after_spike<mem_mmap_allocator<>>, {64});
+    bench_register("shrink_after_spike/mmap_lazy", bm_shrink_after_spike<mem_mmap_allocator<true>>, {64});
+    for (int64_t threads : {1, 2, 4, 8}) {
+        bench_register("contended_read_write/threads", bm_contended_read_write, {threads});
+    }
+    for (int64_t threads : {1, 2, 4, 8}) {
+        bench_register("pool_submit/work_stealing", bm_pool_submit<mem_thread_pool>, {threads});
+        bench_register("pool_submit/mutex", bm_pool_submit<bench_mutex_pool>, {threads});
+        bench_register("pool_submit_batch/work_stealing", bm_pool_submit_batch, {threads});
+        bench_register("pool_spawn/work_stealing", bm_pool_spawn<mem_thread_pool>, {threads});
+        bench_register("pool_spawn/mutex", bm_pool_spawn<bench_mutex_pool>, {threads});
+        bench_register("pool_latency/work_stealing", bm_pool_latency<mem_thread_pool>, {threads});
+        bench_register("pool_latency/mutex", bm_pool_latency<bench_mutex_pool>, {threads});
+    }
+    auto cores = static_cast<int64_t>(mem_parallel::concurrency());
+    for (int64_t size : {256, 4096}) {
+        for (int64_t threads = 1; threads < cores; threads *= 2) {
+            bench_register("parallel_xxh3", bm_parallel_xxh3, {size, threads});
+        }
+        bench_register("parallel_xxh3", bm_parallel_xxh3, {size, cores});
+    }
+    for (int64_t kind = 0; kind < 4; ++kind) {
+        std::string suffix = std::string("/") + bench_utf8_kind_name(kind);
+        bench_register_isa<mem_utf8_to_wide_kernel<char16_t>>("utf8_to_utf16" + suffix, bm_utf8_to_wide<char16_t>, {kind});
+        bench_register_isa<mem_utf8_to_wide_kernel<char32_t>>("utf8_to_utf32" + suffix, bm_utf8_to_wide<char32_t>, {kind});
+        bench_register_isa<mem_wide_to_utf8_kernel<char16_t>>("utf16_to_utf8" + suffix, bm_wide_to_utf8<char16_t>, {kind});
+        bench_register_isa<mem_wide_to_utf8_kernel<char32_t>>("utf32_to_utf8" + suffix, bm_wide_to_utf8<char32_t>, {kind});
+    }
+}
+
+int main(int argc, char **argv) {
+    std::string filter, format = "console", out_path;
+    double min_time = 0.5;
+    int repetitions = 1;
+    bool list = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        auto value = [&](std::string_view key) { return arg.substr(key.size()); };
+        if (arg.starts_with("--benchmark_filter=")) {
+            filter = value("--benchmark_filter=");
+        } else if (arg.starts_with("--benchmark_min_time=")) {
+            min_time = std::stod(std::string(value("--benchmark_min_time=")));
+        } else if (arg.starts_with("--benchmark_repetitions=")) {
+            repetitions = std::stoi(std::string(value("--benchmark_repetitions=")));
+        } else if (arg.starts_with("--benchmark_format=")) {
+            format = value("--benchmark_format=");
+        } else if (arg.starts_with("--benchmark_out=")) {
+            out_path = value("--benchmark_out=");
+        } else if (arg == "--benchmark_list_tests") {
+            list = true;
+        } else {
+            std::cerr << "unknown argument " << arg << std::endl;
+            return 2;
+        }
+    }
+    bench_register_all();
+    std::vector<bench_result> results;
+    bool console = format != "json";
+    if (console && !list) {
+        std::cout << "isa: " << mem_isa_name(mem_active_isa()) << ", cpus: " << std::thread::hardware_concurrency() << std::endl;
+        char header[128];
+        snprintf(header, sizeof(header), "%-48s %17s %17s %12s", "Benchmark", "Time", "CPU", "Iterations");
+        std::cout << header << std::endl;
+    }
+    for (auto const& c : bench_registry()) {
+        if (!filter.empty() && c.name.find(filter) == std::string::npos) {
+            continue;
+        }
+        if (list) {
+            std::cout << c.name << std::endl;
+            continue;
+        }
+        for (int r = 0; r < repetitions; ++r) {
+            results.push_back(bench_run(c, min_time));
+            if (console) {
+                bench_write_console(std::cout, results.back());
+            }
+        }
+    }
+    if (list) {
+        return 0;
+    }
+    if (!console) {
+        bench_write_json(std::cout, results);
+    }
+    if (!out_path.empty()) {
+        std::ofstream out(out_path);
+        bench_write_json(out, results);
+    }
+    return 0;
+}
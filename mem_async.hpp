@@ -0,0 +1,429 @@
+#pragma once
+
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <utility>
+#include "mem_utils.hpp"
+/*
+ * 基于C++20协程的增量解析。
+ *
+ * mem_async_stream把缓冲分为已写入的[0, filled)与尚未写入的部分：生产方通过write()/write_with()在filled处追加数据(缓冲按需自动扩容)，消费方在协程中co_await get<U>()等函数
+ * 从当前位置读取。数据足够时co_await不挂起，直接返回；不足时挂起消费方协程，等生产方追加了足够的数据后在生产方的线程中、write()返回之前恢复它。解析的中间状态保存在协程帧中，
+ * 数据分多次到达时不需要从头重新解析。
+ *
+ * 生产方调用close()表示不会再有数据，此时挂起的读取被恢复，数据仍不足时co_await抛出mem_exception。生产方与消费方可以在不同的线程中，但同一时间只能有一个协程在流上等待。多个生产方
+ * 可以并发写入，各次写入按取得追加位置的顺序依次完成，不会互相覆盖。
+ * 等待中的协程被销毁前应先close()或析构流，否则流中留下的句柄会在下一次写入时被恢复。
+ *
+ * mem_async_task<R>是配套的协程返回类型：调用后立即开始执行，直到第一次挂起；可以在其他协程中co_await以取得结果，用于把解析拆分为多个子协程。
+ */
+
+template<typename R>
+struct mem_async_result {
+    std::optional<R> value;
+
+    void return_value(R v) {
+        value.emplace(std::move(v));
+    }
+
+    R take() {
+        return std::move(*value);
+    }
+};
+
+template<>
+struct mem_async_result<void> {
+    void return_void() {}
+
+    void take() {}
+};
+
+template<typename R = void>
+class mem_async_task {
+public:
+    struct promise_type : mem_async_result<R> {
+        std::exception_ptr error;
+        //等待该任务的协程。任务结束时换成promise自身的地址作为已结束的标记，与co_await一方以原子交换确定由谁恢复等待方
+        std::atomic<void*> continuation {nullptr};
+
+        mem_async_task get_return_object() {
+            return mem_async_task(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        std::suspend_never initial_suspend() noexcept {
+            return {};
+        }
+
+        struct final_awaiter {
+            bool await_ready() noexcept {
+                return false;
+            }
+
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+                promise_type& p = h.promise();
+                void *waiting = p.continuation.exchange(&p, std::memory_order_acq_rel);
+                return waiting != nullptr ? std::coroutine_handle<>::from_address(waiting) : std::noop_coroutine();
+            }
+
+            void await_resume() noexcept {}
+        };
+
+        final_awaiter final_suspend() noexcept {
+            return {};
+        }
+
+        void unhandled_exception() {
+            error = std::current_exception();
+        }
+    };
+private:
+    std::coroutine_handle<promise_type> handle;
+
+    explicit mem_async_task(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+public:
+    mem_async_task(mem_async_task&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+
+    mem_async_task& operator=(mem_async_task&& other) noexcept {
+        if (this != &other) {
+            if (handle) {
+                handle.destroy();
+            }
+            handle = std::exchange(other.handle, nullptr);
+        }
+        return *this;
+    }
+
+    ~mem_async_task() {
+        if (handle) {
+            handle.destroy();
+        }
+    }
+
+    //协程是否已经执行完毕(正常返回或抛出异常)
+    [[nodiscard]] bool done() const {
+        return handle && handle.done();
+    }
+
+    //取得结果，协程抛出的异常在此重新抛出。未执行完毕时抛出mem_exception
+    R get() {
+        if (!done()) {
+            throw mem_exception("mem_async_task is not finished");
+        }
+        if (handle.promise().error) {
+            std::rethrow_exception(handle.promise().error);
+        }
+        return handle.promise().take();
+    }
+
+    auto operator co_await() {
+        struct awaiter {
+            mem_async_task& task;
+
+            bool await_ready() const {
+                return task.done();
+            }
+
+            bool await_suspend(std::coroutine_handle<> waiting) {
+                promise_type& p = task.handle.promise();
+                //交换前任务已经结束时不挂起
+                return p.continuation.exchange(waiting.address(), std::memory_order_acq_rel) == nullptr;
+            }
+
+            R await_resume() {
+                return task.get();
+            }
+        };
+        return awaiter {*this};
+    }
+};
+
+template<typename Buffer = mem_buffer<>>
+class mem_async_stream {
+private:
+    //挂起中的读取，ready()在持有流的锁时调用
+    struct waiter {
+        std::coroutine_handle<> handle;
+
+        virtual bool ready(mem_async_stream& stream) = 0;
+    };
+
+    mem_buffer_holder<Buffer> buffer;
+    size_t pos {0};
+    size_t end {0};
+    bool eof {false};
+    waiter *waiting {nullptr};
+    std::mutex mutex;
+    //生产方之间的锁，从读取追加位置到更新end期间持有，消费方不需要取得
+    std::mutex producing;
+
+    size_t available_locked() const {
+        return end - pos;
+    }
+
+    /*
+     * 以find(data, len)在[pos + scanned, end)中查找，返回找到的位置相对pos的偏移，找不到时返回mem_npos。scanned为[pos, pos + scanned)中已确认没有目标的字节数，找不到时推进到
+     * end，找到时置为找到的偏移，因此数据分多次到达时每个字节只扫描一次。
+     */
+    template<typename Find>
+    size_t scan(size_t& scanned, Find&& find) {
+        size_t from = pos + scanned, r = mem_npos;
+        if (from < end) {
+            buffer.read_with(end - from, from, [&](const char *data) {
+                size_t k = find(data, end - from);
+                r = k == mem_npos ? mem_npos : from + k - pos;
+            });
+        }
+        scanned = r == mem_npos ? end - pos : r;
+        return r;
+    }
+
+    //生产方追加数据后检查挂起的读取，返回条件已满足的读取，由调用方在释放所有锁之后恢复
+    waiter *publish(size_t len) {
+        std::lock_guard guard(mutex);
+        end += len;
+        if (waiting != nullptr && waiting->ready(*this)) {
+            return std::exchange(waiting, nullptr);
+        }
+        return nullptr;
+    }
+
+    /*
+     * 等待need(stream)返回的条件满足后调用take(stream)，流关闭后条件仍不满足时take应抛出异常。Need与Take都在持有流的锁时调用。需要查找的读取(get_varint、read_until)的
+     * Need与Take还接收scanned，见scan()，由awaiter在多次检查之间保存。
+     */
+    template<typename Need, typename Take>
+    struct awaiter : waiter {
+        mem_async_stream& stream;
+        Need need;
+        Take take;
+        size_t scanned {0};
+
+        awaiter(mem_async_stream& stream, Need need, Take take) : stream(stream), need(std::move(need)), take(std::move(take)) {}
+
+        template<typename F>
+        auto call(F& f, mem_async_stream& s) {
+            if constexpr (std::is_invocable_v<F&, mem_async_stream&, size_t&>) {
+                return f(s, scanned);
+            } else {
+                return f(s);
+            }
+        }
+
+        bool ready(mem_async_stream& s) override {
+            return s.eof || call(need, s);
+        }
+
+        bool await_ready() {
+            std::lock_guard guard(stream.mutex);
+            return ready(stream);
+        }
+
+        bool await_suspend(std::coroutine_handle<> h) {
+            std::lock_guard guard(stream.mutex);
+            if (ready(stream)) {
+                return false;
+            }
+            if (stream.waiting != nullptr) {
+                throw mem_exception("another coroutine is already waiting on this mem_async_stream");
+            }
+            this->handle = h;
+            stream.waiting = this;
+            return true;
+        }
+
+        auto await_resume() {
+            std::lock_guard guard(stream.mutex);
+            return call(take, stream);
+        }
+    };
+
+    template<typename Need, typename Take>
+    auto make_awaiter(Need need, Take take) {
+        return awaiter<Need, Take>(*this, std::move(need), std::move(take));
+    }
+
+    void require(size_t len) {
+        if (available_locked() < len) {
+            throw mem_exception(std::format("mem_async_stream closed with {} bytes available, {} required", available_locked(), len));
+        }
+    }
+
+    template<std::endian E, typename U>
+    auto get_endian() {
+        return make_awaiter([](mem_async_stream& s) { return s.available_locked() >= sizeof(U); }, [](mem_async_stream& s) {
+            s.require(sizeof(U));
+            U u {};
+            s.buffer.read_with(sizeof(U), s.pos, [&u](const char *src) { mem_copy_endian<E, U>(&u, src, 1); });
+            s.pos += sizeof(U);
+            return u;
+        });
+    }
+public:
+    explicit mem_async_stream(Buffer& buffer) : buffer(mem_hold(buffer)) {}
+
+    mem_async_stream(mem_async_stream const&) = delete;
+    mem_async_stream& operator=(mem_async_stream const&) = delete;
+
+    //生产方：在已写入部分的末尾追加len字节，缓冲的write_with失败时返回false(mem_buffer不能扩容时直接抛出mem_exception)
+    bool write(const char *src, size_t len) {
+        return write_with(len, [src, len](char *dst) { memcpy(dst, src, len); });
+    }
+
+    /*
+     * 生产方：以指向追加位置的指针调用f，由f直接写入len字节(如从套接字接收)，f的返回值见mem_written，只有实际写入的部分对消费方可见。追加位置在持有producing时取得，
+     * 写入并更新end之后才释放，因此并发的生产方依次追加；f执行期间消费方仍可以读取已写入的数据。满足条件的读取在释放锁之后恢复，恢复的协程可以再次写入该流。
+     */
+    template<typename F>
+    bool write_with(size_t len, F&& f) {
+        waiter *w;
+        {
+            std::lock_guard producer(producing);
+            size_t at;
+            {
+                std::lock_guard guard(mutex);
+                if (eof) {
+                    throw mem_exception("write to a closed mem_async_stream");
+                }
+                at = end;
+            }
+            size_t n = mem_npos;
+            if (!buffer.write_with(len, at, [&](char *dst) { return n = mem_written(len, f, dst); })) {
+                return false;
+            }
+            w = publish(n);
+        }
+        if (w != nullptr) {
+            w->handle.resume();
+        }
+        return true;
+    }
+
+    //生产方：不会再有数据，挂起的读取被恢复。正在进行的写入先完成
+    void close() {
+        waiter *w;
+        {
+            std::lock_guard producer(producing);
+            std::lock_guard guard(mutex);
+            eof = true;
+            w = std::exchange(waiting, nullptr);
+        }
+        if (w != nullptr) {
+            w->handle.resume();
+        }
+    }
+
+    bool closed() {
+        std::lock_guard guard(mutex);
+        return eof;
+    }
+
+    //已写入但尚未读取的字节数
+    size_t available() {
+        std::lock_guard guard(mutex);
+        return available_locked();
+    }
+
+    size_t position() {
+        std::lock_guard guard(mutex);
+        return pos;
+    }
+
+    //已写入的字节数
+    size_t filled() {
+        std::lock_guard guard(mutex);
+        return end;
+    }
+
+    template<typename U>
+    requires std::is_trivially_copyable_v<U>
+    auto get() {
+        return make_awaiter([](mem_async_stream& s) { return s.available_locked() >= sizeof(U); }, [](mem_async_stream& s) {
+            s.require(sizeof(U));
+            U u;
+            s.buffer.read(reinterpret_cast<char*>(&u), sizeof(U), s.pos);
+            s.pos += sizeof(U);
+            return u;
+        });
+    }
+
+    template<mem_swappable U>
+    auto get_le() {
+        return get_endian<std::endian::little, U>();
+    }
+
+    template<mem_swappable U>
+    auto get_be() {
+        return get_endian<std::endian::big, U>();
+    }
+
+    //读取len字节到dst
+    auto read(char *dst, size_t len) {
+        return make_awaiter([len](mem_async_stream& s) { return s.available_locked() >= len; }, [dst, len](mem_async_stream& s) {
+            s.require(len);
+            s.buffer.read(dst, len, s.pos);
+            s.pos += len;
+        });
+    }
+
+    auto skip(size_t len) {
+        return make_awaiter([len](mem_async_stream& s) { return s.available_locked() >= len; }, [len](mem_async_stream& s) {
+            s.require(len);
+            s.pos += len;
+        });
+    }
+
+    /*
+     * 读取LEB128格式的整数，编码与mem_stream::get_varint相同(有符号整数按64位编码)。等待到出现最高位为0的字节为止，超过最大编码长度仍未结束时抛出mem_exception。
+     */
+    template<std::integral U>
+    auto get_varint() {
+        using V = std::conditional_t<std::is_signed_v<U>, uint64_t, U>;
+        static constexpr size_t max_size = mem_varint_max_size<V>;
+        auto complete = [](mem_async_stream& s, size_t& scanned) {
+            return s.available_locked() >= max_size || s.scan(scanned, [](const char *data, size_t len) {
+                for (size_t i = 0; i < len; ++i) {
+                    if ((static_cast<uint8_t>(data[i]) & 0x80) == 0) {
+                        return i;
+                    }
+                }
+                return mem_npos;
+            }) != mem_npos;
+        };
+        return make_awaiter(complete, [](mem_async_stream& s) {
+            size_t len = std::min(s.available_locked(), max_size), n = 0;
+            V v {};
+            if (len != 0) {
+                s.buffer.read_with(len, s.pos, [&](const char *src) { n = mem_varint_decode(src, len, v); });
+            }
+            if (n == 0) {
+                if (len == max_size) {
+                    throw mem_exception(std::format("malformed varint at {}", s.pos));
+                }
+                s.require(len + 1);
+            }
+            s.pos += n;
+            return static_cast<U>(v);
+        });
+    }
+
+    //读取到分隔符delim为止，返回不含分隔符的内容，分隔符被跳过
+    auto read_until(char delim) {
+        auto find = [delim](const char *data, size_t len) { return mem_find_byte(data, len, delim); };
+        return make_awaiter([find](mem_async_stream& s, size_t& scanned) { return s.scan(scanned, find) != mem_npos; },
+                            [find](mem_async_stream& s, size_t& scanned) {
+            //条件满足时scanned已是分隔符的偏移，这里不再重复扫描之前的数据
+            size_t k = s.scan(scanned, find);
+            if (k == mem_npos) {
+                throw mem_exception(std::format("mem_async_stream closed before delimiter, {} bytes available", s.available_locked()));
+            }
+            std::string r(k, '\0');
+            s.buffer.read(r.data(), k, s.pos);
+            s.pos += k + 1;
+            return r;
+        });
+    }
+};
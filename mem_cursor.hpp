@@ -0,0 +1,334 @@
+#pragma once
+
+#include <vector>
+#include "mem_utils.hpp"
+/*
+ * 与缓冲分离的读写游标。缓冲只负责存储，游标是只含缓冲引用、范围与当前位置的轻量对象，可以为每个线程各建一个，互不共享可变状态。
+ *
+ * mem_reader在[begin, end)范围内顺序读取，读取时不加锁，直接从缓冲的存储中拷贝，范围在构造时一次性确定。split()将剩余的范围切分为若干个互不重叠的游标，用于多个线程并行解析
+ * 同一个缓冲；带resync参数的版本将每个切分点后移到下一条记录的开头，使每条记录恰好属于一个游标。
+ *
+ * mem_writer分两种：有界的写游标(指定end)在构造时一次性将缓冲扩容到end，之后在[begin, end)范围内直接写入存储，不加锁，越界的写入返回false，多个有界写游标可以并行写入互不重叠的
+ * 范围；无界的写游标(end为mem_npos)每次写入都通过缓冲的write_with进行，按需自动扩容。
+ *
+ * 与mem_view相同，不加锁的读写要求游标存在期间缓冲不被扩容(否则存储会被迁移)。mem_buffer按值持有(共享存储并延长其生命周期)，其余缓冲按引用持有。游标本身不是线程安全的，
+ * 每个游标只应由一个线程使用。
+ */
+template<typename Buffer = mem_buffer<>>
+class mem_reader {
+private:
+    mem_buffer_holder<const Buffer> buffer;
+    size_t first;
+    size_t last;
+    size_t pos;
+
+    const char *storage() const {
+        return reinterpret_cast<const char*>(buffer.data());
+    }
+
+    template<std::endian E, typename T>
+    bool read_endian(T *dst, size_t count) {
+        size_t len = sizeof(T) * count;
+        if (len > last - pos) {
+            return false;
+        }
+        mem_copy_endian<E, T>(dst, storage() + pos, count);
+        pos += len;
+        return true;
+    }
+public:
+    //范围超出容量的部分被截掉
+    explicit mem_reader(Buffer const& buffer, size_t begin = 0, size_t end = mem_npos) : buffer(mem_hold(buffer)), last(std::min(end, buffer.capacity())) {
+        first = std::min(begin, last);
+        pos = first;
+    }
+
+    //拷贝出的游标与原游标共享控制块，写时复制模式下不是快照
+    mem_reader(mem_reader const& reader) : buffer(mem_hold(reader.buffer)), first(reader.first), last(reader.last), pos(reader.pos) {}
+
+    size_t begin() const {
+        return first;
+    }
+
+    size_t end() const {
+        return last;
+    }
+
+    //当前位置，相对缓冲开头
+    size_t position() const {
+        return pos;
+    }
+
+    //移动到[begin, end]内的position，越界时返回false且不移动
+    bool position(size_t position) {
+        if (position < first || position > last) {
+            return false;
+        }
+        pos = position;
+        return true;
+    }
+
+    size_t remaining() const {
+        return last - pos;
+    }
+
+    bool eof() const {
+        return pos == last;
+    }
+
+    bool read(char *dst, size_t len) {
+        if (len > last - pos) {
+            return false;
+        }
+        memcpy(dst, storage() + pos, len);
+        pos += len;
+        return true;
+    }
+
+    template<typename T>
+    requires std::is_trivially_copyable_v<T>
+    bool read(T& t) {
+        return read(reinterpret_cast<char*>(&t), sizeof(T));
+    }
+
+    template<typename T>
+    requires std::is_trivially_copyable_v<T>
+    T read() {
+        T t {};
+        read(t);
+        return t;
+    }
+
+    template<mem_swappable T>
+    bool read_le(T& t) {
+        return read_endian<std::endian::little>(&t, 1);
+    }
+
+    template<mem_swappable T>
+    bool read_be(T& t) {
+        return read_endian<std::endian::big>(&t, 1);
+    }
+
+    template<mem_swappable T>
+    T read_le() {
+        T t {};
+        read_le(t);
+        return t;
+    }
+
+    template<mem_swappable T>
+    T read_be() {
+        T t {};
+        read_be(t);
+        return t;
+    }
+
+    template<mem_swappable T>
+    bool read_le(T *dst, size_t count) {
+        return read_endian<std::endian::little>(dst, count);
+    }
+
+    template<mem_swappable T>
+    bool read_be(T *dst, size_t count) {
+        return read_endian<std::endian::big>(dst, count);
+    }
+
+    bool skip(size_t len) {
+        if (len > last - pos) {
+            return false;
+        }
+        pos += len;
+        return true;
+    }
+
+    //以指向当前位置的指针调用f，成功后前进len字节
+    template<typename F>
+    bool read_with(size_t len, F&& f) {
+        if (len > last - pos) {
+            return false;
+        }
+        f(storage() + pos);
+        pos += len;
+        return true;
+    }
+
+    //在[position(), end)中查找字节c，返回其相对缓冲开头的偏移，找不到时返回mem_npos
+    size_t find(char c) const {
+        size_t k = mem_find_byte(storage() + pos, last - pos, c);
+        return k == mem_npos ? mem_npos : pos + k;
+    }
+
+    /*
+     * 将[position(), end)等分为n个连续的游标(最后一个包含余数)，n为0时按1处理。
+     */
+    std::vector<mem_reader> split(size_t n) const {
+        return split(n, [](const char *, size_t) { return static_cast<size_t>(0); });
+    }
+
+    /*
+     * 与split(n)相同，但每个切分点按resync后移：resync(data, len)以指向切分点的指针与其后直到end的字节数调用，返回下一条记录开头相对切分点的偏移，找不到时返回mem_npos
+     * (此后的内容全部归入前一个游标)。切分点后移后与后一个切分点重合或越过时，两段合并，因此返回的游标可能少于n个，但都不为空(范围为空时返回一个空游标)。
+     */
+    template<typename Resync>
+    std::vector<mem_reader> split(size_t n, Resync&& resync) const {
+        n = std::max<size_t>(n, 1);
+        size_t total = last - pos, step = total / n;
+        std::vector<mem_reader> parts;
+        size_t start = pos;
+        for (size_t i = 1; i < n && step != 0; ++i) {
+            size_t cut = pos + i * step;
+            if (cut <= start) {
+                continue;
+            }
+            size_t k = resync(storage() + cut, last - cut);
+            if (k == mem_npos || k >= last - cut) {
+                break;
+            }
+            cut += k;
+            if (cut > start) {
+                parts.emplace_back(buffer, start, cut);
+                start = cut;
+            }
+        }
+        parts.emplace_back(buffer, start, last);
+        return parts;
+    }
+};
+
+template<typename Buffer = mem_buffer<>>
+class mem_writer {
+private:
+    mem_buffer_holder<Buffer> buffer;
+    size_t first;
+    size_t last;
+    size_t pos;
+
+    bool bounded() const {
+        return last != mem_npos;
+    }
+
+    //f的返回值见mem_written，游标前进实际写入的字节数，放弃写入时返回false且不移动
+    template<typename F>
+    bool put(size_t len, F&& f) {
+        size_t n = mem_npos;
+        if (bounded()) {
+            if (len <= last - pos) {
+                n = mem_written(len, f, reinterpret_cast<char*>(buffer.data()) + pos);
+            }
+        } else {
+            buffer.write_with(len, pos, [&](char *out) { return n = mem_written(len, f, out); });
+        }
+        if (n == mem_npos) {
+            return false;
+        }
+        pos += n;
+        return true;
+    }
+
+    template<std::endian E, typename T>
+    bool write_endian(const T *src, size_t count) {
+        return put(sizeof(T) * count, [src, count](char *dst) { mem_copy_endian<E, T>(dst, src, count); });
+    }
+public:
+    /*
+     * end不为mem_npos时构造有界的写游标：通过write_with一次性将缓冲扩容到end(内存被快照共享时同时复制出私有内存)，之后直接写入存储。此后再对缓冲创建的快照与游标
+     * 共享内存，游标的写入会出现在快照中，与直接通过data()写入相同。预留时回调报告写入0字节，缓冲的used不变，游标的写入同样不计入used。缓冲不能扩容到end时抛出
+     * mem_exception。
+     */
+    explicit mem_writer(Buffer& buffer, size_t begin = 0, size_t end = mem_npos) : buffer(mem_hold(buffer)), first(begin), last(end), pos(begin) {
+        if (bounded()) {
+            if (end < begin) {
+                throw mem_exception(std::format("invalid writer range [{}, {})", begin, end));
+            }
+            if (!this->buffer.write_with(end - begin, begin, [](char *) { return static_cast<size_t>(0); })) {
+                throw mem_exception(std::format("cannot reserve writer range [{}, {}) in buffer of capacity {}", begin, end, buffer.capacity()));
+            }
+        }
+    }
+
+    //拷贝出的游标与原游标共享控制块，写时复制模式下不是快照
+    mem_writer(mem_writer const& writer) : buffer(mem_hold(writer.buffer)), first(writer.first), last(writer.last), pos(writer.pos) {}
+
+    size_t begin() const {
+        return first;
+    }
+
+    //有界游标的结束位置，无界游标为mem_npos
+    size_t end() const {
+        return last;
+    }
+
+    size_t position() const {
+        return pos;
+    }
+
+    bool position(size_t position) {
+        if (position < first || position > last) {
+            return false;
+        }
+        pos = position;
+        return true;
+    }
+
+    //有界游标剩余可写的字节数，无界游标为mem_npos
+    size_t remaining() const {
+        return bounded() ? last - pos : mem_npos;
+    }
+
+    bool write(const char *src, size_t len) {
+        return put(len, [src, len](char *dst) { memcpy(dst, src, len); });
+    }
+
+    template<typename T>
+    requires std::is_trivially_copyable_v<T>
+    bool write(T const& t) {
+        return write(reinterpret_cast<const char*>(&t), sizeof(T));
+    }
+
+    template<mem_swappable T>
+    bool write_le(T const& t) {
+        return write_endian<std::endian::little>(&t, 1);
+    }
+
+    template<mem_swappable T>
+    bool write_be(T const& t) {
+        return write_endian<std::endian::big>(&t, 1);
+    }
+
+    template<mem_swappable T>
+    bool write_le(const T *src, size_t count) {
+        return write_endian<std::endian::little>(src, count);
+    }
+
+    template<mem_swappable T>
+    bool write_be(const T *src, size_t count) {
+        return write_endian<std::endian::big>(src, count);
+    }
+
+    bool fill(char value, size_t len) {
+        return put(len, [value, len](char *dst) { memset(dst, value, len); });
+    }
+
+    //以指向当前位置的指针调用f，f返回size_t时游标只前进实际写入的字节数，放弃写入时返回false且不移动。见mem_written
+    template<typename F>
+    bool write_with(size_t len, F&& f) {
+        return put(len, std::forward<F>(f));
+    }
+
+    /*
+     * 将有界游标的[position(), end)等分为n个有界的写游标，各自写入互不重叠的范围。无界游标不能切分，此时抛出mem_exception。
+     */
+    std::vector<mem_writer> split(size_t n) const {
+        if (!bounded()) {
+            throw mem_exception("cannot split an unbounded writer");
+        }
+        n = std::max<size_t>(n, 1);
+        size_t step = (last - pos) / n;
+        std::vector<mem_writer> parts;
+        for (size_t i = 0; i < n; ++i) {
+            size_t b = pos + i * step;
+            parts.emplace_back(const_cast<Buffer&>(static_cast<Buffer const&>(buffer)), b, i + 1 == n ? last : b + step);
+        }
+        return parts;
+    }
+};
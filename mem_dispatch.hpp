@@ -0,0 +1,180 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string_view>
+/*
+ * CPU特性检测与运行时分派。进程内只执行一次CPUID探测，得到可用的指令集档位(mem_isa)；每个批量内核通过mem_dispatch在第一次调用时按档位解析出实现并缓存函数指针，之后的调用
+ * 只是一次间接调用。
+ *
+ * 环境变量GXUTILS_ISA可以将档位限制为scalar/sse2/ssse3/sse4.2/avx2/avx512之一，用于对比各档位的性能。该变量只能降低档位，超过CPU实际支持的档位时按实际档位处理。
+ * 档位在第一次使用时确定，之后修改环境变量不再生效。
+ */
+#if defined(__GNUC__) && defined(__x86_64__)
+#define MEM_SIMD_X86
+#include <immintrin.h>
+#include <cpuid.h>
+#define MEM_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+//缓存行大小，用于隔开被不同线程频繁写入的字段
+inline constexpr size_t mem_cache_line_size = 64;
+
+//指令集档位，每一档都包含之前所有档位的指令
+enum class mem_isa : int {
+    scalar,
+    sse2,
+    ssse3,
+    sse42,
+    avx2,
+    avx512
+};
+
+struct mem_cpu_features {
+    bool sse2 = false;
+    bool ssse3 = false;
+    bool sse41 = false;
+    bool sse42 = false;
+    bool popcnt = false;
+    bool avx = false;
+    bool avx2 = false;
+    bool bmi1 = false;
+    bool bmi2 = false;
+    bool avx512f = false;
+    bool avx512bw = false;
+    bool avx512vl = false;
+};
+
+#ifdef MEM_SIMD_X86
+//读取XCR0，确认操作系统在上下文切换时保存了对应的寄存器状态
+inline uint64_t mem_xgetbv() {
+    uint32_t eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return static_cast<uint64_t>(edx) << 32 | eax;
+}
+#endif
+
+inline mem_cpu_features mem_probe_cpu() {
+    mem_cpu_features f;
+#ifdef MEM_SIMD_X86
+    unsigned eax, ebx, ecx, edx;
+    unsigned max = __get_cpuid_max(0, nullptr);
+    if (max < 1) {
+        return f;
+    }
+    __cpuid(1, eax, ebx, ecx, edx);
+    f.sse2 = edx & bit_SSE2;
+    f.ssse3 = ecx & bit_SSSE3;
+    f.sse41 = ecx & bit_SSE4_1;
+    f.sse42 = ecx & bit_SSE4_2;
+    f.popcnt = ecx & bit_POPCNT;
+    bool osxsave = ecx & bit_OSXSAVE;
+    uint64_t xcr0 = osxsave ? mem_xgetbv() : 0;
+    bool ymm = (xcr0 & 0x6) == 0x6;
+    bool zmm = (xcr0 & 0xe6) == 0xe6;
+    f.avx = (ecx & bit_AVX) && ymm;
+    if (max >= 7) {
+        __cpuid_count(7, 0, eax, ebx, ecx, edx);
+        f.avx2 = f.avx && (ebx & bit_AVX2);
+        f.bmi1 = ebx & bit_BMI;
+        f.bmi2 = ebx & bit_BMI2;
+        f.avx512f = zmm && (ebx & bit_AVX512F);
+        f.avx512bw = f.avx512f && (ebx & bit_AVX512BW);
+        f.avx512vl = f.avx512f && (ebx & bit_AVX512VL);
+    }
+#endif
+    return f;
+}
+
+//本机CPU特性，只探测一次
+inline mem_cpu_features const& mem_cpu() {
+    static const mem_cpu_features f = mem_probe_cpu();
+    return f;
+}
+
+inline mem_isa mem_detect_isa(mem_cpu_features const& f) {
+    if (!f.sse2) {
+        return mem_isa::scalar;
+    }
+    if (!f.ssse3) {
+        return mem_isa::sse2;
+    }
+    if (!f.sse41 || !f.sse42 || !f.popcnt) {
+        return mem_isa::ssse3;
+    }
+    if (!f.avx2 || !f.bmi1 || !f.bmi2) {
+        return mem_isa::sse42;
+    }
+    if (!f.avx512f || !f.avx512bw || !f.avx512vl) {
+        return mem_isa::avx2;
+    }
+    return mem_isa::avx512;
+}
+
+inline constexpr std::string_view mem_isa_name(mem_isa isa) {
+    switch (isa) {
+        case mem_isa::sse2: return "sse2";
+        case mem_isa::ssse3: return "ssse3";
+        case mem_isa::sse42: return "sse4.2";
+        case mem_isa::avx2: return "avx2";
+        case mem_isa::avx512: return "avx512";
+        default: return "scalar";
+    }
+}
+
+//解析GXUTILS_ISA，无法识别时返回false
+inline bool mem_parse_isa(std::string_view name, mem_isa& isa) {
+    for (int i = static_cast<int>(mem_isa::scalar); i <= static_cast<int>(mem_isa::avx512); ++i) {
+        if (mem_isa_name(static_cast<mem_isa>(i)) == name) {
+            isa = static_cast<mem_isa>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+//分派使用的档位：CPU支持的最高档位，受GXUTILS_ISA限制
+inline mem_isa mem_active_isa() {
+    static const mem_isa isa = [] {
+        mem_isa detected = mem_detect_isa(mem_cpu());
+        mem_isa forced;
+        const char *env = std::getenv("GXUTILS_ISA");
+        if (env != nullptr && mem_parse_isa(env, forced) && forced < detected) {
+            return forced;
+        }
+        return detected;
+    }();
+    return isa;
+}
+
+/*
+ * 一个分派入口。Kernel需要提供函数类型type以及静态函数resolve(mem_isa)，后者返回该档位下使用的实现。函数指针初始指向一个跳板，第一次调用时跳板解析出实现、写回指针
+ * 并转发调用，效果与GNU ifunc相同，但不依赖动态链接器，也适用于模板实例。多个线程同时第一次调用时会各自解析一次，写入的是同一个值。
+ */
+template<typename Kernel, typename F = typename Kernel::type>
+class mem_dispatch;
+
+template<typename Kernel, typename R, typename... A>
+class mem_dispatch<Kernel, R(A...)> {
+    using fn_t = R(*)(A...);
+
+    static R trampoline(A... args) {
+        fn_t fn = Kernel::resolve(mem_active_isa());
+        ptr.store(fn, std::memory_order_relaxed);
+        return fn(args...);
+    }
+
+    static inline std::atomic<fn_t> ptr {trampoline};
+public:
+    static R call(A... args) {
+        return ptr.load(std::memory_order_relaxed)(args...);
+    }
+
+    //当前档位下的实现，用于测试或在循环外取出指针
+    static fn_t get() {
+        return Kernel::resolve(mem_active_isa());
+    }
+};
@@ -0,0 +1,728 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include "mem_dispatch.hpp"
+/*
+ * 校验和与哈希内核：CRC32C(Castagnoli多项式，与iSCSI/ext4/SSE4.2 crc32指令一致)、XXH3-64(与xxHash 0.8的XXH3_64bits输出一致)以及LZ4帧格式使用的XXH32。
+ * 都提供一次性计算与增量计算，增量计算的结果与对拼接后的数据一次性计算相同。
+ */
+
+inline constexpr uint32_t mem_crc32c_poly = 0x82f63b78;
+
+//按字节分片(slicing-by-8)的查找表，table[k][n]为字节n之后再跟k个0字节的CRC
+inline constexpr std::array<std::array<uint32_t, 256>, 8> mem_crc32c_table = [] {
+    std::array<std::array<uint32_t, 256>, 8> table {};
+    for (uint32_t n = 0; n < 256; ++n) {
+        uint32_t crc = n;
+        for (int k = 0; k < 8; ++k) {
+            crc = crc & 1 ? crc >> 1 ^ mem_crc32c_poly : crc >> 1;
+        }
+        table[0][n] = crc;
+    }
+    for (uint32_t n = 0; n < 256; ++n) {
+        uint32_t crc = table[0][n];
+        for (size_t k = 1; k < 8; ++k) {
+            crc = table[0][crc & 0xff] ^ crc >> 8;
+            table[k][n] = crc;
+        }
+    }
+    return table;
+}();
+
+/*
+ * 将CRC移过len个0字节的线性算子。分段并行计算的CRC通过它合并：crc(A+B) = shift(crc(A), |B|) ^ crc(B)(不计首尾取反)。算子以GF(2)上的32x32矩阵表示，通过反复平方构造，
+ * 最后展开成按字节查表的形式。
+ */
+struct mem_crc32c_shift_table {
+    std::array<std::array<uint32_t, 256>, 4> table {};
+
+    static constexpr uint32_t times(std::array<uint32_t, 32> const& mat, uint32_t vec) {
+        uint32_t sum = 0;
+        for (size_t i = 0; vec != 0; ++i, vec >>= 1) {
+            if (vec & 1) {
+                sum ^= mat[i];
+            }
+        }
+        return sum;
+    }
+
+    static constexpr std::array<uint32_t, 32> square(std::array<uint32_t, 32> const& mat) {
+        std::array<uint32_t, 32> r {};
+        for (size_t i = 0; i < 32; ++i) {
+            r[i] = times(mat, mat[i]);
+        }
+        return r;
+    }
+
+    constexpr explicit mem_crc32c_shift_table(size_t len) {
+        //移过1个0位的算子，之后平方两次得到移过1个0字节的算子
+        std::array<uint32_t, 32> op {};
+        op[0] = mem_crc32c_poly;
+        for (size_t i = 1; i < 32; ++i) {
+            op[i] = 1u << (i - 1);
+        }
+        op = square(square(square(op)));
+        std::array<uint32_t, 32> result {};
+        for (size_t i = 0; i < 32; ++i) {
+            result[i] = 1u << i;
+        }
+        for (; len != 0; len >>= 1, op = square(op)) {
+            if (len & 1) {
+                std::array<uint32_t, 32> next {};
+                for (size_t i = 0; i < 32; ++i) {
+                    next[i] = times(op, result[i]);
+                }
+                result = next;
+            }
+        }
+        for (uint32_t n = 0; n < 256; ++n) {
+            for (size_t k = 0; k < 4; ++k) {
+                table[k][n] = times(result, n << (8 * k));
+            }
+        }
+    }
+
+    constexpr uint32_t operator()(uint32_t crc) const {
+        return table[0][crc & 0xff] ^ table[1][crc >> 8 & 0xff] ^ table[2][crc >> 16 & 0xff] ^ table[3][crc >> 24];
+    }
+};
+
+/*
+ * CRC32C内核。crc为之前数据的CRC(首次计算传0)，返回追加data之后的CRC，因此mem_crc32c(b, lb, mem_crc32c(a, la))等于对a、b拼接后计算的结果。
+ */
+inline uint32_t mem_crc32c_scalar(uint32_t crc, const char *data, size_t len) {
+    auto &t = mem_crc32c_table;
+    auto *p = reinterpret_cast<const uint8_t*>(data);
+    crc = ~crc;
+    for (; len >= 8; len -= 8, p += 8) {
+        uint32_t lo, hi;
+        memcpy(&lo, p, 4);
+        memcpy(&hi, p + 4, 4);
+        lo ^= crc;
+        crc = t[7][lo & 0xff] ^ t[6][lo >> 8 & 0xff] ^ t[5][lo >> 16 & 0xff] ^ t[4][lo >> 24] ^
+              t[3][hi & 0xff] ^ t[2][hi >> 8 & 0xff] ^ t[1][hi >> 16 & 0xff] ^ t[0][hi >> 24];
+    }
+    for (; len != 0; --len, ++p) {
+        crc = t[0][(crc ^ *p) & 0xff] ^ crc >> 8;
+    }
+    return ~crc;
+}
+
+#ifdef MEM_SIMD_X86
+/*
+ * crc32指令的延迟为3个周期、吞吐为每周期1条，单条依赖链只能用到三分之一的吞吐。这里将数据分成相邻的3段同时计算3条独立的CRC，再用移位算子合并。长段用于大块数据，
+ * 短段用于剩余部分。
+ */
+inline constexpr size_t mem_crc32c_long = 8192;
+inline constexpr size_t mem_crc32c_short = 256;
+inline constexpr mem_crc32c_shift_table mem_crc32c_shift_long {mem_crc32c_long};
+inline constexpr mem_crc32c_shift_table mem_crc32c_shift_short {mem_crc32c_short};
+
+template<size_t Stride>
+MEM_TARGET("sse4.2") inline uint64_t mem_crc32c_interleave(uint64_t crc0, const char *&p, size_t& len, mem_crc32c_shift_table const& shift) {
+    while (len >= Stride * 3) {
+        uint64_t crc1 = 0, crc2 = 0;
+        for (const char *end = p + Stride; p < end; p += 8) {
+            uint64_t a, b, c;
+            memcpy(&a, p, 8);
+            memcpy(&b, p + Stride, 8);
+            memcpy(&c, p + Stride * 2, 8);
+            crc0 = _mm_crc32_u64(crc0, a);
+            crc1 = _mm_crc32_u64(crc1, b);
+            crc2 = _mm_crc32_u64(crc2, c);
+        }
+        crc0 = shift(static_cast<uint32_t>(crc0)) ^ crc1;
+        crc0 = shift(static_cast<uint32_t>(crc0)) ^ crc2;
+        p += Stride * 2;
+        len -= Stride * 3;
+    }
+    return crc0;
+}
+
+MEM_TARGET("sse4.2") inline uint32_t mem_crc32c_sse42(uint32_t crc, const char *data, size_t len) {
+    const char *p = data;
+    uint64_t crc0 = ~crc;
+    for (; len != 0 && reinterpret_cast<uintptr_t>(p) % 8 != 0; --len, ++p) {
+        crc0 = _mm_crc32_u8(static_cast<uint32_t>(crc0), static_cast<uint8_t>(*p));
+    }
+    crc0 = mem_crc32c_interleave<mem_crc32c_long>(crc0, p, len, mem_crc32c_shift_long);
+    crc0 = mem_crc32c_interleave<mem_crc32c_short>(crc0, p, len, mem_crc32c_shift_short);
+    for (; len >= 8; len -= 8, p += 8) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        crc0 = _mm_crc32_u64(crc0, v);
+    }
+    for (; len != 0; --len, ++p) {
+        crc0 = _mm_crc32_u8(static_cast<uint32_t>(crc0), static_cast<uint8_t>(*p));
+    }
+    return ~static_cast<uint32_t>(crc0);
+}
+#endif
+
+struct mem_crc32c_kernel {
+    using type = uint32_t(uint32_t, const char*, size_t);
+
+    static type *resolve(mem_isa isa) {
+#ifdef MEM_SIMD_X86
+        if (isa >= mem_isa::sse42) {
+            return mem_crc32c_sse42;
+        }
+#endif
+        return mem_crc32c_scalar;
+    }
+};
+
+inline uint32_t mem_crc32c(const char *data, size_t len, uint32_t crc = 0) {
+    return mem_dispatch<mem_crc32c_kernel>::call(crc, data, len);
+}
+
+/*
+ * XXH3-64。输入不超过240字节时按长度分几档直接混合；更长的输入按64字节一个条带(stripe)累加到8个64位累加器，每16个条带(一个块)用密钥扰乱一次累加器，最后合并。
+ * 累加与扰乱有标量、SSE2与AVX2实现。
+ */
+struct mem_xxh3 {
+    static constexpr uint64_t prime32_1 = 0x9e3779b1u;
+    static constexpr uint64_t prime32_2 = 0x85ebca77u;
+    static constexpr uint64_t prime32_3 = 0xc2b2ae3du;
+    static constexpr uint64_t prime64_1 = 0x9e3779b185ebca87ull;
+    static constexpr uint64_t prime64_2 = 0xc2b2ae3d27d4eb4full;
+    static constexpr uint64_t prime64_3 = 0x165667b19e3779f9ull;
+    static constexpr uint64_t prime64_4 = 0x85ebca77c2b2ae63ull;
+    static constexpr uint64_t prime64_5 = 0x27d4eb2f165667c5ull;
+    static constexpr uint64_t prime_mx1 = 0x165667919e3779f9ull;
+    static constexpr uint64_t prime_mx2 = 0x9fb21c651e98df25ull;
+
+    static constexpr size_t secret_size = 192;
+    static constexpr size_t stripe_len = 64;
+    static constexpr size_t stripes_per_block = (secret_size - stripe_len) / 8;
+    static constexpr size_t block_len = stripe_len * stripes_per_block;
+    static constexpr size_t mid_size_max = 240;
+
+    alignas(64) static constexpr uint8_t default_secret[secret_size] {
+        0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+        0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+        0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+        0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+        0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+        0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+        0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+        0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+        0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+        0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+        0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+        0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e
+    };
+
+    static uint32_t read32(const void *p) {
+        uint32_t v;
+        memcpy(&v, p, 4);
+        return v;
+    }
+
+    static uint64_t read64(const void *p) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        return v;
+    }
+
+    static uint64_t mul128_fold64(uint64_t a, uint64_t b) {
+        unsigned __int128 r = static_cast<unsigned __int128>(a) * b;
+        return static_cast<uint64_t>(r) ^ static_cast<uint64_t>(r >> 64);
+    }
+
+    static uint64_t xxh64_avalanche(uint64_t h) {
+        h ^= h >> 33;
+        h *= prime64_2;
+        h ^= h >> 29;
+        h *= prime64_3;
+        return h ^ h >> 32;
+    }
+
+    static uint64_t avalanche(uint64_t h) {
+        h ^= h >> 37;
+        h *= prime_mx1;
+        return h ^ h >> 32;
+    }
+
+    static uint64_t rrmxmx(uint64_t h, uint64_t len) {
+        h ^= std::rotl(h, 49) ^ std::rotl(h, 24);
+        h *= prime_mx2;
+        h ^= (h >> 35) + len;
+        h *= prime_mx2;
+        return h ^ h >> 28;
+    }
+
+    static uint64_t mix16(const uint8_t *in, const uint8_t *secret, uint64_t seed) {
+        return mul128_fold64(read64(in) ^ (read64(secret) + seed), read64(in + 8) ^ (read64(secret + 8) - seed));
+    }
+
+    //不超过240字节的输入
+    static uint64_t hash_short(const uint8_t *in, size_t len, const uint8_t *secret, uint64_t seed) {
+        if (len == 0) {
+            return xxh64_avalanche(seed ^ read64(secret + 56) ^ read64(secret + 64));
+        }
+        if (len <= 3) {
+            uint32_t combined = static_cast<uint32_t>(in[0]) << 16 | static_cast<uint32_t>(in[len >> 1]) << 24 | in[len - 1] | static_cast<uint32_t>(len) << 8;
+            uint64_t bitflip = (read32(secret) ^ read32(secret + 4)) + seed;
+            return xxh64_avalanche(combined ^ bitflip);
+        }
+        if (len <= 8) {
+            seed ^= static_cast<uint64_t>(__builtin_bswap32(static_cast<uint32_t>(seed))) << 32;
+            uint64_t bitflip = (read64(secret + 8) ^ read64(secret + 16)) - seed;
+            uint64_t input = read32(in + len - 4) + (static_cast<uint64_t>(read32(in)) << 32);
+            return rrmxmx(input ^ bitflip, len);
+        }
+        if (len <= 16) {
+            uint64_t lo = read64(in) ^ ((read64(secret + 24) ^ read64(secret + 32)) + seed);
+            uint64_t hi = read64(in + len - 8) ^ ((read64(secret + 40) ^ read64(secret + 48)) - seed);
+            return avalanche(len + __builtin_bswap64(lo) + hi + mul128_fold64(lo, hi));
+        }
+        uint64_t acc = len * prime64_1;
+        if (len <= 128) {
+            if (len > 32) {
+                if (len > 64) {
+                    if (len > 96) {
+                        acc += mix16(in + 48, secret + 96, seed);
+                        acc += mix16(in + len - 64, secret + 112, seed);
+                    }
+                    acc += mix16(in + 32, secret + 64, seed);
+                    acc += mix16(in + len - 48, secret + 80, seed);
+                }
+                acc += mix16(in + 16, secret + 32, seed);
+                acc += mix16(in + len - 32, secret + 48, seed);
+            }
+            acc += mix16(in, secret, seed);
+            acc += mix16(in + len - 16, secret + 16, seed);
+            return avalanche(acc);
+        }
+        for (size_t i = 0; i < 8; ++i) {
+            acc += mix16(in + 16 * i, secret + 16 * i, seed);
+        }
+        uint64_t acc_end = mix16(in + len - 16, secret + 136 - 17, seed);
+        acc = avalanche(acc);
+        for (size_t i = 8; i < len / 16; ++i) {
+            acc_end += mix16(in + 16 * i, secret + 16 * (i - 8) + 3, seed);
+        }
+        return avalanche(acc + acc_end);
+    }
+
+    static void accumulate_512_scalar(uint64_t *acc, const uint8_t *in, const uint8_t *secret) {
+        for (size_t i = 0; i < 8; ++i) {
+            uint64_t data = read64(in + 8 * i);
+            uint64_t key = data ^ read64(secret + 8 * i);
+            acc[i ^ 1] += data;
+            acc[i] += (key & 0xffffffff) * (key >> 32);
+        }
+    }
+
+    static void scramble_scalar(uint64_t *acc, const uint8_t *secret) {
+        for (size_t i = 0; i < 8; ++i) {
+            uint64_t a = acc[i];
+            a ^= a >> 47;
+            a ^= read64(secret + 8 * i);
+            acc[i] = a * prime32_1;
+        }
+    }
+
+#ifdef MEM_SIMD_X86
+    static void accumulate_512_sse2(uint64_t *acc, const uint8_t *in, const uint8_t *secret) {
+        for (size_t i = 0; i < 4; ++i) {
+            __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 16 * i));
+            __m128i key = _mm_xor_si128(data, _mm_loadu_si128(reinterpret_cast<const __m128i*>(secret + 16 * i)));
+            __m128i product = _mm_mul_epu32(key, _mm_shuffle_epi32(key, _MM_SHUFFLE(0, 3, 0, 1)));
+            __m128i sum = _mm_add_epi64(_mm_loadu_si128(reinterpret_cast<const __m128i*>(acc + 2 * i)), _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2)));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(acc + 2 * i), _mm_add_epi64(product, sum));
+        }
+    }
+
+    static void scramble_sse2(uint64_t *acc, const uint8_t *secret) {
+        const __m128i prime = _mm_set1_epi32(static_cast<int>(prime32_1));
+        for (size_t i = 0; i < 4; ++i) {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(acc + 2 * i));
+            a = _mm_xor_si128(_mm_xor_si128(a, _mm_srli_epi64(a, 47)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(secret + 16 * i)));
+            __m128i lo = _mm_mul_epu32(a, prime);
+            __m128i hi = _mm_mul_epu32(_mm_shuffle_epi32(a, _MM_SHUFFLE(0, 3, 0, 1)), prime);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(acc + 2 * i), _mm_add_epi64(lo, _mm_slli_epi64(hi, 32)));
+        }
+    }
+
+    MEM_TARGET("avx2") static void accumulate_512_avx2(uint64_t *acc, const uint8_t *in, const uint8_t *secret) {
+        for (size_t i = 0; i < 2; ++i) {
+            __m256i data = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + 32 * i));
+            __m256i key = _mm256_xor_si256(data, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(secret + 32 * i)));
+            __m256i product = _mm256_mul_epu32(key, _mm256_shuffle_epi32(key, _MM_SHUFFLE(0, 3, 0, 1)));
+            __m256i sum = _mm256_add_epi64(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(acc + 4 * i)), _mm256_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2)));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(acc + 4 * i), _mm256_add_epi64(product, sum));
+        }
+    }
+
+    MEM_TARGET("avx2") static void scramble_avx2(uint64_t *acc, const uint8_t *secret) {
+        const __m256i prime = _mm256_set1_epi32(static_cast<int>(prime32_1));
+        for (size_t i = 0; i < 2; ++i) {
+            __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(acc + 4 * i));
+            a = _mm256_xor_si256(_mm256_xor_si256(a, _mm256_srli_epi64(a, 47)), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(secret + 32 * i)));
+            __m256i lo = _mm256_mul_epu32(a, prime);
+            __m256i hi = _mm256_mul_epu32(_mm256_shuffle_epi32(a, _MM_SHUFFLE(0, 3, 0, 1)), prime);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(acc + 4 * i), _mm256_add_epi64(lo, _mm256_slli_epi64(hi, 32)));
+        }
+    }
+#endif
+
+    /*
+     * 从第first个条带的位置开始累加stripes个条带，遇到块边界时扰乱累加器，返回累加后在块内的条带位置。长输入的一次性计算与增量计算共用这一过程。ISA取值同mem_utf。
+     */
+    template<int ISA>
+    [[gnu::always_inline]] static size_t consume(uint64_t *acc, size_t first, const uint8_t *in, size_t stripes, const uint8_t *secret) {
+        for (size_t n = 0; n < stripes; ++n) {
+#ifdef MEM_SIMD_X86
+            if constexpr (ISA == 2) {
+                accumulate_512_avx2(acc, in + n * stripe_len, secret + first * 8);
+            } else if constexpr (ISA == 1) {
+                accumulate_512_sse2(acc, in + n * stripe_len, secret + first * 8);
+            } else
+#endif
+            {
+                accumulate_512_scalar(acc, in + n * stripe_len, secret + first * 8);
+            }
+            if (++first == stripes_per_block) {
+#ifdef MEM_SIMD_X86
+                if constexpr (ISA == 2) {
+                    scramble_avx2(acc, secret + secret_size - stripe_len);
+                } else if constexpr (ISA == 1) {
+                    scramble_sse2(acc, secret + secret_size - stripe_len);
+                } else
+#endif
+                {
+                    scramble_scalar(acc, secret + secret_size - stripe_len);
+                }
+                first = 0;
+            }
+        }
+        return first;
+    }
+
+    static constexpr uint64_t init_acc[8] {prime32_3, prime64_1, prime64_2, prime64_3, prime64_4, prime32_2, prime64_5, prime32_1};
+
+    static uint64_t merge(const uint64_t *acc, const uint8_t *secret, uint64_t start) {
+        uint64_t r = start;
+        for (size_t i = 0; i < 4; ++i) {
+            r += mul128_fold64(acc[2 * i] ^ read64(secret + 16 * i), acc[2 * i + 1] ^ read64(secret + 16 * i + 8));
+        }
+        return avalanche(r);
+    }
+
+    //最后一个条带总是取输入末尾的64字节，使用密钥末尾向前错开7字节的位置
+    template<int ISA>
+    [[gnu::always_inline]] static uint64_t finish(uint64_t *acc, const uint8_t *last_stripe, const uint8_t *secret, uint64_t len) {
+#ifdef MEM_SIMD_X86
+        if constexpr (ISA == 2) {
+            accumulate_512_avx2(acc, last_stripe, secret + secret_size - stripe_len - 7);
+        } else if constexpr (ISA == 1) {
+            accumulate_512_sse2(acc, last_stripe, secret + secret_size - stripe_len - 7);
+        } else
+#endif
+        {
+            accumulate_512_scalar(acc, last_stripe, secret + secret_size - stripe_len - 7);
+        }
+        return merge(acc, secret + 11, len * prime64_1);
+    }
+
+    template<int ISA>
+    [[gnu::always_inline]] static uint64_t hash_long(const uint8_t *in, size_t len, const uint8_t *secret) {
+        alignas(32) uint64_t acc[8];
+        memcpy(acc, init_acc, sizeof(acc));
+        size_t stripes = (len - 1) / stripe_len;
+        consume<ISA>(acc, 0, in, stripes, secret);
+        return finish<ISA>(acc, in + len - stripe_len, secret, len);
+    }
+
+    static uint64_t hash_long_scalar(const uint8_t *in, size_t len, const uint8_t *secret) {
+        return hash_long<0>(in, len, secret);
+    }
+
+#ifdef MEM_SIMD_X86
+    static uint64_t hash_long_sse2(const uint8_t *in, size_t len, const uint8_t *secret) {
+        return hash_long<1>(in, len, secret);
+    }
+
+    MEM_TARGET("avx2") static uint64_t hash_long_avx2(const uint8_t *in, size_t len, const uint8_t *secret) {
+        return hash_long<2>(in, len, secret);
+    }
+#endif
+
+    struct hash_long_kernel {
+        using type = uint64_t(const uint8_t*, size_t, const uint8_t*);
+
+        static type *resolve(mem_isa isa) {
+#ifdef MEM_SIMD_X86
+            if (isa >= mem_isa::avx2) {
+                return hash_long_avx2;
+            }
+            if (isa >= mem_isa::sse2) {
+                return hash_long_sse2;
+            }
+#endif
+            return hash_long_scalar;
+        }
+    };
+
+    //增量计算时累加条带，供mem_xxh3_digest使用
+    static size_t consume_scalar(uint64_t *acc, size_t first, const uint8_t *in, size_t stripes, const uint8_t *secret) {
+        return consume<0>(acc, first, in, stripes, secret);
+    }
+
+#ifdef MEM_SIMD_X86
+    static size_t consume_sse2(uint64_t *acc, size_t first, const uint8_t *in, size_t stripes, const uint8_t *secret) {
+        return consume<1>(acc, first, in, stripes, secret);
+    }
+
+    MEM_TARGET("avx2") static size_t consume_avx2(uint64_t *acc, size_t first, const uint8_t *in, size_t stripes, const uint8_t *secret) {
+        return consume<2>(acc, first, in, stripes, secret);
+    }
+#endif
+
+    struct consume_kernel {
+        using type = size_t(uint64_t*, size_t, const uint8_t*, size_t, const uint8_t*);
+
+        static type *resolve(mem_isa isa) {
+#ifdef MEM_SIMD_X86
+            if (isa >= mem_isa::avx2) {
+                return consume_avx2;
+            }
+            if (isa >= mem_isa::sse2) {
+                return consume_sse2;
+            }
+#endif
+            return consume_scalar;
+        }
+    };
+
+    //带种子时，长输入使用由种子派生的密钥
+    static void derive_secret(uint8_t *secret, uint64_t seed) {
+        for (size_t i = 0; i < secret_size; i += 16) {
+            uint64_t lo = read64(default_secret + i) + seed, hi = read64(default_secret + i + 8) - seed;
+            memcpy(secret + i, &lo, 8);
+            memcpy(secret + i + 8, &hi, 8);
+        }
+    }
+};
+
+inline uint64_t mem_xxh3_64(const char *data, size_t len, uint64_t seed = 0) {
+    auto *in = reinterpret_cast<const uint8_t*>(data);
+    if (len <= mem_xxh3::mid_size_max) {
+        return mem_xxh3::hash_short(in, len, mem_xxh3::default_secret, seed);
+    }
+    if (seed == 0) {
+        return mem_dispatch<mem_xxh3::hash_long_kernel>::call(in, len, mem_xxh3::default_secret);
+    }
+    alignas(64) uint8_t secret[mem_xxh3::secret_size];
+    mem_xxh3::derive_secret(secret, seed);
+    return mem_dispatch<mem_xxh3::hash_long_kernel>::call(in, len, secret);
+}
+
+/*
+ * 增量计算的摘要，update追加数据，value返回当前已追加数据的摘要且不影响后续追加。用作mem_checksum_stream的Digest。
+ */
+class mem_crc32c_digest {
+private:
+    uint32_t crc {0};
+public:
+    using value_type = uint32_t;
+
+    void update(const char *data, size_t len) {
+        crc = mem_crc32c(data, len, crc);
+    }
+
+    [[nodiscard]] uint32_t value() const {
+        return crc;
+    }
+
+    void reset() {
+        crc = 0;
+    }
+};
+
+/*
+ * XXH3-64的增量状态。内部缓冲256字节，缓冲满后以4个条带为单位累加，并且总保留至少1个字节不累加，最后一个条带与一次性计算一样在value中处理。
+ */
+class mem_xxh3_digest {
+private:
+    static constexpr size_t buffer_size = 256;
+
+    alignas(64) uint64_t acc[8];
+    alignas(64) uint8_t secret[mem_xxh3::secret_size];
+    alignas(64) uint8_t buffer[buffer_size];
+    size_t buffered {0};
+    size_t stripes {0};
+    uint64_t total {0};
+    uint64_t seed;
+
+    void consume(const uint8_t *in, size_t n) {
+        stripes = mem_dispatch<mem_xxh3::consume_kernel>::call(acc, stripes, in, n, secret);
+    }
+public:
+    using value_type = uint64_t;
+
+    explicit mem_xxh3_digest(uint64_t seed = 0) : seed(seed) {
+        reset();
+    }
+
+    void reset() {
+        memcpy(acc, mem_xxh3::init_acc, sizeof(acc));
+        if (seed == 0) {
+            memcpy(secret, mem_xxh3::default_secret, sizeof(secret));
+        } else {
+            mem_xxh3::derive_secret(secret, seed);
+        }
+        buffered = 0;
+        stripes = 0;
+        total = 0;
+    }
+
+    void update(const char *data, size_t len) {
+        auto *in = reinterpret_cast<const uint8_t*>(data);
+        total += len;
+        if (len <= buffer_size - buffered) {
+            memcpy(buffer + buffered, in, len);
+            buffered += len;
+            return;
+        }
+        if (buffered != 0) {
+            size_t fill = buffer_size - buffered;
+            memcpy(buffer + buffered, in, fill);
+            in += fill;
+            len -= fill;
+            consume(buffer, buffer_size / mem_xxh3::stripe_len);
+            buffered = 0;
+        }
+        if (len > buffer_size) {
+            //直接累加输入中的完整条带，保留最后不超过256字节，并把紧邻其前的64字节存到缓冲末尾，供value拼接最后一个条带
+            size_t n = (len - 1) / buffer_size * (buffer_size / mem_xxh3::stripe_len);
+            consume(in, n);
+            in += n * mem_xxh3::stripe_len;
+            len -= n * mem_xxh3::stripe_len;
+            memcpy(buffer + buffer_size - mem_xxh3::stripe_len, in - mem_xxh3::stripe_len, mem_xxh3::stripe_len);
+        }
+        memcpy(buffer, in, len);
+        buffered = len;
+    }
+
+    [[nodiscard]] uint64_t value() const {
+        using h = mem_xxh3;
+        if (total <= h::mid_size_max) {
+            return h::hash_short(buffer, total, h::default_secret, seed);
+        }
+        alignas(32) uint64_t a[8];
+        memcpy(a, acc, sizeof(a));
+        const uint8_t *last = buffer + buffered - h::stripe_len;
+        uint8_t stitched[h::stripe_len];
+        if (buffered >= h::stripe_len) {
+            mem_dispatch<h::consume_kernel>::call(a, stripes, buffer, (buffered - 1) / h::stripe_len, secret);
+        } else {
+            //缓冲中不足一个条带时，用之前保存在缓冲末尾的数据补齐
+            size_t catchup = h::stripe_len - buffered;
+            memcpy(stitched, buffer + buffer_size - catchup, catchup);
+            memcpy(stitched + catchup, buffer, buffered);
+            last = stitched;
+        }
+        h::accumulate_512_scalar(a, last, secret + h::secret_size - h::stripe_len - 7);
+        return h::merge(a, secret + 11, total * h::prime64_1);
+    }
+};
+
+/*
+ * XXH32，LZ4帧格式的头部校验与内容校验使用它。按16字节一组更新4个累加器，不足16字节的部分缓存到下一次update。
+ */
+class mem_xxh32_digest {
+private:
+    static constexpr uint32_t prime1 = 0x9e3779b1u;
+    static constexpr uint32_t prime2 = 0x85ebca77u;
+    static constexpr uint32_t prime3 = 0xc2b2ae3du;
+    static constexpr uint32_t prime4 = 0x27d4eb2fu;
+    static constexpr uint32_t prime5 = 0x165667b1u;
+
+    uint32_t v[4];
+    uint8_t pending[16];
+    size_t buffered {0};
+    uint64_t total {0};
+    uint32_t seed;
+
+    static uint32_t round(uint32_t acc, const uint8_t *in) {
+        uint32_t x;
+        memcpy(&x, in, 4);
+        return std::rotl(acc + x * prime2, 13) * prime1;
+    }
+
+    void consume(const uint8_t *in) {
+        for (size_t i = 0; i < 4; ++i) {
+            v[i] = round(v[i], in + 4 * i);
+        }
+    }
+public:
+    using value_type = uint32_t;
+
+    explicit mem_xxh32_digest(uint32_t seed = 0) : seed(seed) {
+        reset();
+    }
+
+    void reset() {
+        v[0] = seed + prime1 + prime2;
+        v[1] = seed + prime2;
+        v[2] = seed;
+        v[3] = seed - prime1;
+        buffered = 0;
+        total = 0;
+    }
+
+    void update(const char *data, size_t len) {
+        auto *in = reinterpret_cast<const uint8_t*>(data);
+        total += len;
+        if (buffered + len < 16) {
+            memcpy(pending + buffered, in, len);
+            buffered += len;
+            return;
+        }
+        if (buffered != 0) {
+            size_t fill = 16 - buffered;
+            memcpy(pending + buffered, in, fill);
+            consume(pending);
+            in += fill;
+            len -= fill;
+            buffered = 0;
+        }
+        for (; len >= 16; len -= 16, in += 16) {
+            consume(in);
+        }
+        memcpy(pending, in, len);
+        buffered = len;
+    }
+
+    [[nodiscard]] uint32_t value() const {
+        uint32_t h = total >= 16 ? std::rotl(v[0], 1) + std::rotl(v[1], 7) + std::rotl(v[2], 12) + std::rotl(v[3], 18) : seed + prime5;
+        h += static_cast<uint32_t>(total);
+        size_t i = 0;
+        for (; i + 4 <= buffered; i += 4) {
+            uint32_t x;
+            memcpy(&x, pending + i, 4);
+            h = std::rotl(h + x * prime3, 17) * prime4;
+        }
+        for (; i < buffered; ++i) {
+            h = std::rotl(h + pending[i] * prime5, 11) * prime1;
+        }
+        h ^= h >> 15;
+        h *= prime2;
+        h ^= h >> 13;
+        h *= prime3;
+        return h ^ h >> 16;
+    }
+};
+
+inline uint32_t mem_xxh32(const char *data, size_t len, uint32_t seed = 0) {
+    mem_xxh32_digest d(seed);
+    d.update(data, len);
+    return d.value();
+}
@@ -0,0 +1,483 @@
+#pragma once
+
+#include <memory>
+#include "mem_utils.hpp"
+/*
+ * LZ4块格式与帧格式的压缩与解压，输出与lz4命令行工具及liblz4互通。
+ *
+ * 块格式：一个块由若干序列组成，每个序列为一个令牌字节(高4位字面量长度，低4位匹配长度减4)、字面量长度的扩展字节、字面量、2字节小端的匹配距离以及匹配长度的扩展字节，
+ * 长度为15时用后续字节累加，遇到非255的字节结束。最后一个序列只有字面量，最后5个字节总是字面量，最后一个匹配至少在块结束前12字节处开始。
+ *
+ * 压缩使用与LZ4默认参数相同的贪心匹配：4096项的哈希表，找不到匹配时逐渐加大跳跃的步长。解压时在离两端足够远的地方按16字节整块拷贝，只在块的末尾附近逐字节检查边界。
+ */
+
+inline constexpr size_t mem_lz4_min_match = 4;
+inline constexpr size_t mem_lz4_last_literals = 5;
+inline constexpr size_t mem_lz4_mf_limit = 12;
+inline constexpr size_t mem_lz4_max_offset = 65535;
+inline constexpr size_t mem_lz4_max_input = 0x7e000000;
+inline constexpr int mem_lz4_hash_log = 12;
+
+//压缩len字节后的最大长度，压缩的目标空间按它分配
+constexpr size_t mem_lz4_bound(size_t len) {
+    return len + len / 255 + 16;
+}
+
+inline uint32_t mem_lz4_read32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+inline uint32_t mem_lz4_hash(uint32_t v) {
+    return v * 2654435761u >> (32 - mem_lz4_hash_log);
+}
+
+//ip与match从头开始相同的字节数，不超过limit
+inline size_t mem_lz4_count(const uint8_t *ip, const uint8_t *match, const uint8_t *limit) {
+    const uint8_t *start = ip;
+    while (ip + 8 <= limit) {
+        uint64_t a, b;
+        memcpy(&a, ip, 8);
+        memcpy(&b, match, 8);
+        if (a != b) {
+            return static_cast<size_t>(ip - start) + static_cast<size_t>(__builtin_ctzll(a ^ b) >> 3);
+        }
+        ip += 8;
+        match += 8;
+    }
+    while (ip < limit && *ip == *match) {
+        ++ip;
+        ++match;
+    }
+    return static_cast<size_t>(ip - start);
+}
+
+//写入长度的扩展字节，len为已减去15的部分
+inline uint8_t *mem_lz4_put_length(uint8_t *op, size_t len) {
+    for (; len >= 255; len -= 255) {
+        *op++ = 255;
+    }
+    *op++ = static_cast<uint8_t>(len);
+    return op;
+}
+
+inline bool mem_lz4_get_length(const uint8_t *&ip, const uint8_t *iend, size_t& len) {
+    uint8_t b;
+    do {
+        if (ip >= iend) {
+            return false;
+        }
+        b = *ip++;
+        len += b;
+    } while (b == 255);
+    return true;
+}
+
+/*
+ * 将src的len字节压缩为一个块写入dst，dst至少要有mem_lz4_bound(len)字节，返回压缩后的长度。len超过mem_lz4_max_input时返回mem_npos。
+ */
+inline size_t mem_lz4_compress_block(const char *src, size_t len, char *dst) {
+    if (len > mem_lz4_max_input) {
+        return mem_npos;
+    }
+    auto *base = reinterpret_cast<const uint8_t*>(src);
+    const uint8_t *ip = base, *anchor = base, *const iend = base + len;
+    auto *op = reinterpret_cast<uint8_t*>(dst);
+    if (len >= mem_lz4_mf_limit + 1) {
+        uint32_t table[1 << mem_lz4_hash_log] {};
+        const uint8_t *const mf_limit = iend - mem_lz4_mf_limit;
+        const uint8_t *const match_limit = iend - mem_lz4_last_literals;
+        table[mem_lz4_hash(mem_lz4_read32(ip))] = 0;
+        uint32_t forward_h = mem_lz4_hash(mem_lz4_read32(++ip));
+        for (;;) {
+            const uint8_t *match;
+            const uint8_t *forward_ip = ip;
+            unsigned step = 1, attempts = 1 << 6;
+            //连续找不到匹配时每64次把步长加1，快速跳过不可压缩的数据
+            do {
+                uint32_t h = forward_h;
+                ip = forward_ip;
+                forward_ip += step;
+                step = attempts++ >> 6;
+                if (forward_ip > mf_limit + 1) {
+                    goto last_literals;
+                }
+                match = base + table[h];
+                forward_h = mem_lz4_hash(mem_lz4_read32(forward_ip));
+                table[h] = static_cast<uint32_t>(ip - base);
+            } while (match + mem_lz4_max_offset < ip || mem_lz4_read32(match) != mem_lz4_read32(ip));
+            while (ip > anchor && match > base && ip[-1] == match[-1]) {
+                --ip;
+                --match;
+            }
+            uint8_t *token = op++;
+            size_t literals = static_cast<size_t>(ip - anchor);
+            if (literals >= 15) {
+                *token = 15 << 4;
+                op = mem_lz4_put_length(op, literals - 15);
+            } else {
+                *token = static_cast<uint8_t>(literals << 4);
+            }
+            memcpy(op, anchor, literals);
+            op += literals;
+            for (;;) {
+                auto offset = static_cast<uint16_t>(ip - match);
+                *op++ = static_cast<uint8_t>(offset);
+                *op++ = static_cast<uint8_t>(offset >> 8);
+                size_t match_len = mem_lz4_count(ip + mem_lz4_min_match, match + mem_lz4_min_match, match_limit);
+                ip += match_len + mem_lz4_min_match;
+                if (match_len >= 15) {
+                    *token += 15;
+                    op = mem_lz4_put_length(op, match_len - 15);
+                } else {
+                    *token += static_cast<uint8_t>(match_len);
+                }
+                anchor = ip;
+                if (ip > mf_limit) {
+                    goto last_literals;
+                }
+                table[mem_lz4_hash(mem_lz4_read32(ip - 2))] = static_cast<uint32_t>(ip - 2 - base);
+                //匹配之后紧接着再试一次，命中时直接输出没有字面量的序列
+                uint32_t h = mem_lz4_hash(mem_lz4_read32(ip));
+                match = base + table[h];
+                table[h] = static_cast<uint32_t>(ip - base);
+                if (match + mem_lz4_max_offset < ip || mem_lz4_read32(match) != mem_lz4_read32(ip)) {
+                    break;
+                }
+                token = op++;
+                *token = 0;
+            }
+            forward_h = mem_lz4_hash(mem_lz4_read32(++ip));
+        }
+    }
+last_literals:
+    size_t literals = static_cast<size_t>(iend - anchor);
+    if (literals >= 15) {
+        *op++ = 15 << 4;
+        op = mem_lz4_put_length(op, literals - 15);
+    } else {
+        *op++ = static_cast<uint8_t>(literals << 4);
+    }
+    memcpy(op, anchor, literals);
+    op += literals;
+    return static_cast<size_t>(op - reinterpret_cast<uint8_t*>(dst));
+}
+
+/*
+ * 将src中长度为len的一个块解压到dst，dst最多写入cap字节。prefix为dst之前可以被匹配引用的已解压数据长度，用于帧中相互依赖的块，独立的块传0。返回解压后的长度，
+ * 输入不合法(越界的长度或距离、输出超过cap)时返回mem_npos，不会读写给定范围之外的内存。
+ */
+inline size_t mem_lz4_decompress_block(const char *src, size_t len, char *dst, size_t cap, size_t prefix = 0) {
+    auto *ip = reinterpret_cast<const uint8_t*>(src);
+    const uint8_t *const iend = ip + len;
+    auto *op = reinterpret_cast<uint8_t*>(dst);
+    uint8_t *const oend = op + cap;
+    const uint8_t *const low = op - prefix;
+    if (len == 0) {
+        return mem_npos;
+    }
+    for (;;) {
+        //合法的块以字面量结束，读完一个匹配后不会恰好到达输入末尾
+        if (ip >= iend) {
+            return mem_npos;
+        }
+        unsigned token = *ip++;
+        size_t literals = token >> 4;
+        /*
+         * 快速路径：字面量与匹配都不需要扩展长度、匹配距离不小于8且离两端都足够远时，字面量固定拷贝16字节、匹配固定拷贝3个8字节，没有长度相关的分支。
+         * 文本一类的数据中绝大多数序列走这条路径。
+         */
+        if (literals < 15 && (token & 15) < 15 && iend - ip >= 32 && oend - op >= 48) {
+            memcpy(op, ip, 16);
+            op += literals;
+            ip += literals;
+            size_t offset = ip[0] | static_cast<size_t>(ip[1]) << 8;
+            if (offset >= 8 && offset <= static_cast<size_t>(op - low)) {
+                ip += 2;
+                const uint8_t *match = op - offset;
+                memcpy(op, match, 8);
+                memcpy(op + 8, match + 8, 8);
+                memcpy(op + 16, match + 16, 8);
+                op += (token & 15) + mem_lz4_min_match;
+                continue;
+            }
+            //距离太短或越界时退回一般路径处理匹配部分，字面量已经拷贝完成
+            literals = 0;
+        }
+        if (literals == 15 && !mem_lz4_get_length(ip, iend, literals)) {
+            return mem_npos;
+        }
+        size_t in_left = static_cast<size_t>(iend - ip), out_left = static_cast<size_t>(oend - op);
+        if (literals > in_left || literals > out_left) {
+            return mem_npos;
+        }
+        if (literals + 16 <= in_left && literals + 16 <= out_left) {
+            //两端都留有余量时按16字节整块拷贝，多拷贝的部分会被之后的数据覆盖
+            for (size_t i = 0; i < literals; i += 16) {
+                memcpy(op + i, ip + i, 16);
+            }
+        } else {
+            memcpy(op, ip, literals);
+        }
+        ip += literals;
+        op += literals;
+        if (ip == iend) {
+            return static_cast<size_t>(op - reinterpret_cast<uint8_t*>(dst));
+        }
+        if (iend - ip < 2) {
+            return mem_npos;
+        }
+        size_t offset = ip[0] | static_cast<size_t>(ip[1]) << 8;
+        ip += 2;
+        size_t match_len = token & 15;
+        if (match_len == 15 && !mem_lz4_get_length(ip, iend, match_len)) {
+            return mem_npos;
+        }
+        if (ip == iend) {
+            return mem_npos;
+        }
+        match_len += mem_lz4_min_match;
+        out_left = static_cast<size_t>(oend - op);
+        if (offset == 0 || offset > static_cast<size_t>(op - low) || match_len > out_left) {
+            return mem_npos;
+        }
+        const uint8_t *match = op - offset;
+        uint8_t *const end = op + match_len;
+        if (offset >= 16 && match_len + 16 <= out_left) {
+            //距离不小于16时每块的来源都已写出，可以整块拷贝
+            for (; op < end; op += 16, match += 16) {
+                memcpy(op, match, 16);
+            }
+        } else if (offset >= 8 && match_len + 8 <= out_left) {
+            for (; op < end; op += 8, match += 8) {
+                memcpy(op, match, 8);
+            }
+        } else {
+            //距离很短时match到op之间是重复的模式，每次复制已展开的全部长度，复制量成倍增长
+            while (op < end) {
+                size_t n = std::min(static_cast<size_t>(end - op), static_cast<size_t>(op - match));
+                memcpy(op, match, n);
+                op += n;
+            }
+        }
+        op = end;
+    }
+}
+
+/*
+ * 将src中[off, off + len)压缩为一个块写入dst的dst_off处，返回压缩后的长度，范围越界时返回mem_npos。dst按最坏情况的长度一次性扩容，之后通过mem_transfer_with同时持有两个
+ * 缓冲的锁直接读写各自的存储，不经过中间缓冲；dst的used只计入压缩后的长度。src与dst可以是同一个缓冲，此时两段范围不能重叠。
+ */
+template<typename SrcBuffer, typename DstBuffer>
+size_t mem_lz4_compress(SrcBuffer const& src, size_t off, size_t len, DstBuffer& dst, size_t dst_off = 0) {
+    size_t bound = mem_lz4_bound(len);
+    size_t r = mem_npos;
+    //src的范围在锁内检查
+    if (len > mem_lz4_max_input || !dst.expand(dst_off + bound)) {
+        return r;
+    }
+    mem_transfer_with(src, len, off, dst, bound, dst_off, [&](const char *in, char *out) { return r = mem_lz4_compress_block(in, len, out); });
+    return r;
+}
+
+/*
+ * 将src中[off, off + len)的一个块解压到dst的dst_off处，original_size为解压后的长度(块格式本身不记录)，dst一次性扩容到恰好容纳。返回解压后的长度，输入不合法或范围越界时
+ * 返回mem_npos，此时dst的used不变。加锁方式与mem_lz4_compress相同。
+ */
+template<typename SrcBuffer, typename DstBuffer>
+size_t mem_lz4_decompress(SrcBuffer const& src, size_t off, size_t len, DstBuffer& dst, size_t dst_off, size_t original_size) {
+    size_t r = mem_npos;
+    if (!dst.expand(dst_off + original_size)) {
+        return r;
+    }
+    mem_transfer_with(src, len, off, dst, original_size, dst_off, [&](const char *in, char *out) {
+        return r = mem_lz4_decompress_block(in, len, out, original_size);
+    });
+    return r;
+}
+
+/*
+ * LZ4帧格式：4字节魔数，帧描述(FLG、BD、可选的内容长度与字典ID、1字节头部校验)，若干数据块(4字节小端长度，最高位为1表示未压缩，可选的块校验)，4字节0作为结束标记，
+ * 以及可选的内容校验。校验均为XXH32。
+ */
+inline constexpr uint32_t mem_lz4_frame_magic = 0x184d2204;
+
+//帧中块的最大长度，对应BD字节中的编号4~7
+enum class mem_lz4_block_size : uint8_t {
+    max64kb = 4,
+    max256kb = 5,
+    max1mb = 6,
+    max4mb = 7
+};
+
+constexpr size_t mem_lz4_block_bytes(mem_lz4_block_size size) {
+    return static_cast<size_t>(1) << (8 + 2 * static_cast<int>(size));
+}
+
+/*
+ * 以帧格式将分多次写入的数据压缩到out。数据攒满一个块后压缩，块之间相互独立；不可压缩的块原样存储。块直接压缩到out所在缓冲的存储中，out只按块的最坏长度扩容。
+ * 调用finish()写入结束标记与内容校验后帧才完整，finish()之后不能再写入。
+ */
+template<typename T, typename Buffer>
+requires (sizeof(T) == 1)
+class mem_lz4_frame_writer {
+private:
+    mem_stream<T, Buffer>& out;
+    mem_lz4_block_size block_size;
+    size_t block_bytes;
+    bool content_checksum;
+    std::unique_ptr<char[]> staging;
+    size_t staged {0};
+    mem_xxh32_digest content;
+
+    //按最坏情况预留空间，回调返回实际写入的长度，out的游标与所在缓冲的used只计入这一部分
+    void emit(const char *data, size_t len) {
+        size_t bound = mem_lz4_bound(len);
+        out.reserve(4 + bound);
+        out.write_with(4 + bound, [&](char *p) {
+            size_t stored = mem_lz4_compress_block(data, len, p + 4);
+            uint32_t header;
+            if (stored >= len) {
+                memcpy(p + 4, data, len);
+                stored = len;
+                header = static_cast<uint32_t>(len) | 0x80000000u;
+            } else {
+                header = static_cast<uint32_t>(stored);
+            }
+            mem_copy_endian<std::endian::little, uint32_t>(p, &header, 1);
+            return 4 + stored;
+        });
+    }
+public:
+    explicit mem_lz4_frame_writer(mem_stream<T, Buffer>& out, mem_lz4_block_size block_size = mem_lz4_block_size::max64kb, bool content_checksum = true)
+        : out(out), block_size(block_size), block_bytes(mem_lz4_block_bytes(block_size)), content_checksum(content_checksum), staging(new char[block_bytes]) {
+        uint8_t descriptor[2];
+        descriptor[0] = 0x40 | 0x20 | (content_checksum ? 0x04 : 0);
+        descriptor[1] = static_cast<uint8_t>(static_cast<uint8_t>(block_size) << 4);
+        uint8_t header_checksum = static_cast<uint8_t>(mem_xxh32(reinterpret_cast<const char*>(descriptor), 2) >> 8);
+        out.write_le(mem_lz4_frame_magic);
+        out.write(reinterpret_cast<const char*>(descriptor), 2);
+        out.write(reinterpret_cast<const char*>(&header_checksum), 1);
+    }
+
+    void write(const char *data, size_t len) {
+        if (content_checksum) {
+            content.update(data, len);
+        }
+        if (staged != 0) {
+            size_t n = std::min(len, block_bytes - staged);
+            memcpy(staging.get() + staged, data, n);
+            staged += n;
+            data += n;
+            len -= n;
+            if (staged < block_bytes) {
+                return;
+            }
+            emit(staging.get(), staged);
+            staged = 0;
+        }
+        //整块的数据直接从调用方的内存压缩
+        for (; len >= block_bytes; data += block_bytes, len -= block_bytes) {
+            emit(data, block_bytes);
+        }
+        memcpy(staging.get(), data, len);
+        staged = len;
+    }
+
+    void finish() {
+        if (staged != 0) {
+            emit(staging.get(), staged);
+            staged = 0;
+        }
+        out.write_le(static_cast<uint32_t>(0));
+        if (content_checksum) {
+            out.write_le(content.value());
+        }
+    }
+};
+
+/*
+ * 从in的当前位置解码一个LZ4帧，解压后的数据写入out的当前位置。支持相互依赖的块、块校验、内容长度与内容校验，不支持预设字典。成功时返回true，两个流的游标都移到
+ * 各自数据之后；格式错误、校验不符或数据不完整时返回false，此时游标的位置不确定。每个块通过mem_stream::transfer_with同时持有两个缓冲的锁解压，out所在缓冲的used只计入
+ * 解压出的数据。in与out可以是同一个缓冲，此时输出不能追上尚未读取的输入。
+ */
+template<typename T, typename SrcBuffer, typename U, typename DstBuffer>
+requires (sizeof(T) == 1 && sizeof(U) == 1)
+bool mem_lz4_decompress_frame(mem_stream<T, SrcBuffer>& in, mem_stream<U, DstBuffer>& out) {
+    uint32_t magic;
+    uint8_t descriptor[10];
+    if (!in.read_le(magic) || magic != mem_lz4_frame_magic || !in.read(reinterpret_cast<char*>(descriptor), 2)) {
+        return false;
+    }
+    uint8_t flags = descriptor[0];
+    auto block_id = static_cast<uint8_t>(descriptor[1] >> 4 & 7);
+    if ((flags & 0xc0) != 0x40 || (flags & 0x02) != 0 || (descriptor[1] & 0x8f) != 0 || block_id < 4 || (flags & 0x01) != 0) {
+        return false;
+    }
+    bool independent = flags & 0x20, block_checksum = flags & 0x10, has_size = flags & 0x08, content_checksum = flags & 0x04;
+    size_t descriptor_len = 2;
+    uint64_t content_size = 0;
+    if (has_size) {
+        if (!in.read(reinterpret_cast<char*>(descriptor + 2), 8)) {
+            return false;
+        }
+        mem_copy_endian<std::endian::little, uint64_t>(&content_size, descriptor + 2, 1);
+        descriptor_len += 8;
+    }
+    uint8_t header_checksum;
+    if (!in.read(reinterpret_cast<char*>(&header_checksum), 1) ||
+        header_checksum != static_cast<uint8_t>(mem_xxh32(reinterpret_cast<const char*>(descriptor), descriptor_len) >> 8)) {
+        return false;
+    }
+    size_t block_bytes = mem_lz4_block_bytes(static_cast<mem_lz4_block_size>(block_id));
+    mem_xxh32_digest content;
+    uint64_t total = 0;
+    for (;;) {
+        uint32_t header;
+        if (!in.read_le(header)) {
+            return false;
+        }
+        if (header == 0) {
+            break;
+        }
+        bool raw = header & 0x80000000u;
+        size_t len = header & 0x7fffffffu;
+        if (len > block_bytes) {
+            return false;
+        }
+        size_t produced = mem_npos;
+        uint32_t block_hash = 0;
+        //依赖前面块的数据时，前面解压的数据就在out所在缓冲中当前位置之前
+        size_t prefix = independent ? 0 : static_cast<size_t>(std::min<uint64_t>(total, 65536));
+        out.reserve(block_bytes);
+        bool complete = out.transfer_with(in, len, block_bytes, [&](const char *src, char *dst) {
+            if (block_checksum) {
+                block_hash = mem_xxh32(src, len);
+            }
+            if (raw) {
+                memcpy(dst, src, len);
+                produced = len;
+            } else {
+                produced = mem_lz4_decompress_block(src, len, dst, block_bytes, prefix);
+            }
+            if (content_checksum && produced != mem_npos) {
+                content.update(dst, produced);
+            }
+            return produced;
+        });
+        if (!complete) {
+            return false;
+        }
+        total += produced;
+        uint32_t expected;
+        if (block_checksum && (!in.read_le(expected) || expected != block_hash)) {
+            return false;
+        }
+    }
+    if (has_size && total != content_size) {
+        return false;
+    }
+    uint32_t expected;
+    return !content_checksum || (in.read_le(expected) && expected == content.value());
+}
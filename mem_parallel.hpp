@@ -0,0 +1,119 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <vector>
+#include "mem_cursor.hpp"
+#include "mem_thread_pool.hpp"
+/*
+ * 对缓冲分块并行处理。for_each_chunk将[begin, end)切分为约chunk_size字节的连续块，由多个线程以fn(data, len, offset)处理，offset为块相对缓冲开头的偏移；transform_reduce
+ * 对每块求transform(data, len, offset)，再按块的顺序以reduce从init开始依次合并，reduce不要求满足交换律，结果与单线程逐块计算相同。
+ *
+ * 带resync参数的版本用于记录格式：resync的约定与mem_reader::split相同，每个切分点后移到下一条记录的开头，一条记录不会被切到两个块中。块的数量比线程多得多，线程每次从共享的
+ * 计数器领取下一个块，处理快的线程自然多处理一些块，不需要事先平均分配。chunk_size取几百KB到几MB时既能分摊调度开销，又能让每块的数据留在二级缓存中。
+ *
+ * 与mem_reader相同，处理期间直接读取缓冲的存储，不加锁，调用期间不能对缓冲扩容或写入被处理的范围。块在mem_thread_pool::global()上执行，threads为0时使用池中的全部工作线程，
+ * 调用线程本身也参与处理；有多个NUMA节点时优先交给范围开头所在节点的线程。在池的工作线程中调用时，等待期间该线程继续执行其他任务，因此fn中可以再次调用mem_parallel。
+ * 任一块抛出异常时不再领取新的块，等所有线程结束后将第一个异常重新抛出。
+ */
+class mem_parallel {
+private:
+    template<typename Resync>
+    static constexpr bool is_resync = std::is_invocable_r_v<size_t, Resync, const char*, size_t>;
+
+    template<typename Buffer, typename Resync>
+    static std::vector<mem_reader<Buffer>> chunks(Buffer const& buffer, size_t chunk_size, size_t begin, size_t end, Resync&& resync) {
+        mem_reader<Buffer> range(buffer, begin, end);
+        chunk_size = std::max<size_t>(chunk_size, 1);
+        return range.split((range.remaining() + chunk_size - 1) / chunk_size, std::forward<Resync>(resync));
+    }
+
+    template<typename Buffer>
+    static int node_of(Buffer const& buffer, size_t begin) {
+        if (mem_thread_pool::global().nodes() <= 1 || begin >= buffer.capacity()) {
+            return -1;
+        }
+        return mem_thread_pool::node_of(reinterpret_cast<const char*>(buffer.data()) + begin);
+    }
+
+    //以threads个线程(含调用线程)执行task(0)到task(count - 1)，每个线程从共享的计数器领取下标
+    template<typename Task>
+    static void run(size_t count, size_t threads, int node, Task&& task) {
+        mem_thread_pool& pool = mem_thread_pool::global();
+        threads = std::min(threads == 0 ? pool.size() : threads, count);
+        std::atomic<size_t> next {0};
+        std::exception_ptr error;
+        std::mutex error_mutex;
+        auto work = [&] {
+            size_t i;
+            while ((i = next.fetch_add(1, std::memory_order_relaxed)) < count) {
+                try {
+                    task(i);
+                } catch (...) {
+                    std::lock_guard guard(error_mutex);
+                    if (!error) {
+                        error = std::current_exception();
+                    }
+                    next.store(count, std::memory_order_relaxed);
+                }
+            }
+        };
+        mem_wait_group group;
+        if (threads > 1) {
+            pool.submit_batch(group, threads - 1, [&work](size_t) { work(); }, node);
+        }
+        work();
+        pool.wait(group);
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    static constexpr auto no_resync = [](const char *, size_t) { return static_cast<size_t>(0); };
+public:
+    //threads为0时使用的线程数
+    static size_t concurrency() {
+        return mem_thread_pool::global().size();
+    }
+
+    template<typename Buffer, typename F, typename Resync>
+    requires is_resync<Resync>
+    static void for_each_chunk(Buffer const& buffer, size_t chunk_size, F&& fn, Resync&& resync, size_t threads = 0, size_t begin = 0, size_t end = mem_npos) {
+        auto parts = chunks(buffer, chunk_size, begin, end, std::forward<Resync>(resync));
+        run(parts.size(), threads, node_of(buffer, begin), [&parts, &fn](size_t i) {
+            mem_reader<Buffer>& r = parts[i];
+            size_t offset = r.begin(), len = r.remaining();
+            r.read_with(len, [&fn, len, offset](const char *data) { fn(data, len, offset); });
+        });
+    }
+
+    template<typename Buffer, typename F>
+    static void for_each_chunk(Buffer const& buffer, size_t chunk_size, F&& fn, size_t threads = 0, size_t begin = 0, size_t end = mem_npos) {
+        for_each_chunk(buffer, chunk_size, std::forward<F>(fn), no_resync, threads, begin, end);
+    }
+
+    template<typename Buffer, typename T, typename Reduce, typename Transform, typename Resync>
+    requires is_resync<Resync>
+    static T transform_reduce(Buffer const& buffer, size_t chunk_size, T init, Reduce&& reduce, Transform&& transform, Resync&& resync, size_t threads = 0,
+                              size_t begin = 0, size_t end = mem_npos) {
+        auto parts = chunks(buffer, chunk_size, begin, end, std::forward<Resync>(resync));
+        std::vector<T> results(parts.size());
+        run(parts.size(), threads, node_of(buffer, begin), [&parts, &results, &transform](size_t i) {
+            mem_reader<Buffer>& r = parts[i];
+            size_t offset = r.begin(), len = r.remaining();
+            r.read_with(len, [&](const char *data) { results[i] = transform(data, len, offset); });
+        });
+        for (T& r : results) {
+            init = reduce(std::move(init), std::move(r));
+        }
+        return init;
+    }
+
+    template<typename Buffer, typename T, typename Reduce, typename Transform>
+    static T transform_reduce(Buffer const& buffer, size_t chunk_size, T init, Reduce&& reduce, Transform&& transform, size_t threads = 0, size_t begin = 0,
+                              size_t end = mem_npos) {
+        return transform_reduce(buffer, chunk_size, std::move(init), std::forward<Reduce>(reduce), std::forward<Transform>(transform), no_resync, threads, begin, end);
+    }
+};
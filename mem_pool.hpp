@@ -0,0 +1,367 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "mem_utils.hpp"
+/*
+ * mem_buffer的回收池。acquire(size)返回容量为不小于size的最小容量级(2的幂)的mem_buffer，其控制块记录了所属的池；最后一个引用析构时，mem_buffer不释放内存与控制块，而是
+ * 将它们交还给池，下一次acquire同一容量级时直接复用，稳定状态下不再调用分配器，也不再构造控制块。
+ *
+ * 缓存分两层：每个线程通过线程编号固定使用若干分片之一，分片中每个容量级最多缓存thread_cache_blocks个控制块，分片满时将一半移到共享的仓库，分片空时从仓库取回一批；
+ * 分片的锁只在映射到同一分片的线程之间争用。池中缓存的总字节数超过high_watermark时，交还控制块的线程将缓存释放到low_watermark以下，trim()可以随时主动释放。
+ *
+ * 流量高峰过后缓存可能长期停留在低水位附近而不被使用。trim_idle()释放自上次调用以来一直留在缓存中、没有被取出过的控制块：每个分片的每个容量级记录两次调用之间缓存长度的
+ * 最小值，取出总是从末尾进行，开头这么多个控制块在整个间隔内都是空闲的。idle_trim_interval不为0时池在后台线程中按该间隔调用trim_idle()，持续使用的缓存不受影响。
+ *
+ * 复用时默认将内存清零，与新构造的mem_buffer一致；zero_on_reuse为false时跳过清零，复用的缓冲中保留上一个使用者写入的内容，适合随后会被完整覆盖的场景。
+ *
+ * 扩容或缩小后容量不再是容量级的缓冲、超过max_class的缓冲与快照的控制块照常释放，析构时内存仍被快照共享的控制块
+ * 只释放控制块，内存留给快照。池可以先于它发出的缓冲析构，此后交还的控制块直接释放。所有函数都是线程安全的。
+ */
+
+struct mem_buffer_pool_options {
+    size_t min_class {256};               //最小的容量级
+    size_t max_class {64 * 1024 * 1024};  //最大的容量级，更大的请求直接构造不属于池的缓冲
+    size_t high_watermark {256 * 1024 * 1024};
+    size_t low_watermark {64 * 1024 * 1024};
+    size_t thread_cache_blocks {8};       //每个分片中每个容量级缓存的控制块个数
+    bool zero_on_reuse {true};
+    std::chrono::milliseconds idle_trim_interval {0}; //后台释放空闲缓存的间隔，0表示不启动后台线程
+};
+
+struct mem_buffer_pool_stats {
+    uint64_t hits {0};     //从缓存中复用的次数
+    uint64_t misses {0};   //缓存为空、新分配的次数
+    uint64_t recycled {0}; //交还给池的次数
+    uint64_t rejected {0}; //交还时因容量不是容量级或池已析构而释放的次数
+    uint64_t trimmed {0};  //因超过高水位、trim()或trim_idle()释放的控制块个数
+    uint64_t cached_bytes {0};
+};
+
+template<typename Allocator>
+class mem_buffer_pool {
+private:
+    using blocks = std::vector<mem_control_block*>;
+
+    //hits、recycled与idle只在持有分片的锁时修改，不需要原子操作。idle[c]为上次trim_idle()以来classes[c]长度的最小值
+    struct alignas(mem_cache_line_size) shard {
+        std::mutex mutex;
+        std::vector<blocks> classes;
+        std::vector<size_t> idle;
+        uint64_t hits {0};
+        uint64_t recycled {0};
+    };
+
+    /*
+     * 池的共享状态。引用计数由池本身与每个属于池的控制块(无论发出在外还是缓存在池中)各持有一份，只在分配与释放控制块时变化，复用时不需要修改。池析构后状态留到最后一个
+     * 控制块释放时才释放，交还时不会访问已释放的内存。
+     */
+    struct state final : mem_block_recycler {
+        mem_buffer_pool_options options;
+        size_t class_count;
+        std::vector<std::unique_ptr<shard>> shards;
+        shard depot;
+        std::atomic<size_t> refs {1};
+        std::atomic<bool> closed {false};
+        std::atomic<size_t> cached {0};
+        std::atomic<uint64_t> misses {0};
+        std::atomic<uint64_t> rejected {0};
+        std::atomic<uint64_t> trimmed {0};
+
+        explicit state(mem_buffer_pool_options const& options) : options(options) {
+            this->options.min_class = std::bit_ceil(std::max<size_t>(options.min_class, 1));
+            this->options.max_class = std::max(this->options.min_class, std::bit_floor(options.max_class));
+            this->options.thread_cache_blocks = std::max<size_t>(options.thread_cache_blocks, 1);
+            class_count = static_cast<size_t>(std::countr_zero(this->options.max_class) - std::countr_zero(this->options.min_class)) + 1;
+            size_t n = std::bit_ceil(std::max<size_t>(std::thread::hardware_concurrency(), 1));
+            for (size_t i = 0; i < n; ++i) {
+                shards.push_back(std::make_unique<shard>());
+                shards.back()->classes.resize(class_count);
+                shards.back()->idle.resize(class_count);
+            }
+            depot.classes.resize(class_count);
+            depot.idle.resize(class_count);
+        }
+
+        ~state() {
+            for (auto& s : shards) {
+                free_all(*s);
+            }
+            free_all(depot);
+        }
+
+        //容量对应的容量级下标，不是容量级时返回mem_npos
+        size_t class_of(size_t capacity) const {
+            if (!std::has_single_bit(capacity) || capacity < options.min_class || capacity > options.max_class) {
+                return mem_npos;
+            }
+            return static_cast<size_t>(std::countr_zero(capacity) - std::countr_zero(options.min_class));
+        }
+
+        shard& local() {
+            static std::atomic<size_t> next_thread {0};
+            thread_local size_t index = next_thread.fetch_add(1, std::memory_order_relaxed);
+            return *shards[index & (shards.size() - 1)];
+        }
+
+        //释放缓存中的控制块，调用方仍持有一份引用，状态不会在此期间被释放
+        void destroy(mem_control_block *block) {
+            cached.fetch_sub(block->capacity, std::memory_order_relaxed);
+            Allocator::release(block->data, block->capacity);
+            mem_stats<Allocator>::record_free(block->capacity);
+            delete block;
+            refs.fetch_sub(1, std::memory_order_relaxed);
+        }
+
+        //只在状态析构时调用，此时缓存应已为空
+        void free_all(shard& s) {
+            for (auto& list : s.classes) {
+                for (mem_control_block *block : list) {
+                    Allocator::release(block->data, block->capacity);
+                    mem_stats<Allocator>::record_free(block->capacity);
+                    delete block;
+                }
+                list.clear();
+            }
+        }
+
+        void release_ref() {
+            if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                delete this;
+            }
+        }
+
+        bool recycle(mem_control_block *block) override {
+            size_t c = class_of(block->capacity);
+            //内存仍被快照共享时mem_buffer已将data置空，只回收控制块没有意义
+            if (c == mem_npos || block->data == nullptr || closed.load(std::memory_order_acquire)) {
+                rejected.fetch_add(1, std::memory_order_relaxed);
+                block->recycler = nullptr;
+                release_ref();
+                return false;
+            }
+            shard& s = local();
+            bool over;
+            {
+                std::lock_guard guard(s.mutex);
+                ++s.recycled;
+                blocks& list = s.classes[c];
+                if (list.size() >= options.thread_cache_blocks) {
+                    //分片已满，将较早放入的一半移到仓库
+                    size_t half = list.size() / 2;
+                    std::lock_guard depot_guard(depot.mutex);
+                    depot.classes[c].insert(depot.classes[c].end(), list.begin(), list.begin() + static_cast<ptrdiff_t>(half));
+                    list.erase(list.begin(), list.begin() + static_cast<ptrdiff_t>(half));
+                    s.idle[c] = std::min(s.idle[c], list.size());
+                }
+                list.push_back(block);
+                /*
+                 * 放入之后控制块可能被其他线程取走或释放，之后不能再依赖它持有的引用。持有分片的锁时它还在分片中，状态不会被释放，需要继续访问状态时在此取得一份临时引用。
+                 * 池的析构先设置closed再逐个清空分片，若清空发生在放入之前，这里一定能看到closed，由当前线程释放。
+                 */
+                over = cached.fetch_add(block->capacity, std::memory_order_relaxed) + block->capacity > options.high_watermark ||
+                       closed.load(std::memory_order_acquire);
+                if (over) {
+                    refs.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+            if (over) {
+                trim(closed.load(std::memory_order_acquire) ? 0 : options.low_watermark);
+                release_ref();
+            }
+            return true;
+        }
+
+        mem_control_block *take(size_t c) {
+            shard& s = local();
+            std::lock_guard guard(s.mutex);
+            blocks& list = s.classes[c];
+            if (list.empty()) {
+                std::lock_guard depot_guard(depot.mutex);
+                blocks& shared = depot.classes[c];
+                size_t n = std::min(shared.size(), std::max<size_t>(options.thread_cache_blocks / 2, 1));
+                list.insert(list.end(), shared.end() - static_cast<ptrdiff_t>(n), shared.end());
+                shared.resize(shared.size() - n);
+                depot.idle[c] = std::min(depot.idle[c], shared.size());
+            }
+            if (list.empty()) {
+                return nullptr;
+            }
+            mem_control_block *block = list.back();
+            list.pop_back();
+            s.idle[c] = std::min(s.idle[c], list.size());
+            ++s.hits;
+            cached.fetch_sub(block->capacity, std::memory_order_relaxed);
+            return block;
+        }
+
+        //从较大的容量级开始释放，先仓库后分片，直到缓存不超过target字节
+        size_t trim(size_t target) {
+            size_t released = 0;
+            auto drain = [&](shard& s) {
+                std::lock_guard guard(s.mutex);
+                for (size_t c = class_count; c-- > 0 && cached.load(std::memory_order_relaxed) > target;) {
+                    blocks& list = s.classes[c];
+                    while (!list.empty() && cached.load(std::memory_order_relaxed) > target) {
+                        mem_control_block *block = list.back();
+                        list.pop_back();
+                        released += block->capacity;
+                        trimmed.fetch_add(1, std::memory_order_relaxed);
+                        destroy(block);
+                    }
+                    s.idle[c] = std::min(s.idle[c], list.size());
+                }
+            };
+            drain(depot);
+            for (auto& s : shards) {
+                if (cached.load(std::memory_order_relaxed) <= target) {
+                    break;
+                }
+                drain(*s);
+            }
+            return released;
+        }
+
+        //释放自上次调用以来一直在缓存中的控制块，即每个列表开头的idle[c]个
+        size_t trim_idle() {
+            size_t released = 0;
+            auto drain = [&](shard& s) {
+                std::lock_guard guard(s.mutex);
+                for (size_t c = 0; c < class_count; ++c) {
+                    blocks& list = s.classes[c];
+                    size_t n = std::min(s.idle[c], list.size());
+                    for (size_t i = 0; i < n; ++i) {
+                        released += list[i]->capacity;
+                        trimmed.fetch_add(1, std::memory_order_relaxed);
+                        destroy(list[i]);
+                    }
+                    list.erase(list.begin(), list.begin() + static_cast<ptrdiff_t>(n));
+                    s.idle[c] = list.size();
+                }
+            };
+            drain(depot);
+            for (auto& s : shards) {
+                drain(*s);
+            }
+            return released;
+        }
+    };
+
+    state *shared;
+    std::thread trimmer;
+    std::mutex trimmer_mutex;
+    std::condition_variable trimmer_cv;
+    bool stopping {false};
+public:
+    explicit mem_buffer_pool(mem_buffer_pool_options const& options = {}) : shared(new state(options)) {
+        if (options.idle_trim_interval.count() > 0) {
+            trimmer = std::thread([this, interval = options.idle_trim_interval] {
+                std::unique_lock lock(trimmer_mutex);
+                while (!trimmer_cv.wait_for(lock, interval, [this] { return stopping; })) {
+                    lock.unlock();
+                    shared->trim_idle();
+                    lock.lock();
+                }
+            });
+        }
+    }
+
+    mem_buffer_pool(mem_buffer_pool const&) = delete;
+    mem_buffer_pool& operator=(mem_buffer_pool const&) = delete;
+
+    ~mem_buffer_pool() {
+        if (trimmer.joinable()) {
+            {
+                std::lock_guard guard(trimmer_mutex);
+                stopping = true;
+            }
+            trimmer_cv.notify_one();
+            trimmer.join();
+        }
+        shared->closed.store(true, std::memory_order_release);
+        shared->trim(0);
+        shared->release_ref();
+    }
+
+    /*
+     * 返回容量为不小于size的最小容量级的缓冲，size超过max_class时返回容量恰为size、不属于池的缓冲。
+     */
+    mem_buffer<Allocator> acquire(size_t size) {
+        size = std::max<size_t>(size, 1);
+        if (size > shared->options.max_class) {
+            return mem_buffer<Allocator>(size);
+        }
+        size_t capacity = std::max(std::bit_ceil(size), shared->options.min_class);
+        size_t c = shared->class_of(capacity);
+        mem_control_block *block = shared->take(c);
+        if (block != nullptr) {
+            block->ref_counter.store(1, std::memory_order_relaxed);
+            block->used = 0;
+            if (shared->options.zero_on_reuse) {
+                mem_zero(block->data, block->capacity);
+            }
+        } else {
+            shared->misses.fetch_add(1, std::memory_order_relaxed);
+            block = new mem_control_block(capacity);
+            block->data = reinterpret_cast<char*>(Allocator::alloc(capacity));
+            if (block->data == nullptr) {
+                delete block;
+                throw mem_exception(std::format("cannot allocate memory by allocator {}", typeid(Allocator).name()));
+            }
+            if constexpr (!mem_allocator_zero_filled<Allocator>) {
+                memset(block->data, 0, capacity);
+            }
+            mem_stats<Allocator>::record_alloc(capacity);
+            block->recycler = shared;
+            shared->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+#ifdef BUFFER_DEBUG
+        mem_trace::record(mem_trace_event::create, block, block->capacity);
+#endif
+        return mem_buffer<Allocator>(block, typename mem_buffer<Allocator>::adopt_block {});
+    }
+
+    //释放缓存直到不超过target字节，返回释放的字节数
+    size_t trim(size_t target) {
+        return shared->trim(target);
+    }
+
+    //释放缓存到低水位
+    size_t trim() {
+        return shared->trim(shared->options.low_watermark);
+    }
+
+    //释放自上次调用以来没有被复用过的缓存，返回释放的字节数。第一次调用只开始记录，不释放
+    size_t trim_idle() {
+        return shared->trim_idle();
+    }
+
+    size_t cached_bytes() const {
+        return shared->cached.load(std::memory_order_relaxed);
+    }
+
+    mem_buffer_pool_options const& options() const {
+        return shared->options;
+    }
+
+    mem_buffer_pool_stats stats() const {
+        mem_buffer_pool_stats r;
+        for (auto& s : shared->shards) {
+            std::lock_guard guard(s->mutex);
+            r.hits += s->hits;
+            r.recycled += s->recycled;
+        }
+        r.misses = shared->misses.load(std::memory_order_relaxed);
+        r.rejected = shared->rejected.load(std::memory_order_relaxed);
+        r.trimmed = shared->trimmed.load(std::memory_order_relaxed);
+        r.cached_bytes = shared->cached.load(std::memory_order_relaxed);
+        return r;
+    }
+};
@@ -0,0 +1,575 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "mem_utils.hpp"
+/*
+ * 基于mem_stream的编译期结构体序列化，不需要反射或手写字段列表。
+ *
+ * 支持的类型：算术类型与枚举(按本机字节序，与mem_buffer::write<T>一致)、std::array、std::string、std::vector以及由这些类型组成的聚合体(可以嵌套)。聚合体的字段通过花括号初始化
+ * 探测字段个数，再通过结构化绑定逐个访问，最多支持16个字段，不支持引用成员与基类。std::string与std::vector先写入varint长度前缀，再写入内容。
+ *
+ * 由定长类型组成的连续字段会在栈上拼接成一段紧凑的字节(字段之间没有填充)，然后只调用一次mem_stream::write，即只有一次边界检查、一次加锁和一次memcpy。
+ */
+
+struct mem_any_field {
+    template<typename T>
+    operator T() const;
+};
+
+template<typename T, size_t N>
+constexpr bool mem_brace_constructible = []<size_t... I>(std::index_sequence<I...>) {
+    return requires { T {(static_cast<void>(I), mem_any_field {})...}; };
+}(std::make_index_sequence<N> {});
+
+constexpr size_t mem_max_field_count = 16;
+
+template<typename T, size_t N = 0>
+constexpr size_t mem_field_count() {
+    if constexpr (N < mem_max_field_count && mem_brace_constructible<T, N + 1>) {
+        return mem_field_count<T, N + 1>();
+    } else {
+        return N;
+    }
+}
+
+template<typename T>
+struct mem_is_std_array : std::false_type {};
+
+template<typename U, size_t N>
+struct mem_is_std_array<std::array<U, N>> : std::true_type {};
+
+template<typename T>
+struct mem_is_std_vector : std::false_type {};
+
+template<typename U, typename A>
+struct mem_is_std_vector<std::vector<U, A>> : std::true_type {};
+
+template<typename T>
+concept mem_record = std::is_aggregate_v<T> && std::is_class_v<T> && !mem_is_std_array<T>::value;
+
+//以std::tuple<F&...>返回聚合体v的全部字段
+template<typename T>
+requires mem_record<std::remove_const_t<T>>
+constexpr auto mem_tie_fields(T& v) {
+    constexpr size_t n = mem_field_count<std::remove_const_t<T>>();
+    static_assert(n != 0 && n <= mem_max_field_count, "unsupported aggregate: no fields or too many fields");
+    if constexpr (n == 0) {
+        return std::tie();
+    } else if constexpr (n == 1) {
+        auto& [f0] = v;
+        return std::tie(f0);
+    } else if constexpr (n == 2) {
+        auto& [f0, f1] = v;
+        return std::tie(f0, f1);
+    } else if constexpr (n == 3) {
+        auto& [f0, f1, f2] = v;
+        return std::tie(f0, f1, f2);
+    } else if constexpr (n == 4) {
+        auto& [f0, f1, f2, f3] = v;
+        return std::tie(f0, f1, f2, f3);
+    } else if constexpr (n == 5) {
+        auto& [f0, f1, f2, f3, f4] = v;
+        return std::tie(f0, f1, f2, f3, f4);
+    } else if constexpr (n == 6) {
+        auto& [f0, f1, f2, f3, f4, f5] = v;
+        return std::tie(f0, f1, f2, f3, f4, f5);
+    } else if constexpr (n == 7) {
+        auto& [f0, f1, f2, f3, f4, f5, f6] = v;
+        return std::tie(f0, f1, f2, f3, f4, f5, f6);
+    } else if constexpr (n == 8) {
+        auto& [f0, f1, f2, f3, f4, f5, f6, f7] = v;
+        return std::tie(f0, f1, f2, f3, f4, f5, f6, f7);
+    } else if constexpr (n == 9) {
+        auto& [f0, f1, f2, f3, f4, f5, f6, f7, f8] = v;
+        return std::tie(f0, f1, f2, f3, f4, f5, f6, f7, f8);
+    } else if constexpr (n == 10) {
+        auto& [f0, f1, f2, f3, f4, f5, f6, f7, f8, f9] = v;
+        return std::tie(f0, f1, f2, f3, f4, f5, f6, f7, f8, f9);
+    } else if constexpr (n == 11) {
+        auto& [f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10] = v;
+        return std::tie(f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10);
+    } else if constexpr (n == 12) {
+        auto& [f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11] = v;
+        return std::tie(f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11);
+    } else if constexpr (n == 13) {
+        auto& [f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12] = v;
+        return std::tie(f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12);
+    } else if constexpr (n == 14) {
+        auto& [f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12, f13] = v;
+        return std::tie(f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12, f13);
+    } else if constexpr (n == 15) {
+        auto& [f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12, f13, f14] = v;
+        return std::tie(f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12, f13, f14);
+    } else if constexpr (n == 16) {
+        auto& [f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12, f13, f14, f15] = v;
+        return std::tie(f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12, f13, f14, f15);
+    }
+}
+
+template<typename T>
+using mem_fields_t = decltype(mem_tie_fields(std::declval<T&>()));
+
+/*
+ * 类型的定长布局：flat表示序列化结果长度固定，size为紧凑排列(无填充)后的字节数。
+ */
+template<typename T>
+struct mem_layout {
+    static constexpr bool flat = false;
+    static constexpr size_t size = 0;
+};
+
+template<typename T>
+requires std::is_arithmetic_v<T> || std::is_enum_v<T>
+struct mem_layout<T> {
+    static constexpr bool flat = true;
+    static constexpr size_t size = sizeof(T);
+};
+
+template<typename U, size_t N>
+struct mem_layout<std::array<U, N>> {
+    static constexpr bool flat = mem_layout<U>::flat;
+    static constexpr size_t size = mem_layout<U>::size * N;
+};
+
+template<typename T>
+requires mem_record<T>
+struct mem_layout<T> {
+private:
+    template<typename Tuple>
+    struct fields;
+
+    template<typename... F>
+    struct fields<std::tuple<F&...>> {
+        static constexpr bool flat = (mem_layout<std::remove_cv_t<F>>::flat && ...);
+        static constexpr size_t size = (mem_layout<std::remove_cv_t<F>>::size + ...);
+    };
+public:
+    static constexpr bool flat = fields<mem_fields_t<T>>::flat;
+    static constexpr size_t size = fields<mem_fields_t<T>>::size;
+};
+
+template<typename Tuple, size_t I>
+using mem_field_t = std::remove_cvref_t<std::tuple_element_t<I, Tuple>>;
+
+//从第I个字段开始连续定长字段的结束位置
+template<typename Tuple, size_t I>
+constexpr size_t mem_flat_run_end() {
+    //分成两层，I等于字段数时不会实例化tuple_element<I>
+    if constexpr (I < std::tuple_size_v<Tuple>) {
+        if constexpr (mem_layout<mem_field_t<Tuple, I>>::flat) {
+            return mem_flat_run_end<Tuple, I + 1>();
+        } else {
+            return I;
+        }
+    } else {
+        return I;
+    }
+}
+
+template<typename Tuple, size_t Begin, size_t End>
+constexpr size_t mem_flat_run_size() {
+    if constexpr (Begin == End) {
+        return 0;
+    } else {
+        return mem_layout<mem_field_t<Tuple, Begin>>::size + mem_flat_run_size<Tuple, Begin + 1, End>();
+    }
+}
+
+//将定长的v紧凑写入dst，返回写入的字节数
+template<typename V>
+requires mem_layout<V>::flat
+inline size_t mem_pack(char *dst, V const& v) {
+    if constexpr (std::is_arithmetic_v<V> || std::is_enum_v<V>) {
+        memcpy(dst, &v, sizeof(V));
+    } else if constexpr (mem_is_std_array<V>::value) {
+        size_t off = 0;
+        for (auto const& e : v) {
+            off += mem_pack(dst + off, e);
+        }
+    } else {
+        std::apply([dst](auto const&... f) {
+            size_t off = 0;
+            ((off += mem_pack(dst + off, f)), ...);
+        }, mem_tie_fields(v));
+    }
+    return mem_layout<V>::size;
+}
+
+//mem_pack的逆操作，返回读取的字节数
+template<typename V>
+requires mem_layout<V>::flat
+inline size_t mem_unpack(const char *src, V& v) {
+    if constexpr (std::is_arithmetic_v<V> || std::is_enum_v<V>) {
+        memcpy(&v, src, sizeof(V));
+    } else if constexpr (mem_is_std_array<V>::value) {
+        size_t off = 0;
+        for (auto& e : v) {
+            off += mem_unpack(src + off, e);
+        }
+    } else {
+        std::apply([src](auto&... f) {
+            size_t off = 0;
+            ((off += mem_unpack(src + off, f)), ...);
+        }, mem_tie_fields(v));
+    }
+    return mem_layout<V>::size;
+}
+
+template<typename T, typename Buffer, typename V>
+bool mem_serialize(mem_stream<T, Buffer>& stream, V const& v);
+
+template<typename T, typename Buffer, typename V>
+bool mem_deserialize(mem_stream<T, Buffer>& stream, V& v);
+
+template<size_t I, typename T, typename Buffer, typename Tuple>
+bool mem_serialize_fields(mem_stream<T, Buffer>& stream, Tuple const& fields) {
+    if constexpr (I == std::tuple_size_v<Tuple>) {
+        return true;
+    } else {
+        constexpr size_t end = mem_flat_run_end<Tuple, I>();
+        if constexpr (end > I) {
+            constexpr size_t size = mem_flat_run_size<Tuple, I, end>();
+            char bytes[size];
+            [&]<size_t... J>(std::index_sequence<J...>) {
+                size_t off = 0;
+                ((off += mem_pack(bytes + off, std::get<I + J>(fields))), ...);
+            }(std::make_index_sequence<end - I> {});
+            if (!stream.write(bytes, size)) {
+                return false;
+            }
+            return mem_serialize_fields<end>(stream, fields);
+        } else {
+            if (!mem_serialize(stream, std::get<I>(fields))) {
+                return false;
+            }
+            return mem_serialize_fields<I + 1>(stream, fields);
+        }
+    }
+}
+
+template<size_t I, typename T, typename Buffer, typename Tuple>
+bool mem_deserialize_fields(mem_stream<T, Buffer>& stream, Tuple const& fields) {
+    if constexpr (I == std::tuple_size_v<Tuple>) {
+        return true;
+    } else {
+        constexpr size_t end = mem_flat_run_end<Tuple, I>();
+        if constexpr (end > I) {
+            constexpr size_t size = mem_flat_run_size<Tuple, I, end>();
+            char bytes[size];
+            if (!stream.read(bytes, size)) {
+                return false;
+            }
+            [&]<size_t... J>(std::index_sequence<J...>) {
+                size_t off = 0;
+                ((off += mem_unpack(bytes + off, std::get<I + J>(fields))), ...);
+            }(std::make_index_sequence<end - I> {});
+            return mem_deserialize_fields<end>(stream, fields);
+        } else {
+            if (!mem_deserialize(stream, std::get<I>(fields))) {
+                return false;
+            }
+            return mem_deserialize_fields<I + 1>(stream, fields);
+        }
+    }
+}
+
+/*
+ * 将v序列化写入stream的当前位置，游标前进序列化后的长度。
+ */
+template<typename T, typename Buffer, typename V>
+bool mem_serialize(mem_stream<T, Buffer>& stream, V const& v) {
+    if constexpr (mem_layout<V>::flat) {
+        if constexpr (mem_layout<V>::size == 0) {
+            return true;
+        } else {
+            char bytes[mem_layout<V>::size];
+            mem_pack(bytes, v);
+            return stream.write(bytes, sizeof(bytes));
+        }
+    } else if constexpr (std::is_same_v<V, std::string>) {
+        return stream.put_varint(v.size()) && (v.empty() || stream.write(v.data(), v.size()));
+    } else if constexpr (mem_is_std_vector<V>::value) {
+        using U = typename V::value_type;
+        if (!stream.put_varint(v.size())) {
+            return false;
+        }
+        if constexpr (std::is_arithmetic_v<U> || std::is_enum_v<U>) {
+            return v.empty() || stream.write(reinterpret_cast<const char*>(v.data()), v.size() * sizeof(U));
+        } else {
+            for (auto const& e : v) {
+                if (!mem_serialize(stream, e)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+    } else if constexpr (mem_is_std_array<V>::value) {
+        for (auto const& e : v) {
+            if (!mem_serialize(stream, e)) {
+                return false;
+            }
+        }
+        return true;
+    } else {
+        static_assert(mem_record<V>, "type is not serializable");
+        return mem_serialize_fields<0>(stream, mem_tie_fields(v));
+    }
+}
+
+/*
+ * 序列化后至少占用的字节数，用于在分配内存之前检查来自数据的长度：定长布局(包括数值)为其大小，其余类型(至少有一个varint长度或字段)按1字节计。
+ */
+template<typename U>
+inline constexpr size_t mem_min_encoded_size = mem_layout<U>::flat ? std::max<size_t>(mem_layout<U>::size, 1) : 1;
+
+/*
+ * 从stream的当前位置反序列化到v，数据不足时返回false，此时v的内容不确定。字符串与vector的长度来自数据本身，在分配内存之前先与流中剩余的字节数比较，超出时直接返回false，
+ * 不可信的输入不会导致巨大的分配。
+ */
+template<typename T, typename Buffer, typename V>
+bool mem_deserialize(mem_stream<T, Buffer>& stream, V& v) {
+    if constexpr (mem_layout<V>::flat) {
+        if constexpr (mem_layout<V>::size == 0) {
+            return true;
+        } else {
+            char bytes[mem_layout<V>::size];
+            if (!stream.read(bytes, sizeof(bytes))) {
+                return false;
+            }
+            mem_unpack(bytes, v);
+            return true;
+        }
+    } else if constexpr (std::is_same_v<V, std::string>) {
+        size_t size;
+        if (!stream.get_varint(size) || size > stream.remaining()) {
+            return false;
+        }
+        v.resize(size);
+        return size == 0 || stream.read(v.data(), size);
+    } else if constexpr (mem_is_std_vector<V>::value) {
+        using U = typename V::value_type;
+        size_t size;
+        if (!stream.get_varint(size) || size > stream.remaining() / mem_min_encoded_size<U>) {
+            return false;
+        }
+        v.resize(size);
+        if constexpr (std::is_arithmetic_v<U> || std::is_enum_v<U>) {
+            return size == 0 || stream.read(reinterpret_cast<char*>(v.data()), size * sizeof(U));
+        } else {
+            for (auto& e : v) {
+                if (!mem_deserialize(stream, e)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+    } else if constexpr (mem_is_std_array<V>::value) {
+        for (auto& e : v) {
+            if (!mem_deserialize(stream, e)) {
+                return false;
+            }
+        }
+        return true;
+    } else {
+        static_assert(mem_record<V>, "type is not serializable");
+        return mem_deserialize_fields<0>(stream, mem_tie_fields(v));
+    }
+}
+
+template<typename V, size_t I>
+constexpr size_t mem_field_offset = mem_flat_run_size<mem_fields_t<V>, 0, I>();
+
+/*
+ * 零拷贝的定长记录视图。记录按mem_serialize的紧凑布局保存在缓冲中，构造时一次性检查[off, off + record_size)是否在容量内，之后get<I>()直接从缓冲的存储中按编译期偏移
+ * 用memcpy取出第I个字段，不复制整个记录，也不申请内存。嵌套的聚合体字段可以通过view<I>()取得子视图。
+ *
+ * 视图读取存储时不加锁，持有视图期间不能对缓冲扩容。mem_buffer按值持有(共享存储)，其余缓冲按引用持有。
+ */
+template<typename V, typename Buffer = mem_buffer<>>
+requires mem_record<V> && mem_layout<V>::flat
+class mem_view {
+private:
+    mem_buffer_holder<const Buffer> buffer;
+    size_t off;
+    bool valid;
+public:
+    static constexpr size_t record_size = mem_layout<V>::size;
+
+    mem_view(Buffer const& buffer, size_t off) : buffer(mem_hold(buffer)), off(off), valid(off + record_size <= buffer.capacity()) {}
+
+    //拷贝出的视图与原视图共享控制块，写时复制模式下不是快照
+    mem_view(mem_view const& view) : buffer(mem_hold(view.buffer)), off(view.off), valid(view.valid) {}
+
+    //第index条记录的视图，记录从base开始首尾相接
+    static mem_view at(Buffer const& buffer, size_t index, size_t base = 0) {
+        return mem_view(buffer, base + index * record_size);
+    }
+
+    [[nodiscard]] bool is_valid() const {
+        return valid;
+    }
+
+    explicit operator bool() const {
+        return valid;
+    }
+
+    size_t offset() const {
+        return off;
+    }
+
+    template<size_t I>
+    auto get() const {
+        using F = mem_field_t<mem_fields_t<V>, I>;
+        F f {};
+        if (valid) {
+            mem_unpack(buffer.data() + off + mem_field_offset<V, I>, f);
+        }
+        return f;
+    }
+
+    template<size_t I>
+    requires mem_record<mem_field_t<mem_fields_t<V>, I>>
+    auto view() const {
+        return mem_view<mem_field_t<mem_fields_t<V>, I>, Buffer>(buffer, off + mem_field_offset<V, I>);
+    }
+
+    //取出整条记录
+    V load() const {
+        V v {};
+        if (valid) {
+            mem_unpack(buffer.data() + off, v);
+        }
+        return v;
+    }
+};
+
+template<typename T>
+struct mem_is_optional : std::false_type {};
+
+template<typename U>
+struct mem_is_optional<std::optional<U>> : std::true_type {};
+
+template<typename F>
+using mem_table_value_t = typename std::conditional_t<mem_is_optional<F>::value, F, std::optional<F>>::value_type;
+
+/*
+ * 带偏移表(vtable)的记录格式，用于含有可选字段或需要增删字段的记录。字段可以是定长类型或std::optional<定长类型>，nullopt的字段不占用空间。
+ *
+ * 布局(本机字节序)：uint32 记录总长度 | uint16 字段数n | uint16 偏移[n] | 字段数据。偏移相对记录开头，0表示字段不存在。读取时字段数小于V的字段个数(旧版本写入的记录)的部分按不存在处理。
+ */
+template<typename T, typename Buffer, typename V>
+requires mem_record<V>
+bool mem_serialize_table(mem_stream<T, Buffer>& stream, V const& v) {
+    using fields_t = mem_fields_t<const V>;
+    constexpr size_t n = std::tuple_size_v<fields_t>;
+    constexpr size_t header = 4 + 2 + 2 * n;
+    constexpr size_t max_size = header + []<size_t... I>(std::index_sequence<I...>) {
+        return (mem_layout<mem_table_value_t<mem_field_t<fields_t, I>>>::size + ...);
+    }(std::make_index_sequence<n> {});
+    static_assert(max_size <= UINT16_MAX, "table record too large");
+    char bytes[max_size];
+    size_t size = header;
+    auto fields = mem_tie_fields(v);
+    [&]<size_t... I>(std::index_sequence<I...>) {
+        auto put = [&](size_t index, auto const& f) {
+            uint16_t field_off = 0;
+            if constexpr (mem_is_optional<std::remove_cvref_t<decltype(f)>>::value) {
+                if (f.has_value()) {
+                    field_off = static_cast<uint16_t>(size);
+                    size += mem_pack(bytes + size, *f);
+                }
+            } else {
+                field_off = static_cast<uint16_t>(size);
+                size += mem_pack(bytes + size, f);
+            }
+            memcpy(bytes + 6 + 2 * index, &field_off, 2);
+        };
+        (put(I, std::get<I>(fields)), ...);
+    }(std::make_index_sequence<n> {});
+    auto total = static_cast<uint32_t>(size);
+    auto count = static_cast<uint16_t>(n);
+    memcpy(bytes, &total, 4);
+    memcpy(bytes + 4, &count, 2);
+    return stream.write(bytes, size);
+}
+
+/*
+ * mem_serialize_table写入的记录的零拷贝视图。构造时一次性检查记录头、偏移表以及每个存在的字段是否越界，之后get<I>()按偏移表直接读取，字段不存在时返回std::nullopt。
+ *
+ * 与mem_view相同，视图读取存储时不加锁，持有视图期间不能对缓冲扩容。
+ */
+template<typename V, typename Buffer = mem_buffer<>>
+requires mem_record<V>
+class mem_table_view {
+private:
+    using fields_t = mem_fields_t<V>;
+    static constexpr size_t field_count = std::tuple_size_v<fields_t>;
+
+    mem_buffer_holder<const Buffer> buffer;
+    size_t off;
+    uint32_t total {0};
+    std::array<uint16_t, field_count> offsets {};
+    bool valid {false};
+public:
+    mem_table_view(Buffer const& buffer, size_t off) : buffer(mem_hold(buffer)), off(off) {
+        size_t cap = buffer.capacity();
+        if (off + 6 > cap) {
+            return;
+        }
+        const char *p = buffer.data() + off;
+        uint16_t count;
+        memcpy(&total, p, 4);
+        memcpy(&count, p + 4, 2);
+        if (off + total > cap || 6 + 2 * static_cast<size_t>(count) > total) {
+            return;
+        }
+        bool ok = true;
+        [&]<size_t... I>(std::index_sequence<I...>) {
+            auto check = [&](size_t index, size_t field_size) {
+                if (index >= count) {
+                    return;
+                }
+                memcpy(&offsets[index], p + 6 + 2 * index, 2);
+                if (offsets[index] != 0 && (offsets[index] < 6 + 2 * static_cast<size_t>(count) || offsets[index] + field_size > total)) {
+                    ok = false;
+                }
+            };
+            (check(I, mem_layout<mem_table_value_t<mem_field_t<fields_t, I>>>::size), ...);
+        }(std::make_index_sequence<field_count> {});
+        valid = ok;
+    }
+
+    //拷贝出的视图与原视图共享控制块，写时复制模式下不是快照
+    mem_table_view(mem_table_view const& view) : buffer(mem_hold(view.buffer)), off(view.off), total(view.total), offsets(view.offsets), valid(view.valid) {}
+
+    [[nodiscard]] bool is_valid() const {
+        return valid;
+    }
+
+    explicit operator bool() const {
+        return valid;
+    }
+
+    //记录的总长度，可用于跳到下一条记录
+    size_t size() const {
+        return total;
+    }
+
+    template<size_t I>
+    bool has() const {
+        return valid && offsets[I] != 0;
+    }
+
+    template<size_t I>
+    std::optional<mem_table_value_t<mem_field_t<fields_t, I>>> get() const {
+        if (!has<I>()) {
+            return std::nullopt;
+        }
+        mem_table_value_t<mem_field_t<fields_t, I>> f {};
+        mem_unpack(buffer.data() + off + offsets[I], f);
+        return f;
+    }
+};
@@ -0,0 +1,957 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <concepts>
+#include <type_traits>
+#include "mem_dispatch.hpp"
+/*
+ * mem_utils使用的底层批量内核。每个内核都有可移植的标量实现，在GCC/Clang的x86目标上额外提供SIMD实现，并通过mem_dispatch在运行时按CPU档位选择，编译时无需开启-mavx2等
+ * 选项。各内核的*_kernel结构描述其函数类型及各档位使用的实现。
+ */
+
+template<size_t Width>
+using mem_uint_t = std::conditional_t<Width == 1, uint8_t,
+                   std::conditional_t<Width == 2, uint16_t,
+                   std::conditional_t<Width == 4, uint32_t, uint64_t>>>;
+
+/*
+ * 可以按字节序读写的类型：宽度为1/2/4/8字节的算术类型或枚举类型。
+ */
+template<typename T>
+concept mem_swappable = (std::is_arithmetic_v<T> || std::is_enum_v<T>) && (sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4 || sizeof(T) == 8);
+
+//反转T的字节序，GCC/Clang下编译为bswap指令
+template<mem_swappable T>
+constexpr T mem_byteswap(T v) {
+    if constexpr (sizeof(T) == 1) {
+        return v;
+    } else {
+        using U = mem_uint_t<sizeof(T)>;
+        U u = std::bit_cast<U>(v);
+#if defined(__GNUC__)
+        if constexpr (sizeof(T) == 2) {
+            u = __builtin_bswap16(u);
+        } else if constexpr (sizeof(T) == 4) {
+            u = __builtin_bswap32(u);
+        } else {
+            u = __builtin_bswap64(u);
+        }
+#else
+        U r = 0;
+        for (size_t i = 0; i < sizeof(U); ++i) {
+            r = static_cast<U>((r << 8) | ((u >> (i * 8)) & 0xff));
+        }
+        u = r;
+#endif
+        return std::bit_cast<T>(u);
+    }
+}
+
+template<size_t Width>
+inline void mem_byteswap_scalar(char *dst, const char *src, size_t count) {
+    using U = mem_uint_t<Width>;
+    for (size_t i = 0; i < count; ++i) {
+        U u;
+        memcpy(&u, src + i * Width, Width);
+        u = mem_byteswap(u);
+        memcpy(dst + i * Width, &u, Width);
+    }
+}
+
+#ifdef MEM_SIMD_X86
+//在每个Width字节的元素内反转字节顺序的pshufb掩码
+template<size_t Width>
+constexpr std::array<char, 16> mem_byteswap_mask() {
+    std::array<char, 16> mask {};
+    for (size_t i = 0; i < 16; ++i) {
+        mask[i] = static_cast<char>(i / Width * Width + (Width - 1 - i % Width));
+    }
+    return mask;
+}
+
+template<size_t Width>
+MEM_TARGET("ssse3") inline void mem_byteswap_ssse3(char *dst, const char *src, size_t count) {
+    static constexpr auto mask_bytes = mem_byteswap_mask<Width>();
+    const __m128i mask = _mm_loadu_si128(reinterpret_cast<const __m128i*>(mask_bytes.data()));
+    size_t len = count * Width, i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_shuffle_epi8(v, mask));
+    }
+    mem_byteswap_scalar<Width>(dst + i, src + i, (len - i) / Width);
+}
+
+template<size_t Width>
+MEM_TARGET("avx2") inline void mem_byteswap_avx2(char *dst, const char *src, size_t count) {
+    static constexpr auto mask_bytes = mem_byteswap_mask<Width>();
+    const __m256i mask = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(mask_bytes.data())));
+    size_t len = count * Width, i = 0;
+    for (; i + 64 <= len; i += 64) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i + 32));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_shuffle_epi8(a, mask));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i + 32), _mm256_shuffle_epi8(b, mask));
+    }
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_shuffle_epi8(v, mask));
+    }
+    mem_byteswap_scalar<Width>(dst + i, src + i, (len - i) / Width);
+}
+#endif
+
+template<size_t Width>
+struct mem_byteswap_kernel {
+    using type = void(char*, const char*, size_t);
+
+    static type *resolve(mem_isa isa) {
+#ifdef MEM_SIMD_X86
+        if (isa >= mem_isa::avx2) {
+            return mem_byteswap_avx2<Width>;
+        }
+        if (isa >= mem_isa::ssse3) {
+            return mem_byteswap_ssse3<Width>;
+        }
+#endif
+        return mem_byteswap_scalar<Width>;
+    }
+};
+
+/*
+ * 将count个T从src拷贝到dst并反转每个元素的字节序。dst与src可以相同(原地反转)，但不能部分重叠，也不要求按T对齐。
+ */
+template<mem_swappable T>
+inline void mem_byteswap_array(void *dst, const void *src, size_t count) {
+    auto *d = static_cast<char*>(dst);
+    auto *s = static_cast<const char*>(src);
+    if constexpr (sizeof(T) == 1) {
+        if (d != s) {
+            memmove(d, s, count);
+        }
+        return;
+    } else {
+        mem_dispatch<mem_byteswap_kernel<sizeof(T)>>::call(d, s, count);
+    }
+}
+
+/*
+ * 将count个T以字节序E从src拷贝到dst。E与本机字节序相同时等价于memcpy，否则反转每个元素的字节序。该函数同时用于编码(本机序->E)与解码(E->本机序)。
+ */
+template<std::endian E, mem_swappable T>
+inline void mem_copy_endian(void *dst, const void *src, size_t count) {
+    if constexpr (E == std::endian::native) {
+        if (count != 0) {
+            memcpy(dst, src, count * sizeof(T));
+        }
+    } else {
+        mem_byteswap_array<T>(dst, src, count);
+    }
+}
+
+/*
+ * LEB128(protobuf varint)编解码。每个字节低7位为数据，最高位为1表示后面还有字节。
+ */
+template<std::unsigned_integral T>
+constexpr size_t mem_varint_max_size = (sizeof(T) * 8 + 6) / 7;
+
+template<std::signed_integral T>
+constexpr std::make_unsigned_t<T> mem_zigzag_encode(T v) {
+    using U = std::make_unsigned_t<T>;
+    return static_cast<U>((static_cast<U>(v) << 1) ^ static_cast<U>(v >> (sizeof(T) * 8 - 1)));
+}
+
+template<std::unsigned_integral T>
+constexpr std::make_signed_t<T> mem_zigzag_decode(T v) {
+    return static_cast<std::make_signed_t<T>>((v >> 1) ^ (~(v & 1) + 1));
+}
+
+//将value编码到dst，返回写入的字节数，dst至少需要mem_varint_max_size<T>字节
+template<std::unsigned_integral T>
+inline size_t mem_varint_encode(char *dst, T value) {
+    size_t n = 0;
+    while (value >= 0x80) {
+        dst[n++] = static_cast<char>(value | 0x80);
+        value >>= 7;
+    }
+    dst[n++] = static_cast<char>(value);
+    return n;
+}
+
+//从src解码一个变长整数，返回消耗的字节数。数据不完整、过长或超出T的范围时返回0
+template<std::unsigned_integral T>
+inline size_t mem_varint_decode(const char *src, size_t len, T& value) {
+    constexpr size_t bits = sizeof(T) * 8;
+    if (len != 0 && (static_cast<uint8_t>(src[0]) & 0x80) == 0) {
+        value = static_cast<uint8_t>(src[0]);
+        return 1;
+    }
+    T result = 0;
+    for (size_t i = 0; i < len && i < mem_varint_max_size<T>; ++i) {
+        auto byte = static_cast<uint8_t>(src[i]);
+        size_t shift = i * 7;
+        //最后一个字节中超出T宽度的位必须为0
+        if (shift + 7 > bits && (byte & 0x7f) >> (bits - shift) != 0) {
+            return 0;
+        }
+        result |= static_cast<T>(static_cast<T>(byte & 0x7f) << shift);
+        if ((byte & 0x80) == 0) {
+            value = result;
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+template<std::unsigned_integral T>
+inline size_t mem_varint_decode_batch_scalar(const char *src, size_t len, T *dst, size_t count, size_t& consumed) {
+    size_t i = 0, n = 0;
+    for (; n < count; ++n) {
+        size_t k = mem_varint_decode(src + i, len - i, dst[n]);
+        if (k == 0) {
+            break;
+        }
+        i += k;
+    }
+    consumed = i;
+    return n;
+}
+
+#ifdef MEM_SIMD_X86
+//src开始的16个字节若都是单字节整数，则零扩展写入dst并返回true
+template<typename T>
+inline bool mem_varint_run16(const char *src, T *dst) {
+    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+    if (_mm_movemask_epi8(bytes) != 0) {
+        return false;
+    }
+    const __m128i zero = _mm_setzero_si128();
+    __m128i w[2] = {_mm_unpacklo_epi8(bytes, zero), _mm_unpackhi_epi8(bytes, zero)};
+    for (int h = 0; h < 2; ++h) {
+        __m128i d[2] = {_mm_unpacklo_epi16(w[h], zero), _mm_unpackhi_epi16(w[h], zero)};
+        for (int q = 0; q < 2; ++q) {
+            if constexpr (sizeof(T) == 4) {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + h * 8 + q * 4), d[q]);
+            } else {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + h * 8 + q * 4), _mm_unpacklo_epi32(d[q], zero));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + h * 8 + q * 4 + 2), _mm_unpackhi_epi32(d[q], zero));
+            }
+        }
+    }
+    return true;
+}
+
+//mem_varint_run16的AVX2版本，一次处理32个字节
+template<typename T>
+MEM_TARGET("avx2") inline bool mem_varint_run32(const char *src, T *dst) {
+    __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+    if (_mm256_movemask_epi8(bytes) != 0) {
+        return false;
+    }
+    if constexpr (sizeof(T) == 4) {
+        for (int q = 0; q < 4; ++q) {
+            __m128i part = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + q * 8));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + q * 8), _mm256_cvtepu8_epi32(part));
+        }
+    } else {
+        for (int q = 0; q < 8; ++q) {
+            int32_t part;
+            memcpy(&part, src + q * 4, 4);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + q * 4), _mm256_cvtepu8_epi64(_mm_cvtsi32_si128(part)));
+        }
+    }
+    return true;
+}
+
+/*
+ * Masked VByte风格的查找表：以8个字节的续位掩码为下标，给出这8个字节中从头开始最多4个长度不超过4字节的完整整数，每个整数的字节被pshufb放到各自的32位通道中，
+ * count为解码出的整数个数，consumed为消耗的字节数。count为0时(整数长于4字节或跨出这8个字节)交给逐个解码。
+ */
+struct mem_varint_shuffle_entry {
+    std::array<char, 16> shuffle;
+    uint8_t count;
+    uint8_t consumed;
+};
+
+inline constexpr std::array<mem_varint_shuffle_entry, 256> mem_varint_shuffle_table = [] {
+    std::array<mem_varint_shuffle_entry, 256> table {};
+    for (unsigned mask = 0; mask < 256; ++mask) {
+        auto& entry = table[mask];
+        entry.shuffle.fill(static_cast<char>(0x80));
+        unsigned start = 0;
+        while (entry.count < 4) {
+            unsigned end = start;
+            while (end < 8 && (mask >> end & 1) != 0) {
+                ++end;
+            }
+            if (end == 8 || end - start >= 4) {
+                break;
+            }
+            for (unsigned b = start; b <= end; ++b) {
+                entry.shuffle[entry.count * 4 + b - start] = static_cast<char>(b);
+            }
+            ++entry.count;
+            start = end + 1;
+        }
+        entry.consumed = static_cast<uint8_t>(start);
+    }
+    return table;
+}();
+
+//按查找表解码bytes开头最多4个整数写入dst(总是写满4个通道)，返回表项
+template<typename T>
+MEM_TARGET("ssse3") inline mem_varint_shuffle_entry const& mem_varint_masked_step(__m128i bytes, unsigned mask, T *dst) {
+    auto const& entry = mem_varint_shuffle_table[mask & 0xff];
+    __m128i v = _mm_shuffle_epi8(bytes, _mm_loadu_si128(reinterpret_cast<const __m128i*>(entry.shuffle.data())));
+    //每个32位通道中为小端排列的至多4个7位组，去掉续位后合并
+    __m128i r = _mm_and_si128(v, _mm_set1_epi32(0x7f));
+    r = _mm_or_si128(r, _mm_and_si128(_mm_srli_epi32(v, 1), _mm_set1_epi32(0x3f80)));
+    r = _mm_or_si128(r, _mm_and_si128(_mm_srli_epi32(v, 2), _mm_set1_epi32(0x1fc000)));
+    r = _mm_or_si128(r, _mm_and_si128(_mm_srli_epi32(v, 3), _mm_set1_epi32(0xfe00000)));
+    if constexpr (sizeof(T) == 4) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), r);
+    } else {
+        const __m128i zero = _mm_setzero_si128();
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_unpacklo_epi32(r, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 2), _mm_unpackhi_epi32(r, zero));
+    }
+    return entry;
+}
+
+/*
+ * SIMD批量解码的主体：载入16(AVX2为32)个字节取得续位掩码，全部是单字节整数时整段零扩展写出；否则用Masked VByte查找表一次解码至多4个整数，查找表无法处理的长整数
+ * 退回逐个解码。该函数总是内联进下面带target属性的包装函数，从而按ISA分别生成代码。
+ */
+template<typename T, bool AVX2, bool SSSE3>
+[[gnu::always_inline]] inline size_t mem_varint_decode_words(const char *src, size_t len, T *dst, size_t count, size_t& consumed) {
+    constexpr size_t run = AVX2 ? 32 : 16;
+    size_t i = 0, n = 0;
+    while (count - n >= run && len - i >= run) {
+        bool hit;
+        if constexpr (AVX2) {
+            hit = mem_varint_run32(src + i, dst + n);
+        } else {
+            hit = mem_varint_run16(src + i, dst + n);
+        }
+        if (hit) {
+            i += run;
+            n += run;
+            continue;
+        }
+        //逐段解码，直到本段run个字节被消耗完
+        size_t end = i + run;
+        while (i < end && count - n >= 4 && len - i >= 16) {
+            __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            auto mask = static_cast<unsigned>(_mm_movemask_epi8(bytes));
+            if constexpr (SSSE3) {
+                auto const& entry = mem_varint_masked_step(bytes, mask, dst + n);
+                if (entry.count != 0) {
+                    i += entry.consumed;
+                    n += entry.count;
+                    continue;
+                }
+            }
+            size_t k = mem_varint_decode(src + i, len - i, dst[n]);
+            if (k == 0) {
+                consumed = i;
+                return n;
+            }
+            i += k;
+            ++n;
+        }
+        if (i < end) {
+            break;
+        }
+    }
+    size_t tail;
+    n += mem_varint_decode_batch_scalar(src + i, len - i, dst + n, count - n, tail);
+    consumed = i + tail;
+    return n;
+}
+
+template<typename T>
+inline size_t mem_varint_decode_batch_sse2(const char *src, size_t len, T *dst, size_t count, size_t& consumed) {
+    return mem_varint_decode_words<T, false, false>(src, len, dst, count, consumed);
+}
+
+template<typename T>
+MEM_TARGET("ssse3") inline size_t mem_varint_decode_batch_ssse3(const char *src, size_t len, T *dst, size_t count, size_t& consumed) {
+    return mem_varint_decode_words<T, false, true>(src, len, dst, count, consumed);
+}
+
+template<typename T>
+MEM_TARGET("avx2") inline size_t mem_varint_decode_batch_avx2(const char *src, size_t len, T *dst, size_t count, size_t& consumed) {
+    return mem_varint_decode_words<T, true, true>(src, len, dst, count, consumed);
+}
+#endif
+
+template<typename T>
+struct mem_varint_decode_kernel {
+    using type = size_t(const char*, size_t, T*, size_t, size_t&);
+
+    static type *resolve(mem_isa isa) {
+#ifdef MEM_SIMD_X86
+        //AVX2版本只在整段都是单字节整数时占优，长度混合的输入上慢于SSSE3版本，因此暂不接入，AVX2档位同样使用SSSE3版本
+        if (isa >= mem_isa::ssse3) {
+            return mem_varint_decode_batch_ssse3<T>;
+        }
+        if (isa >= mem_isa::sse2) {
+            return mem_varint_decode_batch_sse2<T>;
+        }
+#endif
+        return mem_varint_decode_batch_scalar<T>;
+    }
+};
+
+/*
+ * 从src中连续解码最多count个变长整数到dst，返回实际解码的个数，consumed为消耗的字节数。遇到不完整或非法的整数时停止。T只能是uint32_t或uint64_t。
+ */
+template<typename T>
+requires std::same_as<T, uint32_t> || std::same_as<T, uint64_t>
+inline size_t mem_varint_decode_batch(const char *src, size_t len, T *dst, size_t count, size_t& consumed) {
+    return mem_dispatch<mem_varint_decode_kernel<T>>::call(src, len, dst, count, consumed);
+}
+
+/*
+ * 字节查找：find_byte查找单个字节，find_any查找集合中任意一个字节，find查找子串。返回相对data的下标，找不到时返回mem_npos。
+ */
+inline constexpr size_t mem_npos = static_cast<size_t>(-1);
+
+inline size_t mem_find_byte_scalar(const char *data, size_t len, char c) {
+    auto *r = static_cast<const char*>(len == 0 ? nullptr : memchr(data, c, len));
+    return r == nullptr ? mem_npos : static_cast<size_t>(r - data);
+}
+
+inline size_t mem_find_any_scalar(const char *data, size_t len, const char *set, size_t set_len) {
+    bool table[256] {};
+    for (size_t i = 0; i < set_len; ++i) {
+        table[static_cast<uint8_t>(set[i])] = true;
+    }
+    for (size_t i = 0; i < len; ++i) {
+        if (table[static_cast<uint8_t>(data[i])]) {
+            return i;
+        }
+    }
+    return mem_npos;
+}
+
+inline size_t mem_find_scalar(const char *data, size_t len, const char *needle, size_t needle_len) {
+    if (needle_len == 0) {
+        return 0;
+    }
+    for (size_t i = 0; i + needle_len <= len; ++i) {
+        size_t k = mem_find_byte_scalar(data + i, len - i - needle_len + 1, needle[0]);
+        if (k == mem_npos) {
+            break;
+        }
+        i += k;
+        if (memcmp(data + i + 1, needle + 1, needle_len - 1) == 0) {
+            return i;
+        }
+    }
+    return mem_npos;
+}
+
+#ifdef MEM_SIMD_X86
+inline size_t mem_find_byte_sse2(const char *data, size_t len, char c) {
+    const __m128i needle = _mm_set1_epi8(c);
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        auto mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)), needle)));
+        if (mask != 0) {
+            return i + static_cast<size_t>(__builtin_ctz(mask));
+        }
+    }
+    size_t k = mem_find_byte_scalar(data + i, len - i, c);
+    return k == mem_npos ? k : i + k;
+}
+
+MEM_TARGET("avx2") inline size_t mem_find_byte_avx2(const char *data, size_t len, char c) {
+    const __m256i needle = _mm256_set1_epi8(c);
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64) {
+        __m256i a = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i)), needle);
+        __m256i b = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + 32)), needle);
+        if (!_mm256_testz_si256(_mm256_or_si256(a, b), _mm256_or_si256(a, b))) {
+            uint64_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(a)) | static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(b))) << 32;
+            return i + static_cast<size_t>(__builtin_ctzll(mask));
+        }
+    }
+    for (; i + 32 <= len; i += 32) {
+        auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i)), needle)));
+        if (mask != 0) {
+            return i + static_cast<size_t>(__builtin_ctz(mask));
+        }
+    }
+    size_t k = mem_find_byte_scalar(data + i, len - i, c);
+    return k == mem_npos ? k : i + k;
+}
+
+MEM_TARGET("avx512f,avx512bw,bmi2") inline size_t mem_find_byte_avx512(const char *data, size_t len, char c) {
+    const __m512i needle = _mm512_set1_epi8(c);
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64) {
+        uint64_t mask = _mm512_cmpeq_epi8_mask(_mm512_loadu_si512(data + i), needle);
+        if (mask != 0) {
+            return i + static_cast<size_t>(__builtin_ctzll(mask));
+        }
+    }
+    if (i < len) {
+        //末尾不足64字节时使用掩码加载，不会读越界
+        __mmask64 live = _bzhi_u64(~0ull, static_cast<unsigned>(len - i));
+        uint64_t mask = _mm512_mask_cmpeq_epi8_mask(live, _mm512_maskz_loadu_epi8(live, data + i), needle);
+        if (mask != 0) {
+            return i + static_cast<size_t>(__builtin_ctzll(mask));
+        }
+    }
+    return mem_npos;
+}
+
+//集合不超过16个字节时逐个广播比较，超过时使用标量查表
+inline size_t mem_find_any_sse2(const char *data, size_t len, const char *set, size_t set_len) {
+    if (set_len > 16) {
+        return mem_find_any_scalar(data, len, set, set_len);
+    }
+    __m128i needles[16];
+    for (size_t j = 0; j < set_len; ++j) {
+        needles[j] = _mm_set1_epi8(set[j]);
+    }
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i hit = _mm_setzero_si128();
+        for (size_t j = 0; j < set_len; ++j) {
+            hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, needles[j]));
+        }
+        auto mask = static_cast<unsigned>(_mm_movemask_epi8(hit));
+        if (mask != 0) {
+            return i + static_cast<size_t>(__builtin_ctz(mask));
+        }
+    }
+    size_t k = mem_find_any_scalar(data + i, len - i, set, set_len);
+    return k == mem_npos ? k : i + k;
+}
+
+MEM_TARGET("avx2") inline size_t mem_find_any_avx2(const char *data, size_t len, const char *set, size_t set_len) {
+    if (set_len > 16) {
+        return mem_find_any_scalar(data, len, set, set_len);
+    }
+    __m256i needles[16];
+    for (size_t j = 0; j < set_len; ++j) {
+        needles[j] = _mm256_set1_epi8(set[j]);
+    }
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        __m256i hit = _mm256_setzero_si256();
+        for (size_t j = 0; j < set_len; ++j) {
+            hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(v, needles[j]));
+        }
+        auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(hit));
+        if (mask != 0) {
+            return i + static_cast<size_t>(__builtin_ctz(mask));
+        }
+    }
+    size_t k = mem_find_any_sse2(data + i, len - i, set, set_len);
+    return k == mem_npos ? k : i + k;
+}
+
+/*
+ * 子串查找：同时比较子串首字节与尾字节所在的两个窗口，只有两者都命中的位置才用memcmp验证中间部分。
+ */
+inline size_t mem_find_sse2(const char *data, size_t len, const char *needle, size_t needle_len) {
+    if (needle_len < 2) {
+        return needle_len == 0 ? 0 : mem_find_byte_sse2(data, len, needle[0]);
+    }
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[needle_len - 1]);
+    size_t i = 0;
+    for (; i + needle_len - 1 + 16 <= len; i += 16) {
+        __m128i a = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)), first);
+        __m128i b = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + needle_len - 1)), last);
+        auto mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_and_si128(a, b)));
+        while (mask != 0) {
+            size_t k = i + static_cast<size_t>(__builtin_ctz(mask));
+            if (memcmp(data + k + 1, needle + 1, needle_len - 2) == 0) {
+                return k;
+            }
+            mask &= mask - 1;
+        }
+    }
+    size_t k = mem_find_scalar(data + i, len - i, needle, needle_len);
+    return k == mem_npos ? k : i + k;
+}
+
+MEM_TARGET("avx2") inline size_t mem_find_avx2(const char *data, size_t len, const char *needle, size_t needle_len) {
+    if (needle_len < 2) {
+        return needle_len == 0 ? 0 : mem_find_byte_avx2(data, len, needle[0]);
+    }
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[needle_len - 1]);
+    size_t i = 0;
+    for (; i + needle_len - 1 + 32 <= len; i += 32) {
+        __m256i a = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i)), first);
+        __m256i b = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + needle_len - 1)), last);
+        auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_and_si256(a, b)));
+        while (mask != 0) {
+            size_t k = i + static_cast<size_t>(__builtin_ctz(mask));
+            if (memcmp(data + k + 1, needle + 1, needle_len - 2) == 0) {
+                return k;
+            }
+            mask &= mask - 1;
+        }
+    }
+    size_t k = mem_find_sse2(data + i, len - i, needle, needle_len);
+    return k == mem_npos ? k : i + k;
+}
+#endif
+
+struct mem_find_byte_kernel {
+    using type = size_t(const char*, size_t, char);
+
+    static type *resolve(mem_isa isa) {
+#ifdef MEM_SIMD_X86
+        if (isa >= mem_isa::avx512) {
+            return mem_find_byte_avx512;
+        }
+        if (isa >= mem_isa::avx2) {
+            return mem_find_byte_avx2;
+        }
+        if (isa >= mem_isa::sse2) {
+            return mem_find_byte_sse2;
+        }
+#endif
+        return mem_find_byte_scalar;
+    }
+};
+
+struct mem_find_any_kernel {
+    using type = size_t(const char*, size_t, const char*, size_t);
+
+    static type *resolve(mem_isa isa) {
+#ifdef MEM_SIMD_X86
+        if (isa >= mem_isa::avx2) {
+            return mem_find_any_avx2;
+        }
+        if (isa >= mem_isa::sse2) {
+            return mem_find_any_sse2;
+        }
+#endif
+        return mem_find_any_scalar;
+    }
+};
+
+struct mem_find_kernel {
+    using type = size_t(const char*, size_t, const char*, size_t);
+
+    static type *resolve(mem_isa isa) {
+#ifdef MEM_SIMD_X86
+        if (isa >= mem_isa::avx2) {
+            return mem_find_avx2;
+        }
+        if (isa >= mem_isa::sse2) {
+            return mem_find_sse2;
+        }
+#endif
+        return mem_find_scalar;
+    }
+};
+
+inline size_t mem_find_byte(const char *data, size_t len, char c) {
+    return mem_dispatch<mem_find_byte_kernel>::call(data, len, c);
+}
+
+inline size_t mem_find_any(const char *data, size_t len, const char *set, size_t set_len) {
+    return mem_dispatch<mem_find_any_kernel>::call(data, len, set, set_len);
+}
+
+inline size_t mem_find(const char *data, size_t len, const char *needle, size_t needle_len) {
+    return mem_dispatch<mem_find_kernel>::call(data, len, needle, needle_len);
+}
+
+/*
+ * 以Width字节的value重复填充count个元素。Width为1时直接使用memset；SIMD版本要求Width整除向量宽度，只用于不超过8的2的幂，其他宽度使用标量版本。
+ */
+template<size_t Width>
+inline void mem_fill_scalar(char *dst, const char *value, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        memcpy(dst + i * Width, value, Width);
+    }
+}
+
+#ifdef MEM_SIMD_X86
+//将value重复铺满Vec字节，Width整除Vec，因此每个向量写入后图案的相位保持不变
+template<size_t Width, size_t Vec>
+inline std::array<char, Vec> mem_fill_pattern(const char *value) {
+    std::array<char, Vec> pattern;
+    for (size_t k = 0; k < Vec; k += Width) {
+        memcpy(pattern.data() + k, value, Width);
+    }
+    return pattern;
+}
+
+template<size_t Width>
+inline void mem_fill_sse2(char *dst, const char *value, size_t count) {
+    auto pattern = mem_fill_pattern<Width, 16>(value);
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pattern.data()));
+    size_t len = count * Width, i = 0;
+    for (; i + 16 <= len; i += 16) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), v);
+    }
+    memcpy(dst + i, pattern.data(), len - i);
+}
+
+template<size_t Width>
+MEM_TARGET("avx2") inline void mem_fill_avx2(char *dst, const char *value, size_t count) {
+    auto pattern = mem_fill_pattern<Width, 32>(value);
+    const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pattern.data()));
+    size_t len = count * Width, i = 0;
+    for (; i + 64 <= len; i += 64) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), v);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i + 32), v);
+    }
+    for (; i + 32 <= len; i += 32) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), v);
+    }
+    memcpy(dst + i, pattern.data(), len - i);
+}
+
+template<size_t Width>
+MEM_TARGET("avx512f,avx512bw,bmi2") inline void mem_fill_avx512(char *dst, const char *value, size_t count) {
+    auto pattern = mem_fill_pattern<Width, 64>(value);
+    const __m512i v = _mm512_loadu_si512(pattern.data());
+    size_t len = count * Width, i = 0;
+    for (; i + 64 <= len; i += 64) {
+        _mm512_storeu_si512(dst + i, v);
+    }
+    if (i < len) {
+        _mm512_mask_storeu_epi8(dst + i, _bzhi_u64(~0ull, static_cast<unsigned>(len - i)), v);
+    }
+}
+#endif
+
+template<size_t Width>
+requires (std::has_single_bit(Width) && Width <= 8)
+struct mem_fill_kernel {
+    using type = void(char*, const char*, size_t);
+
+    static type *resolve(mem_isa isa) {
+#ifdef MEM_SIMD_X86
+        if (isa >= mem_isa::avx512) {
+            return mem_fill_avx512<Width>;
+        }
+        if (isa >= mem_isa::avx2) {
+            return mem_fill_avx2<Width>;
+        }
+        if (isa >= mem_isa::sse2) {
+            return mem_fill_sse2<Width>;
+        }
+#endif
+        return mem_fill_scalar<Width>;
+    }
+};
+
+template<size_t Width>
+inline void mem_fill(char *dst, const char *value, size_t count) {
+    if constexpr (Width == 1) {
+        memset(dst, *value, count);
+    } else if constexpr (std::has_single_bit(Width) && Width <= 8) {
+        mem_dispatch<mem_fill_kernel<Width>>::call(dst, value, count);
+    } else {
+        mem_fill_scalar<Width>(dst, value, count);
+    }
+}
+
+/*
+ * 大块拷贝与清零。长度不小于mem_streaming_threshold()时使用非临时存储(movntdq/vmovntdq)，目标数据直接写回内存而不进入缓存，避免一次数百MB的扩容或复制把其他数据
+ * 挤出末级缓存；低于阈值时仍使用memcpy/memset。写入完成后执行sfence，返回后其他线程可以正常看到写入的数据。
+ */
+inline std::atomic<size_t> mem_streaming_threshold_bytes = [] {
+    const char *env = std::getenv("GXUTILS_STREAMING_THRESHOLD");
+    return env != nullptr ? static_cast<size_t>(std::strtoull(env, nullptr, 0)) : static_cast<size_t>(4) << 20;
+}();
+
+inline size_t mem_streaming_threshold() {
+    return mem_streaming_threshold_bytes.load(std::memory_order_relaxed);
+}
+
+//设置使用非临时存储的最小长度，传入SIZE_MAX可以完全关闭
+inline void mem_set_streaming_threshold(size_t bytes) {
+    mem_streaming_threshold_bytes.store(bytes, std::memory_order_relaxed);
+}
+
+inline void mem_stream_copy_scalar(char *dst, const char *src, size_t len) {
+    memcpy(dst, src, len);
+}
+
+inline void mem_stream_zero_scalar(char *dst, size_t len) {
+    memset(dst, 0, len);
+}
+
+#ifdef MEM_SIMD_X86
+//先用普通拷贝补齐到dst按Align对齐，返回剩余长度
+template<size_t Align>
+inline size_t mem_stream_head(char *&dst, const char *&src, size_t len) {
+    size_t head = std::min((Align - reinterpret_cast<uintptr_t>(dst) % Align) % Align, len);
+    if (src != nullptr) {
+        memcpy(dst, src, head);
+        src += head;
+    } else {
+        memset(dst, 0, head);
+    }
+    dst += head;
+    return len - head;
+}
+
+inline void mem_stream_copy_sse2(char *dst, const char *src, size_t len) {
+    len = mem_stream_head<16>(dst, src, len);
+    for (; len >= 64; len -= 64, src += 64, dst += 64) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16));
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 32));
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 48));
+        _mm_stream_si128(reinterpret_cast<__m128i*>(dst), a);
+        _mm_stream_si128(reinterpret_cast<__m128i*>(dst + 16), b);
+        _mm_stream_si128(reinterpret_cast<__m128i*>(dst + 32), c);
+        _mm_stream_si128(reinterpret_cast<__m128i*>(dst + 48), d);
+    }
+    _mm_sfence();
+    memcpy(dst, src, len);
+}
+
+MEM_TARGET("avx2") inline void mem_stream_copy_avx2(char *dst, const char *src, size_t len) {
+    len = mem_stream_head<32>(dst, src, len);
+    for (; len >= 128; len -= 128, src += 128, dst += 128) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 32));
+        __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 64));
+        __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 96));
+        _mm256_stream_si256(reinterpret_cast<__m256i*>(dst), a);
+        _mm256_stream_si256(reinterpret_cast<__m256i*>(dst + 32), b);
+        _mm256_stream_si256(reinterpret_cast<__m256i*>(dst + 64), c);
+        _mm256_stream_si256(reinterpret_cast<__m256i*>(dst + 96), d);
+    }
+    _mm_sfence();
+    memcpy(dst, src, len);
+}
+
+MEM_TARGET("avx512f") inline void mem_stream_copy_avx512(char *dst, const char *src, size_t len) {
+    len = mem_stream_head<64>(dst, src, len);
+    for (; len >= 256; len -= 256, src += 256, dst += 256) {
+        __m512i a = _mm512_loadu_si512(src);
+        __m512i b = _mm512_loadu_si512(src + 64);
+        __m512i c = _mm512_loadu_si512(src + 128);
+        __m512i d = _mm512_loadu_si512(src + 192);
+        _mm512_stream_si512(reinterpret_cast<__m512i*>(dst), a);
+        _mm512_stream_si512(reinterpret_cast<__m512i*>(dst + 64), b);
+        _mm512_stream_si512(reinterpret_cast<__m512i*>(dst + 128), c);
+        _mm512_stream_si512(reinterpret_cast<__m512i*>(dst + 192), d);
+    }
+    _mm_sfence();
+    memcpy(dst, src, len);
+}
+
+inline void mem_stream_zero_sse2(char *dst, size_t len) {
+    const char *none = nullptr;
+    len = mem_stream_head<16>(dst, none, len);
+    const __m128i z = _mm_setzero_si128();
+    for (; len >= 64; len -= 64, dst += 64) {
+        _mm_stream_si128(reinterpret_cast<__m128i*>(dst), z);
+        _mm_stream_si128(reinterpret_cast<__m128i*>(dst + 16), z);
+        _mm_stream_si128(reinterpret_cast<__m128i*>(dst + 32), z);
+        _mm_stream_si128(reinterpret_cast<__m128i*>(dst + 48), z);
+    }
+    _mm_sfence();
+    memset(dst, 0, len);
+}
+
+MEM_TARGET("avx2") inline void mem_stream_zero_avx2(char *dst, size_t len) {
+    const char *none = nullptr;
+    len = mem_stream_head<32>(dst, none, len);
+    const __m256i z = _mm256_setzero_si256();
+    for (; len >= 128; len -= 128, dst += 128) {
+        _mm256_stream_si256(reinterpret_cast<__m256i*>(dst), z);
+        _mm256_stream_si256(reinterpret_cast<__m256i*>(dst + 32), z);
+        _mm256_stream_si256(reinterpret_cast<__m256i*>(dst + 64), z);
+        _mm256_stream_si256(reinterpret_cast<__m256i*>(dst + 96), z);
+    }
+    _mm_sfence();
+    memset(dst, 0, len);
+}
+
+MEM_TARGET("avx512f") inline void mem_stream_zero_avx512(char *dst, size_t len) {
+    const char *none = nullptr;
+    len = mem_stream_head<64>(dst, none, len);
+    const __m512i z = _mm512_setzero_si512();
+    for (; len >= 256; len -= 256, dst += 256) {
+        _mm512_stream_si512(reinterpret_cast<__m512i*>(dst), z);
+        _mm512_stream_si512(reinterpret_cast<__m512i*>(dst + 64), z);
+        _mm512_stream_si512(reinterpret_cast<__m512i*>(dst + 128), z);
+        _mm512_stream_si512(reinterpret_cast<__m512i*>(dst + 192), z);
+    }
+    _mm_sfence();
+    memset(dst, 0, len);
+}
+#endif
+
+struct mem_stream_copy_kernel {
+    using type = void(char*, const char*, size_t);
+
+    static type *resolve(mem_isa isa) {
+#ifdef MEM_SIMD_X86
+        if (isa >= mem_isa::avx512) {
+            return mem_stream_copy_avx512;
+        }
+        if (isa >= mem_isa::avx2) {
+            return mem_stream_copy_avx2;
+        }
+        if (isa >= mem_isa::sse2) {
+            return mem_stream_copy_sse2;
+        }
+#endif
+        return mem_stream_copy_scalar;
+    }
+};
+
+struct mem_stream_zero_kernel {
+    using type = void(char*, size_t);
+
+    static type *resolve(mem_isa isa) {
+#ifdef MEM_SIMD_X86
+        if (isa >= mem_isa::avx512) {
+            return mem_stream_zero_avx512;
+        }
+        if (isa >= mem_isa::avx2) {
+            return mem_stream_zero_avx2;
+        }
+        if (isa >= mem_isa::sse2) {
+            return mem_stream_zero_sse2;
+        }
+#endif
+        return mem_stream_zero_scalar;
+    }
+};
+
+//拷贝len字节，dst与src不能重叠
+inline void mem_copy(void *dst, const void *src, size_t len) {
+    if (len < mem_streaming_threshold()) {
+        if (len != 0) {
+            memcpy(dst, src, len);
+        }
+        return;
+    }
+    mem_dispatch<mem_stream_copy_kernel>::call(static_cast<char*>(dst), static_cast<const char*>(src), len);
+}
+
+inline void mem_zero(void *dst, size_t len) {
+    if (len < mem_streaming_threshold()) {
+        if (len != 0) {
+            memset(dst, 0, len);
+        }
+        return;
+    }
+    mem_dispatch<mem_stream_zero_kernel>::call(static_cast<char*>(dst), len);
+}
@@ -0,0 +1,225 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include "mem_dispatch.hpp"
+/*
+ * 缓冲统计。定义宏BUFFER_STATISTICS后，各缓冲类在分配、释放、扩容、读写以及等待控制块的锁时记录计数，按分配器类型分别汇总，可随时通过mem_stats<Allocator>::snapshot()
+ * 取得当前的累计值。未定义该宏时所有记录函数都是空函数，不产生线程局部变量，也不改变加锁方式。
+ *
+ * 计数保存在每个线程私有的分片中，记录时只由所属线程写入，不需要原子的读改写，也不会与其他线程争用缓存行。snapshot()加锁遍历所有分片求和，线程退出时其分片的计数
+ * 并入已退出线程的总和，分片留给之后的线程复用。
+ */
+
+//某个分配器类型的累计计数
+struct mem_stats_snapshot {
+    uint64_t allocs {0};             //通过分配器申请内存的次数
+    uint64_t frees {0};              //通过分配器释放内存的次数
+    uint64_t bytes_allocated {0};
+    uint64_t bytes_freed {0};
+    uint64_t expands {0};            //重新分配更大内存的次数，包括写时复制分离时扩大容量的情况
+    uint64_t expand_bytes_moved {0}; //扩容与写时复制分离时从旧内存拷贝的字节数
+    uint64_t reads {0};              //read_with的次数，缓冲与流的读函数都经过它
+    uint64_t read_bytes {0};
+    uint64_t writes {0};             //write_with的次数
+    uint64_t write_bytes {0};
+    uint64_t lock_waits {0};         //控制块的锁已被其他线程持有、需要等待的次数
+    uint64_t lock_wait_ns {0};       //等待锁的总时间
+    uint64_t peak_capacity {0};      //单个缓冲曾达到的最大容量
+
+    //当前仍未释放的字节数
+    uint64_t live_bytes() const {
+        return bytes_allocated - bytes_freed;
+    }
+};
+
+#ifdef BUFFER_STATISTICS
+inline constexpr bool mem_stats_enabled = true;
+#else
+inline constexpr bool mem_stats_enabled = false;
+#endif
+
+template<typename Allocator>
+class mem_stats {
+private:
+    //按缓存行对齐，相邻线程的分片不会共享缓存行
+    struct alignas(mem_cache_line_size) shard {
+        std::atomic<uint64_t> allocs {0};
+        std::atomic<uint64_t> frees {0};
+        std::atomic<uint64_t> bytes_allocated {0};
+        std::atomic<uint64_t> bytes_freed {0};
+        std::atomic<uint64_t> expands {0};
+        std::atomic<uint64_t> expand_bytes_moved {0};
+        std::atomic<uint64_t> reads {0};
+        std::atomic<uint64_t> read_bytes {0};
+        std::atomic<uint64_t> writes {0};
+        std::atomic<uint64_t> write_bytes {0};
+        std::atomic<uint64_t> lock_waits {0};
+        std::atomic<uint64_t> lock_wait_ns {0};
+        std::atomic<uint64_t> peak_capacity {0};
+
+        void add_to(mem_stats_snapshot& s) const {
+            s.allocs += allocs.load(std::memory_order_relaxed);
+            s.frees += frees.load(std::memory_order_relaxed);
+            s.bytes_allocated += bytes_allocated.load(std::memory_order_relaxed);
+            s.bytes_freed += bytes_freed.load(std::memory_order_relaxed);
+            s.expands += expands.load(std::memory_order_relaxed);
+            s.expand_bytes_moved += expand_bytes_moved.load(std::memory_order_relaxed);
+            s.reads += reads.load(std::memory_order_relaxed);
+            s.read_bytes += read_bytes.load(std::memory_order_relaxed);
+            s.writes += writes.load(std::memory_order_relaxed);
+            s.write_bytes += write_bytes.load(std::memory_order_relaxed);
+            s.lock_waits += lock_waits.load(std::memory_order_relaxed);
+            s.lock_wait_ns += lock_wait_ns.load(std::memory_order_relaxed);
+            s.peak_capacity = std::max(s.peak_capacity, peak_capacity.load(std::memory_order_relaxed));
+        }
+
+        void clear() {
+            for (auto *c : {&allocs, &frees, &bytes_allocated, &bytes_freed, &expands, &expand_bytes_moved, &reads, &read_bytes, &writes, &write_bytes,
+                            &lock_waits, &lock_wait_ns, &peak_capacity}) {
+                c->store(0, std::memory_order_relaxed);
+            }
+        }
+    };
+
+    struct registry {
+        std::mutex mutex;
+        std::vector<shard*> live;
+        std::vector<shard*> idle;
+        mem_stats_snapshot retired;
+    };
+
+    //线程退出时将分片并入retired
+    struct releaser {
+        ~releaser() {
+            if (local != nullptr) {
+                registry& r = reg();
+                std::lock_guard guard(r.mutex);
+                local->add_to(r.retired);
+                local->clear();
+                std::erase(r.live, local);
+                r.idle.push_back(local);
+                local = nullptr;
+            }
+        }
+    };
+
+    //注册表与分片都不释放，静态对象析构期间仍可以记录
+    static registry& reg() {
+        static registry *r = new registry;
+        return *r;
+    }
+
+    static inline thread_local shard *local = nullptr;
+
+    static shard *attach() {
+        //线程退出过程中releaser析构之后再记录时重新取得的分片不会被归还，留在live中照常参与统计
+        static thread_local releaser release_on_exit;
+        (void) release_on_exit;
+        registry& r = reg();
+        std::lock_guard guard(r.mutex);
+        shard *s;
+        if (r.idle.empty()) {
+            s = new shard;
+        } else {
+            s = r.idle.back();
+            r.idle.pop_back();
+        }
+        r.live.push_back(s);
+        local = s;
+        return s;
+    }
+
+    static shard& current() {
+        shard *s = local;
+        return s != nullptr ? *s : *attach();
+    }
+
+    //只有所属线程写入，读改写不需要原子指令
+    static void add(std::atomic<uint64_t>& c, uint64_t n) {
+        c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+public:
+    static constexpr bool enabled = mem_stats_enabled;
+
+    static void record_alloc(size_t size) {
+        if constexpr (enabled) {
+            shard& s = current();
+            add(s.allocs, 1);
+            add(s.bytes_allocated, size);
+            if (size > s.peak_capacity.load(std::memory_order_relaxed)) {
+                s.peak_capacity.store(size, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    static void record_free(size_t size) {
+        if constexpr (enabled) {
+            shard& s = current();
+            add(s.frees, 1);
+            add(s.bytes_freed, size);
+        }
+    }
+
+    static void record_expand(size_t moved) {
+        if constexpr (enabled) {
+            shard& s = current();
+            add(s.expands, 1);
+            add(s.expand_bytes_moved, moved);
+        }
+    }
+
+    static void record_read(size_t len) {
+        if constexpr (enabled) {
+            shard& s = current();
+            add(s.reads, 1);
+            add(s.read_bytes, len);
+        }
+    }
+
+    static void record_write(size_t len) {
+        if constexpr (enabled) {
+            shard& s = current();
+            add(s.writes, 1);
+            add(s.write_bytes, len);
+        }
+    }
+
+    /*
+     * 对mutex加锁，启用统计时先try_lock，失败后才计时等待，没有争用时只多一次try_lock。
+     */
+    template<typename Mutex>
+    static void lock(Mutex& mutex) {
+        if constexpr (enabled) {
+            if (mutex.try_lock()) {
+                return;
+            }
+            auto start = std::chrono::steady_clock::now();
+            mutex.lock();
+            auto waited = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+            shard& s = current();
+            add(s.lock_waits, 1);
+            add(s.lock_wait_ns, static_cast<uint64_t>(waited));
+        } else {
+            mutex.lock();
+        }
+    }
+
+    //所有线程的累计计数，未启用统计时全部为0
+    static mem_stats_snapshot snapshot() {
+        mem_stats_snapshot r;
+        if constexpr (enabled) {
+            registry& g = reg();
+            std::lock_guard guard(g.mutex);
+            r = g.retired;
+            for (shard *s : g.live) {
+                s->add_to(r);
+            }
+        }
+        return r;
+    }
+};
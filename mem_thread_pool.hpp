@@ -0,0 +1,515 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#include "mem_utils.hpp"
+/*
+ * 用于缓冲处理的工作窃取线程池。
+ *
+ * 每个工作线程有一个Chase-Lev双端队列，工作线程提交的任务压入自己队列的底部并从底部取出(后进先出，刚写入的数据仍在缓存中)，空闲的线程从其他队列的顶部窃取(先进先出，
+ * 窃取到的通常是较大的未拆分任务)。池外线程提交的任务进入按NUMA节点划分的注入队列。空闲线程依次查找：自己的队列、本节点的注入队列、本节点其他线程的队列、其他节点的注入队列
+ * 与队列，找不到任务时短暂让出CPU后休眠，提交任务时唤醒。
+ *
+ * NUMA拓扑从/sys/devices/system/node读取，有多个节点时工作线程按节点轮流分配并绑定到所在节点的CPU上。提交任务时可以指定节点(如node_of(buffer.data())取得的缓冲所在节点)，
+ * 任务优先由该节点的线程执行，但在其他线程空闲时仍可能被窃取，节点只是提示。非Linux平台或没有NUMA信息时视为只有一个节点。
+ *
+ * mem_wait_group用于等待一组任务完成。工作线程在wait()中等待时会继续执行其他任务，因此任务内可以再提交子任务并等待，不会因线程全部阻塞而死锁。任务抛出的异常记录在所属的
+ * mem_wait_group中，由wait()重新抛出第一个；不属于任何mem_wait_group的任务抛出异常时调用std::terminate()，与std::thread相同。
+ *
+ * 析构时等待所有已提交的任务执行完毕后结束工作线程。
+ */
+
+//一组任务的计数器。add()在提交前增加计数，每个任务完成时done()减少计数，计数回到0后wait()返回
+class mem_wait_group {
+private:
+    std::atomic<size_t> count {0};
+    mutable std::mutex mutex;
+    mutable std::condition_variable cv;
+    std::exception_ptr error;
+public:
+    mem_wait_group() = default;
+    mem_wait_group(mem_wait_group const&) = delete;
+    mem_wait_group& operator=(mem_wait_group const&) = delete;
+
+    void add(size_t n = 1) {
+        count.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    //在锁内减少计数，等待方看到计数为0后还要取得一次锁，保证返回(并析构该对象)时done()已经不再访问它
+    void done(std::exception_ptr e = nullptr) {
+        std::lock_guard guard(mutex);
+        if (e && !error) {
+            error = e;
+        }
+        if (count.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            cv.notify_all();
+        }
+    }
+
+    [[nodiscard]] bool finished() const {
+        return count.load(std::memory_order_acquire) == 0;
+    }
+
+    //阻塞直到计数为0，有任务抛出异常时重新抛出第一个异常
+    void wait() {
+        std::unique_lock lock(mutex);
+        cv.wait(lock, [this] { return count.load(std::memory_order_acquire) == 0; });
+        if (error) {
+            std::exception_ptr e = std::exchange(error, nullptr);
+            std::rethrow_exception(e);
+        }
+    }
+};
+
+class mem_thread_pool {
+private:
+    struct task {
+        std::function<void()> fn;
+        mem_wait_group *group;
+    };
+
+    /*
+     * Chase-Lev工作窃取双端队列(按Lê等人在弱内存模型下的修正版本)。push/pop只能由所属线程调用，steal可以由任意线程调用。扩容后旧数组保留到队列析构，正在窃取的线程仍可
+     * 安全读取。
+     */
+    class deque {
+    private:
+        struct array {
+            int64_t mask;
+            std::unique_ptr<std::atomic<task*>[]> slots;
+
+            explicit array(int64_t capacity) : mask(capacity - 1), slots(new std::atomic<task*>[static_cast<size_t>(capacity)]) {}
+
+            task *get(int64_t i) const {
+                return slots[static_cast<size_t>(i & mask)].load(std::memory_order_relaxed);
+            }
+
+            void put(int64_t i, task *t) {
+                slots[static_cast<size_t>(i & mask)].store(t, std::memory_order_relaxed);
+            }
+        };
+
+        alignas(mem_cache_line_size) std::atomic<int64_t> top {0};
+        alignas(mem_cache_line_size) std::atomic<int64_t> bottom {0};
+        std::atomic<array*> items;
+        std::vector<std::unique_ptr<array>> arrays;
+    public:
+        deque() {
+            arrays.push_back(std::make_unique<array>(256));
+            items.store(arrays.back().get(), std::memory_order_relaxed);
+        }
+
+        void push(task *t) {
+            int64_t b = bottom.load(std::memory_order_relaxed);
+            int64_t tp = top.load(std::memory_order_acquire);
+            array *a = items.load(std::memory_order_relaxed);
+            if (b - tp > a->mask) {
+                auto bigger = std::make_unique<array>((a->mask + 1) * 2);
+                for (int64_t i = tp; i < b; ++i) {
+                    bigger->put(i, a->get(i));
+                }
+                a = bigger.get();
+                arrays.push_back(std::move(bigger));
+                items.store(a, std::memory_order_release);
+            }
+            a->put(b, t);
+            bottom.store(b + 1, std::memory_order_release);
+        }
+
+        task *pop() {
+            int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+            array *a = items.load(std::memory_order_relaxed);
+            bottom.store(b, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t t = top.load(std::memory_order_relaxed);
+            if (t > b) {
+                bottom.store(b + 1, std::memory_order_relaxed);
+                return nullptr;
+            }
+            task *x = a->get(b);
+            if (t == b) {
+                //只剩最后一个，与窃取方竞争
+                if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                    x = nullptr;
+                }
+                bottom.store(b + 1, std::memory_order_relaxed);
+            }
+            return x;
+        }
+
+        task *steal() {
+            int64_t t = top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t b = bottom.load(std::memory_order_acquire);
+            if (t >= b) {
+                return nullptr;
+            }
+            array *a = items.load(std::memory_order_acquire);
+            task *x = a->get(t);
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                return nullptr;
+            }
+            return x;
+        }
+    };
+
+    //池外线程提交的任务，每个NUMA节点一个
+    struct alignas(mem_cache_line_size) injection_queue {
+        std::mutex mutex;
+        std::deque<task*> tasks;
+        std::atomic<size_t> size {0};
+    };
+
+    struct worker {
+        deque tasks;
+        size_t node;
+        size_t index;
+        std::thread thread;
+    };
+
+    std::vector<std::vector<int>> node_cpus;
+    std::vector<std::unique_ptr<injection_queue>> injected;
+    std::vector<std::unique_ptr<worker>> workers;
+    std::vector<std::vector<size_t>> node_workers;
+    std::atomic<size_t> next_node {0};
+    alignas(mem_cache_line_size) std::atomic<uint64_t> epoch {0};
+    std::atomic<size_t> sleepers {0};
+    std::atomic<size_t> pending {0};
+    std::atomic<bool> stopping {false};
+    std::mutex sleep_mutex;
+    std::condition_variable sleep_cv;
+
+    static inline thread_local worker *current = nullptr;
+    static inline thread_local mem_thread_pool *current_pool = nullptr;
+
+    //解析"0-3,8-11"形式的CPU列表
+    static std::vector<int> parse_cpu_list(std::string const& list) {
+        std::vector<int> cpus;
+        size_t i = 0;
+        while (i < list.size()) {
+            size_t comma = list.find(',', i);
+            std::string part = list.substr(i, comma == std::string::npos ? std::string::npos : comma - i);
+            size_t dash = part.find('-');
+            try {
+                int first = std::stoi(part.substr(0, dash));
+                int last = dash == std::string::npos ? first : std::stoi(part.substr(dash + 1));
+                for (int c = first; c <= last; ++c) {
+                    cpus.push_back(c);
+                }
+            } catch (std::exception const&) {
+            }
+            if (comma == std::string::npos) {
+                break;
+            }
+            i = comma + 1;
+        }
+        return cpus;
+    }
+
+    static std::vector<std::vector<int>> read_topology() {
+        std::vector<std::vector<int>> nodes;
+#ifdef __linux__
+        for (int n = 0;; ++n) {
+            std::ifstream in("/sys/devices/system/node/node" + std::to_string(n) + "/cpulist");
+            std::string list;
+            if (!in || !std::getline(in, list)) {
+                break;
+            }
+            auto cpus = parse_cpu_list(list);
+            if (!cpus.empty()) {
+                nodes.push_back(std::move(cpus));
+            }
+        }
+#endif
+        if (nodes.empty()) {
+            nodes.emplace_back();
+        }
+        return nodes;
+    }
+
+    void pin(worker& w) {
+#ifdef __linux__
+        if (node_cpus.size() > 1) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            for (int c : node_cpus[w.node]) {
+                if (c >= 0 && c < CPU_SETSIZE) {
+                    CPU_SET(c, &set);
+                }
+            }
+            //容器限制了可用CPU时绑定可能失败，此时不绑定
+            pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        }
+#else
+        (void) w;
+#endif
+    }
+
+    //提交后唤醒休眠的线程。epoch与sleepers的顺序一致读写保证：提交方看不到休眠者时，休眠者一定能看到新的epoch而不进入休眠
+    void wake(size_t n) {
+        epoch.fetch_add(1, std::memory_order_seq_cst);
+        if (sleepers.load(std::memory_order_seq_cst) > 0) {
+            std::lock_guard guard(sleep_mutex);
+            if (n == 1) {
+                sleep_cv.notify_one();
+            } else {
+                sleep_cv.notify_all();
+            }
+        }
+    }
+
+    void enqueue(task *const *tasks, size_t count, int node) {
+        if (count == 0) {
+            return;
+        }
+        pending.fetch_add(count, std::memory_order_relaxed);
+        worker *w = current_pool == this ? current : nullptr;
+        if (w != nullptr && (node < 0 || static_cast<size_t>(node) == w->node)) {
+            for (size_t i = 0; i < count; ++i) {
+                w->tasks.push(tasks[i]);
+            }
+        } else {
+            size_t n = node >= 0 && static_cast<size_t>(node) < injected.size() ? static_cast<size_t>(node)
+                                                                                 : next_node.fetch_add(1, std::memory_order_relaxed) % injected.size();
+            injection_queue& q = *injected[n];
+            std::lock_guard guard(q.mutex);
+            q.tasks.insert(q.tasks.end(), tasks, tasks + count);
+            q.size.store(q.tasks.size(), std::memory_order_release);
+        }
+        wake(count);
+    }
+
+    task *take_injected(size_t node) {
+        injection_queue& q = *injected[node];
+        if (q.size.load(std::memory_order_acquire) == 0) {
+            return nullptr;
+        }
+        std::lock_guard guard(q.mutex);
+        if (q.tasks.empty()) {
+            return nullptr;
+        }
+        task *t = q.tasks.front();
+        q.tasks.pop_front();
+        q.size.store(q.tasks.size(), std::memory_order_release);
+        return t;
+    }
+
+    task *steal_from(size_t node, size_t skip, size_t seed) {
+        auto const& members = node_workers[node];
+        for (size_t i = 0; i < members.size(); ++i) {
+            size_t k = members[(seed + i) % members.size()];
+            if (k != skip) {
+                if (task *t = workers[k]->tasks.steal()) {
+                    return t;
+                }
+            }
+        }
+        return nullptr;
+    }
+
+    //按亲和性由近到远查找任务
+    task *find(worker& w, size_t seed) {
+        size_t home = w.node;
+        if (task *t = w.tasks.pop()) {
+            return t;
+        }
+        if (task *t = take_injected(home)) {
+            return t;
+        }
+        if (task *t = steal_from(home, w.index, seed)) {
+            return t;
+        }
+        for (size_t i = 1; i < injected.size(); ++i) {
+            size_t n = (home + i) % injected.size();
+            if (task *t = take_injected(n)) {
+                return t;
+            }
+            if (task *t = steal_from(n, w.index, seed)) {
+                return t;
+            }
+        }
+        return nullptr;
+    }
+
+    //pending在任务执行完之后才减少，任务中提交的子任务先计入，析构时不会有线程提前退出
+    void execute(task *t) {
+        std::unique_ptr<task> owned(t);
+        if (t->group == nullptr) {
+            t->fn();
+        } else {
+            std::exception_ptr error;
+            try {
+                t->fn();
+            } catch (...) {
+                error = std::current_exception();
+            }
+            t->group->done(error);
+        }
+        pending.fetch_sub(1, std::memory_order_acq_rel);
+    }
+
+    void run(worker& w) {
+        current = &w;
+        current_pool = this;
+        pin(w);
+        size_t seed = w.index;
+        for (;;) {
+            task *t = nullptr;
+            for (int spin = 0; spin < 64 && t == nullptr; ++spin) {
+                t = find(w, seed++);
+                if (t == nullptr) {
+                    std::this_thread::yield();
+                }
+            }
+            if (t != nullptr) {
+                execute(t);
+                continue;
+            }
+            uint64_t e = epoch.load(std::memory_order_seq_cst);
+            if ((t = find(w, seed++)) != nullptr) {
+                execute(t);
+                continue;
+            }
+            std::unique_lock lock(sleep_mutex);
+            if (stopping.load(std::memory_order_acquire) && pending.load(std::memory_order_acquire) == 0) {
+                break;
+            }
+            sleepers.fetch_add(1, std::memory_order_seq_cst);
+            sleep_cv.wait(lock, [&] { return epoch.load(std::memory_order_seq_cst) != e || stopping.load(std::memory_order_acquire); });
+            sleepers.fetch_sub(1, std::memory_order_relaxed);
+        }
+        current = nullptr;
+        current_pool = nullptr;
+    }
+public:
+    //threads为0时使用std::thread::hardware_concurrency()个工作线程
+    explicit mem_thread_pool(size_t threads = 0) : node_cpus(read_topology()) {
+        if (threads == 0) {
+            threads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+        }
+        for (size_t n = 0; n < node_cpus.size(); ++n) {
+            injected.push_back(std::make_unique<injection_queue>());
+        }
+        node_workers.resize(node_cpus.size());
+        for (size_t i = 0; i < threads; ++i) {
+            auto w = std::make_unique<worker>();
+            w->node = i % node_cpus.size();
+            w->index = i;
+            node_workers[w->node].push_back(i);
+            workers.push_back(std::move(w));
+        }
+        for (auto& w : workers) {
+            w->thread = std::thread([this, p = w.get()] { run(*p); });
+        }
+    }
+
+    mem_thread_pool(mem_thread_pool const&) = delete;
+    mem_thread_pool& operator=(mem_thread_pool const&) = delete;
+
+    ~mem_thread_pool() {
+        {
+            std::lock_guard guard(sleep_mutex);
+            stopping.store(true, std::memory_order_release);
+        }
+        sleep_cv.notify_all();
+        for (auto& w : workers) {
+            w->thread.join();
+        }
+    }
+
+    //进程内共享的默认线程池，第一次使用时创建
+    static mem_thread_pool& global() {
+        static mem_thread_pool pool;
+        return pool;
+    }
+
+    size_t size() const {
+        return workers.size();
+    }
+
+    size_t nodes() const {
+        return node_cpus.size();
+    }
+
+    //当前线程是否为该池的工作线程
+    bool is_worker() const {
+        return current_pool == this;
+    }
+
+    /*
+     * 返回ptr所在页面的NUMA节点，页面尚未分配物理内存、不是Linux或查询失败时返回-1。
+     */
+    static int node_of(const void *ptr) {
+#if defined(__linux__) && defined(SYS_move_pages)
+        auto page = sysconf(_SC_PAGESIZE);
+        void *pages[1] = {reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(ptr) & ~static_cast<uintptr_t>(page - 1))};
+        int status[1] = {-1};
+        //nodes为空时move_pages只查询各页面所在的节点
+        if (syscall(SYS_move_pages, 0, 1UL, pages, nullptr, status, 0) == 0 && status[0] >= 0) {
+            return status[0];
+        }
+#else
+        (void) ptr;
+#endif
+        return -1;
+    }
+
+    //提交一个任务，node为优先执行的NUMA节点，-1表示不指定
+    void submit(std::function<void()> fn, int node = -1) {
+        task *t = new task {std::move(fn), nullptr};
+        enqueue(&t, 1, node);
+    }
+
+    void submit(mem_wait_group& group, std::function<void()> fn, int node = -1) {
+        group.add();
+        task *t = new task {std::move(fn), &group};
+        enqueue(&t, 1, node);
+    }
+
+    /*
+     * 批量提交count个任务fn(0)到fn(count - 1)，只加一次锁、唤醒一次。fn被每个任务拷贝一份。
+     */
+    template<typename F>
+    void submit_batch(mem_wait_group& group, size_t count, F const& fn, int node = -1) {
+        std::vector<task*> tasks;
+        tasks.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            tasks.push_back(new task {[fn, i] { fn(i); }, &group});
+        }
+        group.add(count);
+        enqueue(tasks.data(), tasks.size(), node);
+    }
+
+    /*
+     * 等待group中的任务完成。在工作线程中调用时先执行其他任务直到group完成，避免嵌套等待占满所有线程；池外线程直接阻塞。
+     */
+    void wait(mem_wait_group& group) {
+        if (current_pool == this) {
+            size_t seed = current->index;
+            while (!group.finished()) {
+                if (task *t = find(*current, seed++)) {
+                    execute(t);
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        }
+        group.wait();
+    }
+};
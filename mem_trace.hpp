@@ -0,0 +1,249 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string_view>
+#include <vector>
+#include "mem_dispatch.hpp"
+/*
+ * 缓冲生命周期追踪。定义宏BUFFER_DEBUG后，mem_buffer在创建、引用拷贝、引用释放、扩容、写时复制快照与释放内存时向当前线程的事件环写入一条二进制记录(时间戳、缓冲标识、
+ * 事件类型与大小)，不做格式化也不进行任何系统调用，对并发行为的干扰远小于直接输出。
+ *
+ * 每个线程一个事件环，只有所属线程写入，写满后覆盖最早的记录，环的容量由宏BUFFER_TRACE_CAPACITY指定(记录条数，需为2的幂，默认65536)。mem_trace::dump()将所有线程的事件环
+ * 写为二进制文件，可在运行中调用；mem_trace_to_chrome_json()离线将其转换为Chrome trace/Perfetto可以打开的JSON，每个缓冲的生命周期显示为一个异步区间，其余事件显示为区间内的
+ * 瞬时事件。
+ *
+ * 缓冲标识为控制块的地址，控制块释放后地址可能被新的缓冲复用，但同一地址上的两个生命周期在时间上不会重叠。时间戳在x86上为TSC，其余平台为steady_clock的纳秒数，dump()时
+ * 记录两组时钟的对应关系用于换算。线程退出后事件环仍保留在dump()的输出中，直到被之后新建的线程复用(此时清空并分配新的线程编号)，因此事件环的个数不超过同时存在过的
+ * 线程数的最大值。
+ */
+#ifndef BUFFER_TRACE_CAPACITY
+#define BUFFER_TRACE_CAPACITY 65536
+#endif
+
+enum class mem_trace_event : uint32_t {
+    create,      //size为容量
+    ref_copy,    //size为拷贝后的引用计数
+    ref_release, //size为释放后的引用计数
+    release,     //size为释放的容量
+    expand,      //size为新容量
+    separate,    //写时复制快照创建的控制块，与原控制块共享内存，size为容量
+    shrink,      //shrink_to_fit()或trim()缩小容量，size为新容量
+    unshare      //写入前复制与快照共享的内存，size为新容量
+};
+
+inline constexpr std::string_view mem_trace_event_name(mem_trace_event e) {
+    switch (e) {
+        case mem_trace_event::create: return "create";
+        case mem_trace_event::ref_copy: return "ref_copy";
+        case mem_trace_event::ref_release: return "ref_release";
+        case mem_trace_event::release: return "release";
+        case mem_trace_event::expand: return "expand";
+        case mem_trace_event::separate: return "separate";
+        case mem_trace_event::shrink: return "shrink";
+        case mem_trace_event::unshare: return "unshare";
+        default: return "unknown";
+    }
+}
+
+//dump()输出的一条记录
+struct mem_trace_record {
+    uint64_t timestamp;
+    uint64_t id;
+    uint64_t size;
+    uint64_t event;
+};
+
+class mem_trace {
+private:
+    static constexpr size_t capacity = BUFFER_TRACE_CAPACITY;
+    static_assert(std::has_single_bit(capacity), "BUFFER_TRACE_CAPACITY must be a power of 2");
+
+    /*
+     * 单生产者的事件环。记录的各个字段以relaxed原子变量保存，head在写完一条记录后以release递增；读取方在拷贝前后各读一次head，拷贝期间可能被覆盖的记录丢弃。
+     */
+    struct ring {
+        uint32_t tid;
+        std::atomic<uint64_t> head {0};
+        std::unique_ptr<std::atomic<uint64_t>[]> slots {new std::atomic<uint64_t>[capacity * 4]};
+    };
+
+    struct registry {
+        std::mutex mutex;
+        std::vector<ring*> rings;
+        //所属线程已退出、可以复用的事件环，仍在rings中
+        std::vector<ring*> idle;
+        uint32_t next_tid {1};
+        uint64_t start_timestamp = now();
+        uint64_t start_ns = steady_ns();
+    };
+
+    //线程退出时将事件环交给之后的线程复用
+    struct releaser {
+        ~releaser() {
+            if (local != nullptr) {
+                registry& r = reg();
+                std::lock_guard guard(r.mutex);
+                r.idle.push_back(local);
+                local = nullptr;
+            }
+        }
+    };
+
+    //注册表与事件环都不释放，静态对象析构期间仍可以记录
+    static registry& reg() {
+        static registry *r = new registry;
+        return *r;
+    }
+
+    static inline thread_local ring *local = nullptr;
+
+    static ring *attach() {
+        //线程退出过程中releaser析构之后再记录时重新取得的事件环不会被归还
+        static thread_local releaser release_on_exit;
+        (void) release_on_exit;
+        registry& r = reg();
+        std::lock_guard guard(r.mutex);
+        ring *s;
+        if (r.idle.empty()) {
+            s = new ring;
+            r.rings.push_back(s);
+        } else {
+            //复用的事件环不再有写入方，dump()也需要持有同一个锁，可以直接清空
+            s = r.idle.back();
+            r.idle.pop_back();
+            s->head.store(0, std::memory_order_relaxed);
+        }
+        s->tid = r.next_tid++;
+        local = s;
+        return s;
+    }
+
+    static uint64_t steady_ns() {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    static void put64(std::ostream& out, uint64_t v) {
+        out.write(reinterpret_cast<const char*>(&v), sizeof(v));
+    }
+public:
+    static constexpr char magic[8] = {'G', 'X', 'T', 'R', 'A', 'C', 'E', '1'};
+
+    static uint64_t now() {
+#ifdef MEM_SIMD_X86
+        return __rdtsc();
+#else
+        return steady_ns();
+#endif
+    }
+
+    static void record(mem_trace_event event, const void *id, uint64_t size) {
+        ring *r = local;
+        if (r == nullptr) {
+            r = attach();
+        }
+        uint64_t h = r->head.load(std::memory_order_relaxed);
+        std::atomic<uint64_t> *slot = &r->slots[(h & (capacity - 1)) * 4];
+        slot[0].store(now(), std::memory_order_relaxed);
+        slot[1].store(reinterpret_cast<uintptr_t>(id), std::memory_order_relaxed);
+        slot[2].store(size, std::memory_order_relaxed);
+        slot[3].store(static_cast<uint64_t>(event), std::memory_order_relaxed);
+        r->head.store(h + 1, std::memory_order_release);
+    }
+
+    /*
+     * 将所有事件环写入out(需以二进制方式打开)。格式：8字节魔数，起止时间戳与对应的steady_clock纳秒数共4个uint64_t，事件环个数(uint32_t)；每个事件环为线程编号(uint32_t)、
+     * 记录条数(uint64_t)以及按时间顺序排列的mem_trace_record。整数均为本机字节序。
+     */
+    static void dump(std::ostream& out) {
+        registry& g = reg();
+        std::lock_guard guard(g.mutex);
+        out.write(magic, sizeof(magic));
+        put64(out, g.start_timestamp);
+        put64(out, g.start_ns);
+        put64(out, now());
+        put64(out, steady_ns());
+        auto count = static_cast<uint32_t>(g.rings.size());
+        out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+        std::vector<mem_trace_record> records;
+        for (ring *r : g.rings) {
+            uint64_t end = r->head.load(std::memory_order_acquire);
+            uint64_t begin = end > capacity ? end - capacity : 0;
+            records.resize(end - begin);
+            for (uint64_t i = begin; i < end; ++i) {
+                std::atomic<uint64_t> *slot = &r->slots[(i & (capacity - 1)) * 4];
+                records[i - begin] = {slot[0].load(std::memory_order_relaxed), slot[1].load(std::memory_order_relaxed), slot[2].load(std::memory_order_relaxed),
+                                      slot[3].load(std::memory_order_relaxed)};
+            }
+            /*
+             * 拷贝期间所属线程可能继续写入并覆盖了最早的记录。head为after时第after条记录可能正在写入，它与第after - capacity条共用一个槽位，因此序号不大于after - capacity
+             * 的记录都可能不完整。fence保证上面对槽位的读取不会被重排到再次读取head之后。
+             */
+            std::atomic_thread_fence(std::memory_order_acquire);
+            uint64_t after = r->head.load(std::memory_order_relaxed);
+            size_t skip = after >= begin + capacity ? std::min<size_t>(after - capacity + 1 - begin, records.size()) : 0;
+            out.write(reinterpret_cast<const char*>(&r->tid), sizeof(r->tid));
+            put64(out, records.size() - skip);
+            out.write(reinterpret_cast<const char*>(records.data() + skip), static_cast<std::streamsize>((records.size() - skip) * sizeof(mem_trace_record)));
+        }
+    }
+};
+
+/*
+ * 将mem_trace::dump()的输出转换为Chrome trace JSON(Trace Event Format)。每个控制块对应一个以其地址为id的异步区间，从create或separate开始、到release结束；引用计数变化与扩容
+ * 为区间内的瞬时事件，size在args中。时间以微秒为单位，从追踪开始计算。输入格式不正确时返回false，此时out中可能已有部分输出。
+ */
+inline bool mem_trace_to_chrome_json(std::istream& in, std::ostream& out) {
+    char magic[8];
+    uint64_t clock[4];
+    uint32_t rings;
+    if (!in.read(magic, 8) || memcmp(magic, mem_trace::magic, 8) != 0 || !in.read(reinterpret_cast<char*>(clock), sizeof(clock)) ||
+        !in.read(reinterpret_cast<char*>(&rings), sizeof(rings))) {
+        return false;
+    }
+    uint64_t start = clock[0];
+    double us_per_tick = clock[2] > clock[0] ? static_cast<double>(clock[3] - clock[1]) / static_cast<double>(clock[2] - clock[0]) / 1000.0 : 0.001;
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    bool first = true;
+    auto begin_event = [&] {
+        out << (first ? "\n" : ",\n");
+        first = false;
+    };
+    for (uint32_t r = 0; r < rings; ++r) {
+        uint32_t tid;
+        uint64_t count;
+        if (!in.read(reinterpret_cast<char*>(&tid), sizeof(tid)) || !in.read(reinterpret_cast<char*>(&count), sizeof(count))) {
+            return false;
+        }
+        begin_event();
+        out << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << tid << ",\"args\":{\"name\":\"thread " << tid << "\"}}";
+        for (uint64_t i = 0; i < count; ++i) {
+            mem_trace_record rec;
+            if (!in.read(reinterpret_cast<char*>(&rec), sizeof(rec))) {
+                return false;
+            }
+            auto event = static_cast<mem_trace_event>(rec.event);
+            double ts = rec.timestamp >= start ? static_cast<double>(rec.timestamp - start) * us_per_tick : 0;
+            //写时复制快照的控制块从separate开始自己的生命周期
+            bool begins = event == mem_trace_event::create || event == mem_trace_event::separate;
+            const char *phase = begins ? "b" : event == mem_trace_event::release ? "e" : "n";
+            char id[24];
+            snprintf(id, sizeof(id), "0x%llx", static_cast<unsigned long long>(rec.id));
+            begin_event();
+            out << "{\"ph\":\"" << phase << "\",\"cat\":\"mem_buffer\",\"name\":\"" << (*phase == 'n' ? mem_trace_event_name(event) : "buffer")
+                << "\",\"id\":\"" << id << "\",\"pid\":1,\"tid\":" << tid << ",\"ts\":" << std::fixed << ts << ",\"args\":{\"event\":\""
+                << mem_trace_event_name(event) << "\",\"size\":" << rec.size << "}}";
+        }
+    }
+    out << "\n]}\n";
+    return true;
+}
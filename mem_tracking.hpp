@@ -0,0 +1,170 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <source_location>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "mem_utils.hpp"
+/*
+ * 用于测试的分配跟踪分配器。mem_tracking_allocator<Base>将申请与释放转发给Base，同时记录每块仍未释放的内存的大小与申请位置，在以下情况下报告错误：
+ *
+ * 1. release的size与alloc时的size不一致。按大小分级的分配器依赖该值定位空闲链表，不一致会破坏其内部结构；
+ * 2. release的指针不是由该分配器申请或已经释放(重复释放)；
+ * 3. 进程退出时仍有未释放的内存(泄漏)，逐条列出申请位置。
+ *
+ * 申请与释放的位置通过std::source_location取得，即调用Allocator::alloc/release的函数(如mem_buffer::reallocate)，可区分构造、重新分配(扩容与缩小)、写时复制分离与析构各条路径。
+ * 不转发Base的resize与decommit，重新分配总是经过alloc/release以便记录。
+ *
+ * 默认的错误处理将信息写到stderr后调用std::abort()，测试中可以通过set_failure_handler()替换为记录或抛出异常的处理函数(在析构函数中抛出会导致std::terminate)。
+ * 对齐字节数与Base相同。每种Base各自有一份记录，所有函数都是线程安全的。该分配器每次操作都要加锁查表，只应在测试与调试中使用。
+ */
+template<typename Base = mem_heap_allocator>
+class mem_tracking_allocator {
+public:
+    using failure_handler = void(*)(std::string const& message);
+private:
+    struct record {
+        size_t size;
+        std::source_location where;
+    };
+
+    struct state {
+        std::mutex mutex;
+        std::unordered_map<void*, record> live;
+        size_t live_bytes {0};
+        size_t allocs {0};
+        size_t releases {0};
+        failure_handler handler {default_handler};
+    };
+
+    //退出时检查泄漏。第一次申请时才构造，因此先于它构造完成的静态缓冲都已在它析构之前析构
+    struct leak_checker {
+        ~leak_checker() {
+            check_leaks();
+        }
+    };
+
+    //状态不释放，静态对象析构期间仍可以使用
+    static state& get() {
+        static state *s = new state;
+        return *s;
+    }
+
+    static void default_handler(std::string const& message) {
+        fprintf(stderr, "mem_tracking_allocator: %s\n", message.c_str());
+        std::abort();
+    }
+
+    static std::string location(std::source_location const& where) {
+        return std::format("{}:{} ({})", where.file_name(), where.line(), where.function_name());
+    }
+
+    static void fail(state& s, std::unique_lock<std::mutex>& lock, std::string const& message) {
+        failure_handler handler = s.handler;
+        lock.unlock();
+        handler(message);
+    }
+public:
+    static constexpr size_t alignment = mem_allocator_alignment<Base>;
+    static constexpr bool zero_filled = mem_allocator_zero_filled<Base>;
+
+    static void *alloc(size_t size, std::source_location where = std::source_location::current()) {
+        static leak_checker checker;
+        void *ptr = Base::alloc(size);
+        if (ptr == nullptr) {
+            return ptr;
+        }
+        state& s = get();
+        std::unique_lock lock(s.mutex);
+        auto [it, inserted] = s.live.try_emplace(ptr, record {size, where});
+        if (!inserted) {
+            //Base返回了一块仍被占用的内存
+            record old = it->second;
+            it->second = {size, where};
+            s.live_bytes += size - old.size;
+            fail(s, lock, std::format("{} returned live block {} ({} bytes from {}) again for {}", typeid(Base).name(), ptr, old.size, location(old.where),
+                                      location(where)));
+            return ptr;
+        }
+        s.live_bytes += size;
+        ++s.allocs;
+        return ptr;
+    }
+
+    static void release(void *ptr, size_t size, std::source_location where = std::source_location::current()) {
+        state& s = get();
+        std::unique_lock lock(s.mutex);
+        auto it = s.live.find(ptr);
+        if (it == s.live.end()) {
+            fail(s, lock, std::format("release of {} ({} bytes) at {} which is not allocated or already released", ptr, size, location(where)));
+            return;
+        }
+        record r = it->second;
+        s.live.erase(it);
+        s.live_bytes -= r.size;
+        ++s.releases;
+        if (r.size != size) {
+            //仍按申请时的大小归还，避免错误继续扩散到Base
+            lock.unlock();
+            Base::release(ptr, r.size);
+            lock.lock();
+            fail(s, lock, std::format("size mismatch for {}: allocated {} bytes at {}, released as {} bytes at {}", ptr, r.size, location(r.where), size, location(where)));
+            return;
+        }
+        lock.unlock();
+        Base::release(ptr, size);
+    }
+
+    //仍未释放的块数与字节数
+    static size_t live_count() {
+        state& s = get();
+        std::lock_guard guard(s.mutex);
+        return s.live.size();
+    }
+
+    static size_t live_bytes() {
+        state& s = get();
+        std::lock_guard guard(s.mutex);
+        return s.live_bytes;
+    }
+
+    //累计成功申请与释放的次数
+    static size_t alloc_count() {
+        state& s = get();
+        std::lock_guard guard(s.mutex);
+        return s.allocs;
+    }
+
+    static size_t release_count() {
+        state& s = get();
+        std::lock_guard guard(s.mutex);
+        return s.releases;
+    }
+
+    /*
+     * 对每块未释放的内存报告一次错误，返回其块数。进程退出时自动调用一次，测试中也可以在确认所有缓冲都已析构的位置主动调用。
+     */
+    static size_t check_leaks() {
+        state& s = get();
+        std::unique_lock lock(s.mutex);
+        std::vector<std::pair<void*, record>> leaks(s.live.begin(), s.live.end());
+        lock.unlock();
+        for (auto const& [ptr, r] : leaks) {
+            lock.lock();
+            fail(s, lock, std::format("leaked {} bytes at {} allocated at {}", r.size, ptr, location(r.where)));
+        }
+        return leaks.size();
+    }
+
+    //替换错误处理函数，返回原来的处理函数
+    static failure_handler set_failure_handler(failure_handler handler) {
+        state& s = get();
+        std::lock_guard guard(s.mutex);
+        failure_handler old = s.handler;
+        s.handler = handler;
+        return old;
+    }
+};
@@ -0,0 +1,878 @@
+#pragma once
+
+#include "mem_utils.hpp"
+/*
+ * UTF-8校验以及UTF-8与UTF-16/UTF-32之间的批量转码，用于在char8_stream、char16_stream与char32_stream之间转换。
+ *
+ * UTF-8校验使用Keiser与Lemire的查表算法(simdjson/simdutf中的lookup4)，每次处理16(SSSE3)或32(AVX2)个字节；转码对纯ASCII的数据段直接用SIMD零扩展或打包，多字节的数据段
+ * 用simdutf式的重排表成组转码，只有UTF-16转UTF-8时代理对附近逐码点处理。所有内核都有标量实现，并通过mem_dispatch按CPU档位在运行时选择。UTF-16与UTF-32均为本机字节序。
+ */
+
+inline bool mem_utf8_validate_scalar(const char *data, size_t len) {
+    auto *s = reinterpret_cast<const uint8_t*>(data);
+    size_t i = 0;
+    while (i < len) {
+        uint8_t b = s[i];
+        if (b < 0x80) {
+            ++i;
+            continue;
+        }
+        size_t n;
+        uint8_t lo = 0x80, hi = 0xbf;
+        if (b >= 0xc2 && b <= 0xdf) {
+            n = 2;
+        } else if (b >= 0xe0 && b <= 0xef) {
+            n = 3;
+            lo = b == 0xe0 ? 0xa0 : 0x80;
+            hi = b == 0xed ? 0x9f : 0xbf;
+        } else if (b >= 0xf0 && b <= 0xf4) {
+            n = 4;
+            lo = b == 0xf0 ? 0x90 : 0x80;
+            hi = b == 0xf4 ? 0x8f : 0xbf;
+        } else {
+            return false;
+        }
+        if (len - i < n || s[i + 1] < lo || s[i + 1] > hi) {
+            return false;
+        }
+        for (size_t k = 2; k < n; ++k) {
+            if ((s[i + k] & 0xc0) != 0x80) {
+                return false;
+            }
+        }
+        i += n;
+    }
+    return true;
+}
+
+#ifdef MEM_SIMD_X86
+/*
+ * lookup4算法的查找表。每个字节与其前一个字节的高4位、前一个字节的低4位、自身的高4位分别查表，三者按位与后非0即为错误；三、四字节序列中第三、四个字节的续字节
+ * 由must_be_2_3_continuation单独检查。
+ */
+struct mem_utf8_tables {
+    static constexpr uint8_t too_short = 1 << 0;
+    static constexpr uint8_t too_long = 1 << 1;
+    static constexpr uint8_t overlong_3 = 1 << 2;
+    static constexpr uint8_t too_large = 1 << 3;
+    static constexpr uint8_t surrogate = 1 << 4;
+    static constexpr uint8_t overlong_2 = 1 << 5;
+    static constexpr uint8_t too_large_1000 = 1 << 6;
+    static constexpr uint8_t overlong_4 = 1 << 6;
+    static constexpr uint8_t two_conts = 1 << 7;
+    static constexpr uint8_t carry = too_short | too_long | two_conts;
+
+    static constexpr std::array<uint8_t, 16> byte_1_high {
+        too_long, too_long, too_long, too_long, too_long, too_long, too_long, too_long,
+        two_conts, two_conts, two_conts, two_conts,
+        too_short | overlong_2,
+        too_short,
+        too_short | overlong_3 | surrogate,
+        too_short | too_large | too_large_1000 | overlong_4
+    };
+    static constexpr std::array<uint8_t, 16> byte_1_low {
+        carry | overlong_3 | overlong_2 | overlong_4,
+        carry | overlong_2,
+        carry,
+        carry,
+        carry | too_large,
+        carry | too_large | too_large_1000,
+        carry | too_large | too_large_1000,
+        carry | too_large | too_large_1000,
+        carry | too_large | too_large_1000,
+        carry | too_large | too_large_1000,
+        carry | too_large | too_large_1000,
+        carry | too_large | too_large_1000,
+        carry | too_large | too_large_1000,
+        carry | too_large | too_large_1000 | surrogate,
+        carry | too_large | too_large_1000,
+        carry | too_large | too_large_1000
+    };
+    static constexpr std::array<uint8_t, 16> byte_2_high {
+        too_short, too_short, too_short, too_short, too_short, too_short, too_short, too_short,
+        too_long | overlong_2 | two_conts | overlong_3 | too_large_1000 | overlong_4,
+        too_long | overlong_2 | two_conts | overlong_3 | too_large,
+        too_long | overlong_2 | two_conts | surrogate | too_large,
+        too_long | overlong_2 | two_conts | surrogate | too_large,
+        too_short, too_short, too_short, too_short
+    };
+    //块末尾的字节若不小于对应值，说明多字节序列被截断，需要下一块补全
+    static constexpr std::array<uint8_t, 32> incomplete_max = [] {
+        std::array<uint8_t, 32> max {};
+        max.fill(0xff);
+        max[29] = 0xf0 - 1;
+        max[30] = 0xe0 - 1;
+        max[31] = 0xc0 - 1;
+        return max;
+    }();
+};
+
+MEM_TARGET("ssse3") inline __m128i mem_utf8_load_table(std::array<uint8_t, 16> const& table) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(table.data()));
+}
+
+MEM_TARGET("ssse3") inline bool mem_utf8_validate_ssse3(const char *data, size_t len) {
+    using t = mem_utf8_tables;
+    const __m128i b1h = mem_utf8_load_table(t::byte_1_high), b1l = mem_utf8_load_table(t::byte_1_low), b2h = mem_utf8_load_table(t::byte_2_high);
+    const __m128i low_nibble = _mm_set1_epi8(0x0f);
+    const __m128i max = _mm_loadu_si128(reinterpret_cast<const __m128i*>(t::incomplete_max.data() + 16));
+    __m128i error = _mm_setzero_si128(), prev = _mm_setzero_si128(), prev_incomplete = _mm_setzero_si128();
+    char tail[16] {};
+    for (size_t i = 0; i < len; i += 16) {
+        const char *block = data + i;
+        if (len - i < 16) {
+            //末尾不足一块时补0，补上的0不会引入错误
+            memcpy(tail, block, len - i);
+            block = tail;
+        }
+        __m128i input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block));
+        if (_mm_movemask_epi8(input) == 0) {
+            error = _mm_or_si128(error, prev_incomplete);
+            prev_incomplete = _mm_setzero_si128();
+        } else {
+            __m128i prev1 = _mm_alignr_epi8(input, prev, 15);
+            __m128i sc = _mm_and_si128(_mm_and_si128(
+                _mm_shuffle_epi8(b1h, _mm_and_si128(_mm_srli_epi16(prev1, 4), low_nibble)),
+                _mm_shuffle_epi8(b1l, _mm_and_si128(prev1, low_nibble))),
+                _mm_shuffle_epi8(b2h, _mm_and_si128(_mm_srli_epi16(input, 4), low_nibble)));
+            __m128i prev2 = _mm_alignr_epi8(input, prev, 14), prev3 = _mm_alignr_epi8(input, prev, 13);
+            __m128i must23 = _mm_or_si128(_mm_subs_epu8(prev2, _mm_set1_epi8(static_cast<char>(0xe0 - 0x80))), _mm_subs_epu8(prev3, _mm_set1_epi8(static_cast<char>(0xf0 - 0x80))));
+            //只有111_____减去0x60后不小于0x80，即三、四字节序列的第三、四个字节必须是续字节
+            __m128i must23_80 = _mm_and_si128(must23, _mm_set1_epi8(static_cast<char>(0x80)));
+            error = _mm_or_si128(error, _mm_xor_si128(must23_80, sc));
+            prev_incomplete = _mm_subs_epu8(input, max);
+        }
+        prev = input;
+    }
+    error = _mm_or_si128(error, prev_incomplete);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(error, _mm_setzero_si128())) == 0xffff;
+}
+
+MEM_TARGET("avx2") inline __m256i mem_utf8_load_table256(std::array<uint8_t, 16> const& table) {
+    return _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(table.data())));
+}
+
+//取input拼接在prev之后再右移N个字节的结果，即每个字节前面第N个字节
+template<int N>
+MEM_TARGET("avx2") inline __m256i mem_utf8_prev(__m256i input, __m256i prev) {
+    return _mm256_alignr_epi8(input, _mm256_permute2x128_si256(prev, input, 0x21), 16 - N);
+}
+
+MEM_TARGET("avx2") inline bool mem_utf8_validate_avx2(const char *data, size_t len) {
+    using t = mem_utf8_tables;
+    const __m256i b1h = mem_utf8_load_table256(t::byte_1_high), b1l = mem_utf8_load_table256(t::byte_1_low), b2h = mem_utf8_load_table256(t::byte_2_high);
+    const __m256i low_nibble = _mm256_set1_epi8(0x0f);
+    const __m256i max = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(t::incomplete_max.data()));
+    __m256i error = _mm256_setzero_si256(), prev = _mm256_setzero_si256(), prev_incomplete = _mm256_setzero_si256();
+    char tail[32] {};
+    for (size_t i = 0; i < len; i += 32) {
+        const char *block = data + i;
+        if (len - i < 32) {
+            //末尾不足一块时补0，补上的0不会引入错误
+            memcpy(tail, block, len - i);
+            block = tail;
+        }
+        __m256i input = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block));
+        if (_mm256_movemask_epi8(input) == 0) {
+            error = _mm256_or_si256(error, prev_incomplete);
+            prev_incomplete = _mm256_setzero_si256();
+        } else {
+            __m256i prev1 = mem_utf8_prev<1>(input, prev);
+            __m256i sc = _mm256_and_si256(_mm256_and_si256(
+                _mm256_shuffle_epi8(b1h, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), low_nibble)),
+                _mm256_shuffle_epi8(b1l, _mm256_and_si256(prev1, low_nibble))),
+                _mm256_shuffle_epi8(b2h, _mm256_and_si256(_mm256_srli_epi16(input, 4), low_nibble)));
+            __m256i prev2 = mem_utf8_prev<2>(input, prev), prev3 = mem_utf8_prev<3>(input, prev);
+            __m256i must23 = _mm256_or_si256(_mm256_subs_epu8(prev2, _mm256_set1_epi8(static_cast<char>(0xe0 - 0x80))), _mm256_subs_epu8(prev3, _mm256_set1_epi8(static_cast<char>(0xf0 - 0x80))));
+            __m256i must23_80 = _mm256_and_si256(must23, _mm256_set1_epi8(static_cast<char>(0x80)));
+            error = _mm256_or_si256(error, _mm256_xor_si256(must23_80, sc));
+            prev_incomplete = _mm256_subs_epu8(input, max);
+        }
+        prev = input;
+    }
+    error = _mm256_or_si256(error, prev_incomplete);
+    return _mm256_testz_si256(error, error) != 0;
+}
+#endif
+
+struct mem_utf8_validate_kernel {
+    using type = bool(const char*, size_t);
+
+    static type *resolve(mem_isa isa) {
+#ifdef MEM_SIMD_X86
+        if (isa >= mem_isa::avx2) {
+            return mem_utf8_validate_avx2;
+        }
+        if (isa >= mem_isa::ssse3) {
+            return mem_utf8_validate_ssse3;
+        }
+#endif
+        return mem_utf8_validate_scalar;
+    }
+};
+
+inline bool mem_utf8_validate(const char *data, size_t len) {
+    return mem_dispatch<mem_utf8_validate_kernel>::call(data, len);
+}
+
+/*
+ * 转码后的长度(以目标编码单元计)。UTF-8输入需已通过校验。
+ */
+inline size_t mem_utf8_length_from_utf8_lead(const char *data, size_t len, bool count_four_byte_twice) {
+    size_t n = 0;
+    for (size_t i = 0; i < len; ++i) {
+        auto b = static_cast<uint8_t>(data[i]);
+        n += (b & 0xc0) != 0x80;
+        n += count_four_byte_twice && b >= 0xf0;
+    }
+    return n;
+}
+
+inline size_t mem_utf16_length_from_utf8(const char *data, size_t len) {
+    return mem_utf8_length_from_utf8_lead(data, len, true);
+}
+
+inline size_t mem_utf32_length_from_utf8(const char *data, size_t len) {
+    return mem_utf8_length_from_utf8_lead(data, len, false);
+}
+
+//按字节地址读写第i个编码单元，地址不必按Unit对齐
+template<typename Unit>
+inline Unit mem_utf_load(const char *src, size_t i) {
+    Unit c;
+    memcpy(&c, src + i * sizeof(Unit), sizeof(Unit));
+    return c;
+}
+
+template<typename Unit>
+inline void mem_utf_store(char *dst, size_t i, Unit c) {
+    memcpy(dst + i * sizeof(Unit), &c, sizeof(Unit));
+}
+
+/*
+ * data起len个Unit转UTF-8后的字节数，data不必按Unit对齐。UTF-16遇到不成对的代理项、UTF-32遇到代理项或超出U+10FFFF的码点时返回mem_npos。
+ */
+template<typename Unit>
+inline size_t mem_utf8_length_from_wide(const char *data, size_t len) {
+    size_t n = 0;
+    for (size_t i = 0; i < len; ++i) {
+        char32_t c = mem_utf_load<Unit>(data, i);
+        if constexpr (sizeof(Unit) == 2) {
+            if (c < 0x80) {
+                n += 1;
+            } else if (c < 0x800) {
+                n += 2;
+            } else if (c >= 0xd800 && c <= 0xdbff) {
+                if (i + 1 >= len) {
+                    return mem_npos;
+                }
+                char32_t next = mem_utf_load<Unit>(data, i + 1);
+                if (next < 0xdc00 || next > 0xdfff) {
+                    return mem_npos;
+                }
+                n += 4;
+                ++i;
+            } else if (c >= 0xdc00 && c <= 0xdfff) {
+                return mem_npos;
+            } else {
+                n += 3;
+            }
+        } else {
+            if (c > 0x10ffff || (c >= 0xd800 && c <= 0xdfff)) {
+                return mem_npos;
+            }
+            n += c < 0x80 ? 1 : c < 0x800 ? 2 : c < 0x10000 ? 3 : 4;
+        }
+    }
+    return n;
+}
+
+inline size_t mem_utf8_length_from_utf16(const char16_t *data, size_t len) {
+    return mem_utf8_length_from_wide<char16_t>(reinterpret_cast<const char*>(data), len);
+}
+
+inline size_t mem_utf8_length_from_utf32(const char32_t *data, size_t len) {
+    return mem_utf8_length_from_wide<char32_t>(reinterpret_cast<const char*>(data), len);
+}
+
+//解码src[i]开始的一个码点(输入需已通过校验)，i前进到下一个码点
+inline char32_t mem_utf8_decode_one(const uint8_t *s, size_t& i) {
+    uint8_t b = s[i];
+    if (b < 0x80) {
+        i += 1;
+        return b;
+    }
+    if (b < 0xe0) {
+        char32_t c = (b & 0x1fu) << 6 | (s[i + 1] & 0x3fu);
+        i += 2;
+        return c;
+    }
+    if (b < 0xf0) {
+        char32_t c = (b & 0x0fu) << 12 | (s[i + 1] & 0x3fu) << 6 | (s[i + 2] & 0x3fu);
+        i += 3;
+        return c;
+    }
+    char32_t c = (b & 0x07u) << 18 | (s[i + 1] & 0x3fu) << 12 | (s[i + 2] & 0x3fu) << 6 | (s[i + 3] & 0x3fu);
+    i += 4;
+    return c;
+}
+
+inline size_t mem_utf8_encode_one(char32_t c, char *dst) {
+    if (c < 0x80) {
+        dst[0] = static_cast<char>(c);
+        return 1;
+    }
+    if (c < 0x800) {
+        dst[0] = static_cast<char>(0xc0 | c >> 6);
+        dst[1] = static_cast<char>(0x80 | (c & 0x3f));
+        return 2;
+    }
+    if (c < 0x10000) {
+        dst[0] = static_cast<char>(0xe0 | c >> 12);
+        dst[1] = static_cast<char>(0x80 | (c >> 6 & 0x3f));
+        dst[2] = static_cast<char>(0x80 | (c & 0x3f));
+        return 3;
+    }
+    dst[0] = static_cast<char>(0xf0 | c >> 18);
+    dst[1] = static_cast<char>(0x80 | (c >> 12 & 0x3f));
+    dst[2] = static_cast<char>(0x80 | (c >> 6 & 0x3f));
+    dst[3] = static_cast<char>(0x80 | (c & 0x3f));
+    return 4;
+}
+
+//标量地转码一个码点，UTF-16时码点不小于U+10000写出代理对
+template<typename Unit>
+[[gnu::always_inline]] inline void mem_utf_store_code_point(char *dst, size_t& n, char32_t c) {
+    if (sizeof(Unit) == 2 && c >= 0x10000) {
+        c -= 0x10000;
+        mem_utf_store<Unit>(dst, n++, static_cast<Unit>(0xd800 + (c >> 10)));
+        mem_utf_store<Unit>(dst, n++, static_cast<Unit>(0xdc00 + (c & 0x3ff)));
+    } else {
+        mem_utf_store<Unit>(dst, n++, static_cast<Unit>(c));
+    }
+}
+
+#ifdef MEM_SIMD_X86
+/*
+ * UTF-8转UTF-16/UTF-32的重排表(simdutf的做法)，以16个字节中前12个字节的码点结束掩码为下标，第i位为1表示第i个字节是一个码点的最后一个字节。前6个码点都不超过2字节时
+ * units为6，shuffle把第k个码点的末字节与首字节放到第k个16位通道的低、高字节；否则前4个码点都不超过3字节时units为4，再否则为3(12个字节中总能放下3个码点)，第k个码点的
+ * 字节从后到前放到第k个32位通道的低位起。consumed为这些码点占用的字节数。
+ */
+struct mem_utf8_decode_entry {
+    std::array<char, 16> shuffle;
+    uint8_t units;
+    uint8_t consumed;
+};
+
+inline constexpr std::array<mem_utf8_decode_entry, 4096> mem_utf8_decode_table = [] {
+    std::array<mem_utf8_decode_entry, 4096> table {};
+    for (unsigned mask = 0; mask < 4096; ++mask) {
+        auto& entry = table[mask];
+        entry.shuffle.fill(static_cast<char>(0x80));
+        unsigned ends[12] {}, lens[12] {}, count = 0, start = 0;
+        for (unsigned i = 0; i < 12; ++i) {
+            if ((mask >> i & 1) != 0) {
+                ends[count] = i;
+                lens[count++] = i + 1 - start;
+                start = i + 1;
+            }
+        }
+        bool two = count >= 6, three = count >= 4, four = count >= 3;
+        for (unsigned k = 0; k < count; ++k) {
+            two = two && (k >= 6 || lens[k] <= 2);
+            three = three && (k >= 4 || lens[k] <= 3);
+            four = four && (k >= 3 || lens[k] <= 4);
+        }
+        //合法输入的掩码中前3个码点都能取出，不可能出现的掩码保持consumed为0
+        unsigned units = two ? 6 : three ? 4 : four ? 3 : 0, width = two ? 2 : 4;
+        for (unsigned k = 0; k < units; ++k) {
+            for (unsigned b = 0; b < lens[k]; ++b) {
+                entry.shuffle[k * width + b] = static_cast<char>(ends[k] - b);
+            }
+        }
+        entry.units = static_cast<uint8_t>(units);
+        entry.consumed = static_cast<uint8_t>(units == 0 ? 0 : ends[units - 1] + 1);
+    }
+    return table;
+}();
+
+//把4个32位通道压缩成UTF-16的重排表，以代理对通道的掩码为下标，普通通道取低16位，代理对通道取全部32位
+inline constexpr std::array<std::array<char, 16>, 16> mem_utf16_pack_table = [] {
+    std::array<std::array<char, 16>, 16> table {};
+    for (unsigned mask = 0; mask < 16; ++mask) {
+        table[mask].fill(static_cast<char>(0x80));
+        unsigned n = 0;
+        for (unsigned k = 0; k < 4; ++k) {
+            for (unsigned b = 0; b < ((mask >> k & 1) != 0 ? 4u : 2u); ++b) {
+                table[mask][n++] = static_cast<char>(k * 4 + b);
+            }
+        }
+    }
+    return table;
+}();
+
+/*
+ * 64个字节的两个掩码：high中第i位为1表示第i个字节不是ASCII，ends中第i位为1表示第i个字节是一个码点的最后一个字节(即下一个字节不是续字节)，因此会读取s[64]。
+ */
+inline void mem_utf8_block_masks(const uint8_t *s, uint64_t& high, uint64_t& ends) {
+    uint64_t starts = 0;
+    high = 0;
+    for (int q = 0; q < 4; ++q) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + q * 16));
+        high |= static_cast<uint64_t>(static_cast<unsigned>(_mm_movemask_epi8(v))) << (q * 16);
+        //非续字节有符号比较大于0xbf
+        starts |= static_cast<uint64_t>(static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpgt_epi8(v, _mm_set1_epi8(static_cast<char>(0xbf)))))) << (q * 16);
+    }
+    ends = starts >> 1 | static_cast<uint64_t>((s[64] & 0xc0) != 0x80) << 63;
+}
+
+//将16个ASCII字节零扩展为UTF-16/UTF-32写入out
+template<typename Unit>
+inline void mem_utf8_widen16(const uint8_t *s, char *out) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s));
+    __m128i lo = _mm_unpacklo_epi8(v, zero), hi = _mm_unpackhi_epi8(v, zero);
+    if constexpr (sizeof(Unit) == 2) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), lo);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 16), hi);
+    } else {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_unpacklo_epi16(lo, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 16), _mm_unpackhi_epi16(lo, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 32), _mm_unpacklo_epi16(hi, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 48), _mm_unpackhi_epi16(hi, zero));
+    }
+}
+
+/*
+ * 按重排表转码s开头的6、4或3个码点写入dst，key为从s开始的12位码点结束掩码，units为写出的编码单元数，返回消耗的字节数。dst总是写入16(UTF-32且6个码点时32)字节，
+ * 调用方需保证这些空间之后会被覆盖或在dst范围内。
+ */
+template<typename Unit>
+MEM_TARGET("ssse3") inline size_t mem_utf8_decode_step(const uint8_t *s, unsigned key, char *dst, size_t& units) {
+    __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s));
+    auto const& entry = mem_utf8_decode_table[key];
+    __m128i v = _mm_shuffle_epi8(in, _mm_loadu_si128(reinterpret_cast<const __m128i*>(entry.shuffle.data())));
+    if (entry.units == 6) {
+        //16位通道：(末字节 & 0x7f) | (首字节 & 0x1f) << 6，单字节码点的高字节为0
+        __m128i r = _mm_or_si128(_mm_and_si128(v, _mm_set1_epi16(0x7f)), _mm_srli_epi16(_mm_and_si128(v, _mm_set1_epi16(0x1f00)), 2));
+        if constexpr (sizeof(Unit) == 2) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), r);
+        } else {
+            const __m128i zero = _mm_setzero_si128();
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_unpacklo_epi16(r, zero));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 16), _mm_unpackhi_epi16(r, zero));
+        }
+        units = 6;
+        return entry.consumed;
+    }
+    //32位通道：按高4位查出每个字节的有效位(首字节0x7f/0x1f/0x0f/0x07，续字节0x3f)，再按6位一组合并
+    const __m128i bits = _mm_setr_epi8(0x7f, 0x7f, 0x7f, 0x7f, 0x7f, 0x7f, 0x7f, 0x7f, 0x3f, 0x3f, 0x3f, 0x3f, 0x1f, 0x1f, 0x0f, 0x07);
+    v = _mm_and_si128(v, _mm_shuffle_epi8(bits, _mm_and_si128(_mm_srli_epi16(v, 4), _mm_set1_epi8(0x0f))));
+    __m128i r = _mm_madd_epi16(_mm_maddubs_epi16(v, _mm_set1_epi16(0x4001)), _mm_set1_epi32(0x10000001));
+    if constexpr (sizeof(Unit) == 2) {
+        //BMP之外的码点在通道内换成代理对(高代理在低16位)，再按通道是否为代理对取出1个或2个16位单元
+        __m128i supplementary = _mm_cmpgt_epi32(r, _mm_set1_epi32(0xffff));
+        auto mask = static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(supplementary)));
+        if (mask != 0) {
+            __m128i c = _mm_sub_epi32(r, _mm_set1_epi32(0x10000));
+            __m128i pair = _mm_or_si128(_mm_add_epi32(_mm_srli_epi32(c, 10), _mm_set1_epi32(0xd800)),
+                                        _mm_slli_epi32(_mm_add_epi32(_mm_and_si128(c, _mm_set1_epi32(0x3ff)), _mm_set1_epi32(0xdc00)), 16));
+            r = _mm_or_si128(_mm_and_si128(supplementary, pair), _mm_andnot_si128(supplementary, r));
+        }
+        auto const& pack = mem_utf16_pack_table[mask];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_shuffle_epi8(r, _mm_loadu_si128(reinterpret_cast<const __m128i*>(pack.data()))));
+        units = entry.units + static_cast<size_t>(__builtin_popcount(mask));
+    } else {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), r);
+        units = entry.units;
+    }
+    return entry.consumed;
+}
+
+/*
+ * UTF-16/UTF-32转UTF-8的压缩表。每个32位通道中码点的编码长度为1~4字节，"不小于0x80"、"不小于0x800"、"不小于0x10000"的掩码m1、m2、m3逐通道只有4种组合，以
+ * (m1 ^ m2 ^ m3) | m2 << 4为下标即可区分。每个通道按编码从低位起存放，shuffle把各通道实际使用的字节依次取出，len为总字节数。
+ */
+struct mem_utf8_encode_entry {
+    std::array<char, 16> shuffle;
+    uint8_t len;
+};
+
+inline constexpr std::array<mem_utf8_encode_entry, 256> mem_utf8_encode_table = [] {
+    std::array<mem_utf8_encode_entry, 256> table {};
+    for (unsigned key = 0; key < 256; ++key) {
+        auto& entry = table[key];
+        entry.shuffle.fill(static_cast<char>(0x80));
+        for (unsigned k = 0; k < 4; ++k) {
+            unsigned n = 1 + (key >> k & 1) + 2 * (key >> (k + 4) & 1);
+            for (unsigned b = 0; b < n; ++b) {
+                entry.shuffle[entry.len++] = static_cast<char>(k * 4 + b);
+            }
+        }
+    }
+    return table;
+}();
+
+//将4个32位通道中的码点(不是代理项)编码为UTF-8写入dst，总是写入16字节，返回实际的字节数
+MEM_TARGET("ssse3") inline size_t mem_utf8_encode_step(__m128i v, char *dst) {
+    const __m128i low6 = _mm_and_si128(v, _mm_set1_epi32(0x3f)), mid6 = _mm_and_si128(_mm_srli_epi32(v, 6), _mm_set1_epi32(0x3f));
+    const __m128i high6 = _mm_and_si128(_mm_srli_epi32(v, 12), _mm_set1_epi32(0x3f));
+    const __m128i cont = _mm_set1_epi32(0x80);
+    __m128i two = _mm_or_si128(_mm_or_si128(_mm_srli_epi32(v, 6), _mm_set1_epi32(0xc0)), _mm_slli_epi32(_mm_or_si128(low6, cont), 8));
+    __m128i three = _mm_or_si128(_mm_or_si128(_mm_srli_epi32(v, 12), _mm_set1_epi32(0xe0)),
+                                 _mm_or_si128(_mm_slli_epi32(_mm_or_si128(mid6, cont), 8), _mm_slli_epi32(_mm_or_si128(low6, cont), 16)));
+    __m128i four = _mm_or_si128(_mm_or_si128(_mm_srli_epi32(v, 18), _mm_set1_epi32(0xf0)), _mm_slli_epi32(_mm_or_si128(high6, cont), 8));
+    four = _mm_or_si128(four, _mm_or_si128(_mm_slli_epi32(_mm_or_si128(mid6, cont), 16), _mm_slli_epi32(_mm_or_si128(low6, cont), 24)));
+    __m128i lt80 = _mm_cmplt_epi32(v, _mm_set1_epi32(0x80)), lt800 = _mm_cmplt_epi32(v, _mm_set1_epi32(0x800));
+    __m128i lt10000 = _mm_cmplt_epi32(v, _mm_set1_epi32(0x10000));
+    __m128i wide = _mm_or_si128(_mm_and_si128(lt10000, three), _mm_andnot_si128(lt10000, four));
+    __m128i bytes = _mm_or_si128(_mm_and_si128(lt80, v), _mm_andnot_si128(lt80, _mm_or_si128(_mm_and_si128(lt800, two), _mm_andnot_si128(lt800, wide))));
+    auto m1 = static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(lt80))) ^ 0xf, m2 = static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(lt800))) ^ 0xf;
+    auto m3 = static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(lt10000))) ^ 0xf;
+    auto const& entry = mem_utf8_encode_table[(m1 ^ m2 ^ m3) | m2 << 4];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_shuffle_epi8(bytes, _mm_loadu_si128(reinterpret_cast<const __m128i*>(entry.shuffle.data()))));
+    return entry.len;
+}
+
+//AVX2下32个ASCII字节的零扩展，以及32个ASCII单元的打包(数据段不全是ASCII时不写出并返回false)
+template<typename Unit>
+MEM_TARGET("avx2") inline void mem_utf8_widen32(const uint8_t *s, char *out) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s));
+    if constexpr (sizeof(Unit) == 2) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), _mm256_cvtepu8_epi16(_mm256_castsi256_si128(v)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 32), _mm256_cvtepu8_epi16(_mm256_extracti128_si256(v, 1)));
+    } else {
+        for (int q = 0; q < 4; ++q) {
+            __m128i part = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(s + q * 8));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + q * 32), _mm256_cvtepu8_epi32(part));
+        }
+    }
+}
+
+MEM_TARGET("avx2") inline bool mem_utf16_narrow_ascii32(const char *in, char *out) {
+    __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in));
+    __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + 32));
+    if (!_mm256_testz_si256(_mm256_or_si256(a, b), _mm256_set1_epi16(static_cast<short>(0xff80)))) {
+        return false;
+    }
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xd8));
+    return true;
+}
+#endif
+
+/*
+ * 转码内核，ISA为0时为标量实现，1为SSSE3，2为AVX2。纯ASCII的数据段直接零扩展或打包(AVX2每次32个)；其余数据段UTF-8一侧按重排表每次转码6个不超过2字节、4个不超过3字节
+ * 或3个任意长度的码点，UTF-16/UTF-32一侧每次编码4个码点，只有UTF-16中代理对附近逐码点处理。输入需已通过校验，dst需有足够空间，返回写入的编码单元数。SIMD部分写出的字节可能超过
+ * 实际长度，因此只在剩余输入足以保证输出空间时使用，末尾按标量处理。UTF-16/UTF-32一侧按字节寻址并逐个单元memcpy读写，不要求按Unit对齐。
+ */
+template<int ISA, typename Unit>
+[[gnu::always_inline]] inline size_t mem_utf8_to_wide_impl(const char *src, size_t len, char *dst) {
+    auto *s = reinterpret_cast<const uint8_t*>(src);
+    size_t i = 0, n = 0;
+#ifdef MEM_SIMD_X86
+    if constexpr (ISA >= 1) {
+        /*
+         * 每次处理64字节：先算出整块的掩码，全是ASCII的16(AVX2为32)字节直接零扩展，其余沿码点结束掩码逐步查表转码，步与步之间只依赖表中的消耗字节数。
+         * 剩余至少96字节时，块内消耗至多64字节后还有32字节，至少能产生8个编码单元，足以覆盖多写的部分
+         */
+        while (len - i >= 96) {
+            uint64_t high, ends;
+            mem_utf8_block_masks(s + i, high, ends);
+            size_t pos = 0;
+            while (pos <= 52) {
+                if constexpr (ISA >= 2) {
+                    if (pos <= 32 && static_cast<uint32_t>(high >> pos) == 0) {
+                        mem_utf8_widen32<Unit>(s + i + pos, dst + n * sizeof(Unit));
+                        pos += 32;
+                        n += 32;
+                        continue;
+                    }
+                }
+                if (pos <= 48 && static_cast<uint16_t>(high >> pos) == 0) {
+                    mem_utf8_widen16<Unit>(s + i + pos, dst + n * sizeof(Unit));
+                    pos += 16;
+                    n += 16;
+                    continue;
+                }
+                size_t units;
+                pos += mem_utf8_decode_step<Unit>(s + i + pos, static_cast<unsigned>(ends >> pos) & 0xfff, dst + n * sizeof(Unit), units);
+                n += units;
+            }
+            i += pos;
+        }
+    }
+#endif
+    while (i < len) {
+        mem_utf_store_code_point<Unit>(dst, n, mem_utf8_decode_one(s, i));
+    }
+    return n;
+}
+
+template<int ISA, typename Unit>
+[[gnu::always_inline]] inline size_t mem_wide_to_utf8_impl(const char *src, size_t len, char *dst) {
+    size_t i = 0, n = 0;
+#ifdef MEM_SIMD_X86
+    if constexpr (ISA >= 1) {
+        //每次至多处理16个单元，之后至少还剩16个单元，至少产生16字节，足以覆盖encode_step多写的部分
+        while (len - i >= 32) {
+            const char *in = src + i * sizeof(Unit);
+            if constexpr (ISA >= 2 && sizeof(Unit) == 2) {
+                if (mem_utf16_narrow_ascii32(in, dst + n)) {
+                    i += 32;
+                    n += 32;
+                    continue;
+                }
+            }
+            constexpr size_t block = 16 / sizeof(Unit) * 2;
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 16));
+            const __m128i zero = _mm_setzero_si128();
+            __m128i high = sizeof(Unit) == 2 ? _mm_set1_epi16(static_cast<short>(0xff80)) : _mm_set1_epi32(static_cast<int>(0xffffff80));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(_mm_or_si128(a, b), high), zero)) == 0xffff) {
+                if constexpr (sizeof(Unit) == 2) {
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + n), _mm_packus_epi16(a, b));
+                } else {
+                    _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + n), _mm_packus_epi16(_mm_packs_epi32(a, b), zero));
+                }
+                i += block;
+                n += block;
+                continue;
+            }
+            if constexpr (sizeof(Unit) == 4) {
+                n += mem_utf8_encode_step(a, dst + n);
+                i += 4;
+                continue;
+            }
+            //UTF-16中a没有代理项时按4个一组编码，否则逐码点处理到第一个代理对之后
+            __m128i surrogate = _mm_cmpeq_epi16(_mm_and_si128(a, _mm_set1_epi16(static_cast<short>(0xf800))), _mm_set1_epi16(static_cast<short>(0xd800)));
+            auto special = static_cast<unsigned>(_mm_movemask_epi8(surrogate));
+            if (special == 0) {
+                n += mem_utf8_encode_step(_mm_unpacklo_epi16(a, zero), dst + n);
+                n += mem_utf8_encode_step(_mm_unpackhi_epi16(a, zero), dst + n);
+                i += 8;
+                continue;
+            }
+            size_t stop = i + static_cast<size_t>(__builtin_ctz(special)) / sizeof(Unit) + 1;
+            while (i < stop) {
+                char32_t c = mem_utf_load<Unit>(src, i++);
+                if (sizeof(Unit) == 2 && c >= 0xd800 && c <= 0xdbff) {
+                    c = 0x10000 + ((c - 0xd800) << 10) + (static_cast<char32_t>(mem_utf_load<Unit>(src, i++)) - 0xdc00);
+                }
+                n += mem_utf8_encode_one(c, dst + n);
+            }
+        }
+    }
+#endif
+    while (i < len) {
+        char32_t c = mem_utf_load<Unit>(src, i++);
+        if (sizeof(Unit) == 2 && c >= 0xd800 && c <= 0xdbff) {
+            c = 0x10000 + ((c - 0xd800) << 10) + (static_cast<char32_t>(mem_utf_load<Unit>(src, i++)) - 0xdc00);
+        }
+        n += mem_utf8_encode_one(c, dst + n);
+    }
+    return n;
+}
+
+template<typename Unit>
+inline size_t mem_utf8_to_wide_scalar(const char *src, size_t len, char *dst) {
+    return mem_utf8_to_wide_impl<0, Unit>(src, len, dst);
+}
+
+template<typename Unit>
+inline size_t mem_wide_to_utf8_scalar(const char *src, size_t len, char *dst) {
+    return mem_wide_to_utf8_impl<0, Unit>(src, len, dst);
+}
+
+#ifdef MEM_SIMD_X86
+template<typename Unit>
+MEM_TARGET("ssse3") inline size_t mem_utf8_to_wide_ssse3(const char *src, size_t len, char *dst) {
+    return mem_utf8_to_wide_impl<1, Unit>(src, len, dst);
+}
+
+template<typename Unit>
+MEM_TARGET("ssse3") inline size_t mem_wide_to_utf8_ssse3(const char *src, size_t len, char *dst) {
+    return mem_wide_to_utf8_impl<1, Unit>(src, len, dst);
+}
+
+template<typename Unit>
+MEM_TARGET("avx2") inline size_t mem_utf8_to_wide_avx2(const char *src, size_t len, char *dst) {
+    return mem_utf8_to_wide_impl<2, Unit>(src, len, dst);
+}
+
+template<typename Unit>
+MEM_TARGET("avx2") inline size_t mem_wide_to_utf8_avx2(const char *src, size_t len, char *dst) {
+    return mem_wide_to_utf8_impl<2, Unit>(src, len, dst);
+}
+#endif
+
+//只有SSE2时SIMD部分只能处理纯ASCII的数据段，混合文本上比标量实现更慢，因此不单独提供SSE2档位
+template<typename Unit>
+struct mem_utf8_to_wide_kernel {
+    using type = size_t(const char*, size_t, char*);
+
+    static type *resolve(mem_isa isa) {
+#ifdef MEM_SIMD_X86
+        if (isa >= mem_isa::avx2) {
+            return mem_utf8_to_wide_avx2<Unit>;
+        }
+        if (isa >= mem_isa::ssse3) {
+            return mem_utf8_to_wide_ssse3<Unit>;
+        }
+#endif
+        return mem_utf8_to_wide_scalar<Unit>;
+    }
+};
+
+template<typename Unit>
+struct mem_wide_to_utf8_kernel {
+    using type = size_t(const char*, size_t, char*);
+
+    static type *resolve(mem_isa isa) {
+#ifdef MEM_SIMD_X86
+        if (isa >= mem_isa::avx2) {
+            return mem_wide_to_utf8_avx2<Unit>;
+        }
+        if (isa >= mem_isa::ssse3) {
+            return mem_wide_to_utf8_ssse3<Unit>;
+        }
+#endif
+        return mem_wide_to_utf8_scalar<Unit>;
+    }
+};
+
+template<typename Unit>
+inline size_t mem_utf8_to_wide(const char *src, size_t len, Unit *dst) {
+    return mem_dispatch<mem_utf8_to_wide_kernel<Unit>>::call(src, len, reinterpret_cast<char*>(dst));
+}
+
+template<typename Unit>
+inline size_t mem_wide_to_utf8(const Unit *src, size_t len, char *dst) {
+    return mem_dispatch<mem_wide_to_utf8_kernel<Unit>>::call(reinterpret_cast<const char*>(src), len, dst);
+}
+
+/*
+ * 校验src从当前位置起count个字节是否为合法UTF-8，不移动游标。
+ */
+template<typename Buffer>
+bool mem_utf8_validate(char8_stream<Buffer>& src, size_t count) {
+    bool valid = false;
+    src.read_with(count, [&](const char *data) { valid = mem_utf8_validate(data, count); });
+    if (valid) {
+        src.back(count);
+    }
+    return valid;
+}
+
+//源与目标是同一个缓冲时每次经栈上缓冲转码的输入编码单元数
+inline constexpr size_t mem_transcode_chunk = 1024;
+
+/*
+ * 将src从当前位置起count个编码单元转码后写入dst的当前位置。先在源的锁内计算输出的精确长度，dst所在缓冲最多只扩容一次。源与目标不是同一个缓冲时同时持有两者的锁
+ * (mem_stream::transfer_with)，在锁内校验输入后直接从源存储转码写入目标存储；是同一个缓冲时每次取mem_transcode_chunk个单元经栈上的固定缓冲转码，不在多字节序列或代理对
+ * 中间分块，此时两段范围不应重叠。成功时两个流的游标均前进；输入不合法或数据不足时返回false，且两个游标都不移动。
+ */
+template<typename SrcBuffer, typename DstBuffer, typename Unit>
+requires std::same_as<Unit, char16_t> || std::same_as<Unit, char32_t>
+bool mem_transcode(char8_stream<SrcBuffer>& src, size_t count, mem_stream<Unit, DstBuffer>& dst) {
+    if (src.remaining() < count) {
+        return false;
+    }
+    auto length = [](const char *data, size_t len) {
+        return sizeof(Unit) == 2 ? mem_utf16_length_from_utf8(data, len) : mem_utf32_length_from_utf8(data, len);
+    };
+    using kernel = mem_dispatch<mem_utf8_to_wide_kernel<Unit>>;
+    bool ok = true;
+    size_t units = 0;
+    if (!src.shares_buffer(dst)) {
+        src.read_with(count, [&](const char *data) { units = length(data, count); });
+        src.back(count);
+        dst.reserve(units * sizeof(Unit));
+        return dst.transfer_with(src, count, units * sizeof(Unit), [&](const char *in, char *out) {
+            //计算长度之后源数据可能已被其他线程修改，在两把锁内校验并复核长度
+            if (!mem_utf8_validate(in, count) || length(in, count) != units) {
+                return false;
+            }
+            kernel::call(in, count, out);
+            return true;
+        });
+    }
+    src.read_with(count, [&](const char *data) {
+        ok = mem_utf8_validate(data, count);
+        units = ok ? length(data, count) : 0;
+    });
+    src.back(count);
+    if (!ok) {
+        return false;
+    }
+    dst.reserve(units * sizeof(Unit));
+    char in[mem_transcode_chunk];
+    char out[mem_transcode_chunk * sizeof(Unit)];
+    for (size_t left = count; left > 0;) {
+        size_t n = std::min(left, mem_transcode_chunk);
+        src.read(in, n);
+        if (n < left) {
+            //最后一个首字节开始的序列不完整时留到下一块
+            size_t lead = n - 1;
+            while (lead > 0 && (static_cast<uint8_t>(in[lead]) & 0xc0) == 0x80) {
+                --lead;
+            }
+            auto b = static_cast<uint8_t>(in[lead]);
+            if (lead + (b < 0x80 ? 1 : b < 0xe0 ? 2 : b < 0xf0 ? 3 : 4) > n) {
+                src.back(n - lead);
+                n = lead;
+            }
+        }
+        if (!mem_utf8_validate(in, n)) {
+            throw mem_exception("source of mem_transcode was modified during transcoding");
+        }
+        dst.write(out, kernel::call(in, n, out) * sizeof(Unit));
+        left -= n;
+    }
+    return true;
+}
+
+template<typename SrcBuffer, typename DstBuffer, typename Unit>
+requires std::same_as<Unit, char16_t> || std::same_as<Unit, char32_t>
+bool mem_transcode(mem_stream<Unit, SrcBuffer>& src, size_t count, char8_stream<DstBuffer>& dst) {
+    if (src.remaining() < count * sizeof(Unit)) {
+        return false;
+    }
+    using kernel = mem_dispatch<mem_wide_to_utf8_kernel<Unit>>;
+    size_t bytes = mem_npos;
+    src.read_with(count * sizeof(Unit), [&](const char *data) { bytes = mem_utf8_length_from_wide<Unit>(data, count); });
+    src.back(count);
+    if (bytes == mem_npos) {
+        return false;
+    }
+    dst.reserve(bytes);
+    if (!src.shares_buffer(dst)) {
+        return dst.transfer_with(src, count * sizeof(Unit), bytes, [&](const char *in, char *out) {
+            //计算长度之后源数据可能已被其他线程修改，在两把锁内复核
+            if (mem_utf8_length_from_wide<Unit>(in, count) != bytes) {
+                return false;
+            }
+            kernel::call(in, count, out);
+            return true;
+        });
+    }
+    char in[mem_transcode_chunk * sizeof(Unit)];
+    char out[mem_transcode_chunk * 4];
+    for (size_t left = count; left > 0;) {
+        size_t n = std::min(left, mem_transcode_chunk);
+        src.read(in, n * sizeof(Unit));
+        if constexpr (sizeof(Unit) == 2) {
+            //不把代理对分到两块
+            char32_t last = mem_utf_load<Unit>(in, n - 1);
+            if (n < left && last >= 0xd800 && last <= 0xdbff) {
+                src.back(1);
+                --n;
+            }
+        }
+        if (mem_utf8_length_from_wide<Unit>(in, n) == mem_npos) {
+            throw mem_exception("source of mem_transcode was modified during transcoding");
+        }
+        dst.write(out, kernel::call(in, n, out));
+        left -= n;
+    }
+    return true;
+}
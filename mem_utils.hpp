@@ -1,12 +1,30 @@
 #pragma once
 
+#include <atomic>
 #include <concepts>
 #include <iostream>
 #include <memory>
+#include <cstdlib>
 #include <cstring>
 #include <format>
+#include <functional>
 #include <utility>
 #include <mutex>
+#include <algorithm>
+#include <type_traits>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#include "mem_simd.hpp"
+#include "mem_hash.hpp"
+#include "mem_stats.hpp"
+#include "mem_trace.hpp"
 /*
  *若启用该宏定义，将通过概念约束一些成员模板只能使用数字类型(int8_t/int16_t等)作为模板参数。(C++20及以上可用)
  */
@@ -35,191 +53,1597 @@ public:
     static void release(void *ptr, size_t size) {
         free(ptr);
     }
+    //通过realloc扩大或缩小，失败时返回nullptr，原内存不变
+    static void *resize(void *ptr, size_t /*old_size*/, size_t new_size) {
+        return realloc(ptr, new_size);
+    }
+};
+
+/*
+ * 按Alignment字节对齐的堆内存分配器，Alignment需为2的幂且不小于sizeof(void*)。申请的大小向上取整到Alignment的整数倍，因此扩容、写时复制分离等每次重新申请得到的内存
+ * 都保持对齐。可以作为mem_buffer或mem_small_buffer的Allocator参数，使数据地址满足向量指令整块对齐访问的要求。
+ */
+template<size_t Alignment>
+class mem_aligned_allocator {
+    static_assert(std::has_single_bit(Alignment) && Alignment >= sizeof(void*), "alignment must be a power of 2 and at least sizeof(void*)");
+public:
+    static constexpr size_t alignment = Alignment;
+
+    static void *alloc(size_t size) {
+        return std::aligned_alloc(Alignment, (std::max<size_t>(size, 1) + Alignment - 1) & ~(Alignment - 1));
+    }
+    static void release(void *ptr, size_t /*size*/) {
+        free(ptr);
+    }
+};
+
+/*
+ * 分配器保证的对齐字节数。分配器可以通过静态成员alignment声明，未声明时为malloc保证的alignof(std::max_align_t)。
+ */
+template<typename Allocator>
+inline constexpr size_t mem_allocator_alignment = alignof(std::max_align_t);
+
+template<typename Allocator>
+requires requires { Allocator::alignment; }
+inline constexpr size_t mem_allocator_alignment<Allocator> = Allocator::alignment;
+
+/*
+ * 分配器申请到的内存以及resize扩大后新增的部分是否已经全部为0(如mmap得到的匿名页面)。分配器可以通过静态成员zero_filled声明，未声明时为false，mem_buffer会自行清零；
+ * 为true时mem_buffer构造与扩容都不再清零，也就不会提前访问并提交整个容量的物理页面。
+ */
+template<typename Allocator>
+inline constexpr bool mem_allocator_zero_filled = false;
+
+template<typename Allocator>
+requires requires { Allocator::zero_filled; }
+inline constexpr bool mem_allocator_zero_filled<Allocator> = Allocator::zero_filled;
+
+/*
+ * 分配器可选的两个扩展：static void *resize(void *ptr, size_t old_size, size_t new_size)在原处或移动后改变大小并保留前min(old_size, new_size)字节，失败时返回nullptr且
+ * 原内存不变，mem_buffer扩容与缩小时优先使用它以避免拷贝；static size_t decommit(void *ptr, size_t size)将[ptr, ptr + size)中的物理页面归还给系统而不改变大小，返回归还的
+ * 字节数，mem_buffer::trim()优先使用它。aligned_alloc得到的内存不能通过realloc保持对齐，因此mem_aligned_allocator不提供resize。
+ */
+template<typename Allocator>
+concept mem_resizable_allocator = requires(void *ptr, size_t size) {
+    { Allocator::resize(ptr, size, size) } -> std::same_as<void*>;
+};
+
+template<typename Allocator>
+concept mem_decommit_allocator = requires(void *ptr, size_t size) {
+    { Allocator::decommit(ptr, size) } -> std::same_as<size_t>;
+};
+
+#if defined(__unix__) || defined(__APPLE__)
+/*
+ * 直接通过mmap申请匿名页面的分配器，大小向上取整到页面大小，适合较大的缓冲。mem_buffer::trim()通过madvise将写入过的最高位置之后的整页归还给系统，容量不变，之后写入时
+ * 由系统重新分配页面。Lazy为false时使用MADV_DONTNEED，RSS立即下降，归还部分再次读取为0；Lazy为true时使用MADV_FREE(不支持时退回MADV_DONTNEED)，系统内存紧张时才真正
+ * 回收，开销更小，但回收前仍计入RSS，归还部分再次读取的内容可能是旧数据也可能是0。Linux上resize通过mremap实现，扩容与缩小都不拷贝数据。
+ */
+template<bool Lazy = false>
+class mem_mmap_allocator {
+private:
+    static size_t page_size() {
+        static const size_t size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        return size;
+    }
+
+    static size_t round_up(size_t size) {
+        return (std::max<size_t>(size, 1) + page_size() - 1) & ~(page_size() - 1);
+    }
+public:
+    static constexpr size_t alignment = 4096;
+    static constexpr bool zero_filled = true;
+
+    static void *alloc(size_t size) {
+        void *ptr = mmap(nullptr, round_up(size), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        return ptr == MAP_FAILED ? nullptr : ptr;
+    }
+    static void release(void *ptr, size_t size) {
+        munmap(ptr, round_up(size));
+    }
+#ifdef __linux__
+    static void *resize(void *ptr, size_t old_size, size_t new_size) {
+        //缩小时保留的最后一页中new_size之后的部分清零，之后再扩大时新增的部分仍然全部为0
+        if (new_size < old_size) {
+            memset(static_cast<char*>(ptr) + new_size, 0, std::min(old_size, round_up(new_size)) - new_size);
+        }
+        void *r = mremap(ptr, round_up(old_size), round_up(new_size), MREMAP_MAYMOVE);
+        return r == MAP_FAILED ? nullptr : r;
+    }
+#endif
+    //只归还完全落在[ptr, ptr + size)中的页面
+    static size_t decommit(void *ptr, size_t size) {
+        auto addr = reinterpret_cast<uintptr_t>(ptr);
+        uintptr_t first = (addr + page_size() - 1) & ~(page_size() - 1);
+        uintptr_t last = (addr + size) & ~(page_size() - 1);
+        if (last <= first) {
+            return 0;
+        }
+#ifdef MADV_FREE
+        int advice = Lazy ? MADV_FREE : MADV_DONTNEED;
+#else
+        int advice = MADV_DONTNEED;
+#endif
+        return madvise(reinterpret_cast<void*>(first), last - first, advice) == 0 ? last - first : 0;
+    }
 };
+#endif
 
 template<typename Allocator = mem_heap_allocator>
 class mem_buffer;
 
+template<typename Allocator = mem_heap_allocator>
+class mem_buffer_pool;
+
+template<size_t Alignment>
+using mem_aligned_buffer = mem_buffer<mem_aligned_allocator<Alignment>>;
+
+/*
+ * 一段内存按Align划分后的三部分：起始地址未对齐的头部、起始地址按Align对齐且长度为Align整数倍的主体以及剩余的尾部，三者依次相连。向量代码只需对主体使用对齐的整块
+ * 访问，头尾用标量处理。
+ */
+template<typename T>
+struct mem_aligned_span {
+    T *head;
+    size_t head_size;
+    T *body;
+    size_t body_size;
+    T *tail;
+    size_t tail_size;
+
+    template<size_t Align>
+    static mem_aligned_span split(T *data, size_t len) {
+        auto addr = reinterpret_cast<uintptr_t>(data);
+        size_t head = std::min(len, static_cast<size_t>((Align - addr % Align) % Align));
+        size_t body = (len - head) / Align * Align;
+        return {data, head, data + head, body, data + head + body, len - head - body};
+    }
+};
+
+/*
+ * 访问类持有缓冲的方式：带引用计数的缓冲(如mem_buffer)按值拷贝以共享存储并延长其生命周期，其余缓冲(如mem_small_buffer)按引用持有。缓冲类通过静态成员reference_counted声明自身属于哪一种。
+ */
+template<typename Buffer>
+using mem_buffer_holder = std::conditional_t<Buffer::reference_counted, Buffer, Buffer&>;
+
+/*
+ * 构造访问类持有的缓冲。带引用计数的缓冲通过share()取得与原实例共享控制块的访问实例，写时复制模式下它不是快照，通过访问类的写入对原实例可见。
+ */
+template<typename Buffer>
+constexpr mem_buffer_holder<Buffer> mem_hold(Buffer& buffer) {
+    if constexpr (Buffer::reference_counted) {
+        return buffer.share();
+    } else {
+        return buffer;
+    }
+}
+
+//a与b是否为同一块存储：带引用计数的缓冲比较控制块，其余缓冲比较对象地址
+template<typename A, typename B>
+bool mem_same_block(A const& a, B const& b) {
+    if constexpr (requires { a.shares_block(b); }) {
+        return a.shares_block(b);
+    } else {
+        return static_cast<const void*>(&a) == static_cast<const void*>(&b);
+    }
+}
+
+/*
+ * 调用写入回调并返回实际写入的字节数。f返回void时为len，返回bool时true为len、false为mem_npos(放弃写入)，返回size_t时为f报告的字节数(不超过len，mem_npos表示放弃)。
+ * 按最坏情况的长度预留空间、实际只写入一部分的回调(如压缩)通过返回size_t让used与游标只计入实际写入的部分。
+ */
+template<typename F, typename... Args>
+size_t mem_written(size_t len, F& f, Args... args) {
+    using R = std::invoke_result_t<F&, Args...>;
+    if constexpr (std::is_void_v<R>) {
+        f(args...);
+        return len;
+    } else if constexpr (std::is_same_v<R, bool>) {
+        return f(args...) ? len : mem_npos;
+    } else {
+        return static_cast<size_t>(f(args...));
+    }
+}
+
+/*
+ * 以src中[src_off, src_off + src_len)的const char*与dst中[off, off + len)的char*调用f(in, out)，f的返回值见mem_written，放弃写入时返回false。两者都是mem_buffer时通过
+ * transfer_with按控制块地址顺序同时持有两个锁；其余缓冲不是线程安全的，依次在src.read_with与dst.write_with中调用f。
+ */
+template<typename SrcBuffer, typename DstBuffer, typename F>
+bool mem_transfer_with(SrcBuffer const& src, size_t src_len, size_t src_off, DstBuffer& dst, size_t len, size_t off, F&& f) {
+    if constexpr (requires { dst.transfer_with(src, src_len, src_off, len, off, f); }) {
+        return dst.transfer_with(src, src_len, src_off, len, off, std::forward<F>(f));
+    } else {
+        size_t n = mem_npos;
+        src.read_with(src_len, src_off, [&](const char *in) {
+            dst.write_with(len, off, [&](char *out) { n = mem_written(len, f, in, out); });
+        });
+        return n != mem_npos;
+    }
+}
+
 /*
  * 流式访问内存缓冲类。可以通过构造函数构造，也可以通过mem_buffer内建的几个辅助方法直接获取。
  */
 template<typename T, typename Buffer = mem_buffer<>>
 class mem_stream {
-private:
+    template<typename U, typename B>
+    friend class mem_stream;
+protected:
     size_t pos;
-    Buffer buffer;
+    mem_buffer_holder<Buffer> buffer;
     bool eof_bit {false};
     const size_t step = sizeof(T);
+private:
+
+    /*
+     * 常量求值时不能使用read_with/write_with与reinterpret_cast，逐个元素经std::bit_cast转换并用mem_byteswap按需反转，因此mem_static_buffer上的流可以在编译期读写指定字节序
+     * 的数值。
+     */
+    template<std::endian E, typename U>
+    constexpr bool read_endian(U *dst, size_t count) {
+        size_t len = sizeof(U) * count;
+        bool r;
+        if (std::is_constant_evaluated()) {
+            r = pos + len <= buffer.capacity();
+            for (size_t i = 0; r && i < count; ++i) {
+                std::array<char, sizeof(U)> bytes {};
+                buffer.read(bytes.data(), sizeof(U), pos + i * sizeof(U));
+                U u = std::bit_cast<U>(bytes);
+                dst[i] = E == std::endian::native ? u : mem_byteswap(u);
+            }
+        } else {
+            r = buffer.read_with(len, pos, [dst, count](const char *src) { mem_copy_endian<E, U>(dst, src, count); });
+        }
+        if (r) {
+            pos += len;
+        }
+        if (pos >= buffer.capacity()) {
+            eof_bit = true;
+        }
+        return r;
+    }
+
+    template<std::endian E, typename U>
+    constexpr bool write_endian(const U *src, size_t count) {
+        size_t len = sizeof(U) * count;
+        bool r = true;
+        if (std::is_constant_evaluated()) {
+            for (size_t i = 0; r && i < count; ++i) {
+                auto bytes = std::bit_cast<std::array<char, sizeof(U)>>(E == std::endian::native ? src[i] : mem_byteswap(src[i]));
+                r = buffer.write(bytes.data(), sizeof(U), pos + i * sizeof(U));
+            }
+        } else {
+            r = buffer.write_with(len, pos, [src, count](char *dst) { mem_copy_endian<E, U>(dst, src, count); });
+        }
+        pos += len;
+        return r;
+    }
+
+    //从当前位置查找delim，返回其相对缓冲开头的偏移
+    size_t find_from(const T *delim, size_t len) {
+        size_t cap = buffer.capacity(), r = mem_npos;
+        if (pos >= cap) {
+            return r;
+        }
+        buffer.read_with(cap - pos, pos, [&](const char *data) {
+            auto *d = reinterpret_cast<const char*>(delim);
+            size_t k = len == 1 ? mem_find_byte(data, cap - pos, d[0]) : mem_find(data, cap - pos, d, len);
+            r = k == mem_npos ? mem_npos : pos + k;
+        });
+        return r;
+    }
+
+    bool skip_to(size_t at) {
+        size_t cap = buffer.capacity();
+        pos = at == mem_npos ? std::max(pos, cap) : at;
+        eof_bit = pos >= cap;
+        return at != mem_npos;
+    }
+
+    bool read_to(std::basic_string<T>& out, size_t at, size_t delim_len) {
+        if (at == mem_npos) {
+            return false;
+        }
+        size_t old = out.size();
+        out.resize(old + at - pos);
+        if (at != pos) {
+            buffer.read(reinterpret_cast<char*>(out.data() + old), at - pos, pos);
+        }
+        pos = at + delim_len;
+        eof_bit = pos >= buffer.capacity();
+        return true;
+    }
+
+    template<std::unsigned_integral U>
+    bool decode_varint(U& u) {
+        size_t cap = buffer.capacity();
+        if (pos >= cap) {
+            eof_bit = true;
+            return false;
+        }
+        size_t len = std::min(cap - pos, mem_varint_max_size<U>), n = 0;
+        buffer.read_with(len, pos, [&](const char *src) { n = mem_varint_decode(src, len, u); });
+        pos += n;
+        if (pos >= cap) {
+            eof_bit = true;
+        }
+        return n != 0;
+    }
 public:
-    explicit mem_stream(Buffer& buffer) : pos(0), buffer(buffer) {}
-    mem_stream(mem_stream const&) = default;
-    bool get(T& t) {
+    constexpr explicit mem_stream(Buffer& buffer) : pos(0), buffer(mem_hold(buffer)) {}
+    //拷贝出的流与原流共享控制块，写时复制模式下不是快照
+    constexpr mem_stream(mem_stream const& stream) : pos(stream.pos), buffer(mem_hold(stream.buffer)), eof_bit(stream.eof_bit) {}
+    constexpr bool get(T& t) {
         bool r;
-        if ((r = buffer.read(reinterpret_cast<char*>(&t), step, pos))) {
+        if (std::is_constant_evaluated()) {
+            //常量求值时不能使用reinterpret_cast，经std::bit_cast转换
+            std::array<char, sizeof(T)> bytes {};
+            if ((r = buffer.read(bytes.data(), step, pos))) {
+                t = std::bit_cast<T>(bytes);
+            }
+        } else {
+            r = buffer.read(reinterpret_cast<char*>(&t), step, pos);
+        }
+        if (r) {
             pos += step;
         }
-        if (pos >= buffer.capacity) {
+        if (pos >= buffer.capacity()) {
+            eof_bit = true;
+        }
+        return r;
+    }
+
+    constexpr T get() {
+        T t {};
+        get(t);
+        return t;
+    }
+
+    constexpr T peek() {
+        T t = get();
+        pos--;
+        return t;
+    }
+
+    constexpr T peek(size_t len) {
+        forward(len - 1);
+        T t = get();
+        back(len);
+        return t;
+    }
+
+    constexpr bool put(T const& t) {
+        bool r;
+        if (std::is_constant_evaluated()) {
+            auto bytes = std::bit_cast<std::array<char, sizeof(T)>>(t);
+            r = buffer.write(bytes.data(), step, pos);
+        } else {
+            r = buffer.write(reinterpret_cast<const char*>(&t), step, pos);
+        }
+        pos += step;
+        return r;
+    }
+
+    //从当前位置读取len字节，游标前进len字节
+    bool read(char *dst, size_t len) {
+        bool r;
+        if ((r = buffer.read(dst, len, pos))) {
+            pos += len;
+        }
+        if (pos >= buffer.capacity()) {
+            eof_bit = true;
+        }
+        return r;
+    }
+
+    //在当前位置写入len字节，游标前进len字节
+    bool write(const char *src, size_t len) {
+        bool r = buffer.write(src, len, pos);
+        pos += len;
+        return r;
+    }
+
+    /*
+     * 在持有缓冲锁的情况下以指向当前位置起len字节的指针调用f，成功后游标前进len字节，用于直接在缓冲存储上进行批量处理。f中不应抛出异常，也不应再访问该缓冲。
+     */
+    template<typename F>
+    bool read_with(size_t len, F&& f) {
+        bool r;
+        if ((r = buffer.read_with(len, pos, std::forward<F>(f)))) {
+            pos += len;
+        }
+        if (pos >= buffer.capacity()) {
             eof_bit = true;
         }
         return r;
     }
 
-    T get() {
-        T t;
-        get(t);
-        return t;
+    //f返回size_t时为实际写入的字节数，游标只前进这么多；放弃写入时返回false，游标不动。见mem_written
+    template<typename F>
+    bool write_with(size_t len, F&& f) {
+        size_t n = len;
+        bool r = buffer.write_with(len, pos, [&](char *out) { return n = mem_written(len, f, out); });
+        if (n == mem_npos) {
+            return false;
+        }
+        pos += n;
+        return r;
+    }
+
+    /*
+     * 以源流src当前位置起src_len字节的const char*与当前位置起len字节的char*调用f(in, out)，两个缓冲都是mem_buffer时同时持有两者的锁(见mem_transfer_with)。f成功时两个
+     * 游标都前进，当前游标前进实际写入的字节数(见mem_written)；f放弃写入或src数据不足时返回false，两个游标都不移动。
+     */
+    template<typename U, typename SrcBuffer, typename F>
+    bool transfer_with(mem_stream<U, SrcBuffer>& src, size_t src_len, size_t len, F&& f) {
+        size_t n = mem_npos;
+        if (!mem_transfer_with(src.buffer, src_len, src.pos, buffer, len, pos, [&](const char *in, char *out) { return n = mem_written(len, f, in, out); })) {
+            return false;
+        }
+        src.pos += src_len;
+        if (src.pos >= src.buffer.capacity()) {
+            src.eof_bit = true;
+        }
+        pos += n;
+        return true;
+    }
+
+    //与other是否访问同一块存储
+    template<typename U, typename B>
+    bool shares_buffer(mem_stream<U, B> const& other) const {
+        return mem_same_block(buffer, other.buffer);
+    }
+
+    /*
+     * 与read_with/write_with相同，但以当前位置起len字节按Align划分后的mem_aligned_span调用f。缓冲使用对齐分配器且当前位置是Align的整数倍时头部为空。
+     */
+    template<size_t Align, typename F>
+    bool read_aligned(size_t len, F&& f) {
+        return read_with(len, [&f, len](const char *data) { f(mem_aligned_span<const char>::template split<Align>(data, len)); });
+    }
+
+    template<size_t Align, typename F>
+    bool write_aligned(size_t len, F&& f) {
+        return write_with(len, [&f, len](char *data) { f(mem_aligned_span<char>::template split<Align>(data, len)); });
+    }
+
+    //确保从当前位置起至少还能写入len字节，需要时一次性扩容到恰好容纳
+    bool reserve(size_t len) {
+        return pos + len <= buffer.capacity() || buffer.expand(pos + len);
+    }
+
+    //当前位置之后剩余的字节数
+    size_t remaining() const {
+        size_t cap = buffer.capacity();
+        return pos < cap ? cap - pos : 0;
+    }
+
+    //从当前位置起写入count个value，游标前进count个元素
+    bool fill(T value, size_t count) {
+        return write_with(count * sizeof(T), [&value, count](char *dst) { mem_fill<sizeof(T)>(dst, reinterpret_cast<const char*>(&value), count); });
+    }
+
+    /*
+     * 以大端序(be)或小端序(le)读写任意宽度的数值U，游标按sizeof(U)前进，与流的元素类型T无关。带count参数的版本批量读写count个元素，批量反转使用SIMD实现。
+     * 均为constexpr，可在常量求值中用于mem_static_buffer上的流。
+     */
+    template<mem_swappable U>
+    constexpr bool read_be(U& u) {
+        return read_endian<std::endian::big>(&u, 1);
+    }
+
+    template<mem_swappable U>
+    constexpr bool read_le(U& u) {
+        return read_endian<std::endian::little>(&u, 1);
+    }
+
+    template<mem_swappable U>
+    constexpr U read_be() {
+        U u {};
+        read_be(u);
+        return u;
+    }
+
+    template<mem_swappable U>
+    constexpr U read_le() {
+        U u {};
+        read_le(u);
+        return u;
+    }
+
+    template<mem_swappable U>
+    constexpr bool write_be(U const& u) {
+        return write_endian<std::endian::big>(&u, 1);
+    }
+
+    template<mem_swappable U>
+    constexpr bool write_le(U const& u) {
+        return write_endian<std::endian::little>(&u, 1);
+    }
+
+    template<mem_swappable U>
+    constexpr bool read_be(U *dst, size_t count) {
+        return read_endian<std::endian::big>(dst, count);
+    }
+
+    template<mem_swappable U>
+    constexpr bool read_le(U *dst, size_t count) {
+        return read_endian<std::endian::little>(dst, count);
+    }
+
+    template<mem_swappable U>
+    constexpr bool write_be(const U *src, size_t count) {
+        return write_endian<std::endian::big>(src, count);
+    }
+
+    template<mem_swappable U>
+    constexpr bool write_le(const U *src, size_t count) {
+        return write_endian<std::endian::little>(src, count);
+    }
+
+    /*
+     * 以LEB128(protobuf varint)格式读写整数，游标按实际编码长度前进。有符号整数先符号扩展到64位再编码(与protobuf的int32/int64一致)，负数较多时应使用zigzag版本。
+     */
+    template<std::integral U>
+    bool put_varint(U u) {
+        char bytes[mem_varint_max_size<uint64_t>];
+        size_t n;
+        if constexpr (std::is_signed_v<U>) {
+            n = mem_varint_encode(bytes, static_cast<uint64_t>(static_cast<int64_t>(u)));
+        } else {
+            n = mem_varint_encode(bytes, u);
+        }
+        return write(bytes, n);
+    }
+
+    template<std::integral U>
+    bool get_varint(U& u) {
+        if constexpr (std::is_signed_v<U>) {
+            uint64_t v;
+            if (!decode_varint(v)) {
+                return false;
+            }
+            u = static_cast<U>(static_cast<int64_t>(v));
+            return true;
+        } else {
+            return decode_varint(u);
+        }
+    }
+
+    template<std::integral U>
+    U get_varint() {
+        U u {};
+        get_varint(u);
+        return u;
+    }
+
+    template<std::signed_integral U>
+    bool put_zigzag(U u) {
+        return put_varint(mem_zigzag_encode(u));
+    }
+
+    template<std::signed_integral U>
+    bool get_zigzag(U& u) {
+        std::make_unsigned_t<U> v;
+        if (!decode_varint(v)) {
+            return false;
+        }
+        u = mem_zigzag_decode(v);
+        return true;
+    }
+
+    template<std::signed_integral U>
+    U get_zigzag() {
+        U u {};
+        get_zigzag(u);
+        return u;
+    }
+
+    //从当前位置连续解码最多count个变长整数到dst，整批只加一次锁，返回实际解码的个数。遇到不完整或非法的整数时停止，游标停在该整数的开头。
+    template<typename U>
+    requires std::same_as<U, uint32_t> || std::same_as<U, uint64_t>
+    size_t get_varints(U *dst, size_t count) {
+        size_t cap = buffer.capacity();
+        if (pos >= cap) {
+            eof_bit = true;
+            return 0;
+        }
+        size_t n = 0, consumed = 0;
+        buffer.read_with(cap - pos, pos, [&](const char *src) { n = mem_varint_decode_batch(src, cap - pos, dst, count, consumed); });
+        pos += consumed;
+        if (pos >= cap) {
+            eof_bit = true;
+        }
+        return n;
+    }
+
+    /*
+     * 将游标移动到从当前位置起第一个delim处(不跳过delim)，找不到时移动到末尾并返回false。查找一次完成，不再逐个get()。
+     */
+    bool skip_until(T delim) requires (sizeof(T) == 1) {
+        return skip_to(find_from(&delim, 1));
+    }
+
+    bool skip_until(std::basic_string_view<T> delim) requires (sizeof(T) == 1) {
+        return skip_to(find_from(delim.data(), delim.size()));
+    }
+
+    /*
+     * 将当前位置到第一个delim之前的内容追加到out，并跳过delim。找不到时游标与out均保持不变并返回false，适合数据尚未到齐时重试。
+     */
+    bool read_until(std::basic_string<T>& out, T delim) requires (sizeof(T) == 1) {
+        return read_to(out, find_from(&delim, 1), 1);
+    }
+
+    bool read_until(std::basic_string<T>& out, std::basic_string_view<T> delim) requires (sizeof(T) == 1) {
+        return read_to(out, find_from(delim.data(), delim.size()), delim.size());
+    }
+
+    constexpr void reset() {
+        pos = 0;
+        eof_bit = false;
+    }
+
+    constexpr void back() {
+        pos -= step;
+        if (pos < buffer.capacity()) {
+            eof_bit = false;
+        }
+    }
+
+    constexpr void back(size_t len) {
+        pos -= step * len;
+        if (pos < buffer.capacity()) {
+            eof_bit = false;
+        }
+    }
+
+    constexpr void forward() {
+        pos += step;
+        if (pos >= buffer.capacity()) {
+            eof_bit = true;
+        }
+    }
+
+    constexpr void forward(size_t len) {
+        pos += step * len;
+        if (pos >= buffer.capacity()) {
+            eof_bit = true;
+        }
+    }
+
+    T* ptr() {
+        return reinterpret_cast<T*>(buffer.data() + pos);
+    }
+
+    [[nodiscard]] constexpr bool eof() const {
+        return eof_bit;
+    }
+
+    constexpr bool eof(size_t s) {
+        if (pos + s >= buffer.capacity()) {
+            return true;
+        }
+        return false;
+    }
+
+    //equals to get()
+    constexpr mem_stream& operator>>(T& t) {
+        get(t);
+        return *this;
+    }
+
+    //equals to put()
+    constexpr mem_stream& operator<<(T const& t) {
+        put(t);
+        return *this;
+    }
+
+    explicit mem_stream(mem_stream const&&) = delete;
+    mem_stream() = delete;
+};
+
+/*
+ * 带校验的流，在读写的同时计算经过数据的摘要，省去写入后单独的校验遍历。游标向前经过的字节按顺序累加到Digest中：get/put/read/write等方法移动游标后，新经过的数据
+ * 每满batch字节或调用digest()时在缓冲锁内累加一次，这些数据刚被访问过，仍在缓存中。mem_stream的其他读写方法(字节序、变长整数等)同样会移动游标，其数据在下一次累加时
+ * 计入。游标后退不会撤销已累加的数据，reset()同时清空摘要。
+ */
+template<typename T, typename Buffer = mem_buffer<>, typename Digest = mem_crc32c_digest>
+class mem_checksum_stream : public mem_stream<T, Buffer> {
+private:
+    using base = mem_stream<T, Buffer>;
+    static constexpr size_t batch = 4096;
+    Digest state;
+    size_t digested {0};
+
+    void sync() {
+        size_t end = std::min(this->pos, this->buffer.capacity());
+        if (end > digested) {
+            size_t len = end - digested;
+            this->buffer.read_with(len, digested, [this, len](const char *data) { state.update(data, len); });
+            digested = end;
+        }
+    }
+
+    void flush() {
+        if (this->pos >= digested + batch) {
+            sync();
+        }
+    }
+public:
+    explicit mem_checksum_stream(Buffer& buffer, Digest const& digest = Digest {}) : base(buffer), state(digest) {}
+
+    bool get(T& t) {
+        bool r = base::get(t);
+        flush();
+        return r;
+    }
+
+    T get() {
+        T t {};
+        get(t);
+        return t;
+    }
+
+    bool put(T const& t) {
+        bool r = base::put(t);
+        flush();
+        return r;
+    }
+
+    bool read(char *dst, size_t len) {
+        bool r = base::read(dst, len);
+        flush();
+        return r;
+    }
+
+    bool write(const char *src, size_t len) {
+        bool r = base::write(src, len);
+        flush();
+        return r;
+    }
+
+    mem_checksum_stream& operator>>(T& t) {
+        get(t);
+        return *this;
+    }
+
+    mem_checksum_stream& operator<<(T const& t) {
+        put(t);
+        return *this;
+    }
+
+    void reset() {
+        base::reset();
+        state.reset();
+        digested = 0;
+    }
+
+    //到当前游标位置为止经过数据的摘要
+    typename Digest::value_type digest() {
+        sync();
+        return state.value();
+    }
+};
+
+struct mem_control_block;
+
+/*
+ * 控制块的回收者。引用计数减为0时mem_buffer先将控制块交给它，recycle()返回true表示已接管控制块与内存，mem_buffer不再释放；返回false时照常释放。见mem_pool.hpp。
+ */
+struct mem_block_recycler {
+    virtual bool recycle(mem_control_block *block) = 0;
+protected:
+    ~mem_block_recycler() = default;
+};
+
+/*
+ * mem_buffer的共享控制块。所有通过拷贝引用构造的mem_buffer指向同一个控制块，容量、引用计数、互斥量与内存指针均保存在这里。used为所有实例通过write_with写入过的最高位置，
+ * 用于shrink_to_fit()与trim()。
+ *
+ * 写时复制快照拥有自己的控制块，与原控制块共享同一块内存，shared_storage指向共享内存的控制块个数，不共享时为nullptr。任何一方写入、扩容或缩小之前先复制一份内存并递减该
+ * 计数，减为0的一方负责释放原内存与计数。分配器提供decommit时只复制used之前的部分，见mem_buffer::unshare。
+ *
+ * 控制块按缓存行对齐，三组字段各占一个缓存行：容量与内存指针在每次访问时读取、只在扩容时写入；引用计数在每次拷贝与析构时原子地修改；互斥量在每次读写时加锁，used在
+ * 每次追加写入时修改，且只在持有互斥量时访问，与互斥量放在同一个缓存行。分开后拷贝与析构不会使正在读写的线程缓存的互斥量与容量失效，追加写入也不会使只读的第一个缓存行
+ * 失效，控制块也不会与其他堆对象共享缓存行。
+ */
+struct alignas(mem_cache_line_size) mem_control_block {
+    size_t capacity;
+    char *data {nullptr};
+    mem_block_recycler *recycler {nullptr};
+    std::atomic<int> *shared_storage {nullptr};
+    alignas(mem_cache_line_size) std::atomic<int> ref_counter {1};
+    alignas(mem_cache_line_size) std::mutex mutex;
+    size_t used {0};
+
+    explicit mem_control_block(size_t capacity) : capacity(capacity) {}
+};
+
+/*
+ * mem_buffer(size_t)构造函数将通过capacity从heap内申请一个内存块并将引用计数设为1，任何通过operator=或mem_buffer(mem_buffer const&)引用构造的mem_buffer的每次引用都将使引用技术
+ * 增加1，任何mem_buffer的析构函数被调用后会以原子操作将引用计数减一，减为0的实例负责释放内存与控制块。
+ *
+ * 一旦mem_buffer被分配则不能再更改其指向的内容，若需要拷贝mem_buffer请调用拷贝引用构造函数。
+ *
+ * Allocator是分配器实例，通过以特定Allocator类传入模板参数使用分配器进行内存分配，分配器需实现static void *alloc(size_t)与static void release(void *, size_t)两个函数。默认
+ * 以mem_heap_allocator作为默认模板参数。分配器可选地实现resize与decommit，见mem_resizable_allocator。
+ *
+ * enable_auto_expand若为true，则在调用任何写函数时检查是否越界，若越界则重新分配合适大小的内存，分配大小由字段single_expand_size指定。
+ * enable_auto_release若为true，则在引用计数变为0时释放所有动态释放的资源。
+ * enable_copy_on_write若为true(通过copy_on_write(true)开启，默认关闭)，则拷贝构造得到的是快照(与snapshot()相同)：快照拥有自己的控制块，在任何一方第一次写入、扩容或
+ * 缩小之前与原实例共享内存，之后写入的一方复制一份私有内存，另一方不受影响。该标志随拷贝传递。mem_stream、mem_reader/mem_writer等访问类通过share()持有缓冲，不是快照，
+ * 通过它们写入与直接写入原实例相同。直接通过data()写入共享中的内存会同时改变快照的内容。
+ *
+ * 容量、引用计数、mutex与内存指针均保存在控制块mem_control_block中并随拷贝引用，在任何一个实例中扩容都会使所有共享该控制块的实例可见。
+ *
+ * 以capacity=0构造该类是未定义行为。
+ *
+ * 除position()、position(size_t)与rewind()以外，该类中的所有函数均为可重入的线程安全函数。这三个函数操作的位置属于实例本身，不与其他实例共享，也不受锁保护，多个线程需要
+ * 各自的读写位置时应使用mem_cursor.hpp中的mem_reader/mem_writer或各自的mem_stream。
+ * */
+template<typename Allocator>
+class mem_buffer {
+    template<typename T, typename Buffer>
+    friend class mem_stream;
+    template<typename A>
+    friend class mem_buffer_pool;
+    template<typename A>
+    friend class mem_buffer;
+private:
+    mem_control_block *ctrl;
+    size_t pos;
+    size_t single_expand_size {16 * 1024};
+    bool enable_auto_release;
+    bool enable_auto_expand;
+    bool enable_copy_on_write {false};
+
+    //引用计数减为0后释放内存与控制块，此时已没有其他实例指向block。属于缓冲池的控制块先交给池回收；内存仍被快照共享时只释放控制块，池拒绝回收没有内存的控制块
+    void release_block(mem_control_block *block) {
+#ifdef BUFFER_DEBUG
+        mem_trace::record(mem_trace_event::release, block, block->capacity);
+#endif
+        if (!drop_storage(block)) {
+            block->data = nullptr;
+        }
+        if (block->recycler != nullptr && block->recycler->recycle(block)) {
+            return;
+        }
+        if (block->data != nullptr) {
+            Allocator::release(block->data, block->capacity);
+            mem_stats<Allocator>::record_free(block->capacity);
+        }
+        delete block;
+    }
+
+    //放弃block对共享内存的引用，返回block是否为最后一个使用者(此时由它释放内存)。调用前需持有block的锁或block已没有其他实例
+    static bool drop_storage(mem_control_block *block) {
+        if (block->shared_storage == nullptr) {
+            return true;
+        }
+        //acq_rel保证另一方复制完成之后才可能由这里释放内存
+        bool last = block->shared_storage->fetch_sub(1, std::memory_order_acq_rel) == 1;
+        if (last) {
+            delete block->shared_storage;
+        }
+        block->shared_storage = nullptr;
+        return last;
+    }
+
+    //控制块的内存是否只属于它自己，其他共享者都已放弃时顺便解除共享。调用前需持有控制块的锁
+    bool exclusive() const {
+        if (ctrl->shared_storage == nullptr) {
+            return true;
+        }
+        if (ctrl->shared_storage->load(std::memory_order_acquire) == 1) {
+            drop_storage(ctrl);
+            return true;
+        }
+        return false;
+    }
+
+    /*
+     * 为控制块复制一份大小为new_capacity的私有内存，不再与快照共享，所有指向该控制块的实例都使用新内存。调用前需持有控制块的锁。分配器提供decommit时used之后的内容与trim()
+     * 一样视为未使用，只复制used之前的部分；分配器申请的内存已经为0(如mem_mmap_allocator)时不再清零，未复制的页面直到写入时才由系统分配，1 GB的缓冲只写过开头时分离
+     * 只需复制并占用写过的页面。
+     */
+    void unshare(size_t new_capacity) {
+        char *new_ptr = reinterpret_cast<char*>(Allocator::alloc(new_capacity));
+        if (new_ptr == nullptr) {
+            ctrl->mutex.unlock();
+            throw mem_exception(std::format("cannot allocate memory by allocator {}", typeid(Allocator).name()));
+        }
+        size_t copy_size = std::min(ctrl->capacity, new_capacity);
+        if constexpr (mem_decommit_allocator<Allocator>) {
+            copy_size = std::min(copy_size, ctrl->used);
+        }
+        mem_copy(new_ptr, ctrl->data, copy_size);
+        if constexpr (!mem_allocator_zero_filled<Allocator>) {
+            mem_zero(new_ptr + copy_size, new_capacity - copy_size);
+        }
+        mem_stats<Allocator>::record_alloc(new_capacity);
+        if (new_capacity > ctrl->capacity) {
+            mem_stats<Allocator>::record_expand(copy_size);
+        }
+#ifdef BUFFER_DEBUG
+        mem_trace::record(mem_trace_event::unshare, ctrl, new_capacity);
+#endif
+        //判断需要复制之后其余共享者可能已经全部放弃，此时由当前控制块释放原内存
+        if (drop_storage(ctrl)) {
+            Allocator::release(ctrl->data, ctrl->capacity);
+            mem_stats<Allocator>::record_free(ctrl->capacity);
+        }
+        ctrl->data = new_ptr;
+        ctrl->capacity = new_capacity;
+        ctrl->used = std::min(ctrl->used, new_capacity);
+    }
+
+    //将内存重新分配为new_capacity字节并保留前min(capacity, new_capacity)字节，返回新的地址，原内存已释放。失败时解锁并抛出mem_exception，原内存不变。调用前需持有控制块的锁。
+    char *reallocate(size_t new_capacity) {
+        char *new_ptr;
+        if constexpr (mem_resizable_allocator<Allocator>) {
+            new_ptr = reinterpret_cast<char*>(Allocator::resize(ctrl->data, ctrl->capacity, new_capacity));
+        } else {
+            new_ptr = reinterpret_cast<char*>(Allocator::alloc(new_capacity));
+            if (new_ptr != nullptr) {
+                mem_copy(new_ptr, ctrl->data, std::min(ctrl->capacity, new_capacity));
+                Allocator::release(ctrl->data, ctrl->capacity);
+            }
+        }
+        if (new_ptr == nullptr) {
+            ctrl->mutex.unlock();
+            throw mem_exception(std::format("cannot allocate memory by allocator {}", typeid(Allocator).name()));
+        }
+        return new_ptr;
+    }
+
+    //将容量缩小到new_capacity，内存被快照共享时复制出较小的私有内存。调用前需持有控制块的锁。
+    void shrink(size_t new_capacity) {
+        new_capacity = std::max<size_t>(new_capacity, 1);
+        if (new_capacity >= ctrl->capacity) {
+            return;
+        }
+        if (!exclusive()) {
+            unshare(new_capacity);
+            return;
+        }
+#ifdef BUFFER_DEBUG
+        mem_trace::record(mem_trace_event::shrink, ctrl, new_capacity);
+#endif
+        char *new_ptr = reallocate(new_capacity);
+        mem_stats<Allocator>::record_alloc(new_capacity);
+        mem_stats<Allocator>::record_free(ctrl->capacity);
+        ctrl->data = new_ptr;
+        ctrl->capacity = new_capacity;
+        ctrl->used = std::min(ctrl->used, new_capacity);
+    }
+
+    //将内存扩展到new_capacity，内存被快照共享时复制出较大的私有内存。调用前需持有控制块的锁。
+    void grow(size_t new_capacity) {
+        if (!exclusive()) {
+            unshare(new_capacity);
+            return;
+        }
+#ifdef BUFFER_DEBUG
+        mem_trace::record(mem_trace_event::expand, ctrl, new_capacity);
+#endif
+        char *new_ptr = reallocate(new_capacity);
+        if constexpr (!mem_allocator_zero_filled<Allocator>) {
+            mem_zero(new_ptr + ctrl->capacity, new_capacity - ctrl->capacity);
+        }
+        mem_stats<Allocator>::record_alloc(new_capacity);
+        mem_stats<Allocator>::record_free(ctrl->capacity);
+        mem_stats<Allocator>::record_expand(ctrl->capacity);
+        ctrl->data = new_ptr;
+        ctrl->capacity = new_capacity;
+    }
+
+    //写入[off, off + len)之前按需扩容或复制共享内存。调用前需持有控制块的锁，失败时解锁并抛出mem_exception
+    void prepare_write(size_t len, size_t off) {
+        if (len + off > ctrl->capacity) {
+            if (!enable_auto_expand || !enable_auto_release) {
+                ctrl->mutex.unlock();
+                throw mem_exception("cannot write buffer because its capacity is full");
+            }
+            size_t new_capacity = ctrl->capacity;
+            while (len + off > new_capacity) {
+                new_capacity += single_expand_size;
+            }
+            grow(new_capacity);
+        } else if (!exclusive()) {
+            unshare(ctrl->capacity);
+        }
+    }
+
+    template<typename F>
+    size_t find_in(size_t from, F&& f) const {
+        size_t r = npos;
+        read_with(0, from, [&](const char *data) {
+            size_t k = f(data, ctrl->capacity - from);
+            r = k == npos ? npos : from + k;
+        });
+        return r;
+    }
+
+    //对控制块加锁，启用统计时记录等待时间
+    void lock() const {
+        mem_stats<Allocator>::lock(ctrl->mutex);
+    }
+
+    template<std::endian E, typename T>
+    bool read_endian(T *dst, size_t count) {
+        size_t len = sizeof(T) * count;
+        bool r = read_with(len, pos, [dst, count](const char *src) { mem_copy_endian<E, T>(dst, src, count); });
+        pos += len;
+        return r;
+    }
+
+    template<std::endian E, typename T>
+    bool write_endian(const T *src, size_t count) {
+        size_t len = sizeof(T) * count;
+        bool r = write_with(len, pos, [src, count](char *dst) { mem_copy_endian<E, T>(dst, src, count); });
+        pos += len;
+        return r;
+    }
+
+    //由mem_buffer_pool以已经分配好内存、引用计数为1的控制块构造。标签参数避免与mem_buffer(size_t)在实参为0时产生歧义
+    struct adopt_block {};
+
+    mem_buffer(mem_control_block *block, adopt_block) : ctrl(block), pos(0), enable_auto_release(true), enable_auto_expand(true) {}
+
+    //增加引用计数并返回当前控制块，用于share()与非写时复制模式下的拷贝构造
+    mem_control_block *share_block() const {
+        //来源实例仍持有一份引用，计数不会在此期间减为0，递增不需要与其他操作排序
+#ifdef BUFFER_DEBUG
+        int count = ctrl->ref_counter.fetch_add(1, std::memory_order_relaxed) + 1;
+        mem_trace::record(mem_trace_event::ref_copy, ctrl, count);
+#else
+        ctrl->ref_counter.fetch_add(1, std::memory_order_relaxed);
+#endif
+        return ctrl;
+    }
+
+    //创建与当前控制块共享内存的新控制块，用于snapshot()与写时复制模式下的拷贝构造
+    mem_control_block *snapshot_block() const {
+        auto *block = new mem_control_block(0);
+        lock();
+        if (ctrl->shared_storage == nullptr) {
+            ctrl->shared_storage = new std::atomic<int> {1};
+        }
+        ctrl->shared_storage->fetch_add(1, std::memory_order_relaxed);
+        block->capacity = ctrl->capacity;
+        block->data = ctrl->data;
+        block->used = ctrl->used;
+        block->shared_storage = ctrl->shared_storage;
+        ctrl->mutex.unlock();
+#ifdef BUFFER_DEBUG
+        mem_trace::record(mem_trace_event::separate, block, block->capacity);
+#endif
+        return block;
+    }
+
+    //以block构造，位置与各标志从buffer复制
+    mem_buffer(mem_buffer const& buffer, mem_control_block *block) : ctrl(block), pos(buffer.pos), single_expand_size(buffer.single_expand_size), enable_auto_release(buffer.enable_auto_release), enable_auto_expand(buffer.enable_auto_expand), enable_copy_on_write(buffer.enable_copy_on_write) {}
+public:
+    static constexpr bool reference_counted = true;
+    //data()的对齐字节数，由Allocator决定，扩容与写时复制分离后保持不变
+    static constexpr size_t alignment = mem_allocator_alignment<Allocator>;
+
+    explicit mem_buffer(size_t capacity) : ctrl(new mem_control_block(capacity)), pos(0), enable_auto_release(true), enable_auto_expand(true) {
+        ctrl->data = reinterpret_cast<char*>(Allocator::alloc(capacity));
+        if (ctrl->data == nullptr) {
+            delete ctrl;
+            throw mem_exception(std::format("cannot allocate memory by allocator {}", typeid(Allocator).name()));
+        }
+        if constexpr (!mem_allocator_zero_filled<Allocator>) {
+            memset(ctrl->data, 0, capacity);
+        }
+        mem_stats<Allocator>::record_alloc(capacity);
+#ifdef BUFFER_DEBUG
+        mem_trace::record(mem_trace_event::create, ctrl, capacity);
+#endif
+    }
+
+    //写时复制模式下得到快照，否则与buffer共享控制块
+    mem_buffer(mem_buffer const& buffer) : mem_buffer(buffer, buffer.enable_copy_on_write ? buffer.snapshot_block() : buffer.share_block()) {}
+
+    //与当前实例共享控制块的实例，无论是否处于写时复制模式，通过它的写入与扩容都对当前实例可见。访问类通过mem_hold()以该函数持有缓冲
+    mem_buffer share() const {
+        return mem_buffer(*this, share_block());
+    }
+
+    /*
+     * 当前内容的写时复制快照：拥有自己的控制块，与当前实例共享内存直到任何一方写入、扩容或缩小，此时写入的一方复制一份私有内存。不要求开启copy_on_write。
+     */
+    mem_buffer snapshot() const {
+        return mem_buffer(*this, snapshot_block());
+    }
+
+    //与other是否指向同一个控制块，快照拥有自己的控制块，不算同一个
+    template<typename A>
+    bool shares_block(mem_buffer<A> const& other) const {
+        return static_cast<const void*>(ctrl) == static_cast<const void*>(other.ctrl);
+    }
+
+    /*
+     * 在持有锁的情况下以指向[off, off + len)的const char*调用f，越界时返回false。f中不应抛出异常，也不应再访问该缓冲。
+     */
+    template<typename F>
+    bool read_with(size_t const len, size_t const off, F&& f) const {
+        lock();
+        if (len + off > ctrl->capacity) {
+            ctrl->mutex.unlock();
+            return false; // EOF
+        }
+        f(const_cast<const char*>(ctrl->data + off));
+        ctrl->mutex.unlock();
+        mem_stats<Allocator>::record_read(len);
+        return true;
+    }
+
+    /*
+     * 在持有锁的情况下以指向[off, off + len)的char*调用f，必要时先扩容或进行写时复制分离。f返回size_t时为实际写入的字节数，used只计入这一部分，报告写入0字节时
+     * used不变(可用于只预留空间)；返回false或mem_npos表示放弃写入，不更新used，函数返回false(见mem_written)。f中不应抛出异常，也不应再访问该缓冲。
+     */
+    template<typename F>
+    bool write_with(size_t const len, size_t const off, F&& f) {
+        lock();
+        prepare_write(len, off);
+        size_t n = mem_written(len, f, ctrl->data + off);
+        if (n != mem_npos && n != 0 && off + n > ctrl->used) {
+            ctrl->used = off + n;
+        }
+        ctrl->mutex.unlock();
+        mem_stats<Allocator>::record_write(n == mem_npos ? 0 : n);
+        return n != mem_npos;
+    }
+
+    /*
+     * 同时持有src与当前实例的锁，以src中[src_off, src_off + src_len)的const char*与当前实例[off, off + len)的char*调用f(in, out)，必要时先扩容或复制共享内存。f返回false
+     * 或mem_npos表示放弃写入，此时不更新used，函数返回false；f返回size_t时used只计入实际写入的字节数(见mem_written)。src越界时同样返回false且不调用f。
+     * 两个锁按控制块地址的顺序取得，方向相反的并发调用不会死锁；src与当前实例是同一个控制块时只加一次锁，此时两段范围可能重叠，由调用方处理。f中不应抛出异常，也不应再访问这两个缓冲。
+     */
+    template<typename A, typename F>
+    bool transfer_with(mem_buffer<A> const& src, size_t const src_len, size_t const src_off, size_t const len, size_t const off, F&& f) {
+        mem_control_block *other = src.ctrl;
+        if (other == ctrl) {
+            lock();
+        } else if (std::less<mem_control_block*>()(other, ctrl)) {
+            src.lock();
+            lock();
+        } else {
+            lock();
+            src.lock();
+        }
+        auto unlock_other = [&] {
+            if (other != ctrl) {
+                other->mutex.unlock();
+            }
+        };
+        if (src_len + src_off > other->capacity) {
+            unlock_other();
+            ctrl->mutex.unlock();
+            return false; // EOF
+        }
+        try {
+            prepare_write(len, off);
+        } catch (...) {
+            //prepare_write失败时已解锁当前控制块
+            unlock_other();
+            throw;
+        }
+        //扩容只改变当前控制块，同一控制块时在prepare_write之后再取源地址
+        size_t n = mem_written(len, f, const_cast<const char*>(other->data + src_off), ctrl->data + off);
+        bool r = n != mem_npos;
+        if (r && n != 0 && off + n > ctrl->used) {
+            ctrl->used = off + n;
+        }
+        unlock_other();
+        ctrl->mutex.unlock();
+        mem_stats<A>::record_read(src_len);
+        if (r) {
+            mem_stats<Allocator>::record_write(n);
+        }
+        return r;
+    }
+
+    bool read(char *dst, size_t const len, size_t const off) const {
+        return read_with(len, off, [dst, len](const char *src) { memcpy(dst, src, len); });
+    }
+
+    bool read(char *dst, size_t const len) {
+        bool r = read(dst, len, pos);
+        pos += len;
+        return r;
+    }
+
+    bool write(const char *src, size_t const len, size_t const off) {
+        return write_with(len, off, [src, len](char *dst) { mem_copy(dst, src, len); });
+    }
+
+    bool write(const char *src, const size_t len) {
+        bool r = write(src, len, pos);
+        pos += len;
+        return r;
+    }
+
+    size_t auto_expand_size() const {
+        return single_expand_size;
+    }
+
+    void auto_expand_size(size_t size) {
+        single_expand_size = size;
+    }
+
+    bool copy_on_write() const {
+        return enable_copy_on_write;
+    }
+
+    void copy_on_write(bool enable) {
+        enable_copy_on_write = enable;
+    }
+
+    size_t capacity() const {
+        return ctrl->capacity;
+    }
+
+    char *data() const {
+        return ctrl->data;
+    }
+
+    //指向该控制块的实例数，包括访问类通过share()持有的实例，不包括快照
+    int use_count() const {
+        return ctrl->ref_counter.load(std::memory_order_acquire);
+    }
+
+    template<typename T>
+#ifdef BUFFER_STRICT_TEMPLATE_TYPE_CHECK
+    requires basic_integral_type<T>
+#endif
+    bool write(T const& t) {
+        return write(reinterpret_cast<const char*>(&t), sizeof(T));
+    }
+
+    template<typename T>
+#ifdef BUFFER_STRICT_TEMPLATE_TYPE_CHECK
+    requires basic_integral_type<T>
+#endif
+bool write(T const&& t) {
+        T v = t;
+        return write(reinterpret_cast<char*>(&v), sizeof(T));
+    }
+
+    template<typename T>
+#ifdef BUFFER_STRICT_TEMPLATE_TYPE_CHECK
+    requires basic_integral_type<T>
+#endif
+    bool read(T& t) {
+         return read(reinterpret_cast<char*>(&t), sizeof(T));
+    }
+
+    template<typename Rt>
+#ifdef BUFFER_STRICT_TEMPLATE_TYPE_CHECK
+    requires basic_integral_type<T>
+#endif
+    Rt read() {
+        Rt v;
+        read(v);
+        return v;
+    }
+
+    /*
+     * 以大端序(be)或小端序(le)读写数值，与本机字节序不同时在拷贝过程中反转字节序。带count参数的版本批量读写count个元素，批量反转使用SIMD实现。
+     */
+    template<mem_swappable T>
+    bool read_be(T& t) {
+        return read_endian<std::endian::big>(&t, 1);
+    }
+
+    template<mem_swappable T>
+    bool read_le(T& t) {
+        return read_endian<std::endian::little>(&t, 1);
+    }
+
+    template<mem_swappable Rt>
+    Rt read_be() {
+        Rt v {};
+        read_be(v);
+        return v;
+    }
+
+    template<mem_swappable Rt>
+    Rt read_le() {
+        Rt v {};
+        read_le(v);
+        return v;
+    }
+
+    template<mem_swappable T>
+    bool write_be(T const& t) {
+        return write_endian<std::endian::big>(&t, 1);
+    }
+
+    template<mem_swappable T>
+    bool write_le(T const& t) {
+        return write_endian<std::endian::little>(&t, 1);
+    }
+
+    template<mem_swappable T>
+    bool read_be(T *dst, size_t count) {
+        return read_endian<std::endian::big>(dst, count);
+    }
+
+    template<mem_swappable T>
+    bool read_le(T *dst, size_t count) {
+        return read_endian<std::endian::little>(dst, count);
+    }
+
+    template<mem_swappable T>
+    bool write_be(const T *src, size_t count) {
+        return write_endian<std::endian::big>(src, count);
+    }
+
+    template<mem_swappable T>
+    bool write_le(const T *src, size_t count) {
+        return write_endian<std::endian::little>(src, count);
+    }
+
+    static constexpr size_t npos = mem_npos;
+
+    /*
+     * 从from开始查找字节c、集合set中的任意字节或子串needle，返回其偏移，找不到时返回npos。查找在持有锁的情况下使用SIMD进行，只加锁一次。
+     */
+    size_t find(char c, size_t from = 0) const {
+        return find_in(from, [c](const char *data, size_t len) { return mem_find_byte(data, len, c); });
+    }
+
+    size_t find_any(std::string_view set, size_t from = 0) const {
+        return find_in(from, [set](const char *data, size_t len) { return mem_find_any(data, len, set.data(), set.size()); });
+    }
+
+    size_t find(std::string_view needle, size_t from = 0) const {
+        return find_in(from, [needle](const char *data, size_t len) { return mem_find(data, len, needle.data(), needle.size()); });
+    }
+
+    /*
+     * [off, off + len)的CRC32C与XXH3-64，越界时抛出mem_exception。
+     */
+    uint32_t crc32c(size_t off, size_t len) const {
+        uint32_t r = 0;
+        if (!read_with(len, off, [&r, len](const char *data) { r = mem_crc32c(data, len); })) {
+            throw mem_exception(std::format("checksum range [{}, {}) is out of buffer", off, off + len));
+        }
+        return r;
+    }
+
+    uint64_t xxh3(size_t off, size_t len, uint64_t seed = 0) const {
+        uint64_t r = 0;
+        if (!read_with(len, off, [&r, len, seed](const char *data) { r = mem_xxh3_64(data, len, seed); })) {
+            throw mem_exception(std::format("checksum range [{}, {}) is out of buffer", off, off + len));
+        }
+        return r;
+    }
+
+    //实例自身的位置，不是线程安全的，见类注释
+    size_t position() const {
+        return pos;
+    }
+
+    void position(size_t position) {
+        this->pos = position;
+    }
+
+    void rewind() {
+        this->pos = 0;
     }
 
-    T peek() {
-        T t = get();
-        pos--;
-        return t;
+    bool expand() {
+        if (enable_auto_release && enable_auto_expand) {
+            lock();
+            grow(ctrl->capacity + single_expand_size);
+            ctrl->mutex.unlock();
+            return true;
+        }
+        return false;
     }
 
-    T peek(size_t len) {
-        forward(len - 1);
-        T t = get();
-        back(len);
-        return t;
+    //一次性扩容到至少new_capacity字节，容量已足够时不做任何事
+    bool expand(size_t new_capacity) {
+        if (enable_auto_release && enable_auto_expand) {
+            lock();
+            if (new_capacity > ctrl->capacity) {
+                grow(new_capacity);
+            }
+            ctrl->mutex.unlock();
+            return true;
+        }
+        return false;
     }
 
-    bool put(T const& t) {
-        bool r = buffer.write(reinterpret_cast<const char*>(&t), step, pos);
-        pos += step;
-        return r;
+    //与expand(size_t)相同，预先一次性分配到至少capacity字节，避免随后的写入多次扩容
+    bool reserve(size_t capacity) {
+        return expand(capacity);
     }
 
-    void reset() {
-        pos = 0;
-        eof_bit = false;
+    //所有共享该控制块的实例通过write_with(包括write()与流的写函数)写入过的最高位置，直接通过data()写入的部分不计入
+    size_t used() const {
+        lock();
+        size_t r = ctrl->used;
+        ctrl->mutex.unlock();
+        return r;
     }
 
-    void back() {
-        pos -= step;
-        if (pos < buffer.capacity) {
-            eof_bit = false;
+    /*
+     * 将容量缩小到used字节(至少为1)，保留[0, used)的内容，容量不大于used时不做任何事。与扩容相同，新容量对所有共享该控制块的实例可见；内存被快照共享时复制出较小的
+     * 私有内存，快照不受影响。分配器提供resize时原地缩小，否则重新申请并拷贝。需要enable_auto_release与enable_auto_expand，否则返回false。
+     */
+    bool shrink_to_fit(size_t used) {
+        if (enable_auto_release && enable_auto_expand) {
+            lock();
+            shrink(used);
+            ctrl->mutex.unlock();
+            return true;
         }
+        return false;
     }
 
-    void back(size_t len) {
-        pos -= step * len;
-        if (pos < buffer.capacity) {
-            eof_bit = false;
+    //缩小到used()
+    bool shrink_to_fit() {
+        if (enable_auto_release && enable_auto_expand) {
+            lock();
+            shrink(ctrl->used);
+            ctrl->mutex.unlock();
+            return true;
         }
+        return false;
     }
 
-    void forward() {
-        pos += step;
-        if (pos >= buffer.capacity) {
-            eof_bit = true;
+    /*
+     * 将used()之后未使用的内存归还给系统，返回归还的字节数。分配器提供decommit(如mem_mmap_allocator)时容量不变，只通过madvise释放尾部的整页物理内存；否则与shrink_to_fit()
+     * 相同，容量缩小到used()。条件与shrink_to_fit()相同，不满足时返回0。
+     */
+    size_t trim() {
+        if (!enable_auto_release || !enable_auto_expand) {
+            return 0;
+        }
+        lock();
+        size_t r;
+        if constexpr (mem_decommit_allocator<Allocator>) {
+            r = Allocator::decommit(ctrl->data + ctrl->used, ctrl->capacity - ctrl->used);
+        } else {
+            size_t old_capacity = ctrl->capacity;
+            shrink(ctrl->used);
+            r = old_capacity - ctrl->capacity;
         }
+        ctrl->mutex.unlock();
+        return r;
     }
 
-    void forward(size_t len) {
-        pos += step * len;
-        if (pos >= buffer.capacity) {
-            eof_bit = true;
-        }
+    auto get_byte_stream() {
+        return mem_stream<uint8_t, mem_buffer>(*this);
     }
 
-    T* ptr() {
-        return reinterpret_cast<T*>(*buffer.ptr + pos);
+    auto get_char_stream() {
+        return mem_stream<char, mem_buffer>(*this);
     }
 
-    [[nodiscard]] bool eof() const {
-        return eof_bit;
+    auto get_char8_stream() {
+        return mem_stream<char8_t, mem_buffer>(*this);
     }
 
-    bool eof(size_t s) {
-        if (pos + s >= buffer.capacity) {
-            return true;
-        }
-        return false;
+    auto get_char16_stream() {
+        return mem_stream<char16_t, mem_buffer>(*this);
     }
 
-    //equals to get()
-    mem_stream& operator>>(T& t) {
-        get(t);
-        return *this;
+    auto get_char32_stream() {
+        return mem_stream<char32_t, mem_buffer>(*this);
     }
 
-    //equals to put()
-    mem_stream& operator<<(T const& t) {
-        put(t);
-        return *this;
+    ~mem_buffer() {
+        //acq_rel保证其他实例在递减之前的写入对释放内存的实例可见
+        int remaining = ctrl->ref_counter.fetch_sub(1, std::memory_order_acq_rel) - 1;
+#ifdef BUFFER_DEBUG
+        mem_trace::record(mem_trace_event::ref_release, ctrl, remaining);
+#endif
+        if (remaining == 0 && enable_auto_release) {
+            release_block(ctrl);
+        }
     }
 
-    explicit mem_stream(mem_stream const&&) = delete;
-    mem_stream() = delete;
+    mem_buffer() = delete;
+    mem_buffer const& operator=(mem_buffer const&) = delete;
+    mem_buffer const& operator=(mem_buffer const&&) = delete;
+    explicit mem_buffer(mem_buffer const&& buffer) = delete;
 };
 
 /*
- * mem_buffer(size_t)构造函数将通过capacity从heap内申请一个内存块并将引用计数设为1，任何通过operator=或mem_buffer(mem_buffer const&)引用构造的mem_buffer的每次引用都将使引用技术
- * 增加1，任何mem_buffer的析构函数被调用后会以同步的方式将引用计数减一。
- *
- * 一旦mem_buffer被分配则不能再更改其指向的内容，若需要拷贝mem_buffer请调用拷贝引用构造函数。
- *
- * Allocator是分配器实例，通过以特定Allocator类传入模板参数使用分配器进行内存分配，分配器需实现static void *alloc(size_t)与static void release(void *, size_t)两个函数。默认
- * 以mem_heap_allocator作为默认模板参数。
- *
- * enable_auto_expand若为true，则在调用任何写函数时检查是否越界，若越界则重新分配合适大小的内存，分配大小由字段single_expand_size指定。
- * enable_auto_release若为true，则在引用计数变为0时释放所有动态释放的资源。
+ * 带小缓冲优化的内存缓冲类。容量不超过N字节时数据直接保存在对象内部，不申请堆内存，也没有mutex与引用计数；当write()越过N字节时才通过Allocator申请内存并迁移已有数据，此后按
+ * single_expand_size自动扩容，行为与mem_buffer一致。
  *
- * 成员capacity、mutex均随拷贝引用，在任何一个实例中改变这两个成员字段均会导致所有实例中的两个字段改变。ptr为指向分配内存的二级指针，由Allocator分配后在释放前不再改变，若应用enable_
- * auto_expand则会改变其指向的内存。
- *
- * 以capacity=0构造该类是未定义行为。
+ * 接口与mem_buffer保持一致，可直接作为mem_stream的Buffer模板参数。与mem_buffer不同，拷贝构造会复制全部数据；mem_stream以引用方式持有该类，因此流的生命周期不能超过缓冲本身。
  *
- * 该类中的所有函数均为可重入的线程安全函数。
- * */
-template<typename Allocator>
-class mem_buffer {
-    template<typename T, typename Buffer>
-    friend class mem_stream;
+ * 该类不是线程安全的。
+ */
+template<size_t N, typename Allocator = mem_heap_allocator>
+class mem_small_buffer {
 private:
-    size_t& capacity;
-    size_t pos;
+    alignas(mem_allocator_alignment<Allocator>) char inline_data[N] {};
+    char *heap_data {nullptr};
+    size_t cap {0};
+    size_t pos {0};
     size_t single_expand_size {16 * 1024};
-    int *ref_counter;
-    std::mutex& mutex;
-    char **ptr;
-    bool enable_auto_release;
-    bool enable_auto_expand;
-public:
-    explicit mem_buffer(size_t capacity, std::mutex *mutex = new std::mutex) : capacity(*new size_t), pos(0), mutex(*mutex), enable_auto_release(true), enable_auto_expand(true) {
-        ref_counter = new int[1];
-        *ref_counter = 1;
-        this->capacity = capacity;
-        ptr = reinterpret_cast<char**>(Allocator::alloc(capacity));
-        if (ptr == nullptr) {
-            throw mem_exception(std::format("cannot allocate memory pointer by allocator {}", typeid(Allocator).name()));
-        }
-        *ptr = reinterpret_cast<char*>(Allocator::alloc(capacity));
-        if (*ptr == nullptr) {
+    //通过write_with写入过的最高位置，与mem_buffer的used()相同
+    size_t written {0};
+
+    void grow(size_t new_capacity) {
+        if (new_capacity <= N) {
+            cap = new_capacity;
+            return;
+        }
+        char *new_ptr = reinterpret_cast<char*>(Allocator::alloc(new_capacity));
+        if (new_ptr == nullptr) {
             throw mem_exception(std::format("cannot allocate memory by allocator {}", typeid(Allocator).name()));
         }
-        memset(*ptr, 0, capacity);
+        mem_copy(new_ptr, data(), cap);
+        if constexpr (!mem_allocator_zero_filled<Allocator>) {
+            mem_zero(new_ptr + cap, new_capacity - cap);
+        }
+        mem_stats<Allocator>::record_alloc(new_capacity);
+        mem_stats<Allocator>::record_expand(cap);
+        if (heap_data != nullptr) {
+            Allocator::release(heap_data, cap);
+            mem_stats<Allocator>::record_free(cap);
+        }
+        heap_data = new_ptr;
+        cap = new_capacity;
     }
+public:
+    static constexpr bool reference_counted = false;
+    //内部存储与堆内存都按Allocator的对齐字节数对齐
+    static constexpr size_t alignment = mem_allocator_alignment<Allocator>;
 
-    mem_buffer(mem_buffer const& buffer) : mutex(buffer.mutex), enable_auto_release(buffer.enable_auto_release), enable_auto_expand(buffer.enable_auto_expand), capacity(buffer.capacity), ref_counter(buffer.ref_counter), ptr(buffer.ptr), pos(buffer.pos) {
-        mutex.lock();
-#ifdef BUFFER_DEBUG
-        std::cout << "called ref copy constructor" << std::endl;
-#endif
-        ++(*this->ref_counter);
-        mutex.unlock();
+    explicit mem_small_buffer(size_t capacity = N) {
+        grow(capacity);
     }
 
-    bool read(char *dst, size_t const len, size_t const off) const {
-        if (len + off > capacity) {
+    mem_small_buffer(mem_small_buffer const& buffer) : pos(buffer.pos), single_expand_size(buffer.single_expand_size), written(buffer.written) {
+        grow(buffer.cap);
+        mem_copy(data(), buffer.data(), cap);
+    }
+
+    template<typename F>
+    bool read_with(size_t const len, size_t const off, F&& f) const {
+        if (len + off > cap) {
             return false; // EOF
         }
-        mutex.lock();
-        memcpy(dst, *ptr + off, len);
-        mutex.unlock();
+        f(data() + off);
+        mem_stats<Allocator>::record_read(len);
         return true;
     }
 
+    //f的返回值与mem_buffer::write_with相同，见mem_written
+    template<typename F>
+    bool write_with(size_t const len, size_t const off, F&& f) {
+        if (len + off > cap) {
+            size_t new_capacity = N;
+            while (len + off > new_capacity) {
+                new_capacity += single_expand_size;
+            }
+            grow(new_capacity);
+        }
+        size_t n = mem_written(len, f, data() + off);
+        if (n != mem_npos && n != 0 && off + n > written) {
+            written = off + n;
+        }
+        mem_stats<Allocator>::record_write(n == mem_npos ? 0 : n);
+        return n != mem_npos;
+    }
+
+    bool read(char *dst, size_t const len, size_t const off) const {
+        return read_with(len, off, [dst, len](const char *src) { memcpy(dst, src, len); });
+    }
+
     bool read(char *dst, size_t const len) {
         bool r = read(dst, len, pos);
         pos += len;
@@ -227,17 +1651,7 @@ public:
     }
 
     bool write(const char *src, size_t const len, size_t const off) {
-        mutex.lock();
-        if (len + off > capacity) {
-            if (enable_auto_expand) {
-                expand();
-            } else {
-                throw mem_exception("cannot read buffer because its capacity is full");
-            }
-        }
-        memcpy(*ptr + off, src, len);
-        mutex.unlock();
-        return true;
+        return write_with(len, off, [src, len](char *dst) { mem_copy(dst, src, len); });
     }
 
     bool write(const char *src, const size_t len) {
@@ -254,21 +1668,33 @@ public:
         single_expand_size = size;
     }
 
-    template<typename T>
-#ifdef BUFFER_STRICT_TEMPLATE_TYPE_CHECK
-    requires basic_integral_type<T>
-#endif
-    bool write(T const& t) {
-        return write(reinterpret_cast<const char*>(&t), sizeof(T));
+    size_t capacity() const {
+        return cap;
+    }
+
+    size_t used() const {
+        return written;
+    }
+
+    char *data() {
+        return heap_data != nullptr ? heap_data : inline_data;
+    }
+
+    const char *data() const {
+        return heap_data != nullptr ? heap_data : inline_data;
+    }
+
+    //数据是否仍保存在对象内部
+    bool is_inline() const {
+        return heap_data == nullptr;
     }
 
     template<typename T>
 #ifdef BUFFER_STRICT_TEMPLATE_TYPE_CHECK
     requires basic_integral_type<T>
 #endif
-bool write(T const&& t) {
-        T v = t;
-        return write(reinterpret_cast<char*>(&v), sizeof(T));
+    bool write(T const& t) {
+        return write(reinterpret_cast<const char*>(&t), sizeof(T));
     }
 
     template<typename T>
@@ -276,12 +1702,12 @@ bool write(T const&& t) {
     requires basic_integral_type<T>
 #endif
     bool read(T& t) {
-         return read(reinterpret_cast<char*>(&t), sizeof(T));
+        return read(reinterpret_cast<char*>(&t), sizeof(T));
     }
 
     template<typename Rt>
 #ifdef BUFFER_STRICT_TEMPLATE_TYPE_CHECK
-    requires basic_integral_type<T>
+    requires basic_integral_type<Rt>
 #endif
     Rt read() {
         Rt v;
@@ -302,65 +1728,212 @@ bool write(T const&& t) {
     }
 
     bool expand() {
-        if (enable_auto_release && enable_auto_expand) {
-#ifdef BUFFER_DEBUG
-            std::cout << "try expand buffer, new capacity:" << capacity + single_expand_size << std::endl;
-#endif
-            size_t new_capacity = capacity + single_expand_size;
-            char *new_ptr = reinterpret_cast<char*>(Allocator::alloc(new_capacity));
-            memset(new_ptr, 0, new_capacity);
-            memcpy(new_ptr, *ptr, capacity);
-            Allocator::release(*ptr, capacity);
-            *ptr = new_ptr;
-            capacity = new_capacity;
-            return true;
+        grow(std::max(cap, N) + single_expand_size);
+        return true;
+    }
+
+    bool expand(size_t new_capacity) {
+        if (new_capacity > cap) {
+            grow(new_capacity);
         }
-        return false;
+        return true;
     }
 
     auto get_byte_stream() {
-        return mem_stream<uint8_t, mem_buffer>(*this);
+        return mem_stream<uint8_t, mem_small_buffer>(*this);
     }
 
     auto get_char_stream() {
-        return mem_stream<char, mem_buffer>(*this);
+        return mem_stream<char, mem_small_buffer>(*this);
     }
 
     auto get_char8_stream() {
-        return mem_stream<char8_t, mem_buffer>(*this);
+        return mem_stream<char8_t, mem_small_buffer>(*this);
     }
 
     auto get_char16_stream() {
-        return mem_stream<char16_t, mem_buffer>(*this);
+        return mem_stream<char16_t, mem_small_buffer>(*this);
     }
 
     auto get_char32_stream() {
-        return mem_stream<char32_t, mem_buffer>(*this);
+        return mem_stream<char32_t, mem_small_buffer>(*this);
     }
 
-    ~mem_buffer() {
-        mutex.lock();
-        --(*ref_counter);
-#ifdef BUFFER_DEBUG
-        std::cout << "ref_counter-1, current: " << *ref_counter << std::endl;
-#endif
-        mutex.unlock();
-        if (*ref_counter == 0 && enable_auto_release) {
-#ifdef BUFFER_DEBUG
-            std::cout << "buffer released.";
-#endif
-            Allocator::release(*ptr, capacity);
-            Allocator::release(ptr, sizeof(char**));
-            delete &mutex;
+    ~mem_small_buffer() {
+        if (heap_data != nullptr) {
+            Allocator::release(heap_data, cap);
+            mem_stats<Allocator>::record_free(cap);
+        }
+    }
+
+    mem_small_buffer const& operator=(mem_small_buffer const&) = delete;
+    mem_small_buffer const& operator=(mem_small_buffer const&&) = delete;
+};
+
+/*
+ * 编译期固定容量的内存缓冲类，以std::array<std::byte, N>作为存储，没有堆内存、锁与引用计数。read/write/get_*_stream()均为constexpr，可在常量求值中编码协议头并通过static_assert
+ * 检查结果。
+ *
+ * 容量固定为N，越界写入将抛出mem_exception(在常量求值中表现为编译错误)，expand()总是返回false。mem_stream以引用方式持有该类。
+ *
+ * 该类不是线程安全的。
+ */
+template<size_t N>
+class mem_static_buffer {
+private:
+    std::array<std::byte, N> storage {};
+    size_t pos {0};
+public:
+    static constexpr bool reference_counted = false;
+
+    constexpr mem_static_buffer() = default;
+
+    template<typename F>
+    bool read_with(size_t const len, size_t const off, F&& f) const {
+        if (len + off > N) {
+            return false; // EOF
+        }
+        f(data() + off);
+        return true;
+    }
+
+    template<typename F>
+    bool write_with(size_t const len, size_t const off, F&& f) {
+        if (len + off > N) {
+            throw mem_exception("cannot write buffer because its capacity is full");
+        }
+        return mem_written(len, f, data() + off) != mem_npos;
+    }
+
+    constexpr bool read(char *dst, size_t const len, size_t const off) const {
+        if (len + off > N) {
+            return false; // EOF
+        }
+        if (std::is_constant_evaluated()) {
+            for (size_t i = 0; i < len; ++i) {
+                dst[i] = static_cast<char>(storage[off + i]);
+            }
+        } else {
+            memcpy(dst, storage.data() + off, len);
+        }
+        return true;
+    }
+
+    constexpr bool read(char *dst, size_t const len) {
+        bool r = read(dst, len, pos);
+        pos += len;
+        return r;
+    }
+
+    constexpr bool write(const char *src, size_t const len, size_t const off) {
+        if (len + off > N) {
+            throw mem_exception("cannot write buffer because its capacity is full");
+        }
+        if (std::is_constant_evaluated()) {
+            for (size_t i = 0; i < len; ++i) {
+                storage[off + i] = static_cast<std::byte>(src[i]);
+            }
         } else {
+            memcpy(storage.data() + off, src, len);
+        }
+        return true;
+    }
+
+    constexpr bool write(const char *src, const size_t len) {
+        bool r = write(src, len, pos);
+        pos += len;
+        return r;
+    }
+
+    constexpr size_t capacity() const {
+        return N;
+    }
+
+    char *data() {
+        return reinterpret_cast<char*>(storage.data());
+    }
+
+    const char *data() const {
+        return reinterpret_cast<const char*>(storage.data());
+    }
+
+    //常量求值中访问内容的途径
+    constexpr std::array<std::byte, N> const& bytes() const {
+        return storage;
+    }
+
+    template<typename T>
+#ifdef BUFFER_STRICT_TEMPLATE_TYPE_CHECK
+    requires basic_integral_type<T>
+#endif
+    constexpr bool write(T const& t) {
+        auto bytes = std::bit_cast<std::array<char, sizeof(T)>>(t);
+        return write(bytes.data(), sizeof(T));
+    }
 
+    template<typename T>
+#ifdef BUFFER_STRICT_TEMPLATE_TYPE_CHECK
+    requires basic_integral_type<T>
+#endif
+    constexpr bool read(T& t) {
+        std::array<char, sizeof(T)> bytes {};
+        bool r = read(bytes.data(), sizeof(T));
+        if (r) {
+            t = std::bit_cast<T>(bytes);
         }
+        return r;
     }
 
-    mem_buffer() = delete;
-    mem_buffer const& operator=(mem_buffer const&) = delete;
-    mem_buffer const& operator=(mem_buffer const&&) = delete;
-    explicit mem_buffer(mem_buffer const&& buffer) = delete;
+    template<typename Rt>
+#ifdef BUFFER_STRICT_TEMPLATE_TYPE_CHECK
+    requires basic_integral_type<Rt>
+#endif
+    constexpr Rt read() {
+        Rt v {};
+        read(v);
+        return v;
+    }
+
+    constexpr size_t position() const {
+        return pos;
+    }
+
+    constexpr void position(size_t position) {
+        this->pos = position;
+    }
+
+    constexpr void rewind() {
+        this->pos = 0;
+    }
+
+    constexpr bool expand() {
+        return false;
+    }
+
+    //容量固定，仅当new_capacity不超过N时返回true
+    constexpr bool expand(size_t new_capacity) {
+        return new_capacity <= N;
+    }
+
+    constexpr auto get_byte_stream() {
+        return mem_stream<uint8_t, mem_static_buffer>(*this);
+    }
+
+    constexpr auto get_char_stream() {
+        return mem_stream<char, mem_static_buffer>(*this);
+    }
+
+    constexpr auto get_char8_stream() {
+        return mem_stream<char8_t, mem_static_buffer>(*this);
+    }
+
+    constexpr auto get_char16_stream() {
+        return mem_stream<char16_t, mem_static_buffer>(*this);
+    }
+
+    constexpr auto get_char32_stream() {
+        return mem_stream<char32_t, mem_static_buffer>(*this);
+    }
 };
 
 template<typename Allocator = mem_heap_allocator>
@@ -0,0 +1,149 @@
+/*
+ * mem_async_stream测试：read_until的分隔符与数据分多次到达、写入回调只写入一部分，以及多个生产方并发追加。建议在ThreadSanitizer与AddressSanitizer下分别运行。
+ *
+ * 编译：g++ -std=c++20 -O1 -g -fsanitize=thread -I.. mem_async_test.cpp -o mem_async_test -pthread
+ * 用法：mem_async_test
+ */
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../mem_async.hpp"
+
+static int failures = 0;
+
+#define CHECK(cond) do { if (!(cond)) { std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); ++failures; } } while (0)
+
+//逐行读取直到流关闭，末尾没有分隔符的数据使read_until抛出异常
+static mem_async_task<size_t> read_lines(mem_async_stream<>& s, std::vector<std::string>& lines) {
+    try {
+        for (;;) {
+            lines.push_back(co_await s.read_until('\n'));
+        }
+    } catch (mem_exception const&) {
+    }
+    co_return s.available();
+}
+
+static void write(mem_async_stream<>& s, std::string_view text) {
+    CHECK(s.write(text.data(), text.size()));
+}
+
+/*
+ * 分隔符落在片段开头、末尾或单独成为一个片段，行跨越多个片段
+ */
+static void test_read_until_fragments() {
+    mem_buffer b(1);
+    mem_async_stream s(b);
+    std::vector<std::string> lines;
+    auto task = read_lines(s, lines);
+    for (std::string_view part : {"hel", "lo\nwor", "ld", "\n", "\n", "a\nb\nc", "", "d\n", "tail"}) {
+        CHECK(!task.done());
+        write(s, part);
+    }
+    CHECK(lines == (std::vector<std::string> {"hello", "world", "", "a", "b", "cd"}));
+    s.close();
+    CHECK(task.done());
+    CHECK(task.get() == 4);
+}
+
+//逐字节到达，每一次写入都恢复并检查等待中的读取
+static void test_read_until_bytes() {
+    std::string text;
+    for (int i = 0; i < 50; ++i) {
+        text += std::string(static_cast<size_t>(i), 'x') + "\n";
+    }
+    mem_buffer b(1);
+    mem_async_stream s(b);
+    std::vector<std::string> lines;
+    auto task = read_lines(s, lines);
+    for (char c : text) {
+        write(s, std::string_view(&c, 1));
+    }
+    s.close();
+    CHECK(task.done());
+    CHECK(task.get() == 0);
+    CHECK(lines.size() == 50);
+    for (size_t i = 0; i < lines.size(); ++i) {
+        CHECK(lines[i] == std::string(i, 'x'));
+    }
+}
+
+/*
+ * write_with的回调报告只写入一部分时，只有这一部分对消费方可见，下一次写入紧接其后；放弃写入时不可见
+ */
+static void test_partial_write() {
+    mem_buffer b(1);
+    mem_async_stream s(b);
+    std::vector<std::string> lines;
+    auto task = read_lines(s, lines);
+    CHECK(s.write_with(16, [](char *dst) {
+        memcpy(dst, "ab\ncd", 5);
+        return static_cast<size_t>(5);
+    }));
+    CHECK(s.filled() == 5);
+    CHECK(!s.write_with(16, [](char *) { return false; }));
+    CHECK(s.filled() == 5);
+    write(s, "ef\n");
+    CHECK(lines == (std::vector<std::string> {"ab", "cdef"}));
+    s.close();
+    CHECK(task.get() == 0);
+}
+
+/*
+ * 多个线程并发写入固定长度的记录，每条记录都应完整地出现，同一线程的记录保持写入顺序。写入回调中让出CPU，使其他生产方在写入期间有机会运行
+ */
+static mem_async_task<void> read_records(mem_async_stream<>& s, size_t count, std::vector<std::vector<uint32_t>>& seen) {
+    for (size_t i = 0; i < count; ++i) {
+        auto thread = co_await s.get<uint32_t>();
+        auto seq = co_await s.get<uint32_t>();
+        if (thread < seen.size()) {
+            seen[thread].push_back(seq);
+        }
+    }
+}
+
+static void test_concurrent_producers() {
+    constexpr uint32_t threads = 4, records = 5000;
+    mem_buffer b(1);
+    mem_async_stream s(b);
+    std::vector<std::vector<uint32_t>> seen(threads);
+    auto task = read_records(s, threads * records, seen);
+    std::vector<std::thread> producers;
+    for (uint32_t t = 0; t < threads; ++t) {
+        producers.emplace_back([&s, t] {
+            for (uint32_t i = 0; i < records; ++i) {
+                uint32_t record[2] = {t, i};
+                s.write_with(sizeof(record), [&record](char *dst) {
+                    std::this_thread::yield();
+                    memcpy(dst, record, sizeof(record));
+                });
+            }
+        });
+    }
+    for (auto& p : producers) {
+        p.join();
+    }
+    CHECK(s.filled() == threads * records * 8);
+    CHECK(task.done());
+    for (auto& v : seen) {
+        bool ordered = v.size() == records;
+        for (uint32_t i = 0; ordered && i < records; ++i) {
+            ordered = v[i] == i;
+        }
+        CHECK(ordered);
+    }
+}
+
+int main() {
+    test_read_until_fragments();
+    test_read_until_bytes();
+    test_partial_write();
+    test_concurrent_producers();
+    if (failures != 0) {
+        std::fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    std::puts("ok");
+    return 0;
+}
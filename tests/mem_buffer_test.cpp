@@ -0,0 +1,217 @@
+/*
+ * mem_buffer与mem_small_buffer的测试：写入回调的返回值与used，trim()与shrink_to_fit()之后的容量、used与内容，mmap分配器不清零也不提前提交物理页面，缩小后再扩容的新增部分为0；快照的隔离、use_count与写时复制模式下的流写入。
+ * 并发创建快照的部分建议在ThreadSanitizer下运行：g++ -std=c++20 -O1 -g -fsanitize=thread -I.. mem_buffer_test.cpp -o mem_buffer_test -pthread
+ *
+ * 编译：g++ -std=c++20 -O1 -g -fsanitize=address,undefined -I.. mem_buffer_test.cpp -o mem_buffer_test -pthread
+ * 用法：mem_buffer_test
+ */
+#include <cstdio>
+#include <atomic>
+#include <fstream>
+#include <string_view>
+#include <thread>
+#include "../mem_utils.hpp"
+
+static int failures = 0;
+
+#define CHECK(cond) do { if (!(cond)) { std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); ++failures; } } while (0)
+
+//[off, off + len)中的字节都等于c
+template<typename Buffer>
+static bool all_equal(Buffer const& b, size_t off, size_t len, char c) {
+    for (size_t i = off; i < off + len; ++i) {
+        if (b.data()[i] != c) {
+            return false;
+        }
+    }
+    return true;
+}
+
+#ifdef __linux__
+//当前进程的常驻内存字节数
+static size_t resident_bytes() {
+    size_t pages = 0, resident = 0;
+    std::ifstream("/proc/self/statm") >> pages >> resident;
+    return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+#endif
+
+//不提供decommit的分配器：trim()与shrink_to_fit()相同，容量缩小到used()
+static void test_heap_trim() {
+    mem_buffer<> b(1 << 20);
+    std::string text(1000, 'x');
+    CHECK(b.write(text.data(), text.size(), 0));
+    CHECK(b.used() == 1000);
+    CHECK(b.trim() == (1 << 20) - 1000);
+    CHECK(b.capacity() == 1000 && b.used() == 1000);
+    CHECK(all_equal(b, 0, 1000, 'x'));
+    CHECK(b.shrink_to_fit(500));
+    CHECK(b.capacity() == 500 && b.used() == 500);
+    CHECK(all_equal(b, 0, 500, 'x'));
+    CHECK(b.expand(4096));
+    CHECK(b.capacity() == 4096 && b.used() == 500);
+    CHECK(all_equal(b, 500, 4096 - 500, '\0'));
+}
+
+template<typename Allocator>
+static void test_mmap_trim() {
+    constexpr size_t capacity = 64 << 20;
+#ifdef __linux__
+    size_t before = resident_bytes();
+#endif
+    mem_buffer<Allocator> b(capacity);
+#ifdef __linux__
+    //构造时不清零，不会提交整个容量的物理页面
+    CHECK(resident_bytes() - before < capacity / 4);
+#endif
+    CHECK(all_equal(b, 0, 8192, '\0'));
+    std::string text(10000, 'x');
+    CHECK(b.write(text.data(), text.size(), 0));
+    CHECK(b.used() == 10000);
+    //容量不变，只归还used之后的整页
+    CHECK(b.trim() == capacity - 12288);
+    CHECK(b.capacity() == capacity && b.used() == 10000);
+    CHECK(all_equal(b, 0, 10000, 'x'));
+    CHECK(b.shrink_to_fit(5000));
+    CHECK(b.capacity() == 5000 && b.used() == 5000);
+    CHECK(all_equal(b, 0, 5000, 'x'));
+    //缩小前写入过的、与5000同一页的部分在扩容后也为0
+    CHECK(b.expand(1 << 20));
+    CHECK(b.capacity() == 1 << 20 && b.used() == 5000);
+    CHECK(all_equal(b, 0, 5000, 'x'));
+    CHECK(all_equal(b, 5000, (1 << 20) - 5000, '\0'));
+}
+
+//mem_small_buffer::write_with与mem_buffer一样按回调报告的字节数更新used，放弃写入时返回false
+template<typename Buffer>
+static void test_written_result(Buffer& b) {
+    CHECK(b.write_with(8, 2, [](char *dst) { memcpy(dst, "abc", 3); return static_cast<size_t>(3); }));
+    CHECK(b.used() == 5);
+    CHECK(!b.write_with(8, 10, [](char *) { return false; }));
+    CHECK(!b.write_with(8, 10, [](char *) { return mem_npos; }));
+    CHECK(b.used() == 5);
+    CHECK(b.write_with(4, 5, [](char *dst) { memcpy(dst, "defg", 4); }));
+    CHECK(b.used() == 9);
+    //跨过内部存储的写入迁移到堆上，used同样只计入实际写入的部分
+    CHECK(b.write_with(100, 9, [](char *dst) { dst[0] = 'h'; return static_cast<size_t>(1); }));
+    CHECK(b.used() == 10);
+    std::string back(10, '\0');
+    CHECK(b.read(back.data(), back.size(), 0) && back == std::string("\0\0abcdefgh", 10));
+}
+
+/*
+ * 快照与原实例互不影响：写入、扩容的一方复制私有内存，另一方保持原内容与容量
+ */
+static void test_snapshot_isolation() {
+    mem_buffer<> b(64);
+    CHECK(b.write("hello", 5, 0));
+    auto s = b.snapshot();
+    CHECK(s.data() == b.data());
+    CHECK(!s.shares_block(b));
+    CHECK(b.write("J", 1, 0));
+    CHECK(s.data() != b.data());
+    CHECK(std::string_view(b.data(), 5) == "Jello");
+    CHECK(std::string_view(s.data(), 5) == "hello");
+    CHECK(s.used() == 5);
+
+    auto t = s.snapshot();
+    CHECK(t.expand(4096));
+    CHECK(t.capacity() == 4096 && s.capacity() == 64);
+    CHECK(std::string_view(t.data(), 5) == "hello");
+    CHECK(s.write("y", 1, 4));
+    CHECK(std::string_view(s.data(), 5) == "helly");
+    CHECK(std::string_view(t.data(), 5) == "hello");
+}
+
+/*
+ * use_count只计入共享控制块的实例(包括访问类持有的)，快照与写时复制模式下的拷贝不计入
+ */
+static void test_use_count() {
+    mem_buffer<> b(64);
+    CHECK(b.use_count() == 1);
+    {
+        auto shared = b.share();
+        CHECK(b.use_count() == 2 && shared.shares_block(b));
+        auto s = b.get_byte_stream();
+        CHECK(b.use_count() == 3);
+        auto snap = b.snapshot();
+        CHECK(b.use_count() == 3 && snap.use_count() == 1);
+    }
+    CHECK(b.use_count() == 1);
+    mem_buffer<> plain(b);
+    CHECK(b.use_count() == 2 && plain.shares_block(b));
+    b.copy_on_write(true);
+    mem_buffer<> copy(b);
+    CHECK(b.use_count() == 2 && copy.use_count() == 1);
+    CHECK(copy.copy_on_write() && !copy.shares_block(b));
+}
+
+/*
+ * 写时复制模式下通过流写入的是原实例本身，不会写入私有副本，已有的快照不受影响
+ */
+static void test_stream_write_shared() {
+    mem_buffer<> b(16);
+    b.copy_on_write(true);
+    CHECK(b.write("abcd", 4, 0));
+    mem_buffer<> copy(b);
+    auto s = b.get_byte_stream();
+    CHECK(s.put(static_cast<uint8_t>('x')));
+    CHECK(b.data()[0] == 'x');
+    CHECK(copy.data()[0] == 'a');
+    auto c = copy.get_char_stream();
+    c.forward(1);
+    CHECK(c.put('y'));
+    CHECK(std::string_view(copy.data(), 4) == "aycd");
+    CHECK(std::string_view(b.data(), 4) == "xbcd");
+}
+
+/*
+ * 一个线程不断整块重写缓冲，另一个线程同时创建快照并检查快照内容是一次完整的写入，建议在ThreadSanitizer下运行
+ */
+static void test_snapshot_concurrent() {
+    static constexpr size_t len = 4096;
+    static constexpr int rounds = 2000;
+    mem_buffer<> b(len);
+    std::atomic<bool> done {false};
+    std::thread writer([&] {
+        for (int i = 0; i < rounds; ++i) {
+            b.write_with(len, 0, [i](char *dst) { memset(dst, 'a' + i % 26, len); });
+        }
+        done = true;
+    });
+    int torn = 0;
+    while (!done) {
+        auto s = b.snapshot();
+        s.read_with(len, 0, [&](const char *data) {
+            for (size_t i = 1; i < len; ++i) {
+                if (data[i] != data[0]) {
+                    ++torn;
+                    break;
+                }
+            }
+        });
+    }
+    writer.join();
+    CHECK(torn == 0);
+    CHECK(b.use_count() == 1);
+}
+
+int main() {
+    mem_buffer<> buffer(16);
+    test_written_result(buffer);
+    mem_small_buffer<32> small;
+    test_written_result(small);
+    test_heap_trim();
+    test_mmap_trim<mem_mmap_allocator<>>();
+    test_mmap_trim<mem_mmap_allocator<true>>();
+    test_snapshot_isolation();
+    test_use_count();
+    test_stream_write_shared();
+    test_snapshot_concurrent();
+    if (failures != 0) {
+        std::fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    std::puts("ok");
+    return 0;
+}
@@ -0,0 +1,124 @@
+/*
+ * mem_reader与mem_writer的测试：有界写游标的预留不改变used，写入回调的返回值(见mem_written)，越界读写，按记录边界切分读游标，以及多个线程通过切分出的写游标并行写入。
+ *
+ * 编译：g++ -std=c++20 -O1 -g -fsanitize=address,undefined -I.. mem_cursor_test.cpp -o mem_cursor_test -pthread
+ *       并行写入部分可改用-fsanitize=thread编译
+ * 用法：mem_cursor_test
+ */
+#include <cstdio>
+#include <string>
+#include <thread>
+#include "../mem_cursor.hpp"
+
+static int failures = 0;
+
+#define CHECK(cond) do { if (!(cond)) { std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); ++failures; } } while (0)
+
+//有界写游标只扩容不改变used，游标销毁后缓冲可以收回预留的范围
+static void test_bounded_reserve() {
+    mem_buffer b(16);
+    {
+        mem_writer w(b, 0, 4096);
+        CHECK(b.capacity() >= 4096 && b.used() == 0);
+        CHECK(w.write_le<uint32_t>(0x01020304) && w.write_be<uint16_t>(0x0506));
+        CHECK(w.position() == 6 && w.remaining() == 4090);
+        //越界的写入返回false且不移动
+        std::string big(4091, 'x');
+        CHECK(!w.write(big.data(), big.size()) && w.position() == 6);
+        CHECK(w.fill('y', 4090) && w.remaining() == 0);
+        CHECK(!w.write<char>('z'));
+    }
+    CHECK(b.used() == 0);
+    CHECK(b.shrink_to_fit(6));
+    CHECK(b.capacity() == 6);
+    mem_reader r(b);
+    CHECK(r.read_le<uint32_t>() == 0x01020304 && r.read_be<uint16_t>() == 0x0506);
+    char c;
+    CHECK(r.eof() && !r.read(c));
+}
+
+//写入回调返回bool或size_t时游标只前进实际写入的字节数
+template<bool Bounded>
+static void test_written_result() {
+    mem_buffer b(16);
+    mem_writer w = Bounded ? mem_writer(b, 0, 64) : mem_writer(b);
+    CHECK(w.write_with(8, [](char *dst) { memcpy(dst, "abc", 3); return static_cast<size_t>(3); }));
+    CHECK(w.position() == 3);
+    CHECK(!w.write_with(8, [](char *) { return false; }));
+    CHECK(!w.write_with(8, [](char *) { return mem_npos; }));
+    CHECK(w.position() == 3);
+    CHECK(w.write_with(2, [](char *dst) { memcpy(dst, "de", 2); return true; }));
+    CHECK(w.position() == 5);
+    if constexpr (!Bounded) {
+        CHECK(b.used() == 5);
+    }
+    std::string back(5, '\0');
+    CHECK(b.read(back.data(), 5, 0) && back == "abcde");
+}
+
+//每个切分点后移到下一行的开头，每一行恰好属于一个游标
+static void test_split_records() {
+    std::string text;
+    for (int i = 0; i < 1000; ++i) {
+        text += "record " + std::to_string(i) + "\n";
+    }
+    mem_buffer b(text.size());
+    b.write(text.data(), text.size(), 0);
+    for (size_t n : {1, 2, 3, 7, 64, 5000}) {
+        auto parts = mem_reader(b).split(n, [](const char *data, size_t len) {
+            auto *p = static_cast<const char*>(memchr(data, '\n', len));
+            return p == nullptr ? mem_npos : static_cast<size_t>(p - data) + 1;
+        });
+        CHECK(!parts.empty() && parts.size() <= n);
+        size_t expected = 0, lines = 0;
+        for (auto& part : parts) {
+            CHECK(part.begin() == expected);
+            CHECK(part.begin() == 0 || text[part.begin() - 1] == '\n');
+            expected = part.end();
+            for (size_t i = part.begin(); i < part.end(); ++i) {
+                lines += text[i] == '\n';
+            }
+        }
+        CHECK(expected == text.size() && lines == 1000);
+    }
+}
+
+//切分出的有界写游标由各自的线程写入互不重叠的范围
+static void test_parallel_writers() {
+    constexpr size_t len = 1 << 20;
+    mem_buffer b(16);
+    mem_writer w(b, 0, len);
+    auto parts = w.split(8);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < parts.size(); ++i) {
+        threads.emplace_back([&part = parts[i], i] {
+            while (part.remaining() != 0) {
+                part.write(static_cast<char>('a' + i));
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    bool ok = true;
+    for (size_t i = 0; i < parts.size(); ++i) {
+        for (size_t k = parts[i].begin(); k < parts[i].end(); ++k) {
+            ok = ok && b.data()[k] == static_cast<char>('a' + i);
+        }
+    }
+    CHECK(ok && parts.back().end() == len);
+}
+
+int main() {
+    test_bounded_reserve();
+    test_written_result<true>();
+    test_written_result<false>();
+    test_split_records();
+    test_parallel_writers();
+    if (failures != 0) {
+        std::fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    std::puts("ok");
+    return 0;
+}
@@ -0,0 +1,97 @@
+/*
+ * mem_stream按字节序读写数值：编译期在mem_static_buffer上的结果，以及运行期与逐字节移位拼接的结果对照。
+ *
+ * 编译：g++ -std=c++20 -O1 -g -fsanitize=address,undefined -I.. mem_endian_test.cpp -o mem_endian_test -pthread
+ * 用法：mem_endian_test
+ */
+#include <cstdio>
+#include <random>
+#include "../mem_utils.hpp"
+
+static int failures = 0;
+
+#define CHECK(cond) do { if (!(cond)) { std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); ++failures; } } while (0)
+
+//编译期编码一个协议头：大端的魔数与长度、小端的版本号与浮点数
+constexpr auto encode_header() {
+    mem_static_buffer<19> buffer;
+    auto s = buffer.get_byte_stream();
+    s.write_be(uint32_t {0x47585554});
+    s.write_be(uint16_t {0x0102});
+    s.write_le(uint16_t {0x0304});
+    s.write_le(1.5);
+    const int8_t tail[] = {-1, 2, -3};
+    s.write_be(tail, 3);
+    return buffer.bytes();
+}
+
+constexpr bool decode_header() {
+    mem_static_buffer<19> buffer;
+    auto out = buffer.get_byte_stream();
+    out.write_be(uint32_t {0x47585554});
+    out.write_be(uint16_t {0x0102});
+    out.write_le(uint16_t {0x0304});
+    out.write_le(1.5);
+    const int8_t tail[] = {-1, 2, -3};
+    out.write_be(tail, 3);
+    auto in = buffer.get_byte_stream();
+    int8_t back[3] {};
+    bool ok = in.read_be<uint32_t>() == 0x47585554 && in.read_be<uint16_t>() == 0x0102 && in.read_le<uint16_t>() == 0x0304 && in.read_le<double>() == 1.5 &&
+              in.read_be(back, 3) && back[0] == -1 && back[1] == 2 && back[2] == -3;
+    //数据不足时读取失败，游标不动
+    uint32_t more = 7;
+    return ok && !in.read_be(more) && more == 7 && in.eof();
+}
+
+static_assert(encode_header()[0] == std::byte {0x47} && encode_header()[3] == std::byte {0x54});
+static_assert(encode_header()[4] == std::byte {0x01} && encode_header()[5] == std::byte {0x02});
+static_assert(encode_header()[6] == std::byte {0x04} && encode_header()[7] == std::byte {0x03});
+static_assert(encode_header()[15] == std::byte {0x3f} && encode_header()[16] == std::byte {0xff});
+static_assert(decode_header());
+
+//逐字节移位拼接作为参照
+template<typename U>
+static U load_be(const unsigned char *p) {
+    U v = 0;
+    for (size_t i = 0; i < sizeof(U); ++i) {
+        v = static_cast<U>(v << 8 | p[i]);
+    }
+    return v;
+}
+
+template<typename U>
+static void check_runtime(std::mt19937_64& rng) {
+    for (size_t count : {1, 3, 16, 33, 100}) {
+        std::vector<U> values(count);
+        for (auto& v : values) {
+            v = static_cast<U>(rng());
+        }
+        mem_buffer buffer(8);
+        auto out = buffer.get_byte_stream();
+        CHECK(out.write_be(values.data(), count));
+        CHECK(out.write_le(values[0]));
+        std::vector<unsigned char> raw(count * sizeof(U) + sizeof(U));
+        CHECK(buffer.read(reinterpret_cast<char*>(raw.data()), raw.size(), 0));
+        for (size_t i = 0; i < count; ++i) {
+            CHECK(load_be<U>(raw.data() + i * sizeof(U)) == values[i]);
+        }
+        auto in = buffer.get_byte_stream();
+        std::vector<U> back(count);
+        CHECK(in.read_be(back.data(), count) && back == values);
+        CHECK(in.template read_le<U>() == values[0]);
+    }
+}
+
+int main() {
+    std::mt19937_64 rng(20261016);
+    check_runtime<uint16_t>(rng);
+    check_runtime<uint32_t>(rng);
+    check_runtime<uint64_t>(rng);
+    check_runtime<int32_t>(rng);
+    if (failures != 0) {
+        std::fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    std::puts("ok");
+    return 0;
+}
@@ -0,0 +1,228 @@
+/*
+ * mem_lz4与liblz4的互通测试，以及解压器对截断、损坏输入的模糊测试。损坏的输入只要求返回mem_npos或不越界，建议在AddressSanitizer下运行。
+ *
+ * 编译：g++ -std=c++20 -O1 -g -fsanitize=address,undefined -I.. mem_lz4_test.cpp -o mem_lz4_test -llz4 -pthread
+ * 用法：mem_lz4_test [模糊测试的轮数，默认20000]
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <lz4.h>
+#include <lz4frame.h>
+#include "../mem_lz4.hpp"
+
+static int failures = 0;
+
+#define CHECK(cond) do { if (!(cond)) { std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); ++failures; } } while (0)
+
+//各种可压缩程度的输入：全零、短周期、文本、随机字节以及随机与重复交替
+static std::vector<std::string> make_inputs(std::mt19937& rng) {
+    std::vector<std::string> inputs = {"", "a", "abcd", std::string(13, 'x'), std::string(100000, '\0')};
+    std::string text;
+    const char *words[] = {"buffer ", "stream ", "lz4 ", "block ", "frame ", "mem_utils ", "\n"};
+    while (text.size() < 300000) {
+        text += words[rng() % 7];
+    }
+    inputs.push_back(text);
+    std::string random(70000, '\0');
+    for (auto& c : random) {
+        c = static_cast<char>(rng());
+    }
+    inputs.push_back(random);
+    std::string mixed;
+    while (mixed.size() < 200000) {
+        size_t n = rng() % 300;
+        if (rng() % 2) {
+            mixed.append(n, static_cast<char>('a' + rng() % 3));
+        } else {
+            for (size_t i = 0; i < n; ++i) {
+                mixed.push_back(static_cast<char>(rng()));
+            }
+        }
+    }
+    inputs.push_back(mixed);
+    for (size_t n = 1; n < 64; ++n) {
+        inputs.push_back(text.substr(n * 7, n));
+    }
+    return inputs;
+}
+
+static void test_block_interop(std::vector<std::string> const& inputs) {
+    for (auto const& in : inputs) {
+        //mem_lz4 -> liblz4
+        std::string packed(mem_lz4_bound(in.size()), '\0');
+        size_t n = mem_lz4_compress_block(in.data(), in.size(), packed.data());
+        std::string out(in.size(), '\0');
+        CHECK(LZ4_decompress_safe(packed.data(), out.data(), static_cast<int>(n), static_cast<int>(out.size())) == static_cast<int>(in.size()));
+        CHECK(out == in);
+        //liblz4 -> mem_lz4
+        std::string theirs(LZ4_compressBound(static_cast<int>(in.size())), '\0');
+        int m = LZ4_compress_default(in.data(), theirs.data(), static_cast<int>(in.size()), static_cast<int>(theirs.size()));
+        std::fill(out.begin(), out.end(), '\0');
+        CHECK(mem_lz4_decompress_block(theirs.data(), static_cast<size_t>(m), out.data(), out.size()) == in.size());
+        CHECK(out == in);
+    }
+}
+
+static void test_buffer_round_trip(std::vector<std::string> const& inputs) {
+    for (auto const& in : inputs) {
+        mem_buffer src(16), packed(16), out(16);
+        src.write(in.data(), in.size(), 0);
+        size_t n = mem_lz4_compress(src, 0, in.size(), packed, 3);
+        CHECK(n != mem_npos);
+        //目标按最坏情况扩容，used只计入实际写入的部分
+        CHECK(packed.used() == 3 + n);
+        CHECK(mem_lz4_decompress(packed, 3, n, out, 0, in.size()) == in.size());
+        CHECK(out.used() == in.size());
+        std::string back(in.size(), '\0');
+        CHECK(out.read(back.data(), back.size(), 0));
+        CHECK(back == in);
+        //同一个缓冲中互不重叠的两段
+        mem_buffer same(16);
+        same.write(in.data(), in.size(), 0);
+        size_t m = mem_lz4_compress(same, 0, in.size(), same, in.size());
+        CHECK(m == n && same.used() == in.size() + m);
+        CHECK(mem_lz4_decompress(same, in.size(), m, same, in.size() + m, in.size()) == in.size());
+        CHECK(same.read(back.data(), back.size(), in.size() + m) && back == in);
+    }
+}
+
+//方向相反的并发压缩按控制块地址顺序加锁，不会死锁
+static void test_opposite_directions(std::string const& in) {
+    mem_buffer a(16), b(16);
+    a.write(in.data(), in.size(), 0);
+    b.write(in.data(), in.size(), 0);
+    auto run = [&](mem_buffer<>& src, mem_buffer<>& dst) {
+        for (int i = 0; i < 200; ++i) {
+            CHECK(mem_lz4_compress(src, 0, in.size(), dst, in.size()) != mem_npos);
+        }
+    };
+    std::thread t([&] { run(a, b); });
+    run(b, a);
+    t.join();
+}
+
+static void test_frame_interop(std::vector<std::string> const& inputs) {
+    for (auto const& in : inputs) {
+        for (auto size : {mem_lz4_block_size::max64kb, mem_lz4_block_size::max256kb}) {
+            //mem_lz4 -> liblz4，分成不规则的片段写入
+            mem_buffer frame(16);
+            auto os = frame.get_char_stream();
+            mem_lz4_frame_writer writer(os, size);
+            for (size_t i = 0, step = 1; i < in.size(); i += step, step = step * 3 + 1) {
+                writer.write(in.data() + i, std::min(step, in.size() - i));
+            }
+            writer.finish();
+            size_t frame_len = frame.capacity() - os.remaining();
+            CHECK(frame.used() == frame_len);
+            LZ4F_dctx *ctx;
+            CHECK(!LZ4F_isError(LZ4F_createDecompressionContext(&ctx, LZ4F_VERSION)));
+            std::string out(in.size() + 1, '\0');
+            size_t out_len = out.size(), in_len = frame_len;
+            size_t hint = LZ4F_decompress(ctx, out.data(), &out_len, frame.data(), &in_len, nullptr);
+            LZ4F_freeDecompressionContext(ctx);
+            CHECK(hint == 0 && in_len == frame_len && out_len == in.size());
+            CHECK(out.compare(0, out_len, in) == 0);
+        }
+        //liblz4 -> mem_lz4，默认参数为相互依赖的64 KB块
+        std::string theirs(LZ4F_compressFrameBound(in.size(), nullptr), '\0');
+        size_t m = LZ4F_compressFrame(theirs.data(), theirs.size(), in.data(), in.size(), nullptr);
+        CHECK(!LZ4F_isError(m));
+        mem_buffer src(16), out(16);
+        src.write(theirs.data(), m, 0);
+        auto is = src.get_char_stream();
+        auto os = out.get_char_stream();
+        CHECK(mem_lz4_decompress_frame(is, os));
+        std::string back(in.size(), '\0');
+        CHECK(out.used() == in.size() && os.remaining() == out.capacity() - in.size() && out.read(back.data(), back.size(), 0));
+        CHECK(back == in);
+    }
+}
+
+//截断或损坏的块只能解压失败或得到不越界的结果，在ASan下越界读写会直接报错
+static void fuzz_block(std::vector<std::string> const& inputs, std::mt19937& rng, size_t rounds) {
+    static const unsigned char regression[] = {0x10, 'a', 0x01, 0x00};
+    std::string out(100, '\0');
+    CHECK(mem_lz4_decompress_block(reinterpret_cast<const char*>(regression), 4, out.data(), out.size()) == mem_npos);
+    std::vector<std::string> blocks;
+    for (auto const& in : inputs) {
+        std::string packed(LZ4_compressBound(static_cast<int>(in.size())), '\0');
+        packed.resize(static_cast<size_t>(LZ4_compress_default(in.data(), packed.data(), static_cast<int>(in.size()), static_cast<int>(packed.size()))));
+        blocks.push_back(std::move(packed));
+    }
+    for (size_t round = 0; round < rounds; ++round) {
+        size_t k = rng() % inputs.size();
+        std::string const& block = blocks[k];
+        //每次都放到恰好大小的堆内存中，越界一个字节也会被ASan发现
+        size_t len = block.size();
+        switch (rng() % 3) {
+        case 0:
+            len = rng() % (block.size() + 1);
+            break;
+        case 1:
+            break;
+        default:
+            len = std::min(block.size(), static_cast<size_t>(rng() % 64));
+        }
+        std::unique_ptr<char[]> in(new char[len]);
+        memcpy(in.get(), block.data(), len);
+        for (size_t flips = rng() % 4; flips > 0 && len > 0; --flips) {
+            in[rng() % len] ^= static_cast<char>(1 << (rng() % 8));
+        }
+        size_t cap = inputs[k].size() + rng() % 32;
+        std::unique_ptr<char[]> dst(new char[cap]);
+        size_t n = mem_lz4_decompress_block(in.get(), len, dst.get(), cap);
+        CHECK(n == mem_npos || n <= cap);
+        /*
+         * 两边都接受时结果必须相同。两边对合法性的判断不完全一致：liblz4还检查结尾的格式约定(最后5字节为字面量等)，违反约定但不越界的输入这里可以接受；
+         * 距离为0的匹配不符合格式规范，这里拒绝，而liblz4 1.9.4会接受。
+         */
+        std::unique_ptr<char[]> expected(new char[cap]);
+        int m = LZ4_decompress_safe(in.get(), expected.get(), static_cast<int>(len), static_cast<int>(cap));
+        CHECK(m < 0 || n == mem_npos || (n == static_cast<size_t>(m) && memcmp(dst.get(), expected.get(), n) == 0));
+    }
+}
+
+static void fuzz_frame(std::vector<std::string> const& inputs, std::mt19937& rng, size_t rounds) {
+    std::vector<std::string> frames;
+    for (auto const& in : inputs) {
+        std::string theirs(LZ4F_compressFrameBound(in.size(), nullptr), '\0');
+        theirs.resize(LZ4F_compressFrame(theirs.data(), theirs.size(), in.data(), in.size(), nullptr));
+        frames.push_back(std::move(theirs));
+    }
+    for (size_t round = 0; round < rounds; ++round) {
+        std::string frame = frames[rng() % frames.size()];
+        if (rng() % 2) {
+            frame.resize(rng() % (frame.size() + 1));
+        }
+        for (size_t flips = rng() % 4; flips > 0 && !frame.empty(); --flips) {
+            frame[rng() % frame.size()] ^= static_cast<char>(1 << (rng() % 8));
+        }
+        mem_buffer src(16), out(16);
+        src.write(frame.data(), frame.size(), 0);
+        auto is = src.get_char_stream();
+        auto os = out.get_char_stream();
+        mem_lz4_decompress_frame(is, os);
+    }
+}
+
+int main(int argc, char **argv) {
+    size_t rounds = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 20000;
+    std::mt19937 rng(20260916);
+    auto inputs = make_inputs(rng);
+    test_block_interop(inputs);
+    test_buffer_round_trip(inputs);
+    test_frame_interop(inputs);
+    test_opposite_directions(inputs[5]);
+    fuzz_block(inputs, rng, rounds);
+    fuzz_frame(inputs, rng, rounds / 10);
+    if (failures != 0) {
+        std::fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    std::puts("ok");
+    return 0;
+}
@@ -0,0 +1,185 @@
+/*
+ * mem_buffer_pool测试：复用与统计、不能回收的缓冲、高水位、trim()与trim_idle()的缓存计数，池先于缓冲析构，以及多线程并发取出与交还后的计数。建议在ThreadSanitizer
+ * 与AddressSanitizer下分别运行。
+ *
+ * 编译：g++ -std=c++20 -O1 -g -fsanitize=thread -I.. mem_pool_test.cpp -o mem_pool_test -pthread
+ * 用法：mem_pool_test
+ */
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "../mem_pool.hpp"
+
+static int failures = 0;
+
+#define CHECK(cond) do { if (!(cond)) { std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); ++failures; } } while (0)
+
+static mem_buffer_pool_options small_options() {
+    mem_buffer_pool_options options;
+    options.min_class = 1024;
+    options.max_class = 64 * 1024;
+    return options;
+}
+
+//交还后同一容量级的acquire复用同一块内存并清零，统计与缓存字节数随之变化
+static void test_recycle_take() {
+    mem_buffer_pool<> pool(small_options());
+    const char *data;
+    {
+        auto b = pool.acquire(100);
+        CHECK(b.capacity() == 1024);
+        CHECK(b.write("abc", 3, 0));
+        data = b.data();
+    }
+    auto s = pool.stats();
+    CHECK(s.misses == 1 && s.hits == 0 && s.recycled == 1 && s.rejected == 0);
+    CHECK(pool.cached_bytes() == 1024);
+    {
+        auto b = pool.acquire(1000);
+        CHECK(b.data() == data);
+        CHECK(b.used() == 0 && b.data()[0] == '\0');
+        CHECK(pool.cached_bytes() == 0);
+        //其他容量级不受影响
+        auto c = pool.acquire(1025);
+        CHECK(c.capacity() == 2048);
+    }
+    s = pool.stats();
+    CHECK(s.misses == 2 && s.hits == 1 && s.recycled == 3);
+    CHECK(pool.cached_bytes() == 1024 + 2048);
+    CHECK(s.cached_bytes == pool.cached_bytes());
+}
+
+/*
+ * 扩容后容量不再是容量级、内存仍被快照共享的缓冲在交还时被拒绝，超过max_class的缓冲不属于池
+ */
+static void test_rejected() {
+    mem_buffer_pool<> pool(small_options());
+    {
+        auto b = pool.acquire(1024);
+        CHECK(b.expand(1500));
+    }
+    CHECK(pool.stats().rejected == 1 && pool.cached_bytes() == 0);
+    std::unique_ptr<mem_buffer<>> snap;
+    {
+        auto b = pool.acquire(1024);
+        CHECK(b.write("kept", 4, 0));
+        snap.reset(new mem_buffer<>(b.snapshot()));
+    }
+    CHECK(pool.stats().rejected == 2 && pool.cached_bytes() == 0);
+    CHECK(std::string_view(snap->data(), 4) == "kept");
+    snap.reset();
+    {
+        auto b = pool.acquire(128 * 1024);
+        CHECK(b.capacity() == 128 * 1024);
+    }
+    auto s = pool.stats();
+    CHECK(s.misses == 2 && s.recycled == 0 && s.rejected == 2);
+}
+
+//缓存超过高水位时交还的线程释放到低水位，trim(target)释放到target以下
+static void test_watermark() {
+    auto options = small_options();
+    options.high_watermark = 4096;
+    options.low_watermark = 2048;
+    mem_buffer_pool<> pool(options);
+    {
+        std::vector<std::unique_ptr<mem_buffer<>>> held;
+        for (int i = 0; i < 5; ++i) {
+            held.emplace_back(new mem_buffer<>(pool.acquire(1024)));
+        }
+    }
+    auto s = pool.stats();
+    CHECK(s.recycled == 5 && s.trimmed == 3);
+    CHECK(pool.cached_bytes() == 2048);
+    CHECK(pool.trim(1024) == 1024);
+    CHECK(pool.cached_bytes() == 1024);
+    CHECK(pool.trim(0) == 1024);
+    CHECK(pool.cached_bytes() == 0 && pool.stats().trimmed == 5);
+}
+
+/*
+ * trim_idle()第一次调用只开始记录；两次调用之间被取出过的部分保留，一直没有被取出的部分释放
+ */
+static void test_trim_idle() {
+    mem_buffer_pool<> pool(small_options());
+    {
+        std::vector<std::unique_ptr<mem_buffer<>>> held;
+        for (int i = 0; i < 4; ++i) {
+            held.emplace_back(new mem_buffer<>(pool.acquire(1024)));
+        }
+    }
+    CHECK(pool.cached_bytes() == 4 * 1024);
+    CHECK(pool.trim_idle() == 0);
+    pool.acquire(1024);
+    CHECK(pool.cached_bytes() == 4 * 1024);
+    CHECK(pool.trim_idle() == 3 * 1024);
+    CHECK(pool.cached_bytes() == 1024);
+    CHECK(pool.stats().trimmed == 3);
+    CHECK(pool.trim_idle() == 1024);
+    CHECK(pool.cached_bytes() == 0);
+    CHECK(pool.trim_idle() == 0);
+}
+
+//池析构后交还的缓冲直接释放
+static void test_pool_outlived() {
+    std::unique_ptr<mem_buffer<>> b;
+    {
+        mem_buffer_pool<> pool(small_options());
+        b.reset(new mem_buffer<>(pool.acquire(1024)));
+        pool.acquire(2048);
+    }
+    CHECK(b->write("still usable", 12, 0));
+    b.reset();
+}
+
+/*
+ * 多个线程反复取出与交还，分片满时经过仓库转移；结束后每次取出都计入hits或misses，每次交还都计入recycled，缓存字节数与未释放的控制块一致
+ */
+static void test_concurrent() {
+    auto options = small_options();
+    options.thread_cache_blocks = 2;
+    mem_buffer_pool<> pool(options);
+    constexpr int threads = 4, rounds = 2000;
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&pool, t] {
+            std::vector<std::unique_ptr<mem_buffer<>>> held;
+            for (int i = 0; i < rounds; ++i) {
+                held.emplace_back(new mem_buffer<>(pool.acquire(static_cast<size_t>(1024 << ((i + t) % 3)))));
+                if (held.size() > 3) {
+                    held.erase(held.begin());
+                }
+                if (i % 500 == 0) {
+                    pool.trim_idle();
+                }
+            }
+        });
+    }
+    for (auto& w : workers) {
+        w.join();
+    }
+    auto s = pool.stats();
+    CHECK(s.hits + s.misses == threads * rounds);
+    CHECK(s.recycled == threads * rounds && s.rejected == 0);
+    CHECK(s.misses >= s.trimmed);
+    CHECK(s.cached_bytes == pool.cached_bytes());
+    size_t cached = pool.cached_bytes();
+    CHECK(pool.trim(0) == cached);
+    CHECK(pool.cached_bytes() == 0 && pool.stats().trimmed == s.misses);
+}
+
+int main() {
+    test_recycle_take();
+    test_rejected();
+    test_watermark();
+    test_trim_idle();
+    test_pool_outlived();
+    test_concurrent();
+    if (failures != 0) {
+        std::fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    std::puts("ok");
+    return 0;
+}
@@ -0,0 +1,95 @@
+/*
+ * mem_serialize对定长与变长字段混合的记录的往返测试，以及截断输入的处理。
+ *
+ * 编译：g++ -std=c++20 -O1 -g -fsanitize=address,undefined -I.. mem_serialize_test.cpp -o mem_serialize_test -pthread
+ * 用法：mem_serialize_test
+ */
+#include <cstdio>
+#include "../mem_serialize.hpp"
+
+static int failures = 0;
+
+#define CHECK(cond) do { if (!(cond)) { std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); ++failures; } } while (0)
+
+//最后一个字段为定长类型
+struct named {
+    std::string name;
+    int id;
+
+    bool operator==(named const&) const = default;
+};
+
+//定长字段的连续段出现在开头、中间与结尾
+struct mixed {
+    uint8_t tag;
+    int64_t stamp;
+    std::string text;
+    double ratio;
+    std::array<int16_t, 3> triple;
+    std::vector<uint32_t> ids;
+    char last;
+
+    bool operator==(mixed const&) const = default;
+};
+
+struct point {
+    float x;
+    float y;
+
+    bool operator==(point const&) const = default;
+};
+
+enum class color : uint8_t {
+    red,
+    green
+};
+
+//嵌套的定长与变长记录、记录的vector与array
+struct nested {
+    point origin;
+    named owner;
+    std::vector<named> members;
+    std::array<point, 2> box;
+    color c;
+
+    bool operator==(nested const&) const = default;
+};
+
+template<typename V>
+static void round_trip(V const& v) {
+    mem_buffer buffer(8);
+    auto out = buffer.get_byte_stream();
+    CHECK(mem_serialize(out, v));
+    size_t len = buffer.capacity() - out.remaining();
+    V back {};
+    auto in = buffer.get_byte_stream();
+    CHECK(mem_deserialize(in, back));
+    CHECK(back == v);
+    CHECK(buffer.capacity() - in.remaining() == len);
+    //任何位置截断的数据都只能返回false
+    for (size_t cut = 1; cut < len; ++cut) {
+        mem_buffer part(cut);
+        part.write(buffer.data(), cut, 0);
+        auto truncated = part.get_byte_stream();
+        V partial {};
+        CHECK(!mem_deserialize(truncated, partial));
+    }
+}
+
+int main() {
+    static_assert(!mem_layout<named>::flat && mem_layout<point>::flat);
+    static_assert(mem_flat_run_end<mem_fields_t<named>, 1>() == 2);
+    static_assert(mem_flat_run_end<mem_fields_t<mixed>, 0>() == 2 && mem_flat_run_end<mem_fields_t<mixed>, 3>() == 5);
+    round_trip(named {"", 0});
+    round_trip(named {"alice", -7});
+    round_trip(mixed {1, -123456789012, "text with\0nul", 0.25, {1, -2, 3}, {}, 'z'});
+    round_trip(mixed {0xff, 0, std::string(300, 'q'), -1e300, {}, {1, 2, 3, 0xffffffff}, '\0'});
+    round_trip(nested {{1.5f, -2}, {"owner", 1}, {{"a", 2}, {"", 3}, {std::string(200, 'b'), 4}}, {{{0, 0}, {3, 4}}}, color::green});
+    round_trip(std::vector<mixed> {mixed {2, 3, "x", 4, {5, 6, 7}, {8}, 'y'}, mixed {}});
+    if (failures != 0) {
+        std::fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    std::puts("ok");
+    return 0;
+}
@@ -0,0 +1,187 @@
+/*
+ * mem_simd各ISA档位内核与标量实现的一致性测试，覆盖各种长度的尾部处理与跨越向量块边界的查找目标。每块输入都放在恰好大小的堆内存中，建议在AddressSanitizer下运行以发现越界读写。
+ *
+ * 编译：g++ -std=c++20 -O1 -g -fsanitize=address,undefined -I.. mem_simd_test.cpp -o mem_simd_test -pthread
+ * 用法：mem_simd_test
+ */
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <string>
+#include <string_view>
+#include "../mem_utils.hpp"
+
+static int failures = 0;
+
+#define CHECK(cond) do { if (!(cond)) { std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); ++failures; } } while (0)
+
+//对当前CPU支持的每个ISA档位调用f(isa)
+template<typename F>
+static void for_each_isa(F&& f) {
+    for (int i = 0; i <= static_cast<int>(mem_active_isa()); ++i) {
+        f(static_cast<mem_isa>(i));
+    }
+}
+
+template<size_t Width>
+static void test_fill_kernel() {
+    char value[Width];
+    for (size_t k = 0; k < Width; ++k) {
+        value[k] = static_cast<char>(0x41 + k);
+    }
+    for_each_isa([&](mem_isa isa) {
+        auto *fn = mem_fill_kernel<Width>::resolve(isa);
+        for (size_t count = 0; count < 100; ++count) {
+            std::unique_ptr<char[]> dst(new char[count * Width + 1]);
+            fn(dst.get(), value, count);
+            bool ok = true;
+            for (size_t i = 0; i < count * Width; ++i) {
+                ok = ok && dst[i] == value[i % Width];
+            }
+            CHECK(ok);
+        }
+    });
+}
+
+//宽度不是2的幂或大于8的元素走标量版本
+template<size_t Width>
+struct blob {
+    char bytes[Width];
+};
+
+template<size_t Width>
+static void test_fill_stream() {
+    blob<Width> value;
+    for (size_t k = 0; k < Width; ++k) {
+        value.bytes[k] = static_cast<char>(0x61 + k);
+    }
+    for (size_t count = 0; count < 100; ++count) {
+        mem_buffer b(1);
+        mem_stream<blob<Width>> s(b);
+        CHECK(s.fill(value, count));
+        CHECK(b.used() == count * Width);
+        bool ok = true;
+        for (size_t i = 0; i < count * Width; ++i) {
+            ok = ok && b.data()[i] == value.bytes[i % Width];
+        }
+        CHECK(ok);
+    }
+}
+
+//把src复制到恰好大小的堆内存中，内核读到末尾之后时AddressSanitizer会报告
+static std::unique_ptr<char[]> exact_copy(std::string_view src) {
+    std::unique_ptr<char[]> p(new char[src.size()]);
+    memcpy(p.get(), src.data(), src.size());
+    return p;
+}
+
+/*
+ * 小字母表的随机输入让目标频繁出现、部分匹配频繁失败，每个档位与标量实现逐一比较。长度覆盖0到200，包含16/32/64字节块的各种尾部长度
+ */
+static void test_find_random() {
+    std::mt19937 rng(33);
+    constexpr std::string_view alphabet = "ab\r\n";
+    for_each_isa([&](mem_isa isa) {
+        auto *find_byte = mem_find_byte_kernel::resolve(isa);
+        auto *find_any = mem_find_any_kernel::resolve(isa);
+        auto *find = mem_find_kernel::resolve(isa);
+        for (size_t len = 0; len <= 200; ++len) {
+            for (int round = 0; round < 8; ++round) {
+                std::string text(len, 'x');
+                for (auto& c : text) {
+                    //大多数位置不含目标，使查找能跨过若干整块
+                    c = rng() % 8 == 0 ? alphabet[rng() % alphabet.size()] : 'x';
+                }
+                auto data = exact_copy(text);
+                for (char c : alphabet) {
+                    CHECK(find_byte(data.get(), len, c) == mem_find_byte_scalar(data.get(), len, c));
+                }
+                for (std::string_view set : {"\n", "\r\n", "ab\r\n", "0123456789abcdef\r", "\t\v\f"}) {
+                    CHECK(find_any(data.get(), len, set.data(), set.size()) == mem_find_any_scalar(data.get(), len, set.data(), set.size()));
+                }
+                for (std::string_view needle : {"\r\n", "\r\n\r\n", "a\r", "ba", "xxa", "\nxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxb"}) {
+                    CHECK(find(data.get(), len, needle.data(), needle.size()) == mem_find_scalar(data.get(), len, needle.data(), needle.size()));
+                }
+            }
+        }
+    });
+}
+
+/*
+ * 唯一的目标放在每个位置上，包括横跨16/32/64字节块边界与紧贴输入末尾的位置
+ */
+static void test_find_positions() {
+    for_each_isa([](mem_isa isa) {
+        auto *find_byte = mem_find_byte_kernel::resolve(isa);
+        auto *find_any = mem_find_any_kernel::resolve(isa);
+        auto *find = mem_find_kernel::resolve(isa);
+        for (size_t len : {1, 15, 16, 17, 31, 32, 33, 63, 64, 65, 127, 128, 129, 200}) {
+            for (size_t at = 0; at < len; ++at) {
+                std::string text(len, 'x');
+                text[at] = '\n';
+                auto data = exact_copy(text);
+                CHECK(find_byte(data.get(), len, '\n') == at);
+                CHECK(find_any(data.get(), len, "\r\n", 2) == at);
+            }
+            CHECK(find_byte(exact_copy(std::string(len, 'x')).get(), len, '\n') == mem_npos);
+            for (std::string_view needle : {"\r\n", "\r\n\r\n", "boundary"}) {
+                for (size_t at = 0; at + needle.size() <= len; ++at) {
+                    std::string text(len, 'x');
+                    text.replace(at, needle.size(), needle);
+                    auto data = exact_copy(text);
+                    CHECK(find(data.get(), len, needle.data(), needle.size()) == at);
+                    //只有首字节或尾字节匹配时不能误报
+                    auto head = exact_copy(text.substr(0, at + needle.size() - 1));
+                    CHECK(find(head.get(), at + needle.size() - 1, needle.data(), needle.size()) == mem_npos);
+                }
+            }
+        }
+    });
+}
+
+/*
+ * mem_stream::skip_until与mem_buffer::find使用分派后的内核，"\r\n"横跨块边界或缓冲末尾只剩'\r'时同样要正确处理
+ */
+static void test_skip_until() {
+    for (size_t at : {14, 15, 16, 31, 32, 63, 64, 126}) {
+        std::string text(128, 'x');
+        text.replace(at, 2, "\r\n");
+        mem_buffer b(text.size());
+        b.write(text.data(), text.size(), 0);
+        CHECK(b.find("\r\n") == at);
+        CHECK(b.find('\n', at) == at + 1);
+        CHECK(b.find("\r\n", at + 1) == mem_npos);
+        auto s = b.get_char_stream();
+        CHECK(s.skip_until(std::string_view("\r\n")));
+        CHECK(s.remaining() == text.size() - at);
+        CHECK(s.get() == '\r');
+        CHECK(!s.skip_until(std::string_view("\r\n")));
+        CHECK(s.eof());
+    }
+    std::string text(64, 'x');
+    text.back() = '\r';
+    mem_buffer b(text.size());
+    b.write(text.data(), text.size(), 0);
+    auto s = b.get_char_stream();
+    CHECK(!s.skip_until(std::string_view("\r\n")));
+    CHECK(s.eof());
+}
+
+int main() {
+    test_fill_kernel<2>();
+    test_fill_kernel<4>();
+    test_fill_kernel<8>();
+    test_fill_stream<3>();
+    test_fill_stream<6>();
+    test_fill_stream<16>();
+    test_fill_stream<24>();
+    test_find_random();
+    test_find_positions();
+    test_skip_until();
+    if (failures != 0) {
+        std::fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    std::puts("ok");
+    return 0;
+}
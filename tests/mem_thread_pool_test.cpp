@@ -0,0 +1,126 @@
+/*
+ * mem_thread_pool测试：mem_wait_group重新抛出任务中的异常，submit_batch的每个任务恰好执行一次，工作线程中嵌套提交并等待，析构时执行完已提交的任务。建议在ThreadSanitizer
+ * 与AddressSanitizer下分别运行。
+ *
+ * 编译：g++ -std=c++20 -O1 -g -fsanitize=thread -I.. mem_thread_pool_test.cpp -o mem_thread_pool_test -pthread
+ * 用法：mem_thread_pool_test
+ */
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+#include "../mem_thread_pool.hpp"
+
+static int failures = 0;
+
+#define CHECK(cond) do { if (!(cond)) { std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); ++failures; } } while (0)
+
+//wait()重新抛出第一个异常，其他任务照常执行；异常只抛出一次
+static void test_wait_group_exception(mem_thread_pool& pool) {
+    mem_wait_group group;
+    std::atomic<int> ran {0};
+    for (int i = 0; i < 100; ++i) {
+        pool.submit(group, [i, &ran] {
+            if (i % 10 == 3) {
+                throw std::runtime_error("task " + std::to_string(i));
+            }
+            ran.fetch_add(1, std::memory_order_relaxed);
+        });
+    }
+    bool thrown = false;
+    try {
+        pool.wait(group);
+    } catch (std::runtime_error const& e) {
+        thrown = std::string_view(e.what()).starts_with("task ");
+    }
+    CHECK(thrown);
+    CHECK(group.finished());
+    CHECK(ran.load() == 90);
+    bool again = false;
+    try {
+        pool.wait(group);
+    } catch (...) {
+        again = true;
+    }
+    CHECK(!again);
+}
+
+//submit_batch的每个下标恰好执行一次，count为0时wait()立即返回
+static void test_submit_batch(mem_thread_pool& pool) {
+    constexpr size_t count = 10000;
+    std::unique_ptr<std::atomic<int>[]> hits(new std::atomic<int>[count]);
+    for (size_t i = 0; i < count; ++i) {
+        hits[i] = 0;
+    }
+    mem_wait_group group;
+    pool.submit_batch(group, count, [&hits](size_t i) { hits[i].fetch_add(1, std::memory_order_relaxed); });
+    pool.wait(group);
+    bool once = true;
+    for (size_t i = 0; i < count; ++i) {
+        once = once && hits[i].load() == 1;
+    }
+    CHECK(once);
+
+    mem_wait_group empty;
+    pool.submit_batch(empty, 0, [](size_t) {});
+    pool.wait(empty);
+    CHECK(empty.finished());
+}
+
+/*
+ * 每个任务再批量提交子任务并在工作线程中等待，线程数少于外层任务数时也不会死锁；子任务的异常经内外两层wait()传出
+ */
+static void test_nested_batch(mem_thread_pool& pool) {
+    std::atomic<size_t> sum {0};
+    mem_wait_group outer;
+    pool.submit_batch(outer, 16, [&pool, &sum](size_t i) {
+        mem_wait_group inner;
+        pool.submit_batch(inner, 64, [&sum, i](size_t j) {
+            if (i == 5 && j == 7) {
+                throw std::logic_error("inner");
+            }
+            sum.fetch_add(1, std::memory_order_relaxed);
+        });
+        pool.wait(inner);
+    });
+    bool thrown = false;
+    try {
+        pool.wait(outer);
+    } catch (std::logic_error const&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+    CHECK(sum.load() == 16 * 64 - 1);
+}
+
+//不属于任何mem_wait_group的任务在析构前执行完毕，包括任务中再提交的任务
+static void test_destructor_drains() {
+    std::atomic<int> ran {0};
+    {
+        mem_thread_pool pool(3);
+        for (int i = 0; i < 1000; ++i) {
+            pool.submit([&pool, &ran] {
+                ran.fetch_add(1, std::memory_order_relaxed);
+                pool.submit([&ran] { ran.fetch_add(1, std::memory_order_relaxed); });
+            });
+        }
+    }
+    CHECK(ran.load() == 2000);
+}
+
+int main() {
+    {
+        mem_thread_pool pool(4);
+        test_wait_group_exception(pool);
+        test_submit_batch(pool);
+        test_nested_batch(pool);
+    }
+    test_destructor_drains();
+    if (failures != 0) {
+        std::fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    std::puts("ok");
+    return 0;
+}
@@ -0,0 +1,26 @@
+/*
+ * 将mem_trace::dump()写出的二进制追踪文件转换为Chrome trace JSON，结果可在chrome://tracing或https://ui.perfetto.dev中打开。
+ *
+ * 编译：g++ -std=c++20 -O2 -I.. mem_trace_decode.cpp -o mem_trace_decode
+ * 用法：mem_trace_decode trace.bin > trace.json
+ */
+#include <fstream>
+#include <iostream>
+#include "../mem_trace.hpp"
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        std::cerr << "usage: " << argv[0] << " <trace file>" << std::endl;
+        return 2;
+    }
+    std::ifstream in(argv[1], std::ios::binary);
+    if (!in) {
+        std::cerr << "cannot open " << argv[1] << std::endl;
+        return 1;
+    }
+    if (!mem_trace_to_chrome_json(in, std::cout)) {
+        std::cerr << "malformed trace file " << argv[1] << std::endl;
+        return 1;
+    }
+    return 0;
+}